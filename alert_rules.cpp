@@ -0,0 +1,459 @@
+#include "alert_rules.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cstring>
+#include <cctype>
+
+#include "program_IO.h"
+#include "network_stats.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("alert_rules");
+
+    enum
+    {
+        // deepest the evaluation stack may get for one rule: expressions
+        // deeper than this are refused at compile time
+        MAX_STACK = 16,
+
+        MAX_RUN = 0xffff
+    };
+
+    //* Either is NaN (an unknown link_speed): every comparison is false.
+    inline bool
+    unordered(double a, double b)
+    {
+        return (a != a) || (b != b);
+    }
+}
+
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+
+const char *
+alert_level_name(alert_level level)
+{
+    switch (level)
+    {
+    case ALERT_OK:      return "ok";
+    case ALERT_PENDING: return "pending";
+    case ALERT_FIRING:  return "firing";
+    default:            return "Unknown alert level!";
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Parser
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Recursive descent over one rule's text, emitting postfix instructions
+    as it goes:
+
+        rule   := [name ':'] expr cmp expr ['for' N ['samples']]
+                                           ['clear' N ['samples']]
+        expr   := term (('+' | '-') term)*
+        term   := factor (('*' | '/') factor)*
+        factor := number | '-' factor | '(' expr ')' | 'link_speed'
+                | ('value' | 'delta' | 'rate') '(' COUNTER ')'
+*/
+
+class alert_engine::parser
+{
+private:
+    const std::string &text_;
+    size_t pos_;
+    std::vector<instruction> *out_;
+    std::set<size_t> *used_;
+    int depth_;
+
+    void skip_space(void)
+    {
+        while ((pos_ < text_.size()) && std::isspace((unsigned char)text_[pos_]))
+            ++pos_;
+    }
+
+    bool at_end(void)
+    {
+        skip_space();
+        return pos_ >= text_.size();
+    }
+
+    bool accept(const char *s)
+    {
+        skip_space();
+        size_t n = std::strlen(s);
+        if (text_.compare(pos_, n, s) != 0)
+            return false;
+        pos_ += n;
+        return true;
+    }
+
+    //* accept() for a keyword: not the start of a longer name ("format").
+    bool accept_word(const char *s)
+    {
+        skip_space();
+        size_t n = std::strlen(s);
+        if (text_.compare(pos_, n, s) != 0)
+            return false;
+        if ((pos_ + n < text_.size())
+            && (std::isalnum((unsigned char)text_[pos_ + n])
+                || (text_[pos_ + n] == '_')))
+            return false;
+        pos_ += n;
+        return true;
+    }
+
+    void expect(const char *s)
+    {
+        if (!accept(s))
+            fail("expected '%s'", s);
+    }
+
+    bool peek_identifier(void)
+    {
+        skip_space();
+        return (pos_ < text_.size())
+            && (std::isalpha((unsigned char)text_[pos_]) || (text_[pos_] == '_'));
+    }
+
+    std::string identifier(void)
+    {
+        if (!peek_identifier())
+            fail("expected a name");
+        size_t start = pos_;
+        while ((pos_ < text_.size())
+               && (std::isalnum((unsigned char)text_[pos_]) || (text_[pos_] == '_')))
+            ++pos_;
+        return text_.substr(start, pos_ - start);
+    }
+
+    double number(void)
+    {
+        skip_space();
+        const char *start = text_.c_str() + pos_;
+        char *endptr = 0;
+        double value = std::strtod(start, &endptr);
+        if (endptr == start)
+            fail("expected a number");
+        pos_ += endptr - start;
+        return value;
+    }
+
+    unsigned long count(void)
+    {
+        double value = number();
+        if ((value < 1.0) || (value > MAX_RUN) || (value != (unsigned long)value))
+            fail("sample count %g must be a whole number in [1, %d]",
+                 value, (int)MAX_RUN);
+        if (!accept_word("samples"))
+            accept_word("sample");
+        return (unsigned long)value;
+    }
+
+    void emit(const instruction &i, int stack_change)
+    {
+        depth_ += stack_change;
+        if (depth_ > MAX_STACK)
+            fail("expression needs more than %d stack slots", (int)MAX_STACK);
+        out_->push_back(i);
+    }
+
+    void fail(const char *fmt, ...)
+        __attribute__((format(printf, 2, 3), noreturn));
+
+    void factor(void)
+    {
+        if (accept("("))
+        {
+            expr();
+            expect(")");
+            return;
+        }
+
+        if (accept("-"))
+        {
+            factor();
+            emit(instruction(OP_CONST, 0, -1.0), 1);
+            emit(instruction(OP_MUL), -1);
+            return;
+        }
+
+        if (!peek_identifier())
+        {
+            emit(instruction(OP_CONST, 0, number()), 1);
+            return;
+        }
+
+        std::string name(identifier());
+        if (name == "link_speed")
+        {
+            emit(instruction(OP_LINK_SPEED), 1);
+            return;
+        }
+
+        opcode op;
+        if (name == "value")
+            op = OP_VALUE;
+        else if (name == "delta")
+            op = OP_DELTA;
+        else if (name == "rate")
+            op = OP_RATE;
+        else
+            fail("unknown function or variable '%s'", C(name));
+
+        expect("(");
+        std::string counter(identifier());
+        size_t index;
+        if (!counter_from_name(counter, &index))
+            fail("unknown counter '%s'", C(counter));
+        expect(")");
+
+        used_->insert(index);
+        emit(instruction(op, (uint32_t)index), 1);
+    }
+
+    void term(void)
+    {
+        factor();
+        for (;;)
+        {
+            if (accept("*"))
+            {
+                factor();
+                emit(instruction(OP_MUL), -1);
+            } else if (accept("/"))
+            {
+                factor();
+                emit(instruction(OP_DIV), -1);
+            } else
+                return;
+        }
+    }
+
+    void expr(void)
+    {
+        term();
+        for (;;)
+        {
+            if (accept("+"))
+            {
+                term();
+                emit(instruction(OP_ADD), -1);
+            } else if (accept("-"))
+            {
+                term();
+                emit(instruction(OP_SUB), -1);
+            } else
+                return;
+        }
+    }
+
+    opcode comparison(void)
+    {
+        // two character operators first so '>=' isn't read as '>'
+        if (accept(">="))   return OP_GE;
+        if (accept("<="))   return OP_LE;
+        if (accept("=="))   return OP_EQ;
+        if (accept("!="))   return OP_NE;
+        if (accept(">"))    return OP_GT;
+        if (accept("<"))    return OP_LT;
+        fail("expected a comparison");
+        return OP_GT;
+    }
+
+public:
+
+    parser(const std::string &text, std::vector<instruction> *out,
+           std::set<size_t> *used):
+        text_(text), pos_(0), out_(out), used_(used), depth_(0) {}
+
+    void parse(rule *r)
+    {
+        // optional 'name:' -- only if what follows the name is a colon
+        size_t start = pos_;
+        if (peek_identifier())
+        {
+            std::string name(identifier());
+            if (accept(":"))
+                r->name = name;
+            else
+                pos_ = start;
+        }
+
+        expr();
+        opcode cmp = comparison();
+        expr();
+        emit(instruction(cmp), -2);
+
+        r->for_samples = 1;
+        if (accept_word("for"))
+            r->for_samples = (uint16_t)count();
+        r->clear_samples = r->for_samples;
+        if (accept_word("clear"))
+            r->clear_samples = (uint16_t)count();
+
+        if (!at_end())
+            fail("trailing junk '%s'", text_.c_str() + pos_);
+    }
+};
+
+void
+alert_engine::parser::fail(const char *fmt, ...)
+{
+    char reason[DEFAULT_BUFFER_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(reason, sizeof(reason), fmt, ap);
+    va_end(ap);
+
+    RUNTIME("Rule '%s' at column %lu: %s", C(text_),
+            (unsigned long)pos_ + 1, reason);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// alert_engine
+////////////////////////////////////////////////////////////////////////////////
+
+alert_engine::alert_engine(void):
+    program_(),
+    rules_(),
+    counters_used_()
+{
+
+}
+
+/**
+    Compile one rule and append it to the program.  Nothing is appended if
+    the rule doesn't parse.
+*/
+
+void
+alert_engine::add_rule(const std::string &text)
+{
+    std::vector<instruction> code;
+    std::set<size_t> used;
+    rule r;
+
+    parser p(text, &code, &used);
+    p.parse(&r);
+
+    r.text = text;
+    if (r.name.empty())
+        r.name = text;
+
+    program_.insert(program_.end(), code.begin(), code.end());
+    rules_.push_back(r);
+    counters_used_.insert(used.begin(), used.end());
+}
+
+/**
+    One rule per line.  Blank lines and anything after a '#' are ignored.
+*/
+
+void
+alert_engine::load(const std::string &filename)
+{
+    std::ifstream in(C(filename));
+    if (!in)
+        ERROR("Opening rules file '%s'", C(filename));
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::string::size_type hash = line.find('#');
+        if (hash != std::string::npos)
+            line.erase(hash);
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        add_rule(line);
+    }
+}
+
+/**
+    Run every rule against one interface's inputs.  'states' has one entry
+    per rule; any that change level add an event to 'events'.
+*/
+
+void
+alert_engine::evaluate(const alert_inputs &in, alert_state *states,
+                       std::vector<alert_event> *events) const
+{
+    double stack[MAX_STACK];
+    int top = -1;
+    size_t r = 0;
+
+    const instruction *i = program_.empty() ? 0 : &program_[0];
+    const instruction *const e = i + program_.size();
+    for ( ; i != e; ++i)
+    {
+        bool holds;
+        switch (i->op)
+        {
+        case OP_CONST:      stack[++top] = i->constant; continue;
+        case OP_VALUE:      stack[++top] = (double)in.value[i->index]; continue;
+        case OP_DELTA:      stack[++top] = (double)in.delta[i->index]; continue;
+        case OP_RATE:       stack[++top] = in.rate[i->index]; continue;
+        case OP_LINK_SPEED: stack[++top] = in.link_speed; continue;
+        case OP_ADD:        stack[top - 1] += stack[top]; --top; continue;
+        case OP_SUB:        stack[top - 1] -= stack[top]; --top; continue;
+        case OP_MUL:        stack[top - 1] *= stack[top]; --top; continue;
+        case OP_DIV:        stack[top - 1] /= stack[top]; --top; continue;
+        case OP_GT:         holds = stack[top - 1] > stack[top]; break;
+        case OP_GE:         holds = stack[top - 1] >= stack[top]; break;
+        case OP_LT:         holds = stack[top - 1] < stack[top]; break;
+        case OP_LE:         holds = stack[top - 1] <= stack[top]; break;
+        case OP_EQ:         holds = stack[top - 1] == stack[top]; break;
+        case OP_NE:         holds = (stack[top - 1] != stack[top])
+                                 && !unordered(stack[top - 1], stack[top]);
+                            break;
+        default:
+            RUNTIME("Bad opcode %u in rule program", (unsigned)i->op);
+        }
+
+        // end of a rule: step its state machine
+        const rule &ru = rules_[r];
+        alert_state &s = states[r];
+        const alert_level was = (alert_level)s.level;
+
+        if (holds)
+        {
+            s.false_run = 0;
+            if (s.true_run < MAX_RUN)
+                ++s.true_run;
+            if (s.true_run >= ru.for_samples)
+                s.level = ALERT_FIRING;
+            else if (was == ALERT_OK)
+                s.level = ALERT_PENDING;
+        } else
+        {
+            s.true_run = 0;
+            if (s.false_run < MAX_RUN)
+                ++s.false_run;
+            if ((was == ALERT_PENDING)
+                || ((was == ALERT_FIRING) && (s.false_run >= ru.clear_samples)))
+                s.level = ALERT_OK;
+        }
+
+        if (s.level != was)
+        {
+            alert_event ev;
+            ev.rule = r;
+            ev.from = was;
+            ev.to = (alert_level)s.level;
+            ev.value = stack[top - 1];
+            events->push_back(ev);
+        }
+
+        top = -1;
+        ++r;
+    }
+}
+
+#undef RUNTIME
+#undef ERROR
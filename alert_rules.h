@@ -0,0 +1,136 @@
+#ifndef ALERT_RULES_H
+#define ALERT_RULES_H
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+    Threshold and rate-of-change alerting over the counter_table.
+
+    Rules are written one per line, like:
+
+        crc: rate(RX_CRC_ERRORS) > 0 for 3 samples
+        saturated: rate(TX_BYTES) > 0.9 * link_speed for 5 clear 10
+
+    i.e. an optional 'name:', two arithmetic expressions and a comparison,
+    then optionally how many consecutive samples the comparison must hold
+    before the alert fires ('for', default 1) and how many it must fail
+    before a firing alert clears ('clear', default same as 'for').  The gap
+    between the two is the hysteresis.
+
+    Operands are numbers, value(COUNTER), delta(COUNTER), rate(COUNTER)
+    (per second) and link_speed (bytes per second; while it's unknown,
+    every comparison with it is false, != included).  COUNTER is any of
+    the RX_* and TX_* names.  Keywords ('for', 'clear', 'samples') are
+    whole words.
+
+    All rules are compiled once into a single flat program of stack machine
+    instructions, so evaluating every rule for one interface is one pass
+    over a small array with no allocation and no pointer chasing.
+*/
+
+enum alert_level
+{
+    ALERT_OK,
+    ALERT_PENDING,      // condition holds, but not for long enough yet
+    ALERT_FIRING
+};
+
+const char *alert_level_name(alert_level level);
+
+//* Per (interface, rule): owned by whoever owns the interface.
+struct alert_state
+{
+    uint16_t true_run;  // consecutive samples the condition has held
+    uint16_t false_run; // consecutive samples it hasn't
+    uint8_t level;      // an alert_level
+
+    alert_state(void): true_run(0), false_run(0), level(ALERT_OK) {}
+};
+
+//* What the rules get to look at for one interface: counter_table order.
+struct alert_inputs
+{
+    const uint64_t *value;
+    const uint64_t *delta;
+    const double *rate;
+    double link_speed;
+};
+
+//* Emitted whenever a rule changes level for an interface.
+struct alert_event
+{
+    size_t rule;
+    alert_level from;
+    alert_level to;
+    double value;       // left hand side of the comparison at the time
+};
+
+class alert_engine
+{
+private:
+    enum opcode
+    {
+        OP_CONST,
+        OP_VALUE,
+        OP_DELTA,
+        OP_RATE,
+        OP_LINK_SPEED,
+        OP_ADD,
+        OP_SUB,
+        OP_MUL,
+        OP_DIV,
+        // comparisons end a rule: they consume the stack and update state
+        OP_GT,
+        OP_GE,
+        OP_LT,
+        OP_LE,
+        OP_EQ,
+        OP_NE
+    };
+
+    struct instruction
+    {
+        uint32_t op;
+        uint32_t index;     // counter for OP_VALUE etc.
+        double constant;    // for OP_CONST
+
+        instruction(opcode o, uint32_t i = 0, double c = 0.0):
+            op(o), index(i), constant(c) {}
+    };
+
+    struct rule
+    {
+        std::string name;
+        std::string text;
+        uint16_t for_samples;
+        uint16_t clear_samples;
+    };
+
+    class parser;
+
+    std::vector<instruction> program_;
+    std::vector<rule> rules_;
+    std::set<size_t> counters_used_;
+
+public:
+
+    alert_engine(void);
+
+    void add_rule(const std::string &text);
+    void load(const std::string &filename);
+
+    void evaluate(const alert_inputs &in, alert_state *states,
+                  std::vector<alert_event> *events) const;
+
+    size_t size(void) const { return rules_.size(); }
+    bool empty(void) const { return rules_.empty(); }
+    const std::string &rule_name(size_t r) const { return rules_[r].name; }
+    const std::set<size_t> &counters_used(void) const { return counters_used_; }
+};
+
+#endif  // ALERT_RULES_H
@@ -0,0 +1,223 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Scaling benchmark for capture_group: UDP blasted over loopback from
+    child processes, many flows of it, captured with 0 (the caller's
+    thread), 1, 2 ... N fanout threads.  Reports what was captured, what
+    the rings dropped, and the CPU this process spent per packet.  On
+    loopback the kernel's half (copying into the rings) runs on the
+    senders' side, so the CPU here is ours: walking, parsing, counting.
+
+    Needs CAP_NET_RAW.
+
+    usage: bench_capture [max_threads [seconds [senders]]]
+*/
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+#include "capture_group.h"
+
+namespace
+{
+    const std::string NAME("bench_capture");
+
+    enum
+    {
+        DEFAULT_SECONDS = 3,
+        DEFAULT_SENDERS = 1,
+        FLOWS_PER_SENDER = 64,
+        BATCH = 64,
+        PAYLOAD = 64,
+        SINK_PORT = 9,          // discard: nobody listening, which is fine
+        COUNTERS = 640
+    };
+
+    double
+    monotonic_seconds(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+    }
+
+    double
+    cpu_seconds(void)
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+    }
+
+    //* In a child: FLOWS_PER_SENDER sockets, round robin, until killed.
+    void
+    send_forever(void)
+    {
+        std::vector<int> fds;
+        for (int i = 0; i < FLOWS_PER_SENDER; ++i)
+        {
+            int fd = socket(AF_INET, SOCK_DGRAM, 0);
+            if (fd == -1)
+                _exit(1);
+            fds.push_back(fd);
+        }
+
+        struct sockaddr_in to;
+        std::memset(&to, 0, sizeof(to));
+        to.sin_family = AF_INET;
+        to.sin_port = htons(SINK_PORT);
+        to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        char payload[PAYLOAD];
+        std::memset(payload, 'x', sizeof(payload));
+        struct iovec iov;
+        iov.iov_base = payload;
+        iov.iov_len = sizeof(payload);
+
+        struct mmsghdr messages[BATCH];
+        std::memset(messages, 0, sizeof(messages));
+        for (int i = 0; i < BATCH; ++i)
+        {
+            messages[i].msg_hdr.msg_name = &to;
+            messages[i].msg_hdr.msg_namelen = sizeof(to);
+            messages[i].msg_hdr.msg_iov = &iov;
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        for (size_t n = 0; ; ++n)
+            sendmmsg(fds[n % fds.size()], messages, BATCH, 0);
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    /**
+        Capture with 'threads' for 'seconds', collecting once a second the
+        way the monitor does, and print a line.  The owner thread polls
+        when there are no workers.
+    */
+
+    void
+    run(size_t threads, double seconds)
+    {
+        capture_group group("lo", COUNTERS, threads, FANOUT_HASH);
+        flow_tally tally(COUNTERS);
+        std::vector<int> fds;
+        group.fds(&fds);
+        group.drops();
+
+        uint64_t packets = 0;
+        uint64_t drops = 0;
+        size_t flows = 0;
+
+        const double cpu_start = cpu_seconds();
+        const double start = monotonic_seconds();
+        double next_collect = start + 1.0;
+        double now = start;
+        while (now < start + seconds)
+        {
+            if (fds.empty())
+                poll(0, 0, 10);
+            else
+            {
+                struct pollfd pfd;
+                pfd.fd = fds[0];
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                if (poll(&pfd, 1, 10) > 0)
+                    group.drain();
+            }
+
+            now = monotonic_seconds();
+            if (now >= next_collect)
+            {
+                group.collect(&tally);
+                packets += tally.packets;
+                flows = tally.flows.size();
+                drops += group.drops();
+                next_collect += 1.0;
+            }
+        }
+        group.collect(&tally);
+        packets += tally.packets;
+        drops += group.drops();
+
+        const double wall = monotonic_seconds() - start;
+        const double cpu = cpu_seconds() - cpu_start;
+        ALWAYS("%7lu %12.3f %12.3f %8.1f %10.1f %8lu\n", (unsigned long)threads,
+               (double)packets / wall * 1e-6, (double)drops / wall * 1e-6,
+               cpu / wall * 100.0,
+               packets ? cpu / (double)packets * 1e9 : 0.0,
+               (unsigned long)flows);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const size_t max_threads = (argc > 1) ? std::strtoul(argv[1], 0, 0)
+                             : (size_t)((cpus > 0) ? cpus : 1);
+    const double seconds = (argc > 2) ? std::atof(argv[2]) : DEFAULT_SECONDS;
+    const size_t senders = (argc > 3) ? std::strtoul(argv[3], 0, 0) : DEFAULT_SENDERS;
+
+    std::vector<pid_t> children;
+    int status = 0;
+    try
+    {
+        if ((seconds <= 0.0) || !senders)
+            RUNTIME("seconds and senders must be positive");
+
+        for (size_t i = 0; i < senders; ++i)
+        {
+            pid_t pid = fork();
+            if (pid == -1)
+                RUNTIME("fork");
+            if (pid == 0)
+                send_forever();
+            children.push_back(pid);
+        }
+
+        ALWAYS("%lu senders x %d flows over lo, %.0f s per run, %ld CPUs\n",
+               (unsigned long)senders, (int)FLOWS_PER_SENDER, seconds, cpus);
+        ALWAYS("%7s %12s %12s %8s %10s %8s\n", "threads", "Mpps", "drops Mpps",
+               "cpu %", "ns/pkt", "flows");
+        for (size_t threads = 0; threads <= max_threads; ++threads)
+            run(threads, seconds);
+    } catch (std::exception &e)
+    {
+        ALWAYS("Caught exception.\n");
+        status = 1;
+    }
+
+    for (size_t i = 0; i < children.size(); ++i)
+    {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], 0, 0);
+    }
+    return status;
+}
+
+#undef ALWAYS
+#undef RUNTIME
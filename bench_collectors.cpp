@@ -0,0 +1,851 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Comparison of the collectors at scale.  For each interface count, a
+    fixture with that many interfaces:
+
+      veth       veth pairs in a private network namespace (with its own
+                 sysfs mounted over /sys, in a private mount namespace),
+                 with raw frames sent round them all the while.  Needs
+                 CAP_SYS_ADMIN and CAP_NET_ADMIN.
+      synthetic  a tree shaped like /sys/class/net and a /proc/net/dev on
+                 tmpfs, with the counters rewritten all the while.  For
+                 anyone; tmpfs isn't sysfs, so it's the syscalls and the
+                 memory that carry over, not the times, and there's no
+                 netlink.
+
+    Then for each collector, in a process of its own: one network_stats
+    per interface reading what monitor reads, a sweep to settle, and as
+    many sweeps as fit in the time allowed (one collector that's taken
+    twenty times that just to set up is given up on).  Reports sweep
+    latency (median and 99th percentile), CPU and syscalls per sweep, the
+    time to set up, and the resident memory and fds it took.  -o appends
+    the same, one CSV line per run, for tracking over time.
+
+    usage: bench_collectors [-f veth|synthetic] [-t seconds] [-q]
+                            [-o results.csv] [interfaces ...]
+
+    The default fixture is veth if we can make a network namespace and
+    synthetic if not; the default counts are 10, 1000 and 10000.
+*/
+
+#include <vector>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mount.h>
+#include <sys/wait.h>
+#include <net/if.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/if_packet.h>
+#include <linux/veth.h>
+
+#include "program_IO.h"
+#include "network_stats.h"
+#include "fd_pool.h"
+
+namespace
+{
+    const std::string NAME("bench_collectors");
+
+    enum
+    {
+        DEFAULT_SECONDS = 3,
+
+        // whatever the time allowed, this many sweeps at most
+        MAX_SWEEPS = 1000,
+
+        // and no more than this many times it for setting up and the first
+        // sweep: a collector that slow isn't worth waiting for
+        MAX_SETUP_FACTOR = 20,
+
+        // what monitor reads from every interface
+        COUNTERS_PER_INTERFACE = 8,
+
+        // the traffic: frames (or counter rewrites) a second, in bursts
+        TRAFFIC_PER_SECOND = 20000,
+        TRAFFIC_BURST = 100,
+
+        FRAME_SIZE = 60,
+        ETHERTYPE_EXPERIMENTAL = 0x88b5,
+
+        NETLINK_BUFFER = 1024,
+
+        WHY_SIZE = 160
+    };
+
+    const size_t DEFAULT_COUNTS[] = { 10, 1000, 10000 };
+
+    enum fixture_kind
+    {
+        FIXTURE_VETH,
+        FIXTURE_SYNTHETIC
+    };
+
+    const char *
+    fixture_name(fixture_kind f)
+    {
+        return (f == FIXTURE_VETH) ? "veth" : "synthetic";
+    }
+
+    enum run_status
+    {
+        RUN_OK,
+        RUN_FAILED,             // threw: out of fds, memory...
+        RUN_TOO_SLOW            // gave up setting up
+    };
+
+    const char *const STATUS_NAMES[] = { "ok", "failed", "too_slow" };
+
+    //* What one collector did on one fixture: a CSV line, less the names.
+    struct result
+    {
+        run_status status;
+        size_t sweeps;
+        double p50_us;
+        double p99_us;
+        double cpu_us;          // per sweep
+        double opens;           // per sweep, as are the next two
+        double reads;
+        double closes;
+        double setup_ms;
+        long rss_kb;            // what setting up added
+        long fds;
+        char why[WHY_SIZE];     // if RUN_FAILED: what was thrown
+    };
+
+    double
+    now_seconds(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+    }
+
+    double
+    cpu_seconds(void)
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+    }
+
+    long
+    rss_kb(void)
+    {
+        long pages = 0, resident = 0;
+        FILE *f = std::fopen("/proc/self/statm", "r");
+        if (f)
+        {
+            if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+                resident = 0;
+            std::fclose(f);
+        }
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    //* Asking every fd: listing /proc/self/fd needs one, and we may be out.
+    long
+    open_fds(void)
+    {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl))
+            return -1;
+        long n = 0;
+        for (rlim_t fd = 0; fd < rl.rlim_cur; ++fd)
+        {
+            if (fcntl((int)fd, F_GETFD) != -1)
+                ++n;
+        }
+        return n;
+    }
+
+    std::string
+    interface_name(size_t i)
+    {
+        char name[IFNAMSIZ];
+        std::snprintf(name, sizeof(name), "bc%05lu", (unsigned long)i);
+        return name;
+    }
+
+    //* Append an attribute; the caller makes sure there's room.
+    struct rtattr *
+    add_attr(struct nlmsghdr *h, unsigned short type, const void *data,
+             size_t len)
+    {
+        struct rtattr *a = (struct rtattr *)((char *)h + NLMSG_ALIGN(h->nlmsg_len));
+        a->rta_type = type;
+        a->rta_len = RTA_LENGTH(len);
+        if (len)
+            std::memcpy(RTA_DATA(a), data, len);
+        h->nlmsg_len = NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(a->rta_len);
+        return a;
+    }
+
+    void
+    end_nest(struct nlmsghdr *h, struct rtattr *nest)
+    {
+        nest->rta_len = (unsigned short)((char *)h + h->nlmsg_len - (char *)nest);
+    }
+
+    int
+    rm_entry(const char *path, const struct stat *, int, struct FTW *)
+    {
+        return remove(path);
+    }
+
+    //* Between bursts: TRAFFIC_PER_SECOND, give or take the sending.
+    void
+    pace(void)
+    {
+        struct timespec pause;
+        pause.tv_sec = 0;
+        pause.tv_nsec = 1000000000L / (TRAFFIC_PER_SECOND / TRAFFIC_BURST);
+        nanosleep(&pause, 0);
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    /**
+        Into a network namespace of our own, with a sysfs of its own over
+        /sys in a mount namespace of our own, so /sys/class/net shows what
+        we make.  False if we aren't allowed.
+    */
+
+    bool
+    enter_namespaces(void)
+    {
+        if (unshare(CLONE_NEWNET | CLONE_NEWNS))
+            return false;
+        if (mount("none", "/", 0, MS_REC | MS_PRIVATE, 0))
+            ERROR("Making mounts private");
+        if (mount("sysfs", "/sys", "sysfs", 0, 0))
+            ERROR("Mounting sysfs for the new namespace");
+        return true;
+    }
+
+    //* Send 'h' and wait for the ack: an error is 'what' failing.
+    void
+    ask(int fd, struct nlmsghdr *h, const std::string &what)
+    {
+        if (send(fd, h, h->nlmsg_len, 0) == -1)
+            ERROR("Asking for %s", C(what));
+
+        uint32_t answer[NETLINK_BUFFER / sizeof(uint32_t)];
+        if (recv(fd, answer, sizeof(answer), 0) == -1)
+            ERROR("Reading answer for %s", C(what));
+        const struct nlmsghdr *a = (const struct nlmsghdr *)answer;
+        const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(a);
+        if ((a->nlmsg_type == NLMSG_ERROR) && e->error)
+        {
+            errno = -e->error;
+            ERROR("%s", C(what));
+        }
+    }
+
+    struct nlmsghdr *
+    start_link_message(uint32_t *buffer, unsigned short flags, uint32_t seq)
+    {
+        std::memset(buffer, 0, NETLINK_BUFFER);
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        h->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+        h->nlmsg_type = RTM_NEWLINK;
+        h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+        h->nlmsg_seq = seq;
+        ((struct ifinfomsg *)NLMSG_DATA(h))->ifi_family = AF_UNSPEC;
+        return h;
+    }
+
+    /**
+        Pairs of veths, up, until there are 'count' (rounded up to even).
+        Made down and brought up after: a veth won't come up before its
+        peer's there.
+    */
+
+    void
+    make_veths(size_t count, std::vector<std::string> *names)
+    {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd == -1)
+            ERROR("Opening rtnetlink socket");
+
+        uint32_t buffer[NETLINK_BUFFER / sizeof(uint32_t)];
+        uint32_t seq = 0;
+        for (size_t i = 0; i < count; i += 2)
+        {
+            const std::string name(interface_name(i));
+            const std::string peer(interface_name(i + 1));
+
+            struct nlmsghdr *h = start_link_message(buffer,
+                                     NLM_F_CREATE | NLM_F_EXCL, ++seq);
+            add_attr(h, IFLA_IFNAME, C(name), name.size() + 1);
+            struct rtattr *linkinfo = add_attr(h, IFLA_LINKINFO, 0, 0);
+            add_attr(h, IFLA_INFO_KIND, "veth", 5);
+            struct rtattr *data = add_attr(h, IFLA_INFO_DATA, 0, 0);
+            struct rtattr *info = add_attr(h, VETH_INFO_PEER, 0, 0);
+            // the peer's ifinfomsg is the nest's payload, attributes after
+            struct ifinfomsg *peer_ifi = (struct ifinfomsg *)RTA_DATA(info);
+            peer_ifi->ifi_family = AF_UNSPEC;
+            h->nlmsg_len += NLMSG_ALIGN(sizeof(struct ifinfomsg));
+            add_attr(h, IFLA_IFNAME, C(peer), peer.size() + 1);
+            end_nest(h, info);
+            end_nest(h, data);
+            end_nest(h, linkinfo);
+            ask(fd, h, "veths '" + name + "' and '" + peer + "'");
+
+            names->push_back(name);
+            names->push_back(peer);
+        }
+
+        for (size_t i = 0; i < names->size(); ++i)
+        {
+            struct nlmsghdr *h = start_link_message(buffer, 0, ++seq);
+            struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(h);
+            ifi->ifi_flags = ifi->ifi_change = IFF_UP;
+            add_attr(h, IFLA_IFNAME, C((*names)[i]), (*names)[i].size() + 1);
+            ask(fd, h, "'" + (*names)[i] + "' up");
+        }
+        close(fd);
+    }
+
+    void
+    write_file(const std::string &path, const char *text)
+    {
+        int fd = open(C(path), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            ERROR("Creating '%s'", C(path));
+        const ssize_t len = (ssize_t)std::strlen(text);
+        if (write(fd, text, len) != len)
+            ERROR("Writing '%s'", C(path));
+        close(fd);
+    }
+
+    /**
+        A tree on tmpfs that the collectors can't tell from the real one:
+        <root>/class/net/<name>/statistics/<counter> for every interface
+        and counter, and <root>/net_dev in /proc/net/dev's format.  Points
+        SYSFS_NET_DIR and PROC_NET_DEV at it.  Returns the root.
+    */
+
+    std::string
+    make_synthetic(size_t count, std::vector<std::string> *names)
+    {
+        char root[] = "/dev/shm/bench_collectors.XXXXXX";
+        if (access("/dev/shm", W_OK))
+            std::memcpy(root, "/tmp/", 5);
+        if (!mkdtemp(root))
+            ERROR("Making a dir for the synthetic tree");
+        const std::string base(root);
+
+        std::string dir(base + "/class");
+        mkdir(C(dir), 0755);
+        dir += "/net/";
+        mkdir(C(dir), 0755);
+
+        std::string net_dev("Inter-|   Receive                                                |  Transmit\n"
+                            " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n");
+        for (size_t i = 0; i < count; ++i)
+        {
+            const std::string name(interface_name(i));
+            const std::string interface_dir(dir + name);
+            const std::string stats_dir(interface_dir + "/statistics/");
+            if (mkdir(C(interface_dir), 0755) || mkdir(C(stats_dir), 0755))
+                ERROR("Making '%s'", C(stats_dir));
+            for (size_t c = 0; c < NUM_COUNTERS; ++c)
+                write_file(stats_dir + counter_filename(c),
+                           "                   0\n");
+            char ifindex[32];
+            std::snprintf(ifindex, sizeof(ifindex), "%lu\n", (unsigned long)i + 1);
+            write_file(interface_dir + "/ifindex", ifindex);
+
+            net_dev += name + ":";
+            for (size_t column = 0; column < 16; ++column)
+                net_dev += " 0";
+            net_dev += "\n";
+            names->push_back(name);
+        }
+        write_file(base + "/net_dev", C(net_dev));
+
+        SYSFS_NET_DIR = dir;
+        PROC_NET_DEV = base + "/net_dev";
+        return base;
+    }
+
+    //* In a child: frames round every interface, until killed.
+    void
+    send_frames(const std::vector<std::string> &names)
+    {
+        int fd = socket(AF_PACKET, SOCK_RAW, 0);
+        if (fd == -1)
+            _exit(1);
+
+        std::vector<int> indexes;
+        for (size_t i = 0; i < names.size(); ++i)
+            indexes.push_back((int)if_nametoindex(C(names[i])));
+
+        unsigned char frame[FRAME_SIZE];
+        std::memset(frame, 0, sizeof(frame));
+        std::memset(frame, 0xff, 6);                    // broadcast
+        frame[6] = 0x02;                                // locally administered
+        frame[12] = ETHERTYPE_EXPERIMENTAL >> 8;
+        frame[13] = ETHERTYPE_EXPERIMENTAL & 0xff;
+
+        struct sockaddr_ll to;
+        std::memset(&to, 0, sizeof(to));
+        to.sll_family = AF_PACKET;
+        to.sll_halen = 6;
+        std::memset(to.sll_addr, 0xff, 6);
+
+        for (size_t n = 0; ; ++n)
+        {
+            to.sll_ifindex = indexes[n % indexes.size()];
+            sendto(fd, frame, sizeof(frame), 0, (struct sockaddr *)&to,
+                   sizeof(to));
+            if ((n % TRAFFIC_BURST) == 0)
+                pace();
+        }
+    }
+
+    //* In a child: the synthetic counters going up, until killed.
+    void
+    rewrite_counters(const std::vector<std::string> &names)
+    {
+        const size_t moving[] = { counter_index(RX_BYTES), counter_index(RX_PACKETS),
+                                  counter_index(TX_BYTES), counter_index(TX_PACKETS) };
+        const size_t num_moving = sizeof(moving) / sizeof(moving[0]);
+        for (size_t n = 0; ; ++n)
+        {
+            const size_t which = n % (names.size() * num_moving);
+            const std::string path(SYSFS_NET_DIR + names[which / num_moving]
+                                   + "/statistics/"
+                                   + counter_filename(moving[which % num_moving]));
+            // the same width every time, in place: a reader never sees
+            // the file empty, as it would between a truncate and a write
+            char text[32];
+            std::snprintf(text, sizeof(text), "%20lu\n", (unsigned long)n);
+            int fd = open(C(path), O_WRONLY);
+            if (fd != -1)
+            {
+                if (pwrite(fd, text, std::strlen(text), 0)) { }
+                close(fd);
+            }
+            if ((n % TRAFFIC_BURST) == 0)
+                pace();
+        }
+    }
+
+    /**
+        What bench_collectors is for: 'names' read with 'kind', as the
+        monitor would.  Runs in a child of its own, so the memory is all
+        this collector's.
+    */
+
+    result
+    measure(collector_kind kind, const std::vector<std::string> &names,
+            double seconds)
+    {
+        std::set<rx_fields> rx;
+        rx.insert(RX_BYTES);
+        rx.insert(RX_PACKETS);
+        rx.insert(RX_DROPPED);
+        rx.insert(RX_ERRORS);
+        std::set<tx_fields> tx;
+        tx.insert(TX_BYTES);
+        tx.insert(TX_PACKETS);
+        tx.insert(TX_DROPPED);
+        tx.insert(TX_ERRORS);
+
+        result r;
+        std::memset(&r, 0, sizeof(r));
+
+        // half the fds for the pool, as monitor does
+        struct rlimit rl;
+        getrlimit(RLIMIT_NOFILE, &rl);
+        const size_t budget = (rl.rlim_cur == RLIM_INFINITY) ? 65536
+                                                             : rl.rlim_cur / 2;
+        fd_pool *pool = (kind == COLLECTOR_SYSFS_POOLED) ? new fd_pool(budget)
+                                                         : 0;
+
+        const long rss_before = rss_kb();
+        const double setup_start = now_seconds();
+        const double setup_end = setup_start + seconds * MAX_SETUP_FACTOR;
+        std::vector<network_stats *> stats;
+        stats.reserve(names.size());
+        for (size_t i = 0; (i < names.size()) && (now_seconds() < setup_end); ++i)
+        {
+            stats.push_back(new network_stats(names[i], kind, pool));
+            stats.back()->set_rx_stats_to_update(rx);
+            stats.back()->set_tx_stats_to_update(tx);
+        }
+        start_collector_sweep();
+        for (size_t i = 0; (i < stats.size()) && (now_seconds() < setup_end); ++i)
+            stats[i]->update_all();
+        r.setup_ms = (now_seconds() - setup_start) * 1e3;
+        r.rss_kb = rss_kb() - rss_before;
+        r.fds = open_fds();
+
+        if (now_seconds() >= setup_end)
+        {
+            r.status = RUN_TOO_SLOW;
+            for (size_t i = 0; i < stats.size(); ++i)
+                delete stats[i];
+            delete pool;
+            return r;
+        }
+
+        std::vector<double> sweep_us;
+        const collector_syscall_counts before = network_stats::get_syscall_counts();
+        const double cpu_start = cpu_seconds();
+        const double end = now_seconds() + seconds;
+        do
+        {
+            const double start = now_seconds();
+            start_collector_sweep();
+            for (size_t i = 0; i < stats.size(); ++i)
+                stats[i]->update_all();
+            sweep_us.push_back((now_seconds() - start) * 1e6);
+        } while ((now_seconds() < end) && (sweep_us.size() < MAX_SWEEPS));
+        const double cpu = cpu_seconds() - cpu_start;
+        const collector_syscall_counts &after = network_stats::get_syscall_counts();
+
+        const double n = (double)sweep_us.size();
+        std::sort(sweep_us.begin(), sweep_us.end());
+        r.status = RUN_OK;
+        r.sweeps = sweep_us.size();
+        r.p50_us = sweep_us[sweep_us.size() / 2];
+        r.p99_us = sweep_us[std::min(sweep_us.size() - 1,
+                                     (size_t)std::ceil(n * 0.99) - 1)];
+        r.cpu_us = cpu / n * 1e6;
+        r.opens = (double)(after.opens - before.opens) / n;
+        r.reads = (double)(after.reads - before.reads) / n;
+        r.closes = (double)(after.closes - before.closes) / n;
+
+        for (size_t i = 0; i < stats.size(); ++i)
+            delete stats[i];
+        delete pool;
+        return r;
+    }
+
+    /**
+        measure() in a child, whose stdout (every collector's chatter about
+        the files it opens) goes nowhere: the answer comes back on a pipe.
+    */
+
+    result
+    measure_apart(collector_kind kind, const std::vector<std::string> &names,
+                  double seconds)
+    {
+        result r;
+        std::memset(&r, 0, sizeof(r));
+        r.status = RUN_FAILED;
+
+        int pipe_fds[2];
+        if (pipe(pipe_fds))
+            ERROR("pipe");
+
+        std::fflush(0);
+        pid_t pid = fork();
+        if (pid == -1)
+            ERROR("fork");
+        if (pid == 0)
+        {
+            close(pipe_fds[0]);
+            int null = open("/dev/null", O_WRONLY);
+            if (null != -1)
+                dup2(null, STDOUT_FILENO);
+            try
+            {
+                r = measure(kind, names, seconds);
+            } catch (std::exception &e)
+            {
+                r.status = RUN_FAILED;
+                std::snprintf(r.why, sizeof(r.why), "%s", e.what());
+                r.why[std::strcspn(r.why, "\n")] = '\0';
+            }
+            if (write(pipe_fds[1], &r, sizeof(r))) { }
+            _exit(0);
+        }
+
+        close(pipe_fds[1]);
+        if (read(pipe_fds[0], &r, sizeof(r)) != (ssize_t)sizeof(r))
+            r.status = RUN_FAILED;
+        close(pipe_fds[0]);
+        waitpid(pid, 0, 0);
+        return r;
+    }
+
+    void
+    print(fixture_kind fixture, size_t count, collector_kind kind,
+          const result &r, FILE *csv)
+    {
+        if (r.status == RUN_FAILED)
+        {
+            ALWAYS("%10lu %-11s failed: %s\n", (unsigned long)count,
+                   collector_kind_name(kind), r.why[0] ? r.why : "died");
+        } else if (r.status == RUN_TOO_SLOW)
+        {
+            ALWAYS("%10lu %-11s %s %.0f s\n", (unsigned long)count,
+                   collector_kind_name(kind), "gave up setting up after",
+                   r.setup_ms / 1e3);
+        } else
+        {
+            ALWAYS("%10lu %-11s %6lu %10.1f %10.1f %10.1f %8.0f %6.0f %6.0f %6.0f %9.1f %9ld %7ld\n",
+                   (unsigned long)count, collector_kind_name(kind),
+                   (unsigned long)r.sweeps, r.p50_us, r.p99_us, r.cpu_us,
+                   r.opens + r.reads + r.closes, r.opens, r.reads, r.closes,
+                   r.setup_ms, r.rss_kb, r.fds);
+        }
+
+        if (csv)
+        {
+            std::fprintf(csv, "%s,%lu,%s,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%ld,%ld\n",
+                         fixture_name(fixture), (unsigned long)count,
+                         collector_kind_name(kind), STATUS_NAMES[r.status],
+                         (unsigned long)r.sweeps, r.p50_us, r.p99_us, r.cpu_us,
+                         r.opens + r.reads + r.closes, r.opens, r.reads,
+                         r.closes, r.setup_ms, r.rss_kb, r.fds);
+            std::fflush(csv);
+        }
+    }
+
+    /**
+        One interface count: the fixture, its traffic, and every collector
+        that makes sense on it.  In a child, so the namespaces (and the
+        interfaces in them) go when it does.
+    */
+
+    void
+    run_count(fixture_kind fixture, size_t count, double seconds,
+              bool traffic, FILE *csv)
+    {
+        std::vector<std::string> names;
+        std::string root;
+        const double start = now_seconds();
+        if (fixture == FIXTURE_VETH)
+        {
+            if (!enter_namespaces())
+                ERROR("Making network and mount namespaces");
+            make_veths(count, &names);
+        } else
+            root = make_synthetic(count, &names);
+        const double made = now_seconds() - start;
+
+        pid_t driver = -1;
+        if (traffic)
+        {
+            std::fflush(0);
+            driver = fork();
+            if (driver == -1)
+                ERROR("fork");
+            if (driver == 0)
+            {
+                if (fixture == FIXTURE_VETH)
+                    send_frames(names);
+                else
+                    rewrite_counters(names);
+                _exit(0);
+            }
+        }
+
+        ALWAYS("%lu %s interfaces made in %.1f s\n", (unsigned long)names.size(),
+               fixture_name(fixture), made);
+        for (size_t k = 0; k < NUM_COLLECTOR_KINDS; ++k)
+        {
+            const collector_kind kind = (collector_kind)k;
+            if (!collector_kind_built(kind))
+                continue;
+            if ((fixture == FIXTURE_SYNTHETIC) && (kind == COLLECTOR_NETLINK))
+                continue;
+            print(fixture, names.size(), kind, measure_apart(kind, names, seconds),
+                  csv);
+        }
+
+        if (driver > 0)
+        {
+            kill(driver, SIGKILL);
+            waitpid(driver, 0, 0);
+        }
+        if (!root.empty())
+            nftw(C(root), rm_entry, 64, FTW_DEPTH | FTW_PHYS);
+    }
+
+    //* Enough fds for the persistent collector at 'count', if we may.
+    void
+    raise_fd_limit(size_t count)
+    {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl))
+            return;
+        const rlim_t want = count * COUNTERS_PER_INTERFACE + 1024;
+        if (rl.rlim_cur >= want)
+            return;
+        rl.rlim_cur = want;
+        if (rl.rlim_max < want)
+            rl.rlim_max = want;
+        if (setrlimit(RLIMIT_NOFILE, &rl))
+        {
+            getrlimit(RLIMIT_NOFILE, &rl);
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+    }
+
+    //* Can we make a network namespace?  Tried in a child, to stay put.
+    bool
+    can_unshare(void)
+    {
+        std::fflush(0);
+        pid_t pid = fork();
+        if (pid == 0)
+            _exit(unshare(CLONE_NEWNET | CLONE_NEWNS) ? 1 : 0);
+        int status = 1;
+        if (pid > 0)
+            waitpid(pid, &status, 0);
+        return (pid > 0) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    double seconds = DEFAULT_SECONDS;
+    bool traffic = true;
+    bool fixture_chosen = false;
+    fixture_kind fixture = FIXTURE_SYNTHETIC;
+    const char *csv_path = 0;
+
+    int c;
+    while ((c = getopt(argc, argv, "f:t:qo:")) != -1)
+    {
+        switch (c)
+        {
+        case 'f':
+            fixture_chosen = true;
+            fixture = (std::strcmp(optarg, "veth") == 0) ? FIXTURE_VETH
+                                                         : FIXTURE_SYNTHETIC;
+            break;
+        case 't':
+            seconds = std::atof(optarg);
+            break;
+        case 'q':
+            traffic = false;
+            break;
+        case 'o':
+            csv_path = optarg;
+            break;
+        default:
+            ALWAYS("usage: bench_collectors [-f veth|synthetic] [-t seconds] "
+                   "[-q] [-o results.csv] [interfaces ...]\n");
+            return 1;
+        }
+    }
+
+    std::vector<size_t> counts;
+    for (int i = optind; i < argc; ++i)
+        counts.push_back(std::strtoul(argv[i], 0, 0));
+    if (counts.empty())
+        counts.assign(DEFAULT_COUNTS,
+                      DEFAULT_COUNTS + sizeof(DEFAULT_COUNTS) / sizeof(DEFAULT_COUNTS[0]));
+
+    int status = 0;
+    FILE *csv = 0;
+    try
+    {
+        if (seconds <= 0.0)
+            RUNTIME("seconds must be positive");
+        if (!fixture_chosen)
+            fixture = can_unshare() ? FIXTURE_VETH : FIXTURE_SYNTHETIC;
+
+        if (csv_path)
+        {
+            struct stat st;
+            const bool fresh = stat(csv_path, &st) || (st.st_size == 0);
+            csv = std::fopen(csv_path, "a");
+            if (!csv)
+                ERROR("Opening '%s'", csv_path);
+            if (fresh)
+                std::fprintf(csv, "fixture,interfaces,collector,status,sweeps,"
+                             "sweep_us_p50,sweep_us_p99,cpu_us_per_sweep,"
+                             "syscalls_per_sweep,opens_per_sweep,reads_per_sweep,"
+                             "closes_per_sweep,setup_ms,rss_kb,fds\n");
+        }
+
+        ALWAYS("%s fixture, %d counters an interface, %.1f s a collector, "
+               "traffic %s\n", fixture_name(fixture), (int)COUNTERS_PER_INTERFACE,
+               seconds, traffic ? "on" : "off");
+        ALWAYS("%10s %-11s %6s %10s %10s %10s %8s %6s %6s %6s %9s %9s %7s\n",
+               "interfaces", "collector", "sweeps", "p50 us", "p99 us",
+               "cpu us", "syscalls", "opens", "reads", "closes", "setup ms",
+               "rss kB", "fds");
+
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            if (counts[i] == 0)
+                continue;
+            raise_fd_limit(counts[i]);
+
+            std::fflush(0);
+            pid_t pid = fork();
+            if (pid == -1)
+                ERROR("fork");
+            if (pid == 0)
+            {
+                int code = 0;
+                try
+                {
+                    run_count(fixture, counts[i], seconds, traffic, csv);
+                } catch (std::exception &e)
+                {
+                    code = 1;
+                }
+                std::fflush(0);
+                _exit(code);
+            }
+
+            int child_status = 0;
+            waitpid(pid, &child_status, 0);
+            if (!WIFEXITED(child_status) || WEXITSTATUS(child_status))
+                status = 1;
+        }
+    } catch (std::exception &e)
+    {
+        ALWAYS("Caught exception.\n");
+        status = 1;
+    }
+
+    if (csv)
+        std::fclose(csv);
+    return status;
+}
+
+#undef ALWAYS
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,191 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Benchmark for the per-packet half of flow_capture: header parsing and
+    the Space-Saving update, over synthetic packets (IPv4 and IPv6, TCP and
+    UDP) from a skewed population of flows, the way real traffic is.  The
+    kernel's side, filling the ring, isn't ours to speed up; this is what
+    we spend per packet once it's there.  Checked against exact counts.
+
+    usage: bench_flows [packets [flows [counters]]]
+*/
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include <time.h>
+
+#include "program_IO.h"
+#include "flow_capture.h"
+
+namespace
+{
+    const std::string NAME("bench_flows");
+
+    enum
+    {
+        DEFAULT_PACKETS = 20 * 1000 * 1000,
+        DEFAULT_FLOWS = 100 * 1000,
+        DEFAULT_COUNTERS = 640,         // what --flows 10 gets
+        DISTINCT_PACKETS = 1 << 16,     // cycled through, so it's in cache
+        SNAPLEN = 128,
+        CHECK_TOP = 10
+    };
+
+    double
+    cpu_seconds(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+    }
+
+    struct packet
+    {
+        uint16_t ethertype;
+        uint16_t length;                // on the wire
+        uint8_t data[SNAPLEN];          // from the network header
+    };
+
+    void
+    put16(uint8_t *p, uint16_t v)
+    {
+        p[0] = v >> 8;
+        p[1] = v & 0xff;
+    }
+
+    //* Flow 'f': one in four IPv6, one in three UDP, sizes all over.
+    void
+    make_packet(size_t f, packet *p)
+    {
+        std::memset(p, 0, sizeof(*p));
+        const bool v6 = (f % 4) == 0;
+        const uint8_t protocol = ((f % 3) == 0) ? 17 : 6;
+        p->length = 64 + (f * 37) % 1400;
+
+        uint8_t *l4;
+        if (v6)
+        {
+            p->ethertype = 0x86dd;
+            p->data[0] = 0x60;
+            p->data[6] = protocol;
+            p->data[8] = 0x20;
+            std::memcpy(p->data + 20, &f, sizeof(f));
+            p->data[24] = 0x20;
+            p->data[39] = 1;
+            l4 = p->data + 40;
+        }
+        else
+        {
+            p->ethertype = 0x0800;
+            p->data[0] = 0x45;
+            p->data[9] = protocol;
+            p->data[12] = 10;
+            std::memcpy(p->data + 13, &f, 3);
+            p->data[16] = 192;
+            p->data[19] = 1;
+            l4 = p->data + 20;
+        }
+        put16(l4, 1024 + f % 60000);
+        put16(l4 + 2, (f % 7) ? 443 : 53);
+    }
+
+    //* Zipf-ish: flow ranks drawn so a few flows carry most packets.
+    size_t
+    skewed(size_t flows)
+    {
+        const double u = (double)(std::rand() + 1) / ((double)RAND_MAX + 2);
+        return (size_t)std::pow((double)flows, u) - 1;
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+int
+main(int argc, char *argv[])
+{
+    const size_t packets = (argc > 1) ? std::strtoul(argv[1], 0, 0) : DEFAULT_PACKETS;
+    const size_t flows = (argc > 2) ? std::strtoul(argv[2], 0, 0) : DEFAULT_FLOWS;
+    const size_t counters = (argc > 3) ? std::strtoul(argv[3], 0, 0) : DEFAULT_COUNTERS;
+
+    try
+    {
+        if (!packets || !flows || !counters)
+            RUNTIME("packets, flows and counters must be positive");
+
+        std::srand(12345);
+        std::vector<packet> input(DISTINCT_PACKETS);
+        for (size_t i = 0; i < input.size(); ++i)
+            make_packet(skewed(flows), &input[i]);
+
+        flow_counters heavy(counters);
+        uint64_t unparsed = 0;
+
+        const double start = cpu_seconds();
+        for (size_t i = 0; i < packets; ++i)
+        {
+            const packet &p = input[i & (DISTINCT_PACKETS - 1)];
+            flow_key key;
+            if (parse_flow(p.ethertype, p.data, SNAPLEN, &key))
+                heavy.offer(key, p.length);
+            else
+                ++unparsed;
+        }
+        const double cpu = cpu_seconds() - start;
+
+        // the same packets, counted exactly
+        std::map<std::string, uint64_t> exact;
+        uint64_t total = 0;
+        for (size_t i = 0; i < packets; ++i)
+        {
+            const packet &p = input[i & (DISTINCT_PACKETS - 1)];
+            flow_key key;
+            parse_flow(p.ethertype, p.data, SNAPLEN, &key);
+            exact[flow_name(key)] += p.length;
+            total += p.length;
+        }
+
+        std::vector<flow_counters::counter> top;
+        heavy.sorted(&top);
+        size_t wrong = 0;
+        for (size_t i = 0; (i < top.size()) && (i < CHECK_TOP); ++i)
+        {
+            const uint64_t truth = exact[flow_name(top[i].key)];
+            const bool ok = (top[i].count >= truth)
+                         && (top[i].count - top[i].error <= truth);
+            ALWAYS("%-48s %12llu B (true %12llu, error <= %llu)%s\n",
+                   C(flow_name(top[i].key)), (unsigned long long)top[i].count,
+                   (unsigned long long)truth,
+                   (unsigned long long)top[i].error, ok ? "" : " WRONG");
+            wrong += !ok;
+        }
+
+        const double ns = cpu / (double)packets * 1e9;
+        ALWAYS("%lu packets, %lu distinct flows, %lu counters, %lu unparsed\n",
+               (unsigned long)packets, (unsigned long)exact.size(),
+               (unsigned long)counters, (unsigned long)unparsed);
+        ALWAYS("%.1f ns per packet: %.1f Mpps per core, %.1f%% of a core at "
+               "1 Mpps\n", ns, 1e3 / ns, ns * 1e6 / 1e9 * 100.0);
+        ALWAYS("bound: anything over %.0f B is counted; %lu of the top %d "
+               "outside their error\n", (double)total / (double)counters,
+               (unsigned long)wrong, (int)CHECK_TOP);
+        if (wrong)
+            return 1;
+    } catch (std::exception &e)
+    {
+        ALWAYS("Caught exception.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+#undef ALWAYS
+#undef RUNTIME
@@ -0,0 +1,561 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Microbenchmarks for what every sweep does per interface: reading one
+    counter (update_one), reading all the Rx ones (update_receive_data),
+    handing them out (get_receive_data, fetch_one_rx), turning them into
+    deltas and rates (counter_rates, monitor's compute_rates), and printing
+    a line about it (cprint, to /dev/null).
+
+    Pinned to one CPU.  Each case is run in batches big enough to swamp
+    the timer, warmed up, then timed over many batches with the TSC where
+    there is one (calibrated against CLOCK_MONOTONIC; it wants an
+    invariant TSC) and the clock where there isn't.  Reports the minimum,
+    median, 90th and 99th percentile per call.
+
+    -s saves each case's median and 99th percentile (case,p50_ns,p99_ns);
+    -b compares the medians against saved ones and exits 1 if any is more
+    than -r percent (default 10) slower.  The 99th percentiles are kept
+    for whoever reads the file: tails are too noisy to gate on.  Baselines
+    are only good for the machine, build and interface they were made
+    with.
+
+    usage: bench_network_stats [-c cpu] [-i interface] [-n batches]
+                               [-s save.csv] [-b baseline.csv] [-r percent]
+                               [case ...]
+*/
+
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+#include "network_stats.h"
+
+namespace
+{
+    const std::string NAME("bench_network_stats");
+
+    enum
+    {
+        DEFAULT_BATCHES = 1000,
+        DEFAULT_TOLERANCE_PERCENT = 10,
+
+        // a batch takes at least this long, so the timer's a rounding error
+        BATCH_NS = 20 * 1000,
+        MAX_BATCH = 1 << 20,
+
+        WARMUP_NS = 50 * 1000 * 1000,
+        CALIBRATE_NS = 100 * 1000 * 1000
+    };
+
+    //* Reads of a single counter: what every other update is made of.
+    const rx_fields ONE_COUNTER = RX_BYTES;
+
+    uint64_t
+    now_ns(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    const bool HAVE_TSC = true;
+
+    //* lfence first, so nothing before is still in flight.
+    inline uint64_t
+    ticks(void)
+    {
+        uint32_t lo, hi;
+        __asm__ __volatile__("lfence\n\trdtsc" : "=a"(lo), "=d"(hi) : : "memory");
+        return ((uint64_t)hi << 32) | lo;
+    }
+#else
+    const bool HAVE_TSC = false;
+
+    inline uint64_t
+    ticks(void)
+    {
+        return now_ns();
+    }
+#endif
+
+    //* Ticks per ns: 1 without a TSC.
+    double
+    calibrate(void)
+    {
+        if (!HAVE_TSC)
+            return 1.0;
+        const uint64_t ns0 = now_ns();
+        const uint64_t t0 = ticks();
+        while (now_ns() - ns0 < CALIBRATE_NS)
+            ;
+        const uint64_t ns1 = now_ns();
+        const uint64_t t1 = ticks();
+        return (double)(t1 - t0) / (double)(ns1 - ns0);
+    }
+
+    //* What two ticks() back to back cost: taken off every batch.
+    uint64_t
+    timer_overhead(void)
+    {
+        std::vector<uint64_t> samples(1000);
+        for (size_t i = 0; i < samples.size(); ++i)
+        {
+            const uint64_t start = ticks();
+            samples[i] = ticks() - start;
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    bool
+    tsc_invariant(void)
+    {
+        FILE *f = std::fopen("/proc/cpuinfo", "r");
+        if (!f)
+            return false;
+        char line[4096];
+        bool constant = false, nonstop = false;
+        while (std::fgets(line, sizeof(line), f) && !(constant && nonstop))
+        {
+            if (std::strncmp(line, "flags", 5))
+                continue;
+            constant = std::strstr(line, " constant_tsc") != 0;
+            nonstop = std::strstr(line, " nonstop_tsc") != 0;
+            break;
+        }
+        std::fclose(f);
+        return constant && nonstop;
+    }
+
+    //* fetch_one_rx() is for network_stats' own getters: let us at it.
+    class exposed_stats : public network_stats
+    {
+    public:
+        exposed_stats(const std::string &interface): network_stats(interface) {}
+
+        using network_stats_base::fetch_one_rx;
+    };
+
+    /**
+        What the cases work on: set up once, before any of them run.  The
+        sink is where results go so nothing's thrown away unread.
+    */
+
+    struct fixture
+    {
+        std::string interface;
+        int fd;                         // on ONE_COUNTER's file
+        exposed_stats *stats;           // every Rx counter, persistent fds
+        counter_table then;
+        counter_table now;
+        uint64_t delta[NUM_COUNTERS];
+        double rate[NUM_COUNTERS];
+    };
+
+    fixture bench;
+    volatile uint64_t sink;
+    volatile double sink_rate;
+
+    struct result
+    {
+        std::string name;
+        size_t batch;
+        double min_ns;
+        double p50_ns;
+        double p90_ns;
+        double p99_ns;
+        double p50_ticks;
+    };
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    void
+    do_update_one(void)
+    {
+        sink = network_stats::update_one(bench.fd);
+    }
+
+    void
+    do_update_receive_data(void)
+    {
+        bench.stats->update_receive_data();
+    }
+
+    void
+    do_get_receive_data(void)
+    {
+        const receive_data r = bench.stats->get_receive_data();
+        sink = r.bytes;
+    }
+
+    void
+    do_fetch_one_rx(void)
+    {
+        sink = bench.stats->fetch_one_rx(ONE_COUNTER);
+    }
+
+    void
+    do_counter_rates(void)
+    {
+        ++bench.now.value[counter_index(ONE_COUNTER)];
+        counter_rates(bench.now, bench.then, 1.0, bench.delta, bench.rate);
+        sink_rate = bench.rate[counter_index(ONE_COUNTER)];
+    }
+
+    //* One of monitor's lines, or near enough.
+    void
+    do_cprint(void)
+    {
+        const double *r = bench.rate;
+        ALWAYS("%-10s %lu rx %12.0f B/s %10.0f pkt/s tx %12.0f B/s %10.0f pkt/s\n",
+               C(bench.interface), (unsigned long)sink,
+               r[counter_index(RX_BYTES)], r[counter_index(RX_PACKETS)],
+               r[counter_index(TX_BYTES)], r[counter_index(TX_PACKETS)]);
+    }
+
+    struct bench_case
+    {
+        const char *name;
+        void (*run)(void);
+        bool to_stdout;                 // prints: point stdout at /dev/null
+    };
+
+    const bench_case CASES[] =
+    {
+        { "update_one",             do_update_one,          false },
+        { "update_receive_data",    do_update_receive_data, false },
+        { "get_receive_data",       do_get_receive_data,    false },
+        { "fetch_one_rx",           do_fetch_one_rx,        false },
+        { "counter_rates",          do_counter_rates,       false },
+        { "cprint",                 do_cprint,              true }
+    };
+    const size_t NUM_CASES = sizeof(CASES) / sizeof(CASES[0]);
+
+    void
+    set_up(const std::string &interface)
+    {
+        bench.interface = interface;
+
+        const std::string path(SYSFS_NET_DIR + interface + "/statistics/"
+                               + counter_filename(counter_index(ONE_COUNTER)));
+        bench.fd = open(C(path), O_RDONLY | O_CLOEXEC);
+        if (bench.fd == -1)
+            ERROR("Opening '%s'", C(path));
+
+        std::set<rx_fields> rx;
+        for (size_t i = 0; i < NUM_RX_FIELDS; ++i)
+            rx.insert((rx_fields)i);
+        bench.stats = new exposed_stats(interface);
+        bench.stats->set_rx_stats_to_update(rx);
+        bench.stats->update_all();
+
+        bench.stats->get_counter_table(&bench.then);
+        bench.now = bench.then;
+    }
+
+    void
+    tear_down(void)
+    {
+        delete bench.stats;
+        close(bench.fd);
+    }
+
+    uint64_t
+    time_batch(void (*run)(void), size_t batch, uint64_t overhead)
+    {
+        const uint64_t start = ticks();
+        for (size_t i = 0; i < batch; ++i)
+            run();
+        const uint64_t t = ticks() - start;
+        return (t > overhead) ? t - overhead : 0;
+    }
+
+    //* A warmup, batches big enough, then 'batches' of them timed.
+    result
+    measure(const bench_case &c, size_t batches, double ticks_per_ns,
+            uint64_t overhead)
+    {
+        result r;
+        r.name = c.name;
+
+        const uint64_t warm_until = now_ns() + WARMUP_NS;
+        while (now_ns() < warm_until)
+            c.run();
+
+        const uint64_t batch_ticks = (uint64_t)(BATCH_NS * ticks_per_ns);
+        r.batch = 1;
+        while ((time_batch(c.run, r.batch, overhead) < batch_ticks)
+               && (r.batch < MAX_BATCH))
+            r.batch *= 2;
+
+        std::vector<double> per_call(batches);
+        for (size_t i = 0; i < batches; ++i)
+            per_call[i] = (double)time_batch(c.run, r.batch, overhead)
+                        / (double)r.batch;
+        std::sort(per_call.begin(), per_call.end());
+
+        const size_t n = per_call.size();
+        r.min_ns = per_call[0] / ticks_per_ns;
+        r.p50_ns = per_call[n / 2] / ticks_per_ns;
+        r.p90_ns = per_call[std::min(n - 1, (n * 90 + 99) / 100 - 1)] / ticks_per_ns;
+        r.p99_ns = per_call[std::min(n - 1, (n * 99 + 99) / 100 - 1)] / ticks_per_ns;
+        r.p50_ticks = per_call[n / 2];
+        return r;
+    }
+
+    //* With stdout on /dev/null for the duration, for the cases that print.
+    result
+    measure_quietly(const bench_case &c, size_t batches, double ticks_per_ns,
+                    uint64_t overhead)
+    {
+        std::cout << std::flush;
+        const int saved = dup(STDOUT_FILENO);
+        const int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if ((saved == -1) || (null == -1))
+            ERROR("Getting /dev/null ready for '%s'", c.name);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+
+        result r = measure(c, batches, ticks_per_ns, overhead);
+
+        std::cout << std::flush;
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+        return r;
+    }
+
+    //* -1 for any CPU: the last one we're allowed, away from CPU 0's chores.
+    int
+    pin(int cpu)
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed))
+            ERROR("sched_getaffinity");
+        if (cpu < 0)
+        {
+            for (int i = CPU_SETSIZE - 1; (i >= 0) && (cpu < 0); --i)
+            {
+                if (CPU_ISSET(i, &allowed))
+                    cpu = i;
+            }
+        }
+
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        if (sched_setaffinity(0, sizeof(one), &one))
+            ERROR("Pinning to CPU %d", cpu);
+        return cpu;
+    }
+
+    void
+    save(const char *path, const std::vector<result> &results)
+    {
+        FILE *f = std::fopen(path, "w");
+        if (!f)
+            ERROR("Opening '%s'", path);
+        std::fprintf(f, "case,p50_ns,p99_ns\n");
+        for (size_t i = 0; i < results.size(); ++i)
+            std::fprintf(f, "%s,%.3f,%.3f\n", C(results[i].name),
+                         results[i].p50_ns, results[i].p99_ns);
+        if (std::fclose(f))
+            ERROR("Writing '%s'", path);
+    }
+
+    //* Case name to saved median; whatever doesn't parse is skipped.
+    std::map<std::string, double>
+    load(const char *path)
+    {
+        FILE *f = std::fopen(path, "r");
+        if (!f)
+            ERROR("Opening baseline '%s'", path);
+
+        std::map<std::string, double> medians;
+        char line[256];
+        while (std::fgets(line, sizeof(line), f))
+        {
+            char *comma = std::strchr(line, ',');
+            if (!comma)
+                continue;
+            *comma = '\0';
+            char *end;
+            const double p50 = std::strtod(comma + 1, &end);
+            if (end != comma + 1)
+                medians[line] = p50;
+        }
+        std::fclose(f);
+        return medians;
+    }
+
+    //* How many medians are more than 'tolerance' (a fraction) slower.
+    size_t
+    compare(const std::vector<result> &results,
+            const std::map<std::string, double> &baseline, double tolerance)
+    {
+        size_t regressions = 0;
+        ALWAYS("%-22s %10s %10s %8s\n", "case", "base ns", "now ns", "change");
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            std::map<std::string, double>::const_iterator b =
+                baseline.find(results[i].name);
+            if ((b == baseline.end()) || (b->second <= 0.0))
+            {
+                ALWAYS("%-22s %10s %10.1f %8s\n", C(results[i].name), "-",
+                       results[i].p50_ns, "new");
+                continue;
+            }
+
+            const double change = results[i].p50_ns / b->second - 1.0;
+            const bool slower = change > tolerance;
+            if (slower)
+                ++regressions;
+            ALWAYS("%-22s %10.1f %10.1f %+7.1f%%%s\n", C(results[i].name),
+                   b->second, results[i].p50_ns, change * 100.0,
+                   slower ? "  REGRESSION" : "");
+        }
+        return regressions;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    int cpu = -1;
+    std::string interface("lo");
+    size_t batches = DEFAULT_BATCHES;
+    const char *save_path = 0;
+    const char *baseline_path = 0;
+    double tolerance = DEFAULT_TOLERANCE_PERCENT / 100.0;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:i:n:s:b:r:")) != -1)
+    {
+        switch (c)
+        {
+        case 'c':
+            cpu = std::atoi(optarg);
+            break;
+        case 'i':
+            interface = optarg;
+            break;
+        case 'n':
+            batches = std::strtoul(optarg, 0, 0);
+            break;
+        case 's':
+            save_path = optarg;
+            break;
+        case 'b':
+            baseline_path = optarg;
+            break;
+        case 'r':
+            tolerance = std::atof(optarg) / 100.0;
+            break;
+        default:
+            ALWAYS("usage: bench_network_stats [-c cpu] [-i interface] "
+                   "[-n batches] [-s save.csv] [-b baseline.csv] "
+                   "[-r percent] [case ...]\n");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    try
+    {
+        if (batches == 0)
+            RUNTIME("Need at least one batch");
+
+        std::vector<const bench_case *> chosen;
+        for (int i = optind; i < argc; ++i)
+        {
+            size_t k = 0;
+            while ((k < NUM_CASES) && std::strcmp(argv[i], CASES[k].name))
+                ++k;
+            if (k == NUM_CASES)
+                RUNTIME("No case '%s'", argv[i]);
+            chosen.push_back(&CASES[k]);
+        }
+        if (chosen.empty())
+        {
+            for (size_t k = 0; k < NUM_CASES; ++k)
+                chosen.push_back(&CASES[k]);
+        }
+
+        cpu = pin(cpu);
+        const double ticks_per_ns = calibrate();
+        const uint64_t overhead = timer_overhead();
+        ALWAYS("CPU %d, %s at %.3f GHz%s, timer overhead %lu ticks, "
+               "%lu batches a case, interface '%s'\n", cpu,
+               HAVE_TSC ? "TSC" : "CLOCK_MONOTONIC", ticks_per_ns,
+               (HAVE_TSC && !tsc_invariant()) ? " (not invariant!)" : "",
+               (unsigned long)overhead, (unsigned long)batches, C(interface));
+
+        set_up(interface);
+
+        std::vector<result> results;
+        ALWAYS("%-22s %8s %10s %10s %10s %10s %10s\n", "case", "batch",
+               "min ns", "p50 ns", "p90 ns", "p99 ns", "p50 ticks");
+        for (size_t i = 0; i < chosen.size(); ++i)
+        {
+            const bench_case &k = *chosen[i];
+            results.push_back(k.to_stdout
+                              ? measure_quietly(k, batches, ticks_per_ns, overhead)
+                              : measure(k, batches, ticks_per_ns, overhead));
+            const result &r = results.back();
+            ALWAYS("%-22s %8lu %10.1f %10.1f %10.1f %10.1f %10.0f\n",
+                   C(r.name), (unsigned long)r.batch, r.min_ns, r.p50_ns,
+                   r.p90_ns, r.p99_ns, r.p50_ticks);
+        }
+
+        tear_down();
+
+        if (save_path)
+        {
+            save(save_path, results);
+            ALWAYS("Saved to '%s'\n", save_path);
+        }
+        if (baseline_path)
+        {
+            const size_t regressions = compare(results, load(baseline_path),
+                                               tolerance);
+            if (regressions)
+            {
+                ALWAYS("%lu case(s) more than %.0f%% slower than '%s'\n",
+                       (unsigned long)regressions, tolerance * 100.0,
+                       baseline_path);
+                status = 1;
+            }
+        }
+    } catch (std::exception &e)
+    {
+        ALWAYS("Caught exception.\n");
+        status = 1;
+    }
+
+    return status;
+}
+
+#undef ALWAYS
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,133 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Benchmark for sliding_percentile: a year of synthetic 5 minute averages
+    pushed through a 30 day window, checked every so often against a brute
+    force sort of the same window.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cstdlib>
+
+#include <time.h>
+
+#include "program_IO.h"
+#include "percentile_window.h"
+
+namespace
+{
+    const std::string NAME("bench_percentile");
+
+    enum
+    {
+        BUCKETS_PER_DAY = 24 * 12,
+        WINDOW_BUCKETS = 30 * BUCKETS_PER_DAY,
+        YEAR_BUCKETS = 365 * BUCKETS_PER_DAY,
+        CHECK_EVERY = 10007             // prime, so we land all over the day
+    };
+
+    double
+    now_ns(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+    }
+
+    /**
+        Something vaguely like a transit link: a diurnal swing, a weekly
+        dip, noise, and the occasional burst that billing is meant to
+        forgive.
+    */
+
+    double
+    synthetic_rate(size_t bucket)
+    {
+        const double day = (double)(bucket % BUCKETS_PER_DAY) / BUCKETS_PER_DAY;
+        const size_t weekday = (bucket / BUCKETS_PER_DAY) % 7;
+
+        double rate = 400e6 + 300e6 * std::sin(2.0 * M_PI * day);
+        if (weekday >= 5)
+            rate *= 0.6;
+        rate += (std::rand() % 1000) * 50e3;
+        if ((std::rand() % 100) == 0)
+            rate += 2e9;
+        return rate;
+    }
+
+    double
+    brute_force(const std::vector<double> &samples, size_t end, double fraction)
+    {
+        const size_t begin = (end > WINDOW_BUCKETS) ? end - WINDOW_BUCKETS : 0;
+        std::vector<double> window(samples.begin() + begin, samples.begin() + end);
+        size_t k = (size_t)std::ceil(fraction * (double)window.size() - 1e-9);
+        if (k == 0)
+            k = 1;
+        std::nth_element(window.begin(), window.begin() + (k - 1), window.end());
+        return window[k - 1];
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+
+int
+main(int argc, char *argv[])
+{
+    std::srand(12345);
+
+    std::vector<double> samples(YEAR_BUCKETS);
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = synthetic_rate(i);
+
+    sliding_percentile p95(0.95, WINDOW_BUCKETS);
+
+    // timings per update, then sorted for percentiles of our own
+    std::vector<double> update_ns;
+    update_ns.reserve(samples.size());
+
+    double query_sum = 0.0;
+    size_t mismatches = 0;
+
+    const double start = now_ns();
+    for (size_t i = 0; i < samples.size(); ++i)
+    {
+        const double before = now_ns();
+        p95.add(samples[i]);
+        query_sum += p95.percentile();
+        update_ns.push_back(now_ns() - before);
+
+        if (((i + 1) % CHECK_EVERY) == 0)
+        {
+            double expected = brute_force(samples, i + 1, 0.95);
+            if (expected != p95.percentile())
+            {
+                ALWAYS("Mismatch at bucket %lu: got %.0f expected %.0f\n",
+                       (unsigned long)i, p95.percentile(), expected);
+                ++mismatches;
+            }
+        }
+    }
+    const double total = now_ns() - start;
+
+    std::sort(update_ns.begin(), update_ns.end());
+    const size_t n = update_ns.size();
+
+    ALWAYS("%lu buckets (%lu day window): %.3f ms total\n",
+           (unsigned long)n, (unsigned long)(WINDOW_BUCKETS / BUCKETS_PER_DAY),
+           total * 1e-6);
+    ALWAYS("update+query ns: p50 %.0f p95 %.0f p99 %.0f max %.0f\n",
+           update_ns[n / 2], update_ns[(n * 95) / 100],
+           update_ns[(n * 99) / 100], update_ns[n - 1]);
+    ALWAYS("final 95th percentile: %.0f bits/s (checksum %.0f)\n",
+           p95.percentile() * 8.0, query_sum);
+    ALWAYS("%lu mismatches against brute force\n", (unsigned long)mismatches);
+
+    return mismatches ? 1 : 0;
+}
+
+#undef ALWAYS
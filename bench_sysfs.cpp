@@ -0,0 +1,177 @@
+/**
+    Author: Robert Crocombe
+    Classification: Unclassified
+    Initial Release Date:
+
+    Benchmark for the sysfs collectors: the same interface opened many
+    times over (sysfs doesn't care, and it stands in for many interfaces),
+    swept repeatedly with each.  Reports syscalls, wall and CPU
+    time per sweep, and how many fds each needed to do it.
+
+    usage: bench_sysfs [interface [copies [sweeps]]]
+*/
+
+#include <vector>
+#include <set>
+#include <string>
+#include <cstdlib>
+
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "program_IO.h"
+#include "network_stats.h"
+#include "fd_pool.h"
+
+namespace
+{
+    const std::string NAME("bench_sysfs");
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    enum
+    {
+        DEFAULT_COPIES = 500,
+        DEFAULT_SWEEPS = 200,
+
+        // what monitor reads from every interface
+        COUNTERS_PER_INTERFACE = 8
+    };
+
+    double
+    now_seconds(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+    }
+
+    double
+    cpu_seconds(void)
+    {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+            + (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+    }
+
+    /**
+        Open 'copies' of 'interface' with 'kind' and sweep them all
+        'sweeps' times, reporting per sweep costs.  A 'budget' of 0 means
+        no pool.
+    */
+
+    void
+    run(const std::string &interface, size_t copies, size_t sweeps,
+        collector_kind kind, size_t budget)
+    {
+        std::set<rx_fields> rx;
+        rx.insert(RX_BYTES);
+        rx.insert(RX_PACKETS);
+        rx.insert(RX_DROPPED);
+        rx.insert(RX_ERRORS);
+        std::set<tx_fields> tx;
+        tx.insert(TX_BYTES);
+        tx.insert(TX_PACKETS);
+        tx.insert(TX_DROPPED);
+        tx.insert(TX_ERRORS);
+
+        fd_pool *pool = budget ? new fd_pool(budget) : 0;
+        std::vector<network_stats *> stats;
+        for (size_t i = 0; i < copies; ++i)
+        {
+            stats.push_back(new network_stats(interface, kind, pool));
+            stats.back()->set_rx_stats_to_update(rx);
+            stats.back()->set_tx_stats_to_update(tx);
+        }
+
+        // one sweep to fill the pool, so we measure the steady state
+        for (size_t i = 0; i < copies; ++i)
+            stats[i]->update_all();
+
+        const collector_syscall_counts before = network_stats::get_syscall_counts();
+        const uint64_t pool_closes_before = pool ? pool->closes() : 0;
+        const double wall_start = now_seconds();
+        const double cpu_start = cpu_seconds();
+
+        for (size_t s = 0; s < sweeps; ++s)
+        {
+            for (size_t i = 0; i < copies; ++i)
+                stats[i]->update_all();
+        }
+
+        const double cpu = cpu_seconds() - cpu_start;
+        const double wall = now_seconds() - wall_start;
+        const collector_syscall_counts &after = network_stats::get_syscall_counts();
+
+        const double opens = (double)(after.opens - before.opens);
+        const double reads = (double)(after.reads - before.reads);
+        const double closes = (double)(after.closes - before.closes)
+            + (double)((pool ? pool->closes() : 0) - pool_closes_before);
+
+        size_t fds = 0;
+        switch (kind)
+        {
+        case COLLECTOR_SYSFS_OPENAT:    fds = copies; break;
+        case COLLECTOR_SYSFS_POOLED:    fds = copies + pool->size(); break;
+        default:                        fds = copies * COUNTERS_PER_INTERFACE; break;
+        }
+
+        char label[32];
+        if (pool)
+            std::snprintf(label, sizeof(label), "%s/%lu",
+                          collector_kind_name(kind), (unsigned long)budget);
+        else
+            std::snprintf(label, sizeof(label), "%s", collector_kind_name(kind));
+
+        const double n = (double)sweeps;
+        ALWAYS("%-16s %8.0f %8.0f %8.0f %10.1f %10.1f %8lu\n", label,
+               opens / n, reads / n, closes / n,
+               wall / n * 1e6, cpu / n * 1e6, (unsigned long)fds);
+
+        for (size_t i = 0; i < copies; ++i)
+            delete stats[i];
+        delete pool;
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    const std::string interface((argc > 1) ? argv[1] : "lo");
+    const size_t copies = (argc > 2) ? std::strtoul(argv[2], 0, 0) : DEFAULT_COPIES;
+    const size_t sweeps = (argc > 3) ? std::strtoul(argv[3], 0, 0) : DEFAULT_SWEEPS;
+
+    try
+    {
+        if ((copies == 0) || (sweeps == 0))
+            RUNTIME("copies and sweeps must be positive");
+
+        const size_t counters = copies * COUNTERS_PER_INTERFACE;
+
+        ALWAYS("%lu x '%s', %lu counters each, %lu sweeps: per sweep\n",
+               (unsigned long)copies, C(interface),
+               (unsigned long)COUNTERS_PER_INTERFACE, (unsigned long)sweeps);
+        ALWAYS("%-16s %8s %8s %8s %10s %10s %8s\n", "collector",
+               "opens", "reads", "closes", "wall us", "cpu us", "fds");
+
+        run(interface, copies, sweeps, COLLECTOR_SYSFS_FD, 0);
+        run(interface, copies, sweeps, COLLECTOR_SYSFS_OPENAT, 0);
+        run(interface, copies, sweeps, COLLECTOR_SYSFS_POOLED, counters);
+        run(interface, copies, sweeps, COLLECTOR_SYSFS_POOLED, counters / 4);
+    } catch (std::exception &e)
+    {
+        ALWAYS("Caught exception.\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+#undef ALWAYS
+#undef RUNTIME
@@ -0,0 +1,228 @@
+#include "bql_stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("bql_stats");
+
+    const std::string QUEUES_DIR("/queues/");
+    const std::string BQL_DIR("/byte_queue_limits/");
+
+    //* fd for 'path', or -1 if it isn't there.
+    int
+    open_optional(const std::string &path)
+    {
+        return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    size_t
+    bucket(uint64_t bytes)
+    {
+        size_t b = 0;
+        while (bytes && (b < BQL_HISTOGRAM_BUCKETS - 1))
+        {
+            bytes >>= 1;
+            ++b;
+        }
+        return b;
+    }
+
+    //* Counter delta that doesn't go negative when something resets it.
+    uint64_t
+    since(uint64_t now, uint64_t then)
+    {
+        return (now >= then) ? now - then : 0;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+bql_queue::bql_queue(void):
+    queue(-1),
+    inflight_fd(-1),
+    limit_fd(-1),
+    stall_cnt_fd(-1),
+    tx_timeout_fd(-1),
+    inflight(0),
+    limit(0),
+    samples(0),
+    at_limit(0),
+    max_inflight(0),
+    stalls(0),
+    timeouts(0),
+    stall_cnt(0),
+    tx_timeout(0)
+{
+    std::fill(histogram, histogram + BQL_HISTOGRAM_BUCKETS, 0);
+}
+
+/**
+    Open inflight and limit for every tx queue that has them.  Throws if
+    none do: there's nothing for us here.
+*/
+
+bql_stats::bql_stats(const network_stats &stats):
+    interface_(stats.get_interface_name()),
+    queues_()
+{
+    const std::string queues_path(stats.get_interface_path() + QUEUES_DIR);
+    DIR *dir = opendir(C(queues_path));
+    if (!dir)
+        ERROR("Opening '%s'", C(queues_path));
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != 0)
+    {
+        if (std::string(entry->d_name).compare(0, 3, "tx-") != 0)
+            continue;
+
+        const std::string queue_path(queues_path + entry->d_name);
+        bql_queue q;
+        q.queue = std::atoi(entry->d_name + 3);
+        q.inflight_fd = open_optional(queue_path + BQL_DIR + "inflight");
+        q.limit_fd = open_optional(queue_path + BQL_DIR + "limit");
+        if ((q.inflight_fd == -1) || (q.limit_fd == -1))
+        {
+            if (q.inflight_fd != -1)
+                close(q.inflight_fd);
+            if (q.limit_fd != -1)
+                close(q.limit_fd);
+            continue;
+        }
+        q.stall_cnt_fd = open_optional(queue_path + BQL_DIR + "stall_cnt");
+        q.tx_timeout_fd = open_optional(queue_path + "/tx_timeout");
+        queues_.push_back(q);
+    }
+    closedir(dir);
+
+    if (queues_.empty())
+        RUNTIME("%s: no tx queues with byte queue limits", C(interface_));
+
+    // sysfs lists them in whatever order: reports read better in order
+    for (size_t i = 1; i < queues_.size(); ++i)
+    {
+        for (size_t j = i; (j > 0) && (queues_[j].queue < queues_[j - 1].queue); --j)
+            std::swap(queues_[j], queues_[j - 1]);
+    }
+
+    CPRINT("%s: %lu tx queues with byte queue limits\n", C(interface_),
+           (unsigned long)queues_.size());
+
+    // only baselines the counters: there was no previous interval
+    reset();
+    for (size_t i = 0; i < queues_.size(); ++i)
+        queues_[i].stalls = queues_[i].timeouts = 0;
+}
+
+bql_stats::~bql_stats(void)
+{
+    for (size_t i = 0; i < queues_.size(); ++i)
+    {
+        const int fds[] = { queues_[i].inflight_fd, queues_[i].limit_fd,
+                            queues_[i].stall_cnt_fd, queues_[i].tx_timeout_fd };
+        for (size_t f = 0; f < sizeof(fds) / sizeof(fds[0]); ++f)
+        {
+            if (fds[f] != -1)
+                close(fds[f]);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One look at every queue: two preads each.
+*/
+
+void
+bql_stats::sample(void)
+{
+    for (size_t i = 0; i < queues_.size(); ++i)
+    {
+        bql_queue &q = queues_[i];
+        q.inflight = network_stats::update_one(q.inflight_fd);
+        q.limit = network_stats::update_one(q.limit_fd);
+
+        ++q.histogram[bucket(q.inflight)];
+        ++q.samples;
+        if (q.inflight && (q.inflight >= q.limit))
+            ++q.at_limit;
+        q.max_inflight = std::max(q.max_inflight, q.inflight);
+    }
+}
+
+/**
+    Start a new reporting interval: clear the histograms, and work out how
+    many stalls and timeouts the last one had.
+*/
+
+void
+bql_stats::reset(void)
+{
+    for (size_t i = 0; i < queues_.size(); ++i)
+    {
+        bql_queue &q = queues_[i];
+        std::fill(q.histogram, q.histogram + BQL_HISTOGRAM_BUCKETS, 0);
+        q.samples = q.at_limit = q.max_inflight = 0;
+
+        if (q.stall_cnt_fd != -1)
+        {
+            const uint64_t now = network_stats::update_one(q.stall_cnt_fd);
+            q.stalls = since(now, q.stall_cnt);
+            q.stall_cnt = now;
+        }
+        if (q.tx_timeout_fd != -1)
+        {
+            const uint64_t now = network_stats::update_one(q.tx_timeout_fd);
+            q.timeouts = since(now, q.tx_timeout);
+            q.tx_timeout = now;
+        }
+    }
+}
+
+/**
+    Upper bound of the histogram bucket the 'fraction' point falls in (but
+    never more than the max we saw): as close as a log2 histogram can say.
+*/
+
+uint64_t
+bql_stats::percentile(const bql_queue &q, double fraction)
+{
+    if (q.samples == 0)
+        return 0;
+
+    uint64_t wanted = (uint64_t)(fraction * (double)q.samples);
+    if (wanted >= q.samples)
+        wanted = q.samples - 1;
+
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BQL_HISTOGRAM_BUCKETS; ++b)
+    {
+        seen += q.histogram[b];
+        if (seen > wanted)
+            return b ? std::min(((uint64_t)1 << b) - 1, q.max_inflight) : 0;
+    }
+    return q.max_inflight;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,84 @@
+#ifndef BQL_STATS_H
+#define BQL_STATS_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "network_stats.h"
+
+/**
+    Byte Queue Limits, per transmit queue: how many bytes are in flight to
+    the hardware (inflight) against how many BQL currently allows (limit).
+    A queue sitting at its limit is stopped, and everything behind it in
+    the qdisc waits -- head of line blocking that the aggregate counters
+    can't show.
+
+    inflight changes every packet, so it's sampled many times a second
+    (sample()) into a log2 histogram per queue; the owner reports and
+    clears the histograms every sweep (reset()).  The counters that only
+    matter per sweep (stall_cnt, tx_timeout) are read then too.
+
+    Files are held open and read the way network_stats reads its own.
+    Drivers that don't do BQL have no byte_queue_limits directories (on
+    recent kernels), and we have nothing to say about them.
+*/
+
+enum
+{
+    BQL_HISTOGRAM_BUCKETS = 33      // 0, then [2^(b-1), 2^b) up to 4 GB
+};
+
+struct bql_queue
+{
+    int queue;                      // N in tx-N
+
+    int inflight_fd;
+    int limit_fd;
+    int stall_cnt_fd;               // -1 on kernels without stall detection
+    int tx_timeout_fd;              // -1 if not there
+
+    uint64_t inflight;              // as of the last sample
+    uint64_t limit;
+
+    // since the last reset()
+    uint64_t histogram[BQL_HISTOGRAM_BUCKETS];
+    uint64_t samples;
+    uint64_t at_limit;              // samples with inflight >= limit
+    uint64_t max_inflight;
+    uint64_t stalls;
+    uint64_t timeouts;
+
+    // counters as of the last reset(), for the deltas above
+    uint64_t stall_cnt;
+    uint64_t tx_timeout;
+
+    bql_queue(void);
+};
+
+class bql_stats
+{
+private:
+    std::string interface_;
+    std::vector<bql_queue> queues_;
+
+    // uncopyable: owns fds
+    bql_stats(const bql_stats &b);
+    bql_stats &operator =(const bql_stats &b);
+
+public:
+
+    explicit bql_stats(const network_stats &stats);
+    ~bql_stats(void);
+
+    void sample(void);
+    void reset(void);
+
+    size_t size(void) const { return queues_.size(); }
+    const bql_queue &queue(size_t i) const { return queues_[i]; }
+
+    static uint64_t percentile(const bql_queue &q, double fraction);
+};
+
+#endif  // BQL_STATS_H
@@ -0,0 +1,324 @@
+#include "capture_group.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <linux/if_packet.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("capture_group");
+
+    enum
+    {
+        // a worker looks for stop_ at least this often
+        WORKER_POLL_MS = 100,
+
+        // collect() checks for answers this often
+        COLLECT_WAIT_NS = 50 * 1000
+    };
+
+    int
+    kernel_mode(fanout_mode m)
+    {
+        return (m == FANOUT_CPU) ? PACKET_FANOUT_CPU : PACKET_FANOUT_HASH;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+const char *
+fanout_mode_name(fanout_mode m)
+{
+    return (m == FANOUT_CPU) ? "cpu" : "hash";
+}
+
+bool
+fanout_mode_from_name(const std::string &name, fanout_mode *m)
+{
+    if (name == "hash")
+        *m = FANOUT_HASH;
+    else if (name == "cpu")
+        *m = FANOUT_CPU;
+    else
+        return false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+capture_group::worker::worker(capture_group *g, size_t counters):
+    group(g),
+    capture(0),
+    wake_fd(-1),
+    requested(0),
+    acknowledged(0),
+    thread(),
+    started(false),
+    exited(false)
+{
+    tallies[0] = flow_tally(counters);
+    tallies[1] = flow_tally(counters);
+}
+
+/**
+    The first socket of a fanout group asks the kernel for an id nobody
+    else is using (where it can: 4.20 on), and the rest join that.
+*/
+
+capture_group::capture_group(const std::string &interface, size_t counters,
+                             size_t threads, fanout_mode mode,
+                             unsigned sample):
+    interface_(interface),
+    sample_(sample ? sample : 1),
+    workers_(),
+    threaded_(threads > 0),
+    stop_(false)
+{
+    try
+    {
+        if (!threaded_)
+        {
+            workers_.push_back(new worker(this, counters));
+            workers_.back()->capture = new flow_capture(interface,
+                                                        flow_capture::NO_FANOUT,
+                                                        sample_);
+            return;
+        }
+
+#ifdef PACKET_FANOUT_FLAG_UNIQUEID
+        int fanout = (kernel_mode(mode) | PACKET_FANOUT_FLAG_UNIQUEID) << 16;
+#else
+        int fanout = (kernel_mode(mode) << 16) | (getpid() & 0xffff);
+#endif
+        for (size_t i = 0; i < threads; ++i)
+        {
+            workers_.push_back(new worker(this, counters));
+            worker *w = workers_.back();
+            w->capture = new flow_capture(interface, fanout, sample_);
+            if (i == 0)
+                fanout = (kernel_mode(mode) << 16) | w->capture->fanout_id();
+
+            w->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (w->wake_fd == -1)
+                ERROR("Opening eventfd for capture thread %lu", (unsigned long)i);
+        }
+
+        for (size_t i = 0; i < workers_.size(); ++i)
+            start(workers_[i]);
+
+        CPRINT("%s: %lu capture threads in fanout group %d by %s\n",
+               C(interface), (unsigned long)threads, fanout & 0xffff,
+               fanout_mode_name(mode));
+    } catch (...)
+    {
+        shut_down();
+        throw;
+    }
+}
+
+capture_group::~capture_group(void)
+{
+    shut_down();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+void *
+capture_group::run(void *arg)
+{
+    worker *w = (worker *)arg;
+    w->group->work(w);
+    return 0;
+}
+
+/**
+    Runs on a worker thread: wait for the ring (or for collect()), empty
+    it into the current tally, and switch tallies if asked.  Draining
+    before answering means everything the kernel finished before the
+    request lands on the old side.  No exceptions on this side of
+    pthread_join(), and nothing printed.
+*/
+
+void
+capture_group::work(worker *w)
+{
+    struct pollfd pfd[2];
+    pfd[0].fd = w->capture->fd();
+    pfd[1].fd = w->wake_fd;
+
+    while (!stop_)
+    {
+        pfd[0].events = pfd[1].events = POLLIN;
+        pfd[0].revents = pfd[1].revents = 0;
+        if ((poll(pfd, 2, WORKER_POLL_MS) == -1) && (errno != EINTR))
+            break;
+        if (pfd[1].revents & POLLIN)
+        {
+            uint64_t count;
+            if (read(w->wake_fd, &count, sizeof(count))) { }
+        }
+
+        const unsigned acknowledged = w->acknowledged;
+        w->capture->drain(&w->tallies[acknowledged & 1]);
+
+        const unsigned requested = w->requested;
+        if (requested != acknowledged)
+        {
+            // the old tally's contents before the answer
+            __sync_synchronize();
+            w->acknowledged = requested;
+        }
+    }
+
+    w->exited = true;
+}
+
+//* Workers leave the signals to the main thread.
+void
+capture_group::start(worker *w)
+{
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int ret = pthread_create(&w->thread, 0, run, w);
+    pthread_sigmask(SIG_SETMASK, &old, 0);
+
+    if (ret)
+    {
+        errno = ret;
+        ERROR("Starting capture thread for '%s'", C(interface_));
+    }
+    w->started = true;
+}
+
+void
+capture_group::shut_down(void)
+{
+    stop_ = true;
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        const uint64_t one = 1;
+        if ((workers_[i]->wake_fd != -1)
+            && (write(workers_[i]->wake_fd, &one, sizeof(one)) == -1))
+            REPORT("Waking capture thread %lu", (unsigned long)i);
+    }
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        worker *w = workers_[i];
+        if (w->started && pthread_join(w->thread, 0))
+            REPORT("Joining capture thread %lu", (unsigned long)i);
+        delete w->capture;
+        if ((w->wake_fd != -1) && close(w->wake_fd))
+            REPORT("Closing eventfd %d", w->wake_fd);
+        delete w;
+    }
+    workers_.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+//* For the owner to poll: none when the threads are doing it.
+void
+capture_group::fds(std::vector<int> *out) const
+{
+    if (!threaded_)
+        out->push_back(workers_[0]->capture->fd());
+}
+
+void
+capture_group::drain(void)
+{
+    if (!threaded_)
+        workers_[0]->capture->drain(&workers_[0]->tallies[0]);
+}
+
+/**
+    Everything captured since the last call, merged into 'out' (cleared
+    first).  With threads, that's a switch of tallies for each, and a wait
+    of no more than a wakeup and a drain for them all to answer.
+*/
+
+void
+capture_group::collect(flow_tally *out)
+{
+    out->clear();
+
+    if (!threaded_)
+    {
+        worker *w = workers_[0];
+        w->capture->drain(&w->tallies[0]);
+        out->merge(w->tallies[0]);
+        w->tallies[0].clear();
+        return;
+    }
+
+    const uint64_t one = 1;
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        worker *w = workers_[i];
+        __sync_add_and_fetch(&w->requested, 1);
+        if (write(w->wake_fd, &one, sizeof(one)) == -1)
+            ERROR("Waking capture thread %lu", (unsigned long)i);
+    }
+
+    struct timespec pause;
+    pause.tv_sec = 0;
+    pause.tv_nsec = COLLECT_WAIT_NS;
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        worker *w = workers_[i];
+        while ((w->acknowledged != w->requested) && !w->exited)
+            nanosleep(&pause, 0);
+    }
+
+    // the answers before the tallies they cover
+    __sync_synchronize();
+
+    for (size_t i = 0; i < workers_.size(); ++i)
+    {
+        worker *w = workers_[i];
+        if (w->acknowledged != w->requested)
+        {
+            CPRINT("%s: capture thread %lu has stopped\n", C(interface_),
+                   (unsigned long)i);
+            continue;
+        }
+        flow_tally &retired = w->tallies[(w->acknowledged + 1) & 1];
+        out->merge(retired);
+        retired.clear();
+    }
+}
+
+uint64_t
+capture_group::drops(void)
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < workers_.size(); ++i)
+        total += workers_[i]->capture->drops();
+    return total;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
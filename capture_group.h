@@ -0,0 +1,89 @@
+#ifndef CAPTURE_GROUP_H
+#define CAPTURE_GROUP_H
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "flow_capture.h"
+
+enum fanout_mode
+{
+    FANOUT_HASH,                // by flow hash: a flow stays on one thread
+    FANOUT_CPU                  // by the CPU the packet arrived on
+};
+
+const char *fanout_mode_name(fanout_mode m);
+bool fanout_mode_from_name(const std::string &name, fanout_mode *m);
+
+/**
+    Capture for one interface, on the caller's thread or spread over
+    worker threads.
+
+    Every ring gets the same 1 in 'sample' of the packets it's given.
+
+    With no threads, there's one flow_capture: the owner polls fds() and
+    calls drain() when one is readable.
+
+    With N threads, each has its own flow_capture, all in one PACKET_FANOUT
+    group, so the kernel spreads the packets over them (by flow hash, or
+    by receiving CPU) and each thread walks its own ring.  Each thread
+    counts into one of a pair of tallies that nobody else touches.  At
+    collect() the owner asks every thread to switch to the other one of
+    its pair, waits for it to say so (a counter each way, and a barrier),
+    and merges the tallies they've let go of.  Nothing is locked on the
+    packet path, and nothing is shared but the two counters.
+*/
+
+class capture_group
+{
+private:
+    struct worker
+    {
+        capture_group *group;
+        flow_capture *capture;
+        flow_tally tallies[2];  // counting into [acknowledged & 1]
+        int wake_fd;            // eventfd: collect() wants an answer
+        volatile unsigned requested;
+        volatile unsigned acknowledged;
+        pthread_t thread;
+        bool started;
+        volatile bool exited;   // poll() failed: it won't answer again
+
+        worker(capture_group *g, size_t counters);
+    };
+
+    std::string interface_;
+    unsigned sample_;
+    std::vector<worker *> workers_;
+    bool threaded_;
+    volatile bool stop_;
+
+    static void *run(void *arg);
+    void work(worker *w);
+    void start(worker *w);
+    void shut_down(void);
+
+    // uncopyable: owns sockets and threads
+    capture_group(const capture_group &g);
+    capture_group &operator =(const capture_group &g);
+
+public:
+
+    capture_group(const std::string &interface, size_t counters,
+                  size_t threads, fanout_mode mode, unsigned sample = 1);
+    ~capture_group(void);
+
+    void fds(std::vector<int> *out) const;
+    void drain(void);
+
+    void collect(flow_tally *out);
+    uint64_t drops(void);     // since the last call, over every ring
+    size_t threads(void) const { return threaded_ ? workers_.size() : 0; }
+    unsigned sample(void) const { return sample_; }
+};
+
+#endif  // CAPTURE_GROUP_H
@@ -0,0 +1,149 @@
+#include "collector.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "program_IO.h"
+#include "sysfs_collector.h"
+#include "procfs_collector.h"
+#include "netlink_collector.h"
+#include "uring_collector.h"
+
+namespace
+{
+    // once have interface-specific dir, stats are under this dir
+    const std::string STATS_DIR("/statistics/");
+
+    // module/class name
+    const std::string NAME("collector");
+
+    enum
+    {
+        // # bytes to read from any given stats file: this should be
+        // way more than we need, i.e. if we read this many, it's probably
+        // bad
+        READ_SIZE = 32
+    };
+
+    const char *const KIND_NAMES[NUM_COLLECTOR_KINDS] =
+    {
+        "persistent",
+        "openat",
+        "pooled",
+        "procfs",
+        "netlink",
+        "io_uring"
+    };
+}
+
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+collector_syscall_counts collector_syscalls = { 0, 0, 0 };
+uint64_t collector_sweep = 0;
+std::string SYSFS_NET_DIR("/sys/class/net/");
+std::string PROC_NET_DEV("/proc/net/dev");
+
+const char *
+collector_kind_name(collector_kind k)
+{
+    return ((size_t)k < NUM_COLLECTOR_KINDS) ? KIND_NAMES[k]
+                                             : "Unknown collector!";
+}
+
+bool
+collector_kind_from_name(const std::string &name, collector_kind *k)
+{
+    for (size_t i = 0; i < NUM_COLLECTOR_KINDS; ++i)
+    {
+        if (name == KIND_NAMES[i])
+        {
+            *k = (collector_kind)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+//* Is it in this binary?  Whether the kernel will have it is another thing.
+bool
+collector_kind_built(collector_kind k)
+{
+    return (k == COLLECTOR_IO_URING) ? uring_collector::built()
+                                     : ((size_t)k < NUM_COLLECTOR_KINDS);
+}
+
+void
+start_collector_sweep(void)
+{
+    ++collector_sweep;
+}
+
+/**
+    Given the file descriptor to a statistics file, retrieve the ASCII data
+    from that file and convert it into something numeric and return that.
+*/
+
+uint64_t
+read_stats_file(int fd)
+{
+    // read value and check for basic validity: pread() from the start
+    // saves the lseek() to rewind
+    char rbuf[READ_SIZE];
+    ssize_t r_ret = pread(fd, rbuf, READ_SIZE, 0);
+    ++collector_syscalls.reads;
+    if (r_ret == READ_SIZE)
+        RUNTIME("Wow, actually read %d bytes from fd %d", (int)r_ret, fd);
+    if (r_ret <= 0)
+        ERROR("Read %d bytes from fd %d", (int)r_ret, fd);
+    // Turn value into a string
+    rbuf[r_ret] = '\0';
+
+    // try and convert ASCII to numeric data
+    char *endptr;
+    errno = 0;
+    long value = strtol(rbuf, &endptr, 10); // expect value to be decimal
+    if (errno && (errno != EINTR))
+        ERROR("Unable to convert network stat value '%s' to long for fd %d",
+             rbuf, fd);
+
+    return (uint64_t)value;
+}
+
+collector_target::collector_target(const std::string &name, collector_kind k,
+                                   fd_pool *p):
+    interface(name),
+    stats_path(SYSFS_NET_DIR + name + STATS_DIR),
+    kind(k),
+    pool(p)
+{
+}
+
+collector *
+make_collector(const collector_target &target)
+{
+    switch (target.kind)
+    {
+    case COLLECTOR_SYSFS_FD:
+        return new collector_adapter<sysfs_fd_collector>(target);
+    case COLLECTOR_SYSFS_OPENAT:
+        return new collector_adapter<sysfs_openat_collector>(target);
+    case COLLECTOR_SYSFS_POOLED:
+        return new collector_adapter<sysfs_pooled_collector>(target);
+    case COLLECTOR_PROCFS:
+        return new collector_adapter<procfs_collector>(target);
+    case COLLECTOR_NETLINK:
+        return new collector_adapter<netlink_collector>(target);
+    case COLLECTOR_IO_URING:
+        return new collector_adapter<uring_collector>(target);
+    default:
+        break;
+    }
+
+    RUNTIME("Unknown collector %d", (int)target.kind);
+}
+
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,199 @@
+#ifndef COLLECTOR_H
+#define COLLECTOR_H
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "counter_table.h"
+
+class fd_pool;
+
+/**
+    Where the counters come from.
+
+    SYSFS_FD ("persistent") opens each statistics file once and keeps it
+    open: one pread() per counter per sample, but one fd per counter,
+    which at 21 counters an interface runs out of RLIMIT_NOFILE at a few
+    thousand interfaces.
+
+    SYSFS_OPENAT keeps one O_PATH fd on each interface's statistics dir
+    and opens, reads and closes the counter on every sample: three
+    syscalls instead of one, but one fd per interface.
+
+    SYSFS_POOLED is SYSFS_OPENAT with an fd_pool in front: the most
+    recently used counters stay open up to the pool's budget.
+
+    PROCFS reads /proc/net/dev once a sweep for every interface, and each
+    finds its own line in that: few syscalls, but the kernel formats every
+    interface's line, and it doesn't have all the counters.
+
+    NETLINK asks rtnetlink for the interface's rtnl_link_stats64: one
+    request per interface a sweep, a send and a receive whose reply has
+    all of its counters, binary, with nothing to parse.  Every interface
+    asks on the same socket, so it's one fd however many there are.
+
+    IO_URING is SYSFS_FD with every interface's reads queued on one
+    shared io_uring once a sweep, and an io_uring_enter() for each
+    ring-full of them.
+*/
+
+enum collector_kind
+{
+    COLLECTOR_SYSFS_FD,
+    COLLECTOR_SYSFS_OPENAT,
+    COLLECTOR_SYSFS_POOLED,
+    COLLECTOR_PROCFS,
+    COLLECTOR_NETLINK,
+    COLLECTOR_IO_URING,
+    NUM_COLLECTOR_KINDS
+};
+
+const char *collector_kind_name(collector_kind k);
+bool collector_kind_from_name(const std::string &name, collector_kind *k);
+bool collector_kind_built(collector_kind k);
+
+/**
+    What the collectors have cost in syscalls, over all instances.  Sends,
+    receives and io_uring_enter()s count as reads.
+*/
+
+struct collector_syscall_counts
+{
+    uint64_t opens;
+    uint64_t reads;
+    uint64_t closes;
+};
+
+extern collector_syscall_counts collector_syscalls;
+
+/**
+    Whoever sweeps every interface (monitor, the benches) calls this
+    first.  Collectors that read once for all interfaces (procfs) read
+    again on the first collect() after it.  Without it they still read
+    again before handing any interface the same reading twice, so sweeps
+    come out right either way, if sometimes with more reads.
+*/
+
+void start_collector_sweep(void);
+extern uint64_t collector_sweep;        // how many times it's been called
+
+/**
+    Where the files are: the dir holding a dir for each interface (with a
+    trailing '/') and /proc/net/dev.  Only changed to point at a fake tree
+    (bench_collectors does), before any network_stats is made.
+*/
+
+extern std::string SYSFS_NET_DIR;
+extern std::string PROC_NET_DEV;
+
+uint64_t read_stats_file(int fd);
+
+//* Everything a collector might want to know about what it's reading.
+struct collector_target
+{
+    std::string interface;
+    std::string stats_path;     // the sysfs statistics dir, with a '/'
+    collector_kind kind;        // for dynamic_collector
+    fd_pool *pool;              // for COLLECTOR_SYSFS_POOLED
+
+    collector_target(const std::string &name, collector_kind k, fd_pool *p);
+};
+
+/**
+    What basic_network_stats<C> wants of a collector C:
+
+        explicit C(const collector_target &target);
+        bool provides(size_t counter) const;
+        void add(size_t counter);
+        void collect(size_t first, size_t last, counter_table *values);
+        void release(void);
+        void retain(void);
+        const char *name(void) const;
+
+    add() starts reading a counter_table slot, and throws if that can't
+    be done, so mistakes show up then rather than on the first sweep.
+    collect() writes the current value of every added slot in [first,
+    last) into 'values', and nothing else.  release() gives back whatever
+    is held open for each counter, until retain().
+
+    The collectors themselves are in sysfs_collector.h, procfs_collector.h,
+    netlink_collector.h and uring_collector.h.  Named as a template
+    argument, their collect()s inline into the caller's; picked at run time
+    they're behind 'collector', for one virtual call a sweep.
+*/
+
+class collector
+{
+public:
+    virtual ~collector(void) {}
+
+    virtual bool provides(size_t counter) const = 0;
+    virtual void add(size_t counter) = 0;
+    virtual void collect(size_t first, size_t last, counter_table *values) = 0;
+    virtual void release(void) = 0;
+    virtual void retain(void) = 0;
+    virtual const char *name(void) const = 0;
+};
+
+template <typename C>
+class collector_adapter : public collector
+{
+private:
+    C impl_;
+
+    // uncopyable: as C
+    collector_adapter(const collector_adapter &a);
+    collector_adapter &operator =(const collector_adapter &a);
+
+public:
+
+    explicit collector_adapter(const collector_target &target): impl_(target) {}
+
+    bool provides(size_t counter) const { return impl_.provides(counter); }
+    void add(size_t counter) { impl_.add(counter); }
+    void collect(size_t first, size_t last, counter_table *values)
+    {
+        impl_.collect(first, last, values);
+    }
+    void release(void) { impl_.release(); }
+    void retain(void) { impl_.retain(); }
+    const char *name(void) const { return impl_.name(); }
+};
+
+//* One of target.kind, on the heap.
+collector *make_collector(const collector_target &target);
+
+/**
+    The collector for basic_network_stats when the kind is only known at
+    run time: whatever make_collector() makes of the target.
+*/
+
+class dynamic_collector
+{
+private:
+    collector *impl_;
+
+    // uncopyable: owns impl_
+    dynamic_collector(const dynamic_collector &d);
+    dynamic_collector &operator =(const dynamic_collector &d);
+
+public:
+
+    explicit dynamic_collector(const collector_target &target):
+        impl_(make_collector(target)) {}
+    ~dynamic_collector(void) { delete impl_; }
+
+    bool provides(size_t counter) const { return impl_->provides(counter); }
+    void add(size_t counter) { impl_->add(counter); }
+    void collect(size_t first, size_t last, counter_table *values)
+    {
+        impl_->collect(first, last, values);
+    }
+    void release(void) { impl_->release(); }
+    void retain(void) { impl_->retain(); }
+    const char *name(void) const { return impl_->name(); }
+};
+
+#endif  // COLLECTOR_H
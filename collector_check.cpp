@@ -0,0 +1,251 @@
+#include "collector_check.h"
+
+#include <vector>
+#include <cstdio>
+
+#include "program_IO.h"
+#include "network_stats.h"
+#include "fd_pool.h"
+#include "sysfs_collector.h"
+#include "procfs_collector.h"
+#include "netlink_collector.h"
+#include "uring_collector.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("collector_check");
+
+    // what a slot holds until something writes it
+    const uint64_t UNTOUCHED = ~(uint64_t)0;
+
+    enum
+    {
+        // enough for the pooled collector to hold everything
+        POOL_SIZE = NUM_COUNTERS,
+
+        // failures printed for each collector: the rest are like them
+        MAX_FAILURES = 8
+    };
+
+    enum outcome
+    {
+        PASSED,
+        FAILED,
+        UNAVAILABLE
+    };
+
+    typedef basic_network_stats<sysfs_fd_collector> reference_stats;
+
+    /**
+        What 'kind' should read for 'counter', going by 'files'.  The one
+        deliberate difference: /proc/net/dev's Rx drops count the missed
+        ones too.
+    */
+
+    uint64_t
+    expected(collector_kind kind, size_t counter, const counter_table &files)
+    {
+        if ((kind == COLLECTOR_PROCFS) && (counter == counter_index(RX_DROPPED)))
+            return files.value[counter_index(RX_DROPPED)]
+                + files.value[counter_index(RX_MISSED_ERRORS)];
+        return files.value[counter];
+    }
+
+    void
+    fill(counter_table *t)
+    {
+        for (size_t i = 0; i < NUM_COUNTERS; ++i)
+            t->value[i] = UNTOUCHED;
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    //* One collector, going through the motions.
+    template <typename Collector>
+    class checker
+    {
+    private:
+        collector_kind kind_;
+        Collector &collector_;
+        reference_stats &files_;
+        std::vector<std::string> *failures_;
+
+        void fail(const char *what, size_t counter, uint64_t value)
+        {
+            char line[256];
+            std::snprintf(line, sizeof(line), "%s: %s (read %llu)", what,
+                          counter_name(counter), (unsigned long long)value);
+            failures_->push_back(line);
+        }
+
+        //* Is 't' right for [first, last), and untouched elsewhere?
+        void check_range(const char *when, size_t first, size_t last)
+        {
+            counter_table before, got, after;
+            files_.update_all();
+            files_.get_counter_table(&before);
+            fill(&got);
+            collector_.collect(first, last, &got);
+            files_.update_all();
+            files_.get_counter_table(&after);
+
+            for (size_t i = 0; i < NUM_COUNTERS; ++i)
+            {
+                const bool wanted = collector_.provides(i)
+                                 && (i >= first) && (i < last);
+                if (!wanted)
+                {
+                    if (got.value[i] != UNTOUCHED)
+                        fail(when, i, got.value[i]);
+                    continue;
+                }
+                if ((got.value[i] < expected(kind_, i, before))
+                    || (got.value[i] > expected(kind_, i, after)))
+                    fail(when, i, got.value[i]);
+            }
+        }
+
+        void check_all(const char *when)
+        {
+            check_range(when, 0, NUM_COUNTERS);
+            check_range(when, 0, NUM_RX_FIELDS);
+            check_range(when, NUM_RX_FIELDS, NUM_COUNTERS);
+        }
+
+    public:
+
+        checker(collector_kind kind, Collector &c, reference_stats &files,
+                std::vector<std::string> *failures):
+            kind_(kind),
+            collector_(c),
+            files_(files),
+            failures_(failures)
+        {
+        }
+
+        void run(void)
+        {
+            for (size_t i = 0; i < NUM_COUNTERS; ++i)
+            {
+                if (collector_.provides(i))
+                    collector_.add(i);
+            }
+
+            check_all("collect");
+            collector_.release();
+            check_all("released");
+            collector_.retain();
+            check_all("retained");
+        }
+    };
+
+    template <typename Collector>
+    outcome
+    check(const collector_target &target, reference_stats &files,
+          std::vector<std::string> *failures)
+    {
+        Collector *c;
+        try
+        {
+            c = new Collector(target);
+        } catch (std::exception &e)
+        {
+            failures->push_back(e.what());
+            return UNAVAILABLE;
+        }
+
+        try
+        {
+            checker<Collector>(target.kind, *c, files, failures).run();
+        } catch (std::exception &e)
+        {
+            failures->push_back(e.what());
+        }
+        delete c;
+        return failures->empty() ? PASSED : FAILED;
+    }
+
+    //* The named collector for 'target.kind'.
+    outcome
+    check_static(const collector_target &target, reference_stats &files,
+                 std::vector<std::string> *failures)
+    {
+        switch (target.kind)
+        {
+        case COLLECTOR_SYSFS_FD:
+            return check<sysfs_fd_collector>(target, files, failures);
+        case COLLECTOR_SYSFS_OPENAT:
+            return check<sysfs_openat_collector>(target, files, failures);
+        case COLLECTOR_SYSFS_POOLED:
+            return check<sysfs_pooled_collector>(target, files, failures);
+        case COLLECTOR_PROCFS:
+            return check<procfs_collector>(target, files, failures);
+        case COLLECTOR_NETLINK:
+            return check<netlink_collector>(target, files, failures);
+        case COLLECTOR_IO_URING:
+            return check<uring_collector>(target, files, failures);
+        default:
+            break;
+        }
+        failures->push_back("no such collector");
+        return FAILED;
+    }
+
+    void
+    report(const collector_target &target, const char *how, outcome o,
+           const std::vector<std::string> &failures)
+    {
+        static const char *const OUTCOMES[] = { "ok", "FAILED", "unavailable" };
+        ALWAYS("%s: %-10s %-8s %s\n", C(target.interface),
+               collector_kind_name(target.kind), how, OUTCOMES[o]);
+        for (size_t i = 0; (i < failures.size()) && (i < MAX_FAILURES); ++i)
+            ALWAYS("    %s\n", C(failures[i]));
+        if (failures.size() > MAX_FAILURES)
+            ALWAYS("    ... and %lu more\n",
+                   (unsigned long)(failures.size() - MAX_FAILURES));
+    }
+}
+
+bool
+check_collectors(const std::string &interface)
+{
+    reference_stats files(interface);
+    std::set<rx_fields> rx;
+    for (size_t r = 0; r < NUM_RX_FIELDS; ++r)
+        rx.insert((rx_fields)r);
+    std::set<tx_fields> tx;
+    for (size_t t = 0; t < NUM_TX_FIELDS; ++t)
+        tx.insert((tx_fields)t);
+    files.set_rx_stats_to_update(rx);
+    files.set_tx_stats_to_update(tx);
+
+    fd_pool pool(POOL_SIZE);
+    bool passed = true;
+    for (size_t k = 0; k < NUM_COLLECTOR_KINDS; ++k)
+    {
+        const collector_target target(interface, (collector_kind)k, &pool);
+        if (!collector_kind_built(target.kind))
+        {
+            ALWAYS("%s: %-10s not built\n", C(interface),
+                   collector_kind_name(target.kind));
+            continue;
+        }
+
+        std::vector<std::string> failures;
+        outcome o = check_static(target, files, &failures);
+        report(target, "static", o, failures);
+        passed = passed && (o != FAILED);
+
+        failures.clear();
+        o = check<dynamic_collector>(target, files, &failures);
+        report(target, "runtime", o, failures);
+        passed = passed && (o != FAILED);
+    }
+    return passed;
+}
+
+#undef ALWAYS
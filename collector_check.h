@@ -0,0 +1,26 @@
+#ifndef COLLECTOR_CHECK_H
+#define COLLECTOR_CHECK_H
+
+#include <string>
+
+/**
+    The conformance check every collector has to pass, run by
+    'main --check-collectors'.  On 'interface', for each collector built
+    in, both ways of having it (named as a template argument, and made by
+    make_collector() at run time):
+
+      - every counter it provides can be added;
+      - a full collect() writes every one of them, and no other slot, and
+        each value lies between two readings of the sysfs files (an fd
+        per counter) taken either side of it: counters only go up;
+      - collecting the Rx half writes no Tx slot, and the reverse;
+      - all of that again after release(), and after retain().
+
+    A collector whose constructor throws (no io_uring in this kernel, say)
+    is reported as unavailable, not failed.  Prints a line each; true if
+    nothing failed.
+*/
+
+bool check_collectors(const std::string &interface);
+
+#endif  // COLLECTOR_CHECK_H
@@ -0,0 +1,237 @@
+#include "counter_recording.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("counter_recording");
+
+    const char MAGIC[8] = { 'n', 's', 't', 'a', 't', 'r', 'e', 'c' };
+
+    enum
+    {
+        VERSION = 1,
+        BYTE_ORDER_MARK = 0x01020304,
+        SWEEP_MARK = 0x73776570,        // "swep"
+
+        // sweeps are a few hundred bytes an interface: read them in big bites
+        STDIO_BUFFER = 1024 * 1024,
+
+        // far more interfaces than a sweep will ever have: a count above
+        // it isn't one
+        MAX_SAMPLES = 1024 * 1024
+    };
+
+    struct file_header
+    {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t version;
+        uint32_t num_counters;
+        uint32_t sample_size;
+    };
+
+    struct sweep_header
+    {
+        uint32_t mark;
+        uint32_t count;                 // recorded_samples following
+        int64_t now;                    // time_t
+        double elapsed;
+    };
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+link_info
+recorded_sample::link(void) const
+{
+    link_info info;
+    info.speed = (long)speed;
+    info.mtu = (long)mtu;
+    info.duplex = (link_duplex)duplex;
+    return info;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+counter_recorder::counter_recorder(const std::string &path):
+    path_(path),
+    file_(0),
+    samples_()
+{
+    file_ = std::fopen(C(path_), "wb");
+    if (!file_)
+        ERROR("Opening '%s' to record to", C(path_));
+
+    file_header h;
+    std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+    h.byte_order = BYTE_ORDER_MARK;
+    h.version = VERSION;
+    h.num_counters = NUM_COUNTERS;
+    h.sample_size = sizeof(recorded_sample);
+    if ((std::fwrite(&h, sizeof(h), 1, file_) != 1) || std::fflush(file_))
+    {
+        std::fclose(file_);
+        ERROR("Writing header to '%s'", C(path_));
+    }
+    CPRINT("Recording counters to '%s'\n", C(path_));
+}
+
+counter_recorder::~counter_recorder(void)
+{
+    if (std::fclose(file_))
+        REPORT("Closing '%s'", C(path_));
+}
+
+counter_replay::counter_replay(const std::string &path):
+    path_(path),
+    file_(0),
+    size_(0),
+    now_(0),
+    elapsed_(0.0),
+    samples_(),
+    sweeps_(0),
+    total_samples_(0)
+{
+    file_ = std::fopen(C(path_), "rb");
+    if (!file_)
+        ERROR("Opening recording '%s'", C(path_));
+    std::setvbuf(file_, 0, _IOFBF, STDIO_BUFFER);
+
+    file_header h;
+    try
+    {
+        struct stat st;
+        if (fstat(fileno(file_), &st))
+            ERROR("Stat of '%s'", C(path_));
+        size_ = (uint64_t)st.st_size;
+
+        if (std::fread(&h, sizeof(h), 1, file_) != 1)
+            RUNTIME("'%s' is too short to be a recording", C(path_));
+        if (std::memcmp(h.magic, MAGIC, sizeof(h.magic)))
+            RUNTIME("'%s' isn't a recording", C(path_));
+        if (h.byte_order != BYTE_ORDER_MARK)
+            RUNTIME("'%s' was recorded with the other byte order", C(path_));
+        if ((h.version != VERSION) || (h.num_counters != NUM_COUNTERS)
+            || (h.sample_size != sizeof(recorded_sample)))
+            RUNTIME("'%s' is version %u with %u counters in %u bytes: we "
+                    "want version %d with %d in %lu", C(path_), h.version,
+                    h.num_counters, h.sample_size, (int)VERSION,
+                    (int)NUM_COUNTERS, (unsigned long)sizeof(recorded_sample));
+    } catch (...)
+    {
+        std::fclose(file_);
+        throw;
+    }
+}
+
+counter_replay::~counter_replay(void)
+{
+    std::fclose(file_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+counter_recorder::add(const std::string &name, int ifindex,
+                      const link_info &link, const counter_table &values,
+                      bool baseline)
+{
+    samples_.resize(samples_.size() + 1);
+    recorded_sample &s = samples_.back();
+
+    std::memset(&s, 0, sizeof(s));
+    std::strncpy(s.name, C(name), sizeof(s.name) - 1);
+    s.ifindex = ifindex;
+    s.flags = baseline ? (uint32_t)recorded_sample::BASELINE : 0;
+    s.speed = link.speed;
+    s.mtu = link.mtu;
+    s.duplex = link.duplex;
+    std::memcpy(s.value, values.value, sizeof(s.value));
+}
+
+void
+counter_recorder::write_sweep(time_t now, double elapsed)
+{
+    sweep_header h;
+    h.mark = SWEEP_MARK;
+    h.count = (uint32_t)samples_.size();
+    h.now = now;
+    h.elapsed = elapsed;
+
+    const bool ok = (std::fwrite(&h, sizeof(h), 1, file_) == 1)
+                 && (samples_.empty()
+                     || (std::fwrite(&samples_[0], sizeof(recorded_sample),
+                                     samples_.size(), file_) == samples_.size()))
+                 && (std::fflush(file_) == 0);
+    samples_.clear();
+    if (!ok)
+        ERROR("Recording to '%s'", C(path_));
+}
+
+bool
+counter_replay::next(void)
+{
+    sweep_header h;
+    const size_t got = std::fread(&h, sizeof(h), 1, file_);
+    if (got != 1)
+    {
+        if (std::ferror(file_))
+            ERROR("Reading '%s'", C(path_));
+        return false;
+    }
+    if (h.mark != SWEEP_MARK)
+        RUNTIME("'%s' is garbled after sweep %lu", C(path_),
+                (unsigned long)sweeps_);
+    if (h.count > MAX_SAMPLES)
+        RUNTIME("'%s' is garbled after sweep %lu: %u samples", C(path_),
+                (unsigned long)sweeps_, h.count);
+
+    // only as many as the file has room for: never more than that in memory
+    const long at = std::ftell(file_);
+    const uint64_t left = ((at >= 0) && ((uint64_t)at < size_))
+                        ? size_ - (uint64_t)at : 0;
+    const bool cut = (uint64_t)h.count * sizeof(recorded_sample) > left;
+    if (!cut)
+        samples_.resize(h.count);
+    if (cut
+        || (h.count
+            && (std::fread(&samples_[0], sizeof(recorded_sample), h.count,
+                           file_) != h.count)))
+    {
+        if (std::ferror(file_))
+            ERROR("Reading '%s'", C(path_));
+        CPRINT("'%s' ends part way through sweep %lu: stopping there\n",
+               C(path_), (unsigned long)sweeps_ + 1);
+        samples_.clear();
+        return false;
+    }
+
+    for (size_t i = 0; i < samples_.size(); ++i)
+        samples_[i].name[sizeof(samples_[i].name) - 1] = '\0';
+
+    now_ = (time_t)h.now;
+    elapsed_ = h.elapsed;
+    ++sweeps_;
+    total_samples_ += h.count;
+    return true;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
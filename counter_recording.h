@@ -0,0 +1,116 @@
+#ifndef COUNTER_RECORDING_H
+#define COUNTER_RECORDING_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "counter_table.h"
+#include "network_stats.h"
+
+/**
+    One interface's counters in one sweep, as recorded: the whole
+    counter_table (zero where nothing was read) and what the link was.
+
+    The first time an interface is recorded, a BASELINE sample holding the
+    reading its first deltas are from goes just before it, so a replay's
+    deltas come out the same as the recorded run's did.
+*/
+
+struct recorded_sample
+{
+    enum
+    {
+        BASELINE = 1
+    };
+
+    char name[IFNAMSIZ];            // NUL terminated
+    int32_t ifindex;
+    uint32_t flags;
+    int64_t speed;                  // link_info's
+    int64_t mtu;
+    int32_t duplex;
+    uint32_t reserved;
+    uint64_t value[NUM_COUNTERS];
+
+    link_info link(void) const;
+};
+
+/**
+    Writes what monitor reads every sweep to a file, for counter_replay.
+
+    The format is raw structs in this machine's byte order, after a header
+    saying what they are: a recording is for replaying on the same sort of
+    machine, with the same build's counter_table.  Each sweep is a header
+    (the time, the seconds since the last, how many samples) and then its
+    recorded_samples.  Every sweep is flushed, so a crash loses the sweep
+    it happened in and no more.
+*/
+
+class counter_recorder
+{
+private:
+    std::string path_;
+    FILE *file_;
+    std::vector<recorded_sample> samples_;      // this sweep's, so far
+
+    // uncopyable: owns file_
+    counter_recorder(const counter_recorder &r);
+    counter_recorder &operator =(const counter_recorder &r);
+
+public:
+
+    explicit counter_recorder(const std::string &path);
+    ~counter_recorder(void);
+
+    void add(const std::string &name, int ifindex, const link_info &link,
+             const counter_table &values, bool baseline);
+    void write_sweep(time_t now, double elapsed);
+};
+
+/**
+    Plays back a counter_recorder's file a sweep at a time: next() moves
+    on to the next sweep, and false says there isn't one.  A sweep cut off
+    by the recorder dying is treated as the end; one claiming more samples
+    than any host has interfaces is garbage, and an error.
+*/
+
+class counter_replay
+{
+private:
+    std::string path_;
+    FILE *file_;
+    uint64_t size_;                             // bytes, when opened
+
+    time_t now_;
+    double elapsed_;
+    std::vector<recorded_sample> samples_;      // this sweep's
+
+    uint64_t sweeps_;                           // so far
+    uint64_t total_samples_;
+
+    // uncopyable: owns file_
+    counter_replay(const counter_replay &r);
+    counter_replay &operator =(const counter_replay &r);
+
+public:
+
+    explicit counter_replay(const std::string &path);
+    ~counter_replay(void);
+
+    bool next(void);
+
+    time_t now(void) const { return now_; }
+    double elapsed(void) const { return elapsed_; }
+    const std::vector<recorded_sample> &samples(void) const { return samples_; }
+
+    uint64_t sweeps(void) const { return sweeps_; }
+    uint64_t total_samples(void) const { return total_samples_; }
+};
+
+#endif  // COUNTER_RECORDING_H
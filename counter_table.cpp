@@ -0,0 +1,146 @@
+#include "counter_table.h"
+
+#include <linux/if_link.h>
+
+namespace
+{
+    // in counter_table order
+    const char *const FILENAMES[NUM_COUNTERS] =
+    {
+        "rx_bytes",
+        "rx_compressed",
+        "rx_crc_errors",
+        "rx_dropped",
+        "rx_errors",
+        "rx_fifo_errors",
+        "rx_frame_errors",
+        "rx_length_errors",
+        "rx_missed_errors",
+        "rx_over_errors",
+        "rx_packets",
+
+        "tx_aborted_errors",
+        "tx_bytes",
+        "tx_carrier_errors",
+        "tx_compressed",
+        "tx_dropped",
+        "tx_errors",
+        "tx_fifo_errors",
+        "tx_heartbeat_errors",
+        "tx_packets",
+        "tx_window_errors"
+    };
+}
+
+const char *
+rx_name(enum rx_fields r)
+{
+    #define STRINGIFY(x) case x: return #x;
+    switch (r)
+    {
+    STRINGIFY(RX_BYTES); STRINGIFY(RX_COMPRESSED); STRINGIFY(RX_CRC_ERRORS);
+    STRINGIFY(RX_DROPPED); STRINGIFY(RX_ERRORS); STRINGIFY(RX_FIFO_ERRORS);
+    STRINGIFY(RX_FRAME_ERRORS); STRINGIFY(RX_LENGTH_ERRORS);
+    STRINGIFY(RX_MISSED_ERRORS); STRINGIFY(RX_OVER_ERRORS);
+    STRINGIFY(RX_PACKETS);
+    default: return "Unknown Rx!";
+    }
+    #undef STRINGIFY
+}
+
+const char *
+tx_name(enum tx_fields t)
+{
+    #define STRINGIFY(x) case x: return #x;
+    switch (t)
+    {
+    STRINGIFY(TX_ABORTED_ERRORS); STRINGIFY(TX_BYTES);
+    STRINGIFY(TX_CARRIER_ERRORS); STRINGIFY(TX_COMPRESSED);
+    STRINGIFY(TX_DROPPED); STRINGIFY(TX_ERRORS); STRINGIFY(TX_FIFO_ERRORS);
+    STRINGIFY(TX_HEARTBEAT_ERRORS); STRINGIFY(TX_PACKETS);
+    STRINGIFY(TX_WINDOW_ERRORS);
+    default: return "Unknown Tx!";
+    }
+    #undef STRINGIFY
+}
+
+/**
+    Name for a slot in a counter_table: same as rx_name()/tx_name().
+*/
+
+const char *
+counter_name(size_t index)
+{
+    if (index < NUM_RX_FIELDS)
+        return rx_name((rx_fields)index);
+    if (index < NUM_COUNTERS)
+        return tx_name((tx_fields)(index - NUM_RX_FIELDS));
+    return "Unknown counter!";
+}
+
+/**
+    Reverse of counter_name(): false if 'name' isn't one of ours.
+*/
+
+bool
+counter_from_name(const std::string &name, size_t *index)
+{
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+    {
+        if (name == counter_name(i))
+        {
+            *index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+counter_filename(size_t index)
+{
+    return (index < NUM_COUNTERS) ? FILENAMES[index] : "unknown_counter";
+}
+
+void
+counter_rates(const counter_table &now, const counter_table &then,
+              double elapsed, uint64_t *delta, double *rate)
+{
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+    {
+        const uint64_t n = now.value[i];
+        const uint64_t t = then.value[i];
+        delta[i] = (n >= t) ? n - t : 0;
+        rate[i] = (double)delta[i] * per_second;
+    }
+}
+
+void
+stats64_to_counters(const struct rtnl_link_stats64 &s, counter_table *c)
+{
+    uint64_t *v = c->value;
+
+    v[counter_index(RX_BYTES)] = s.rx_bytes;
+    v[counter_index(RX_COMPRESSED)] = s.rx_compressed;
+    v[counter_index(RX_CRC_ERRORS)] = s.rx_crc_errors;
+    v[counter_index(RX_DROPPED)] = s.rx_dropped;
+    v[counter_index(RX_ERRORS)] = s.rx_errors;
+    v[counter_index(RX_FIFO_ERRORS)] = s.rx_fifo_errors;
+    v[counter_index(RX_FRAME_ERRORS)] = s.rx_frame_errors;
+    v[counter_index(RX_LENGTH_ERRORS)] = s.rx_length_errors;
+    v[counter_index(RX_MISSED_ERRORS)] = s.rx_missed_errors;
+    v[counter_index(RX_OVER_ERRORS)] = s.rx_over_errors;
+    v[counter_index(RX_PACKETS)] = s.rx_packets;
+
+    v[counter_index(TX_ABORTED_ERRORS)] = s.tx_aborted_errors;
+    v[counter_index(TX_BYTES)] = s.tx_bytes;
+    v[counter_index(TX_CARRIER_ERRORS)] = s.tx_carrier_errors;
+    v[counter_index(TX_COMPRESSED)] = s.tx_compressed;
+    v[counter_index(TX_DROPPED)] = s.tx_dropped;
+    v[counter_index(TX_ERRORS)] = s.tx_errors;
+    v[counter_index(TX_FIFO_ERRORS)] = s.tx_fifo_errors;
+    v[counter_index(TX_HEARTBEAT_ERRORS)] = s.tx_heartbeat_errors;
+    v[counter_index(TX_PACKETS)] = s.tx_packets;
+    v[counter_index(TX_WINDOW_ERRORS)] = s.tx_window_errors;
+}
@@ -0,0 +1,113 @@
+#ifndef COUNTER_TABLE_H
+#define COUNTER_TABLE_H
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct receive_data
+{
+    uint64_t bytes,
+             compressed,
+             CRC_errors,
+             dropped,
+             errors,
+             FIFO_errors,
+             frame_errors,
+             length_errors,
+             missed_errors,
+             over_errors,
+             packets;
+};
+
+struct transmit_data
+{
+    uint64_t aborted_errors,
+             bytes,
+             carrier_errors,
+             compressed,
+             dropped,
+             errors,
+             FIFO_errors,
+             heartbeat_errors,
+             packets,
+             window_errors;
+};
+
+
+enum rx_fields
+{
+    RX_BYTES,
+    RX_COMPRESSED,
+    RX_CRC_ERRORS,
+    RX_DROPPED,
+    RX_ERRORS,
+    RX_FIFO_ERRORS,
+    RX_FRAME_ERRORS,
+    RX_LENGTH_ERRORS,
+    RX_MISSED_ERRORS,
+    RX_OVER_ERRORS,
+    RX_PACKETS
+};
+
+enum tx_fields
+{
+    TX_ABORTED_ERRORS,
+    TX_BYTES,
+    TX_CARRIER_ERRORS,
+    TX_COMPRESSED,
+    TX_DROPPED,
+    TX_ERRORS,
+    TX_FIFO_ERRORS,
+    TX_HEARTBEAT_ERRORS,
+    TX_PACKETS,
+    TX_WINDOW_ERRORS
+};
+
+enum
+{
+    NUM_RX_FIELDS = RX_PACKETS + 1,
+    NUM_TX_FIELDS = TX_WINDOW_ERRORS + 1,
+    NUM_COUNTERS = NUM_RX_FIELDS + NUM_TX_FIELDS
+};
+
+/**
+    Every Rx and Tx field in one flat array, Rx first: this is what the
+    code downstream of network_stats (rates, alerting) indexes into, so it
+    doesn't have to care which direction a counter is for.  It's also what
+    every collector fills, whatever it reads.
+*/
+
+struct counter_table
+{
+    uint64_t value[NUM_COUNTERS];
+};
+
+inline size_t counter_index(rx_fields r) { return (size_t)r; }
+inline size_t counter_index(tx_fields t) { return NUM_RX_FIELDS + (size_t)t; }
+
+const char *rx_name(rx_fields r);
+const char *tx_name(tx_fields t);
+const char *counter_name(size_t index);
+bool counter_from_name(const std::string &name, size_t *index);
+
+//* The file under /sys/class/net/<interface>/statistics/ holding it.
+const char *counter_filename(size_t index);
+
+/**
+    Deltas from 'then' to 'now' and per second rates over 'elapsed'
+    seconds, for every counter.  Counters only go backwards when something
+    resets them; that's a delta of zero rather than an enormous unsigned
+    wraparound.
+*/
+
+void counter_rates(const counter_table &now, const counter_table &then,
+                   double elapsed, uint64_t *delta, double *rate);
+
+struct rtnl_link_stats64;
+
+//* What the kernel hands netlink (IFLA_STATS64), in counter_table order.
+void stats64_to_counters(const struct rtnl_link_stats64 &s, counter_table *c);
+
+#endif  // COUNTER_TABLE_H
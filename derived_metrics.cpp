@@ -0,0 +1,95 @@
+#include "derived_metrics.h"
+
+#include <limits>
+
+namespace
+{
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+
+    /**
+        out = 100 * part / (part + rest): the share of all the things that
+        happened to packets that were 'part'.  NaN when nothing happened.
+    */
+
+    void
+    ratio(const std::vector<double> &part, const std::vector<double> &rest,
+          std::vector<double> *out)
+    {
+        const size_t n = part.size();
+        const double *p = n ? &part[0] : 0;
+        const double *r = n ? &rest[0] : 0;
+        double *o = n ? &(*out)[0] : 0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const double total = p[i] + r[i];
+            o[i] = (total > 0.0) ? 100.0 * p[i] / total : NaN;
+        }
+    }
+
+    //* out = bytes / packets, NaN with no packets
+    void
+    packet_size(const std::vector<double> &bytes,
+                const std::vector<double> &packets, std::vector<double> *out)
+    {
+        const size_t n = bytes.size();
+        const double *b = n ? &bytes[0] : 0;
+        const double *p = n ? &packets[0] : 0;
+        double *o = n ? &(*out)[0] : 0;
+
+        for (size_t i = 0; i < n; ++i)
+            o[i] = (p[i] > 0.0) ? b[i] / p[i] : NaN;
+    }
+
+    //* out = 100 * bytes / elapsed / speed: NaN speed propagates
+    void
+    utilization(const std::vector<double> &bytes,
+                const std::vector<double> &inverse_elapsed,
+                const std::vector<double> &inverse_speed,
+                std::vector<double> *out)
+    {
+        const size_t n = bytes.size();
+        const double *b = n ? &bytes[0] : 0;
+        const double *e = n ? &inverse_elapsed[0] : 0;
+        const double *s = n ? &inverse_speed[0] : 0;
+        double *o = n ? &(*out)[0] : 0;
+
+        for (size_t i = 0; i < n; ++i)
+            o[i] = 100.0 * b[i] * e[i] * s[i];
+    }
+}
+
+void
+derived_metrics::resize(size_t n)
+{
+    std::vector<double> *columns[] =
+    {
+        &rx_bytes, &rx_packets, &rx_dropped, &rx_errors,
+        &tx_bytes, &tx_packets, &tx_dropped, &tx_errors,
+        &inverse_speed, &inverse_elapsed,
+        &rx_utilization, &tx_utilization,
+        &rx_packet_size, &tx_packet_size,
+        &rx_drop_ratio, &tx_drop_ratio,
+        &rx_error_ratio, &tx_error_ratio
+    };
+
+    for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); ++i)
+        columns[i]->resize(n, 0.0);
+}
+
+void
+derived_metrics::compute(void)
+{
+    utilization(rx_bytes, inverse_elapsed, inverse_speed, &rx_utilization);
+    utilization(tx_bytes, inverse_elapsed, inverse_speed, &tx_utilization);
+
+    packet_size(rx_bytes, rx_packets, &rx_packet_size);
+    packet_size(tx_bytes, tx_packets, &tx_packet_size);
+
+    // dropped/errored packets aren't counted in 'packets', so the ratio
+    // is against the sum of both
+    ratio(rx_dropped, rx_packets, &rx_drop_ratio);
+    ratio(tx_dropped, tx_packets, &tx_drop_ratio);
+    ratio(rx_errors, rx_packets, &rx_error_ratio);
+    ratio(tx_errors, tx_packets, &tx_error_ratio);
+}
@@ -0,0 +1,42 @@
+#ifndef DERIVED_METRICS_H
+#define DERIVED_METRICS_H
+
+#include <vector>
+
+#include <stddef.h>
+
+/**
+    Metrics computed from the raw counter deltas: utilization against link
+    speed, average packet size, and drop and error ratios, for Rx and Tx.
+
+    Laid out as one array per quantity with one slot per interface, so
+    compute() is a handful of straight loops over contiguous doubles that
+    the compiler can vectorize, rather than a pass over each interface's
+    record in turn.  The owner fills the input columns, calls compute(),
+    and reads the output columns.
+
+    Quantities that don't make sense (no link speed, no packets) come out
+    as NaN.
+*/
+
+struct derived_metrics
+{
+    // inputs: per sweep deltas, and link speed inverted so compute() only
+    // multiplies
+    std::vector<double> rx_bytes, rx_packets, rx_dropped, rx_errors;
+    std::vector<double> tx_bytes, tx_packets, tx_dropped, tx_errors;
+    std::vector<double> inverse_speed;  // 1 / (bytes/s), NaN if unknown
+    std::vector<double> inverse_elapsed;
+
+    // outputs
+    std::vector<double> rx_utilization, tx_utilization;     // percent
+    std::vector<double> rx_packet_size, tx_packet_size;     // bytes
+    std::vector<double> rx_drop_ratio, tx_drop_ratio;       // percent
+    std::vector<double> rx_error_ratio, tx_error_ratio;     // percent
+
+    void resize(size_t n);
+    size_t size(void) const { return rx_bytes.size(); }
+    void compute(void);
+};
+
+#endif  // DERIVED_METRICS_H
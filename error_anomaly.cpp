@@ -0,0 +1,78 @@
+#include "error_anomaly.h"
+
+#include <string>
+#include <cmath>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("error_anomaly");
+}
+
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+const size_t ERROR_COUNTERS[NUM_ERROR_COUNTERS] =
+{
+    RX_CRC_ERRORS,
+    RX_ERRORS,
+    RX_FIFO_ERRORS,
+    RX_FRAME_ERRORS,
+    RX_LENGTH_ERRORS,
+    RX_MISSED_ERRORS,
+    RX_OVER_ERRORS,
+    NUM_RX_FIELDS + TX_ABORTED_ERRORS,
+    NUM_RX_FIELDS + TX_CARRIER_ERRORS,
+    NUM_RX_FIELDS + TX_ERRORS,
+    NUM_RX_FIELDS + TX_FIFO_ERRORS,
+    NUM_RX_FIELDS + TX_HEARTBEAT_ERRORS,
+    NUM_RX_FIELDS + TX_WINDOW_ERRORS
+};
+
+anomaly_detector::anomaly_detector(double threshold, double alpha,
+                                   double min_stddev, uint32_t warmup):
+    alpha_(alpha),
+    threshold_(threshold),
+    min_stddev_(min_stddev),
+    warmup_(warmup)
+{
+    if ((alpha <= 0.0) || (alpha > 1.0))
+        RUNTIME("EWMA weight %f must be in (0, 1]", alpha);
+    if (threshold <= 0.0)
+        RUNTIME("Anomaly z-score threshold %f must be positive", threshold);
+    if (min_stddev <= 0.0)
+        RUNTIME("Minimum standard deviation %f must be positive", min_stddev);
+}
+
+/**
+    Score 'rate' against the baseline, then fold it in.  Returns true if
+    the anomalous flag changed, so the caller only has to report edges;
+    'z' gets the score either way.
+
+    Scoring happens before the update so that a spike is judged against
+    what came before it, not against a baseline it has already dragged
+    upwards.  The mean and variance update is the usual incremental EWMA
+    one (Finch, "Incremental calculation of weighted mean and variance").
+*/
+
+bool
+anomaly_detector::update(ewma_baseline *b, double rate, double *z) const
+{
+    const double stddev = std::sqrt(b->variance);
+    *z = (rate - b->mean) / ((stddev > min_stddev_) ? stddev : min_stddev_);
+
+    const uint8_t was = b->anomalous;
+    b->anomalous = (b->samples >= warmup_) && (*z >= threshold_);
+
+    const double diff = rate - b->mean;
+    const double increment = alpha_ * diff;
+    b->mean += increment;
+    b->variance = (1.0 - alpha_) * (b->variance + diff * increment);
+    if (b->samples < warmup_)
+        ++b->samples;
+
+    return b->anomalous != was;
+}
+
+#undef RUNTIME
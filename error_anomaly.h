@@ -0,0 +1,56 @@
+#ifndef ERROR_ANOMALY_H
+#define ERROR_ANOMALY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "network_stats.h"
+
+/**
+    Anomaly detection for the error counters.  These sit at zero (or some
+    small steady trickle) until a cable or optic starts to go, so rather
+    than a fixed threshold we keep an exponentially weighted mean and
+    variance of each counter's rate and flag samples that are too many
+    standard deviations above it.
+
+    The baseline is a handful of numbers per counter and nothing else: no
+    history is kept, so the cost is the same for 1 port or 10,000.
+*/
+
+enum
+{
+    NUM_ERROR_COUNTERS = 13
+};
+
+//* counter_table slots we run anomaly detection over
+extern const size_t ERROR_COUNTERS[NUM_ERROR_COUNTERS];
+
+struct ewma_baseline
+{
+    double mean;        // of the rate, per second
+    double variance;
+    uint32_t samples;   // counts up to the warmup and stops there
+    uint8_t anomalous;  // last sample was over the threshold
+
+    ewma_baseline(void): mean(0.0), variance(0.0), samples(0), anomalous(0) {}
+};
+
+class anomaly_detector
+{
+private:
+    double alpha_;          // weight of the newest sample
+    double threshold_;      // z-score at which we call it anomalous
+    double min_stddev_;     // floor, so a flat-zero baseline isn't infinitely touchy
+    uint32_t warmup_;       // samples before we trust the baseline
+
+public:
+
+    anomaly_detector(double threshold = 4.0, double alpha = 0.01,
+                     double min_stddev = 0.25, uint32_t warmup = 30);
+
+    bool update(ewma_baseline *b, double rate, double *z) const;
+
+    double threshold(void) const { return threshold_; }
+};
+
+#endif  // ERROR_ANOMALY_H
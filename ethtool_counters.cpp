@@ -0,0 +1,268 @@
+#include "ethtool_counters.h"
+
+#include <cstdlib>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("ethtool_counters");
+
+    //* Skip one '_', '-' or '.' separator, if there is one.
+    size_t
+    skip_separator(const std::string &s, size_t pos)
+    {
+        if ((pos < s.size()) && ((s[pos] == '_') || (s[pos] == '-') || (s[pos] == '.')))
+            return pos + 1;
+        return pos;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+/**
+    Drivers don't agree on how to spell per-queue counters: 'rx_queue_0_
+    packets' (ixgbe, veth), 'rx0_packets' (mlx5), 'rx-0.packets' (i40e),
+    'tx_queue_3_drops'.  They do all start with the direction, then maybe
+    'queue', then the queue number, then the rest; that's what we look for.
+*/
+
+bool
+parse_queue_counter(const std::string &name, queue_counter *q)
+{
+    if (name.compare(0, 2, "rx") == 0)
+        q->direction = QUEUE_RX;
+    else if (name.compare(0, 2, "tx") == 0)
+        q->direction = QUEUE_TX;
+    else
+        return false;
+
+    size_t pos = skip_separator(name, 2);
+    if (name.compare(pos, 5, "queue") == 0)
+        pos = skip_separator(name, pos + 5);
+
+    const size_t digits = pos;
+    while ((pos < name.size()) && (name[pos] >= '0') && (name[pos] <= '9'))
+        ++pos;
+    if ((pos == digits) || (pos == name.size()))
+        return false;
+
+    const size_t separator = pos;
+    pos = skip_separator(name, pos);
+    if ((pos == separator) || (pos == name.size()))
+        return false;
+
+    q->queue = std::atoi(name.c_str() + digits);
+    q->metric = name.substr(pos);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Fetch the names and a first set of values, so the first update() has
+    something to diff against.  Throws if the interface has no ethtool
+    stats (lo, for one).
+*/
+
+ethtool_counters::ethtool_counters(int socket, const std::string &interface):
+    socket_(socket),
+    interface_(interface),
+    names_(),
+    queues_(),
+    values_(),
+    previous_(),
+    request_(0),
+    request_pages_(0)
+{
+    if (interface.size() >= IFNAMSIZ)
+        RUNTIME("Interface name '%s' too long", C(interface));
+
+    read_names();
+    try
+    {
+        update();
+    } catch (...)
+    {
+        unmap_request();
+        throw;
+    }
+    previous_ = values_;
+
+    for (size_t i = 0; i < names_.size(); ++i)
+        CPRINT("%s: %s = %llu\n", C(interface_), C(names_[i]),
+               (unsigned long long)values_[i]);
+}
+
+ethtool_counters::~ethtool_counters(void)
+{
+    unmap_request();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+bool
+ethtool_counters::ioctl_ok(void *data) const
+{
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, C(interface_), IFNAMSIZ - 1);
+    ifr.ifr_data = (char *)data;
+    return ioctl(socket_, SIOCETHTOOL, &ifr) == 0;
+}
+
+//* How many stats the driver has right now.
+size_t
+ethtool_counters::count(void) const
+{
+    // sset_info is followed by one u32 per set asked for
+    uint64_t buffer[(sizeof(struct ethtool_sset_info) + sizeof(uint32_t))
+                    / sizeof(uint64_t) + 1];
+    memset(buffer, 0, sizeof(buffer));
+    struct ethtool_sset_info *info = (struct ethtool_sset_info *)buffer;
+    info->cmd = ETHTOOL_GSSET_INFO;
+    info->sset_mask = 1ULL << ETH_SS_STATS;
+
+    if (!ioctl_ok(info))
+        ERROR("%s: ETHTOOL_GSSET_INFO", C(interface_));
+    if (!(info->sset_mask & (1ULL << ETH_SS_STATS)))
+        return 0;
+    return info->data[0];
+}
+
+void
+ethtool_counters::read_names(void)
+{
+    const size_t n = count();
+    if (n == 0)
+        RUNTIME("%s: driver has no ethtool stats", C(interface_));
+
+    std::vector<uint64_t> buffer((sizeof(struct ethtool_gstrings)
+                                  + n * ETH_GSTRING_LEN) / sizeof(uint64_t) + 1);
+    struct ethtool_gstrings *strings = (struct ethtool_gstrings *)&buffer[0];
+    strings->cmd = ETHTOOL_GSTRINGS;
+    strings->string_set = ETH_SS_STATS;
+    strings->len = n;
+    if (!ioctl_ok(strings))
+        ERROR("%s: ETHTOOL_GSTRINGS", C(interface_));
+
+    names_.clear();
+    queues_.clear();
+    for (size_t i = 0; i < strings->len; ++i)
+    {
+        const char *s = (const char *)strings->data + i * ETH_GSTRING_LEN;
+        names_.push_back(std::string(s, strnlen(s, ETH_GSTRING_LEN)));
+
+        queue_counter q;
+        if (parse_queue_counter(names_.back(), &q))
+        {
+            q.index = i;
+            queues_.push_back(q);
+        }
+    }
+
+    map_request(names_.size());
+    values_.assign(names_.size(), 0);
+    previous_.assign(names_.size(), 0);
+
+    CPRINT("%s: %lu ethtool stats, %lu of them per queue\n", C(interface_),
+           (unsigned long)names_.size(), (unsigned long)queues_.size());
+}
+
+/**
+    Room for at least 'n' values, followed by a guard page.
+*/
+
+void
+ethtool_counters::map_request(size_t n)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t needed = sizeof(struct ethtool_stats) + n * sizeof(uint64_t);
+    const size_t pages = (needed + page - 1) / page;
+    if (request_ && (pages <= request_pages_))
+        return;
+
+    unmap_request();
+    void *p = mmap(0, (pages + 1) * page, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        ERROR("%s: mapping %lu pages for ETHTOOL_GSTATS", C(interface_),
+              (unsigned long)pages + 1);
+    if (mprotect((char *)p + pages * page, page, PROT_NONE))
+    {
+        munmap(p, (pages + 1) * page);
+        ERROR("%s: protecting guard page", C(interface_));
+    }
+
+    request_ = (struct ethtool_stats *)p;
+    request_pages_ = pages;
+}
+
+void
+ethtool_counters::unmap_request(void)
+{
+    if (!request_)
+        return;
+    munmap(request_, (request_pages_ + 1) * sysconf(_SC_PAGESIZE));
+    request_ = 0;
+    request_pages_ = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One ETHTOOL_GSTATS for every counter.  A change in how many there are
+    means the names we have are wrong: fetch them again, and start the
+    deltas over.  EFAULT is the guard page telling us the same thing.
+*/
+
+void
+ethtool_counters::update(void)
+{
+    request_->cmd = ETHTOOL_GSTATS;
+    request_->n_stats = names_.size();
+    const bool ok = ioctl_ok(request_);
+    if (!ok && (errno != EFAULT))
+        ERROR("%s: ETHTOOL_GSTATS", C(interface_));
+
+    if (!ok || (request_->n_stats != names_.size()))
+    {
+        CPRINT("%s: driver's stats changed from %lu: rereading names\n",
+               C(interface_), (unsigned long)names_.size());
+        read_names();
+
+        request_->cmd = ETHTOOL_GSTATS;
+        request_->n_stats = names_.size();
+        if (!ioctl_ok(request_) || (request_->n_stats != names_.size()))
+            ERROR("%s: ETHTOOL_GSTATS after rereading names", C(interface_));
+        memcpy(&values_[0], request_->data, values_.size() * sizeof(uint64_t));
+        previous_ = values_;
+        return;
+    }
+
+    previous_.swap(values_);
+    memcpy(&values_[0], request_->data, values_.size() * sizeof(uint64_t));
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,91 @@
+#ifndef ETHTOOL_COUNTERS_H
+#define ETHTOOL_COUNTERS_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+    Every counter the driver keeps, via the SIOCETHTOOL ioctl: the same
+    numbers 'ethtool -S' prints, per-queue ones included, which sysfs's
+    statistics directory doesn't have.
+
+    The names (ETHTOOL_GSSET_INFO for how many, ETHTOOL_GSTRINGS for what)
+    are fetched once; each update() is then one ETHTOOL_GSTATS for all of
+    the values.  If the driver comes back with a different number of them
+    (queues were added, say) the names are fetched again.
+
+    The ioctl wants a socket, any socket: the owner keeps one and hands it
+    to every ethtool_counters.
+
+    ETHTOOL_GSTATS writes however many values the driver has now, whatever
+    size of buffer we said we had, so the buffer sits right up against an
+    inaccessible guard page: if the driver has grown past it, the kernel
+    faults on the guard page and fails the ioctl with EFAULT instead of
+    writing over our heap.
+*/
+
+enum queue_direction
+{
+    QUEUE_RX,
+    QUEUE_TX
+};
+
+//* A counter whose name says it belongs to one queue.
+struct queue_counter
+{
+    size_t index;               // into values()
+    queue_direction direction;
+    int queue;
+    std::string metric;         // what's left of the name: "packets" etc.
+};
+
+bool parse_queue_counter(const std::string &name, queue_counter *q);
+
+class ethtool_counters
+{
+private:
+    int socket_;                // not ours
+    std::string interface_;
+
+    std::vector<std::string> names_;
+    std::vector<queue_counter> queues_;
+    std::vector<uint64_t> values_;
+    std::vector<uint64_t> previous_;
+
+    struct ethtool_stats *request_;     // ETHTOOL_GSTATS buffer, reused
+    size_t request_pages_;              // not counting the guard page
+
+    bool ioctl_ok(void *data) const;
+    size_t count(void) const;
+    void read_names(void);
+    void map_request(size_t n);
+    void unmap_request(void);
+
+    // uncopyable: owns the mapping
+    ethtool_counters(const ethtool_counters &e);
+    ethtool_counters &operator =(const ethtool_counters &e);
+
+public:
+
+    ethtool_counters(int socket, const std::string &interface);
+    ~ethtool_counters(void);
+
+    void update(void);
+
+    size_t size(void) const { return values_.size(); }
+    const std::string &name(size_t i) const { return names_[i]; }
+    uint64_t value(size_t i) const { return values_[i]; }
+
+    //* Since the last update(); 0 if the counter went backwards.
+    uint64_t delta(size_t i) const
+    {
+        return (values_[i] >= previous_[i]) ? values_[i] - previous_[i] : 0;
+    }
+
+    const std::vector<queue_counter> &queues(void) const { return queues_; }
+    const std::string &get_interface_name(void) const { return interface_; }
+};
+
+#endif  // ETHTOOL_COUNTERS_H
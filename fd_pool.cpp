@@ -0,0 +1,133 @@
+#include "fd_pool.h"
+
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("fd_pool");
+}
+
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+fd_pool::fd_pool(size_t capacity):
+    capacity_(capacity),
+    lru_(),
+    entries_(),
+    closes_(0)
+{
+    if (capacity == 0)
+        RUNTIME("fd pool needs room for at least one fd");
+}
+
+fd_pool::~fd_pool(void)
+{
+    std::map<key, entry>::iterator i = entries_.begin();
+    for ( ; i != entries_.end(); ++i)
+    {
+        if (close(i->second.fd))
+            REPORT("Closing pooled fd %d", i->second.fd);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+void
+fd_pool::evict_oldest(void)
+{
+    std::map<key, entry>::iterator victim = entries_.find(lru_.back());
+    if (close(victim->second.fd))
+        REPORT("Closing pooled fd %d", victim->second.fd);
+    ++closes_;
+    entries_.erase(victim);
+    lru_.pop_back();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    An open fd for 'filename' relative to 'dirfd', opening it (and closing
+    the least recently used fd, if we're full) if it isn't already open.
+    'opened' says whether we had to.
+
+    The fd stays owned by the pool: don't close it, and don't hang on to it
+    past the next acquire().
+*/
+
+int
+fd_pool::acquire(int dirfd, int id, const char *filename, bool *opened)
+{
+    const key k(dirfd, id);
+
+    std::map<key, entry>::iterator i = entries_.find(k);
+    if (i != entries_.end())
+    {
+        // move to the front of the line
+        lru_.splice(lru_.begin(), lru_, i->second.lru);
+        *opened = false;
+        return i->second.fd;
+    }
+
+    if (entries_.size() >= capacity_)
+        evict_oldest();
+
+    int fd = openat(dirfd, filename, O_RDONLY | O_CLOEXEC);
+    if ((fd == -1) && ((errno == EMFILE) || (errno == ENFILE))
+        && !entries_.empty())
+    {
+        // the rest of the process got there first: this is our size now
+        evict_oldest();
+        capacity_ = entries_.size() + 1;
+        fd = openat(dirfd, filename, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd == -1)
+        ERROR("Opening '%s' relative to dirfd %d", filename, dirfd);
+
+    lru_.push_front(k);
+    entry e;
+    e.fd = fd;
+    e.lru = lru_.begin();
+    entries_.insert(std::make_pair(k, e));
+
+    *opened = true;
+    return fd;
+}
+
+/**
+    Close everything opened relative to 'dirfd': call before closing the
+    dirfd itself, since the number is about to be reused.
+*/
+
+void
+fd_pool::forget(int dirfd)
+{
+    std::map<key, entry>::iterator i = entries_.lower_bound(key(dirfd, 0));
+    while ((i != entries_.end()) && (i->first.first == dirfd))
+    {
+        if (close(i->second.fd))
+            REPORT("Closing pooled fd %d", i->second.fd);
+        ++closes_;
+        lru_.erase(i->second.lru);
+        entries_.erase(i++);
+    }
+}
+
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,61 @@
+#ifndef FD_POOL_H
+#define FD_POOL_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    A bounded, least-recently-used set of open stats file descriptors,
+    shared by every network_stats using the pooled sysfs strategy.
+
+    Each fd is keyed by the directory fd it was opened relative to (one per
+    interface) and a small integer naming the file within it.  Hot
+    counters stay open and cost one read per sample, exactly like the
+    persistent strategy; once the pool is full the coldest fd is closed to
+    make room, so the process never holds more than 'capacity' of them no
+    matter how many interfaces there are.  If the process runs out of fds
+    before the pool is full (the dir fds count too), the pool shrinks to
+    what it has.
+*/
+
+class fd_pool
+{
+private:
+    typedef std::pair<int, int> key;     // (dirfd, file id)
+    typedef std::list<key> lru_list;
+
+    struct entry
+    {
+        int fd;
+        lru_list::iterator lru;         // position in lru_
+    };
+
+    size_t capacity_;
+    lru_list lru_;                      // most recently used at the front
+    std::map<key, entry> entries_;
+    uint64_t closes_;                   // evictions and forgets, ever
+
+    void evict_oldest(void);
+
+    // uncopyable: owns fds
+    fd_pool(const fd_pool &p);
+    fd_pool &operator =(const fd_pool &p);
+
+public:
+
+    explicit fd_pool(size_t capacity);
+    ~fd_pool(void);
+
+    int acquire(int dirfd, int id, const char *filename, bool *opened);
+    void forget(int dirfd);
+
+    size_t size(void) const { return entries_.size(); }
+    size_t capacity(void) const { return capacity_; }
+    uint64_t closes(void) const { return closes_; }
+};
+
+#endif  // FD_POOL_H
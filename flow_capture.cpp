@@ -0,0 +1,467 @@
+#include "flow_capture.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("flow_capture");
+
+    enum
+    {
+        // enough for Ethernet, two VLAN tags, IPv6 with a couple of
+        // extension headers, and the ports
+        SNAPLEN = 128,
+
+        // 16 blocks of 1 MB: at ~200 bytes a packet in the ring, about
+        // 80,000 packets, or 80 ms at 1 Mpps, of slack
+        BLOCK_SIZE = 1 << 20,
+        BLOCKS = 16,
+        FRAME_SIZE = 2048,      // V3 packs packets; this is only a sanity bound
+
+        // how long the kernel holds a block that isn't full
+        BLOCK_TIMEOUT_MS = 64,
+
+        ETHERTYPE_IPV4 = 0x0800,
+        ETHERTYPE_IPV6 = 0x86dd,
+        ETHERTYPE_VLAN = 0x8100,
+        ETHERTYPE_QINQ = 0x88a8,
+        ETHERTYPE_ARP = 0x0806,
+
+        // IPv6 extension headers we step over
+        IPV6_HOP_BY_HOP = 0,
+        IPV6_ROUTING = 43,
+        IPV6_FRAGMENT = 44,
+        IPV6_DESTINATION = 60,
+        MAX_EXTENSION_HEADERS = 8
+    };
+
+    // flow_key's IPv4 addresses: ::ffff:a.b.c.d
+    const uint8_t MAPPED[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+    inline uint16_t
+    get16(const uint8_t *p)
+    {
+        return (uint16_t)((p[0] << 8) | p[1]);
+    }
+
+    bool
+    has_ports(uint8_t protocol)
+    {
+        return (protocol == IPPROTO_TCP) || (protocol == IPPROTO_UDP)
+            || (protocol == IPPROTO_SCTP) || (protocol == IPPROTO_UDPLITE);
+    }
+
+    const char *
+    protocol_name(uint8_t protocol, char *buf, size_t size)
+    {
+        switch (protocol)
+        {
+        case IPPROTO_TCP:       return "tcp";
+        case IPPROTO_UDP:       return "udp";
+        case IPPROTO_ICMP:      return "icmp";
+        case IPPROTO_ICMPV6:    return "icmpv6";
+        case IPPROTO_SCTP:      return "sctp";
+        case IPPROTO_UDPLITE:   return "udplite";
+        case IPPROTO_GRE:       return "gre";
+        case IPPROTO_ESP:       return "esp";
+        }
+        std::snprintf(buf, size, "proto %u", protocol);
+        return buf;
+    }
+
+    //* "10.0.0.1:443" or "[fe80::1]:443", without the port if 'port' < 0.
+    std::string
+    endpoint(const uint8_t *address, int port)
+    {
+        char text[INET6_ADDRSTRLEN];
+        const bool v4 = !std::memcmp(address, MAPPED, sizeof(MAPPED));
+        inet_ntop(v4 ? AF_INET : AF_INET6, v4 ? address + 12 : address,
+                  text, sizeof(text));
+        if (port < 0)
+            return text;
+
+        char buf[INET6_ADDRSTRLEN + 16];
+        std::snprintf(buf, sizeof(buf), v4 ? "%s:%d" : "[%s]:%d", text, port);
+        return buf;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Flows
+////////////////////////////////////////////////////////////////////////////////
+
+bool
+flow_key::operator ==(const flow_key &k) const
+{
+    return !std::memcmp(this, &k, sizeof(k));
+}
+
+size_t
+flow_key_hash::operator()(const flow_key &k) const
+{
+    uint64_t w[sizeof(flow_key) / sizeof(uint64_t)];
+    std::memcpy(w, &k, sizeof(w));
+
+    uint64_t h = 0;
+    for (size_t i = 0; i < sizeof(w) / sizeof(w[0]); ++i)
+    {
+        h = (h ^ w[i]) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return (size_t)h;
+}
+
+bool
+parse_flow(uint16_t ethertype, const uint8_t *packet, size_t length,
+           flow_key *key)
+{
+    size_t offset = 0;
+    while ((ethertype == ETHERTYPE_VLAN) || (ethertype == ETHERTYPE_QINQ))
+    {
+        if (length < offset + 4)
+            return false;
+        ethertype = get16(packet + offset + 2);
+        offset += 4;
+    }
+
+    std::memset(key, 0, sizeof(*key));
+    uint8_t protocol;
+    bool first_fragment = true;
+
+    if (ethertype == ETHERTYPE_IPV4)
+    {
+        const uint8_t *ip = packet + offset;
+        if (length < offset + 20)
+            return false;
+        const size_t header = (ip[0] & 0x0f) * 4;
+        if ((header < 20) || (length < offset + header))
+            return false;
+
+        protocol = ip[9];
+        first_fragment = ((get16(ip + 6) & 0x1fff) == 0);
+        key->src[10] = key->src[11] = 0xff;
+        key->dst[10] = key->dst[11] = 0xff;
+        std::memcpy(key->src + 12, ip + 12, 4);
+        std::memcpy(key->dst + 12, ip + 16, 4);
+        offset += header;
+    }
+    else if (ethertype == ETHERTYPE_IPV6)
+    {
+        const uint8_t *ip = packet + offset;
+        if (length < offset + 40)
+            return false;
+
+        protocol = ip[6];
+        std::memcpy(key->src, ip + 8, 16);
+        std::memcpy(key->dst, ip + 24, 16);
+        offset += 40;
+
+        for (int i = 0; i < MAX_EXTENSION_HEADERS; ++i)
+        {
+            if (length < offset + 8)
+                break;
+            const uint8_t *x = packet + offset;
+            if ((protocol == IPV6_HOP_BY_HOP) || (protocol == IPV6_ROUTING)
+                || (protocol == IPV6_DESTINATION))
+            {
+                protocol = x[0];
+                offset += (x[1] + 1) * 8;
+            }
+            else if (protocol == IPV6_FRAGMENT)
+            {
+                protocol = x[0];
+                first_fragment = ((get16(x + 2) & 0xfff8) == 0);
+                offset += 8;
+            }
+            else
+                break;
+        }
+    }
+    else
+        return false;
+
+    key->protocol = protocol;
+    if (first_fragment && has_ports(protocol) && (length >= offset + 4))
+    {
+        key->sport = get16(packet + offset);
+        key->dport = get16(packet + offset + 2);
+    }
+    return true;
+}
+
+std::string
+flow_name(const flow_key &key)
+{
+    char buf[16];
+    const bool ports = has_ports(key.protocol);
+    return std::string(protocol_name(key.protocol, buf, sizeof(buf))) + " "
+        + endpoint(key.src, ports ? key.sport : -1) + " > "
+        + endpoint(key.dst, ports ? key.dport : -1);
+}
+
+flow_tally::flow_tally(size_t counters):
+    flows(counters),
+    counting(counters != 0),
+    packets(0),
+    bytes(0),
+    unparsed(0),
+    mix()
+{
+}
+
+void
+flow_tally::clear(void)
+{
+    flows.clear();
+    packets = bytes = unparsed = 0;
+    mix.clear();
+}
+
+void
+flow_tally::merge(const flow_tally &t)
+{
+    if (counting)
+        flows.merge(t.flows);
+    packets += t.packets;
+    bytes += t.bytes;
+    unparsed += t.unparsed;
+    mix.merge(t.mix);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+flow_capture::flow_capture(const std::string &interface, int fanout,
+                           unsigned sample):
+    fd_(-1),
+    ring_(0),
+    ring_size_(0),
+    blocks_(BLOCKS),
+    block_size_(BLOCK_SIZE),
+    current_(0),
+    loopback_(false),
+    sample_(sample ? sample : 1)
+{
+    // protocol 0: nothing arrives until bind(), after the ring is set up
+    fd_ = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (fd_ == -1)
+        ERROR("Opening packet socket for '%s'", C(interface));
+
+    try
+    {
+        setup(interface, fanout);
+    } catch (...)
+    {
+        if (ring_)
+            munmap(ring_, ring_size_);
+        close(fd_);
+        throw;
+    }
+}
+
+flow_capture::~flow_capture(void)
+{
+    if (munmap(ring_, ring_size_))
+        REPORT("Unmapping packet ring");
+    if (close(fd_))
+        REPORT("Closing packet socket %d", fd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+void
+flow_capture::setup(const std::string &interface, int fanout)
+{
+    struct ifreq ifr;
+    std::memset(&ifr, 0, sizeof(ifr));
+    std::strncpy(ifr.ifr_name, C(interface), IFNAMSIZ - 1);
+    if (ioctl(fd_, SIOCGIFFLAGS, &ifr))
+        ERROR("Getting flags of '%s'", C(interface));
+    loopback_ = (ifr.ifr_flags & IFF_LOOPBACK);
+    if (ioctl(fd_, SIOCGIFINDEX, &ifr))
+        ERROR("Getting index of '%s'", C(interface));
+    const int ifindex = ifr.ifr_ifindex;
+
+    const int version = TPACKET_V3;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)))
+        ERROR("Asking for TPACKET_V3");
+
+    // "accept SNAPLEN bytes": the kernel copies no more than that.  When
+    // sampling, a random number mod sample_ picks who gets that far, so
+    // the rest are dropped before anything is copied.
+    struct sock_filter filter[] =
+    {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_RANDOM)),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, sample_),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SNAPLEN),
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog program;
+    program.len = (sample_ > 1) ? sizeof(filter) / sizeof(filter[0]) : 1;
+    program.filter = (sample_ > 1) ? filter : filter + 3;
+    if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)))
+        ERROR("Attaching %s filter", (sample_ > 1) ? "sampling" : "snaplen");
+
+    // kernels before 4.20 don't have this; walk_block() checks as well
+    const int ignore = 1;
+    if (loopback_)
+        setsockopt(fd_, SOL_PACKET, PACKET_IGNORE_OUTGOING, &ignore, sizeof(ignore));
+
+    struct tpacket_req3 req;
+    std::memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size_;
+    req.tp_block_nr = blocks_;
+    req.tp_frame_size = FRAME_SIZE;
+    req.tp_frame_nr = (block_size_ * blocks_) / FRAME_SIZE;
+    req.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+    if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)))
+        ERROR("Setting up a %u x %lu byte ring", blocks_, (unsigned long)block_size_);
+
+    ring_size_ = block_size_ * blocks_;
+    void *ring = mmap(0, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (ring == MAP_FAILED)
+        ERROR("Mapping the packet ring");
+    ring_ = (uint8_t *)ring;
+
+    struct sockaddr_ll sll;
+    std::memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(fd_, (struct sockaddr *)&sll, sizeof(sll)))
+        ERROR("Binding packet socket to '%s'", C(interface));
+
+    if ((fanout != NO_FANOUT) && setsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)))
+        ERROR("Joining fanout group %d on '%s'", fanout & 0xffff, C(interface));
+
+    CPRINT("%s: capturing into a %lu MB ring\n", C(interface),
+           (unsigned long)(ring_size_ >> 20));
+}
+
+/**
+    Every packet in a block the kernel has handed over.  The network
+    header offset and the protocol come with each packet, so it doesn't
+    matter whether there's an Ethernet header in front (or a VLAN tag the
+    NIC already took off).
+*/
+
+void
+flow_capture::walk_block(const uint8_t *block, flow_tally *t)
+{
+    const struct tpacket_block_desc *b = (const struct tpacket_block_desc *)block;
+    const uint32_t count = b->hdr.bh1.num_pkts;
+    const uint8_t *p = block + b->hdr.bh1.offset_to_first_pkt;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const struct tpacket3_hdr *h = (const struct tpacket3_hdr *)p;
+        const struct sockaddr_ll *sll = (const struct sockaddr_ll *)
+            (p + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        p += h->tp_next_offset;
+
+        if (loopback_ && (sll->sll_pkttype == PACKET_OUTGOING))
+            continue;
+
+        ++t->packets;
+        t->bytes += h->tp_len;
+
+        // tp_net is past tp_mac; what was captured runs from tp_mac
+        const size_t skip = h->tp_net - h->tp_mac;
+        const uint16_t ethertype = ntohs(sll->sll_protocol);
+        flow_key key;
+        if ((h->tp_snaplen > skip)
+            && parse_flow(ethertype, (const uint8_t *)h + h->tp_net,
+                          h->tp_snaplen - skip, &key))
+        {
+            if (t->counting)
+                t->flows.offer(key, h->tp_len);
+            t->mix.add(std::memcmp(key.src, MAPPED, sizeof(MAPPED))
+                       ? L3_IPV6 : L3_IPV4, key.protocol, h->tp_len);
+        }
+        else
+        {
+            ++t->unparsed;
+            t->mix.add((ethertype == ETHERTYPE_ARP) ? L3_ARP : L3_OTHER, 0,
+                       h->tp_len);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Walk every block the kernel has finished with, in ring order, giving
+    each back as soon as we're done with it.
+*/
+
+void
+flow_capture::drain(flow_tally *t)
+{
+    for (;;)
+    {
+        struct tpacket_block_desc *b = (struct tpacket_block_desc *)
+            (ring_ + (size_t)current_ * block_size_);
+        if (!(*(volatile uint32_t *)&b->hdr.bh1.block_status & TP_STATUS_USER))
+            return;
+
+        // status before contents, and contents before giving it back
+        __sync_synchronize();
+        walk_block((const uint8_t *)b, t);
+        __sync_synchronize();
+        *(volatile uint32_t *)&b->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+        current_ = (current_ + 1) % blocks_;
+    }
+}
+
+uint64_t
+flow_capture::drops(void)
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+    if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &stats, &length))
+        return 0;
+    return stats.tp_drops;
+}
+
+//* The fanout group we ended up in (the kernel picks, if asked to).
+int
+flow_capture::fanout_id(void) const
+{
+    int fanout = 0;
+    socklen_t length = sizeof(fanout);
+    if (getsockopt(fd_, SOL_PACKET, PACKET_FANOUT, &fanout, &length))
+        ERROR("Getting fanout group of packet socket %d", fd_);
+    return fanout & 0xffff;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
@@ -0,0 +1,129 @@
+#ifndef FLOW_CAPTURE_H
+#define FLOW_CAPTURE_H
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "space_saving.h"
+#include "packet_mix.h"
+
+/**
+    A flow: protocol and both ends.  IPv4 addresses are kept as IPv4-mapped
+    IPv6, so there's one key type; ports are 0 for protocols without them
+    (and for fragments after the first).
+*/
+
+struct flow_key
+{
+    uint8_t src[16];
+    uint8_t dst[16];
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t protocol;           // IPPROTO_*
+    uint8_t pad[3];             // zeroed, so keys hash and compare as bytes
+
+    bool operator ==(const flow_key &k) const;
+};
+
+struct flow_key_hash
+{
+    size_t operator()(const flow_key &k) const;
+};
+
+/**
+    Fill 'key' from the 'length' bytes at 'packet', which start at the
+    network header of a packet of 'ethertype' (host order).  False for
+    anything that isn't IPv4 or IPv6, or is too short to tell.  In-band
+    VLAN tags and the common IPv6 extension headers are stepped over.
+*/
+
+bool parse_flow(uint16_t ethertype, const uint8_t *packet, size_t length,
+                flow_key *key);
+
+//* "tcp 10.0.0.1:443 > 10.0.0.2:51234", "icmp fe80::1 > fe80::2" ...
+std::string flow_name(const flow_key &key);
+
+typedef space_saving<flow_key, flow_key_hash> flow_counters;
+
+/**
+    What a capture saw over an interval: heavy flows, the mix, and totals.
+    Made with no counters, it keeps no flows at all, only the rest.
+*/
+
+struct flow_tally
+{
+    flow_counters flows;
+    bool counting;              // flows: made with counters
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t unparsed;          // not IP
+    packet_mix mix;
+
+    explicit flow_tally(size_t counters = 1);
+    void clear(void);
+
+    //* Fold in another tally (e.g. another fanout member's).
+    void merge(const flow_tally &t);
+};
+
+/**
+    Who's using an interface: an AF_PACKET socket with a TPACKET_V3 ring
+    mapped into our address space.  The kernel fills whole blocks of
+    packets and hands them over by flipping a status word; we walk a block
+    in place, with no copies and no syscalls, and hand it back.  A block is
+    handed over when full or when it's been open a while, so a quiet
+    interface still wakes us up.
+
+    A socket filter cuts every packet down to its headers before the
+    kernel copies it into the ring; the original length rides along for
+    the byte counts.  Given a 'sample' of N, the filter also lets only a
+    random one in N through, for when an estimate of the mix will do and
+    the ring can't keep up with everything.  On a loopback interface each
+    packet would be seen twice, going out and coming in, so outgoing ones
+    are ignored.
+
+    Flows go into a flow_tally, whose Space-Saving structure keeps the
+    heavy ones by bytes in fixed memory, however many flows there are.
+
+    Given a fanout argument (PACKET_FANOUT's: group id | mode << 16) the
+    socket joins a fanout group once it's bound, and the kernel spreads
+    the interface's packets over the group's sockets.
+*/
+
+class flow_capture
+{
+private:
+    int fd_;
+    uint8_t *ring_;
+    size_t ring_size_;
+    unsigned blocks_;
+    size_t block_size_;
+    unsigned current_;          // next block we expect the kernel to hand over
+    bool loopback_;
+    unsigned sample_;           // 1 in this many packets
+
+    void setup(const std::string &interface, int fanout);
+    void walk_block(const uint8_t *block, flow_tally *t);
+
+    // uncopyable: owns the socket and the mapping
+    flow_capture(const flow_capture &f);
+    flow_capture &operator =(const flow_capture &f);
+
+public:
+    enum { NO_FANOUT = -1 };    // 0 is a fine fanout argument: group 0, by hash
+
+    flow_capture(const std::string &interface, int fanout = NO_FANOUT,
+                 unsigned sample = 1);
+    ~flow_capture(void);
+
+    int fd(void) const { return fd_; }
+    void drain(flow_tally *t);
+    uint64_t drops(void);     // since the last call: the ring was full
+    int fanout_id(void) const;
+    unsigned sample(void) const { return sample_; }
+};
+
+#endif  // FLOW_CAPTURE_H
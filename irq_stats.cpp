@@ -0,0 +1,441 @@
+#include "irq_stats.h"
+
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("irq_stats");
+
+    const char INTERRUPTS_PATH[] = "/proc/interrupts";
+    const std::string SYSFS_PATH("/sys/class/net/");
+
+    enum
+    {
+        // a handful of CPUs; grows to fit
+        INITIAL_BUFFER_SIZE = 64 * 1024
+    };
+
+    /**
+        First byte at or after 'p' that isn't a space.  The CPU columns are
+        " %10u" apiece, so most of the file is runs of spaces: with SSE2
+        we compare 16 bytes at once and take the first mismatch from the
+        mask.
+    */
+
+    inline const char *
+    skip_spaces(const char *p, const char *end)
+    {
+#ifdef __SSE2__
+        const __m128i space = _mm_set1_epi8(' ');
+        while (end - p >= 16)
+        {
+            const __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            const unsigned mask =
+                ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)) & 0xffff;
+            if (mask)
+                return p + __builtin_ctz(mask);
+            p += 16;
+        }
+#endif
+        while ((p < end) && (*p == ' '))
+            ++p;
+        return p;
+    }
+
+    //* Just past the end of the line 'p' is on (glibc's memchr is vectorized).
+    inline const char *
+    next_line(const char *p, const char *end)
+    {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        return nl ? nl + 1 : end;
+    }
+
+    //* The number at 'p' (after any spaces), leaving 'p' after it.
+    inline uint64_t
+    parse_number(const char **p, const char *end)
+    {
+        const char *q = skip_spaces(*p, end);
+        uint64_t x = 0;
+        while ((q < end) && ((unsigned)(*q - '0') < 10))
+            x = x * 10 + (uint64_t)(*q++ - '0');
+        *p = q;
+        return x;
+    }
+
+    /**
+        The IRQ number of the line at 'p', leaving 'p' after the colon, or
+        -1 for the named lines (NMI:, LOC: ...) and the header.
+    */
+
+    inline int
+    parse_irq(const char **p, const char *end)
+    {
+        const char *q = skip_spaces(*p, end);
+        int irq = 0;
+        const char *start = q;
+        while ((q < end) && ((unsigned)(*q - '0') < 10))
+            irq = irq * 10 + (*q++ - '0');
+        if ((q == start) || (q == end) || (*q != ':'))
+            return -1;
+        *p = q + 1;
+        return irq;
+    }
+
+    //* Does 'needle' occur in 'haystack'?
+    bool
+    contains(const std::string &haystack, const char *needle)
+    {
+        return haystack.find(needle) != std::string::npos;
+    }
+
+    /**
+        What a driver's suffix says about the queue: "TxRx-3" is "rxtx-3",
+        virtio's "input.0" is "rx-0".  Anything without both a direction
+        and a number is left as the driver named it.
+    */
+
+    std::string
+    queue_label(const std::string &suffix)
+    {
+        if (suffix.empty())
+            return "all";
+
+        std::string s(suffix);
+        for (size_t i = 0; i < s.size(); ++i)
+            s[i] = (char)std::tolower((unsigned char)s[i]);
+
+        const char *direction = 0;
+        if (contains(s, "txrx") || contains(s, "rxtx") || contains(s, "combined"))
+            direction = "rxtx";
+        else if (contains(s, "rx") || contains(s, "input"))
+            direction = "rx";
+        else if (contains(s, "tx") || contains(s, "output"))
+            direction = "tx";
+
+        // the last run of digits
+        size_t last = s.find_last_of("0123456789");
+        if (!direction || (last == std::string::npos))
+            return suffix;
+        size_t first = last;
+        while ((first > 0) && std::isdigit((unsigned char)s[first - 1]))
+            --first;
+
+        return std::string(direction) + "-" + s.substr(first, last - first + 1);
+    }
+
+    /**
+        If 'name' is in 'token' as a whole word -- at the start or after a
+        '-', and followed by the end or a '-' -- put what follows in
+        'suffix'.  "eth1" isn't in "eth10-rx-0", nor "eth0" in "eth0.100".
+    */
+
+    bool
+    find_name(const std::string &token, const std::string &name,
+              std::string *suffix)
+    {
+        if (name.empty())
+            return false;
+
+        size_t pos = token.find(name);
+        for ( ; pos != std::string::npos; pos = token.find(name, pos + 1))
+        {
+            const size_t after = pos + name.size();
+            if ((pos > 0) && (token[pos - 1] != '-'))
+                continue;
+            if ((after < token.size()) && (token[after] != '-'))
+                continue;
+            *suffix = (after < token.size()) ? token.substr(after + 1) : "";
+            return true;
+        }
+        return false;
+    }
+
+    /**
+        Last component of the interface's device link, e.g. "virtio3".
+        Bus addresses ("0000:00:05.0") are no use: drivers of PCI devices
+        name their IRQs after the interface, and the address turns up in
+        the chip name of every one of the device's IRQs.
+    */
+
+    std::string
+    device_name(const std::string &interface)
+    {
+        const std::string link(SYSFS_PATH + interface + "/device");
+        char target[PATH_MAX];
+        ssize_t n = readlink(link.c_str(), target, sizeof(target) - 1);
+        if (n <= 0)
+            return "";      // virtual: no device
+        target[n] = '\0';
+        const char *slash = std::strrchr(target, '/');
+        const std::string device(slash ? slash + 1 : target);
+        return (device.find(':') == std::string::npos) ? device : "";
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+irq_stats::irq_stats(void):
+    fd_(-1),
+    buffer_(INITIAL_BUFFER_SIZE),
+    length_(0),
+    lines_(0),
+    cpus_(),
+    interfaces_(),
+    queues_(),
+    by_interface_()
+{
+    fd_ = open(INTERRUPTS_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+        ERROR("Opening '%s'", INTERRUPTS_PATH);
+}
+
+irq_stats::~irq_stats(void)
+{
+    if (close(fd_))
+        REPORT("Closing '%s'", INTERRUPTS_PATH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+void
+irq_stats::read_file(void)
+{
+    for (;;)
+    {
+        ssize_t n = pread(fd_, &buffer_[0], buffer_.size(), 0);
+        if (n == -1)
+            ERROR("Reading '%s'", INTERRUPTS_PATH);
+        if ((size_t)n < buffer_.size())
+        {
+            length_ = (size_t)n;
+            return;
+        }
+        buffer_.resize(buffer_.size() * 2);
+    }
+}
+
+/**
+    Add 'irq' to queues_ if one of the words in 'action' names one of our
+    interfaces or its device.
+*/
+
+bool
+irq_stats::match(const std::string &action, int irq)
+{
+    size_t start = 0;
+    while (start < action.size())
+    {
+        size_t stop = action.find(' ', start);
+        if (stop == std::string::npos)
+            stop = action.size();
+        std::string token(action, start, stop - start);
+        start = stop + 1;
+
+        // shared IRQs list their actions "a, b"
+        if (!token.empty() && (token[token.size() - 1] == ','))
+            token.erase(token.size() - 1);
+        if (token.empty())
+            continue;
+
+        for (size_t i = 0; i < interfaces_.size(); ++i)
+        {
+            std::string suffix;
+            if (!find_name(token, interfaces_[i].name, &suffix)
+                && !find_name(token, interfaces_[i].device, &suffix))
+                continue;
+
+            irq_queue q;
+            q.irq = irq;
+            q.interface = interfaces_[i].name;
+            q.queue = queue_label(suffix);
+            queues_.push_back(q);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+    The slow path, when the file's shape is new to us: the CPUs from the
+    header, then every IRQ line's action names checked against our
+    interfaces.  Counts start from here, with no deltas.
+*/
+
+void
+irq_stats::index(void)
+{
+    cpus_.clear();
+    queues_.clear();
+    by_interface_.clear();
+    lines_ = 0;
+
+    const char *p = &buffer_[0];
+    const char *end = p + length_;
+
+    // header: "           CPU0       CPU1 ..."
+    const char *eol = next_line(p, end);
+    while (p < eol)
+    {
+        p = skip_spaces(p, eol);
+        if ((eol - p > 3) && !std::strncmp(p, "CPU", 3))
+            cpus_.push_back(std::atoi(p + 3));
+        while ((p < eol) && !std::isspace((unsigned char)*p))
+            ++p;
+        while ((p < eol) && std::isspace((unsigned char)*p))
+            ++p;
+    }
+    ++lines_;
+    p = eol;
+
+    while (p < end)
+    {
+        eol = next_line(p, end);
+        ++lines_;
+
+        const int irq = parse_irq(&p, eol);
+        if (irq == -1)
+        {
+            p = eol;
+            continue;
+        }
+
+        std::vector<uint64_t> count(cpus_.size());
+        for (size_t c = 0; c < cpus_.size(); ++c)
+            count[c] = parse_number(&p, eol);
+
+        // the rest: chip, hardware irq, trigger, then the actions
+        const char *stop = ((eol > p) && (eol[-1] == '\n')) ? eol - 1 : eol;
+        if (match(std::string(p, stop - p), irq))
+        {
+            queues_.back().count = count;
+            queues_.back().delta.assign(cpus_.size(), 0);
+            by_interface_[queues_.back().interface].push_back(queues_.size() - 1);
+        }
+        p = eol;
+    }
+
+    CPRINT("%lu interface irqs over %lu cpus\n", (unsigned long)queues_.size(),
+           (unsigned long)cpus_.size());
+}
+
+/**
+    The fast path: step over every line that isn't one of ours -- IRQ
+    numbers ascend, as does queues_ -- and convert the columns of those
+    that are.  False if the shape has changed: a different number of
+    lines or CPUs, or one of our IRQs missing.
+*/
+
+bool
+irq_stats::parse(void)
+{
+    const char *p = &buffer_[0];
+    const char *end = p + length_;
+
+    // count the CPUs without converting them: the header has no other 'C's
+    const char *eol = next_line(p, end);
+    size_t cpus = 0;
+    for (const char *q = p; (q = (const char *)memchr(q, 'C', eol - q)); ++q)
+        ++cpus;
+    if (cpus != cpus_.size())
+        return false;
+    p = eol;
+
+    size_t lines = 1;
+    size_t next = 0;        // into queues_
+    while (p < end)
+    {
+        eol = next_line(p, end);
+        ++lines;
+
+        if (next < queues_.size())
+        {
+            const char *q = p;
+            const int irq = parse_irq(&q, eol);
+            if (irq == queues_[next].irq)
+            {
+                irq_queue &iq = queues_[next++];
+                for (size_t c = 0; c < cpus; ++c)
+                {
+                    // the kernel's counts are 32 bits, and wrap
+                    const uint64_t x = parse_number(&q, eol);
+                    iq.delta[c] = (uint32_t)(x - iq.count[c]);
+                    iq.count[c] = x;
+                }
+            }
+            else if ((irq != -1) && (irq > queues_[next].irq))
+                return false;       // ours went away
+        }
+        p = eol;
+    }
+
+    return (lines == lines_) && (next == queues_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Map IRQs to these interfaces from now on.  Call whenever the set of
+    interfaces (or their names) changes.
+*/
+
+void
+irq_stats::map_interfaces(const std::vector<std::string> &names)
+{
+    interfaces_.clear();
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        interface_names n;
+        n.name = names[i];
+        n.device = device_name(names[i]);
+        interfaces_.push_back(n);
+    }
+
+    read_file();
+    index();
+}
+
+void
+irq_stats::update(void)
+{
+    read_file();
+    if (!parse())
+        index();
+}
+
+const std::vector<size_t> *
+irq_stats::queues_for(const std::string &interface) const
+{
+    std::map<std::string, std::vector<size_t> >::const_iterator i =
+        by_interface_.find(interface);
+    return (i == by_interface_.end()) ? 0 : &i->second;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,87 @@
+#ifndef IRQ_STATS_H
+#define IRQ_STATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    Per-CPU interrupt counts for the IRQs that belong to network
+    interfaces, from /proc/interrupts: which CPUs each queue's interrupts
+    land on, to put IRQ affinity next to the traffic.
+
+    /proc/interrupts is a line per IRQ and a column per CPU, so on a big
+    host it's hundreds of kilobytes, nearly all of it space padding.  The
+    scanner skips runs of spaces 16 bytes at a time with SSE2 (a plain
+    loop elsewhere), finds line ends with memchr(), and only converts the
+    columns of lines we've mapped; everything else is stepped over.  The
+    counts are the kernel's unsigned ints, so deltas are taken modulo 2^32
+    and come out right across a wrap.
+
+    IRQs are mapped to interfaces by the name the driver registered them
+    under: "eth0", "eth0-TxRx-3", "i40e-eth0-rx-1" or, for virtio, the
+    virtio device's own name ("virtio3-input.0") -- which is why the
+    interface's device is looked up too.  The map is rebuilt when the
+    interfaces change, and when the file's shape does (CPUs coming and
+    going, or a driver requesting its IRQs when the link comes up).
+*/
+
+struct irq_queue
+{
+    int irq;
+    std::string interface;
+    std::string queue;              // "rx-0", "tx-0", "rxtx-3" or the driver's name
+    std::vector<uint64_t> count;    // by column: see irq_stats::cpu()
+    std::vector<uint64_t> delta;
+};
+
+class irq_stats
+{
+private:
+    struct interface_names
+    {
+        std::string name;
+        std::string device;         // e.g. "virtio3"; empty if none
+    };
+
+    int fd_;
+    std::vector<char> buffer_;
+    size_t length_;
+    size_t lines_;                  // the last index() saw
+
+    std::vector<int> cpus_;
+    std::vector<interface_names> interfaces_;
+    std::vector<irq_queue> queues_;                     // by irq
+    std::map<std::string, std::vector<size_t> > by_interface_;
+
+    void read_file(void);
+    void index(void);
+    bool match(const std::string &action, int irq);
+    bool parse(void);
+
+    // uncopyable: owns an fd
+    irq_stats(const irq_stats &s);
+    irq_stats &operator =(const irq_stats &s);
+
+public:
+
+    irq_stats(void);
+    ~irq_stats(void);
+
+    void map_interfaces(const std::vector<std::string> &names);
+    void update(void);
+
+    size_t cpus(void) const { return cpus_.size(); }
+    int cpu(size_t column) const { return cpus_[column]; }
+
+    size_t size(void) const { return queues_.size(); }
+    const irq_queue &queue(size_t i) const { return queues_[i]; }
+
+    //* Indices of 'interface's queues, or null if it has none.
+    const std::vector<size_t> *queues_for(const std::string &interface) const;
+};
+
+#endif  // IRQ_STATS_H
@@ -0,0 +1,224 @@
+#include "link_events.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("link_events");
+
+    enum
+    {
+        // plenty for a burst of container churn: the kernel batches as
+        // many messages per datagram as fit
+        RECV_BUFFER_SIZE = 64 * 1024,
+
+        // ask for this much socket buffer so bursts don't overrun us
+        SOCKET_BUFFER_SIZE = 4 * 1024 * 1024
+    };
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+link_event::link_event(void):
+    type(LINK_NEW),
+    when(0.0),
+    ifindex(-1),
+    name(),
+    flags(0),
+    operstate(-1),
+    carrier(-1),
+    carrier_changes(-1),
+    carrier_up_count(-1),
+    carrier_down_count(-1),
+    kind(),
+    link(-1),
+    link_netnsid(-1)
+{
+
+}
+
+link_events::link_events(void):
+    fd_(-1),
+    overrun_(false)
+{
+    fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                 NETLINK_ROUTE);
+    if (fd_ == -1)
+        ERROR("Opening rtnetlink socket");
+
+    // Best effort: if we can't get the size we asked for we'll find out
+    // via ENOBUFS and resync.
+    int size = SOCKET_BUFFER_SIZE;
+    if (setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)))
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK;
+    if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        close(fd_);
+        ERROR("Binding rtnetlink socket to RTNLGRP_LINK");
+    }
+
+    CPRINT("Subscribed to link events on fd %d\n", fd_);
+}
+
+link_events::~link_events(void)
+{
+    if (close(fd_))
+        REPORT("Closing rtnetlink socket %d", fd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Ask the kernel for an RTM_NEWLINK for every link there is.  The answers
+    come back on the same socket and read_events() handles them like any
+    other, so this is how we learn the current state of things without
+    going to sysfs.
+*/
+
+void
+link_events::request_dump(void)
+{
+    struct
+    {
+        struct nlmsghdr header;
+        struct rtgenmsg body;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body));
+    request.header.nlmsg_type = RTM_GETLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.body.rtgen_family = AF_UNSPEC;
+
+    if (send(fd_, &request, request.header.nlmsg_len, 0) == -1)
+        ERROR("Requesting link dump on fd %d", fd_);
+}
+
+/**
+    Drain the socket, appending one link_event per RTM_NEWLINK or
+    RTM_DELLINK.  Doesn't block.
+*/
+
+void
+link_events::read_events(std::vector<link_event> *events)
+{
+    // netlink messages want 4 byte alignment
+    static uint32_t buffer[RECV_BUFFER_SIZE / sizeof(uint32_t)];
+
+    for (;;)
+    {
+        ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+        if (n == -1)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return;
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS)
+            {
+                CPRINT("Link events overran the socket buffer\n");
+                overrun_ = true;
+                continue;
+            }
+            ERROR("Reading link events from fd %d", fd_);
+        }
+
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        const double when = (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            if ((h->nlmsg_type != RTM_NEWLINK) && (h->nlmsg_type != RTM_DELLINK))
+                continue;
+
+            struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(h);
+
+            link_event ev;
+            ev.type = (h->nlmsg_type == RTM_NEWLINK) ? LINK_NEW : LINK_DEL;
+            ev.when = when;
+            ev.ifindex = ifi->ifi_index;
+            ev.flags = ifi->ifi_flags;
+
+            int attr_len = IFLA_PAYLOAD(h);
+            struct rtattr *a = IFLA_RTA(ifi);
+            for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+            {
+                const void *data = RTA_DATA(a);
+                switch (a->rta_type)
+                {
+                case IFLA_IFNAME:
+                    ev.name = (const char *)data;
+                    break;
+                case IFLA_OPERSTATE:
+                    ev.operstate = *(const uint8_t *)data;
+                    break;
+                case IFLA_CARRIER:
+                    ev.carrier = *(const uint8_t *)data;
+                    break;
+                case IFLA_CARRIER_CHANGES:
+                    ev.carrier_changes = *(const uint32_t *)data;
+                    break;
+                case IFLA_CARRIER_UP_COUNT:
+                    ev.carrier_up_count = *(const uint32_t *)data;
+                    break;
+                case IFLA_CARRIER_DOWN_COUNT:
+                    ev.carrier_down_count = *(const uint32_t *)data;
+                    break;
+                case IFLA_LINK:
+                    ev.link = *(const int32_t *)data;
+                    break;
+                case IFLA_LINK_NETNSID:
+                    ev.link_netnsid = *(const int32_t *)data;
+                    break;
+                case IFLA_LINKINFO:
+                {
+                    int info_len = RTA_PAYLOAD(a);
+                    struct rtattr *info = (struct rtattr *)RTA_DATA(a);
+                    for ( ; RTA_OK(info, info_len); info = RTA_NEXT(info, info_len))
+                    {
+                        if (info->rta_type == IFLA_INFO_KIND)
+                            ev.kind = (const char *)RTA_DATA(info);
+                    }
+                    break;
+                }
+                }
+            }
+
+            events->push_back(ev);
+        }
+    }
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
@@ -0,0 +1,79 @@
+#ifndef LINK_EVENTS_H
+#define LINK_EVENTS_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+    Interface hotplug via an rtnetlink socket subscribed to RTNLGRP_LINK:
+    the kernel tells us when links appear, disappear, get renamed or change
+    state, so we never have to rescan /sys/class/net to find out.
+
+    The socket is non-blocking: hand fd() to poll() and call read_events()
+    when it's readable.
+*/
+
+enum link_event_type
+{
+    LINK_NEW,       // added, renamed, or changed state: RTM_NEWLINK
+    LINK_DEL        // gone: RTM_DELLINK
+};
+
+/**
+    What we pull out of a link message.  Fields the kernel didn't send are
+    -1: older kernels lack the carrier counts, and hand-made events (see
+    monitor::resync) have nothing but a name.
+*/
+
+struct link_event
+{
+    link_event_type type;
+    double when;                // wall clock seconds, when we read it
+    int ifindex;
+    std::string name;
+    unsigned flags;             // IFF_UP etc.
+
+    int operstate;              // IF_OPER_*
+    int carrier;                // 0 or 1
+    int64_t carrier_changes;
+    int64_t carrier_up_count;
+    int64_t carrier_down_count;
+
+    std::string kind;           // IFLA_INFO_KIND: "veth" etc., empty if none
+    int link;                   // IFLA_LINK: the peer's ifindex, for veths
+    int link_netnsid;           // IFLA_LINK_NETNSID: where the peer is
+
+    link_event(void);
+};
+
+class link_events
+{
+private:
+    int fd_;
+    bool overrun_;      // the kernel dropped events on us: caller must resync
+
+    // uncopyable: owns the socket
+    link_events(const link_events &l);
+    link_events &operator =(const link_events &l);
+
+public:
+
+    link_events(void);
+    ~link_events(void);
+
+    int fd(void) const { return fd_; }
+    void request_dump(void);
+    void read_events(std::vector<link_event> *events);
+
+    //* True (once) if events were lost since the last call.
+    bool overrun(void)
+    {
+        bool was = overrun_;
+        overrun_ = false;
+        return was;
+    }
+};
+
+#endif  // LINK_EVENTS_H
@@ -0,0 +1,149 @@
+#include "link_state.h"
+
+#include <cstdio>
+
+#include <linux/if.h>
+
+namespace
+{
+    enum
+    {
+        // a link that flaps more than this within the window is flapping:
+        // we don't need to know by exactly how much, and we don't want the
+        // memory to grow without bound
+        MAX_FLAPS_KEPT = 1024
+    };
+}
+
+const char *
+operstate_name(int operstate)
+{
+    switch (operstate)
+    {
+    case IF_OPER_UNKNOWN:           return "unknown";
+    case IF_OPER_NOTPRESENT:        return "notpresent";
+    case IF_OPER_DOWN:              return "down";
+    case IF_OPER_LOWERLAYERDOWN:    return "lowerlayerdown";
+    case IF_OPER_TESTING:           return "testing";
+    case IF_OPER_DORMANT:           return "dormant";
+    case IF_OPER_UP:                return "up";
+    case -1:                        return "-";
+    default:                        return "Unknown operstate!";
+    }
+}
+
+link_state::link_state(void):
+    known_(false),
+    flags_(0),
+    operstate_(-1),
+    carrier_(-1),
+    carrier_changes_(-1),
+    carrier_up_count_(-1),
+    carrier_down_count_(-1),
+    last_change_(0.0),
+    flaps_()
+{
+
+}
+
+/**
+    Administratively down, or the kernel says there's nothing underneath
+    it.  'unknown' is what lo and plenty of virtual interfaces report
+    while working perfectly well, so that counts as up.
+*/
+
+bool
+link_state::down(void) const
+{
+    if (!known_)
+        return false;
+    if (!(flags_ & IFF_UP))
+        return true;
+    return (operstate_ == IF_OPER_DOWN)
+        || (operstate_ == IF_OPER_LOWERLAYERDOWN)
+        || (operstate_ == IF_OPER_NOTPRESENT);
+}
+
+/**
+    Fold in a link message.  Returns true if operstate, carrier or the
+    up/down flag changed, with a description of the change in 'what'.
+
+    Events without an operstate didn't come from the kernel (see
+    link_event) and are ignored.
+
+    The carrier_changes counter counts transitions even if we missed the
+    messages for some of them, so flaps are counted from its deltas rather
+    than from the messages we happened to see.
+*/
+
+bool
+link_state::update(const link_event &ev, std::string *what)
+{
+    if (ev.operstate == -1)
+        return false;
+
+    const bool was_known = known_;
+    const bool was_up = (flags_ & IFF_UP) != 0;
+    const bool is_up = (ev.flags & IFF_UP) != 0;
+    const int was_operstate = operstate_;
+    const int was_carrier = carrier_;
+
+    if ((ev.carrier_changes >= 0) && (carrier_changes_ >= 0)
+        && (ev.carrier_changes > carrier_changes_))
+    {
+        int64_t n = ev.carrier_changes - carrier_changes_;
+        if (n > MAX_FLAPS_KEPT)
+            n = MAX_FLAPS_KEPT;
+        for (int64_t i = 0; i < n; ++i)
+            flaps_.push_back(ev.when);
+        while (flaps_.size() > MAX_FLAPS_KEPT)
+            flaps_.pop_front();
+    }
+
+    known_ = true;
+    flags_ = ev.flags;
+    operstate_ = ev.operstate;
+    if (ev.carrier != -1)
+        carrier_ = ev.carrier;
+    if (ev.carrier_changes != -1)
+        carrier_changes_ = ev.carrier_changes;
+    if (ev.carrier_up_count != -1)
+        carrier_up_count_ = ev.carrier_up_count;
+    if (ev.carrier_down_count != -1)
+        carrier_down_count_ = ev.carrier_down_count;
+
+    // The first message tells us how things are, not how they changed
+    if (!was_known)
+    {
+        last_change_ = ev.when;
+        return false;
+    }
+
+    if ((was_up == is_up) && (was_operstate == operstate_)
+        && (was_carrier == carrier_))
+        return false;
+
+    last_change_ = ev.when;
+
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "%s, operstate %s -> %s, carrier %d -> %d",
+                  (was_up == is_up) ? (is_up ? "up" : "down")
+                                    : (is_up ? "down -> up" : "up -> down"),
+                  operstate_name(was_operstate), operstate_name(operstate_),
+                  was_carrier, carrier_);
+    *what = buf;
+    return true;
+}
+
+/**
+    Carrier transitions in the last 'window' seconds.  Forgets anything
+    older, so call it regularly.
+*/
+
+size_t
+link_state::flaps(double now, double window)
+{
+    while (!flaps_.empty() && (flaps_.front() < now - window))
+        flaps_.pop_front();
+    return flaps_.size();
+}
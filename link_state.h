@@ -0,0 +1,55 @@
+#ifndef LINK_STATE_H
+#define LINK_STATE_H
+
+#include <string>
+#include <deque>
+
+#include <stdint.h>
+
+#include "link_events.h"
+
+/**
+    Per interface link state as netlink tells it to us: administrative
+    flags, operstate, carrier and the kernel's carrier counters.  Every
+    transition gets a timestamp, and carrier transitions are remembered for
+    a window so we can say how much a link has been flapping lately.
+
+    Until the first link message arrives we know nothing, and say the link
+    is up: better to read the counters of a down link than to skip the
+    counters of an up one.
+*/
+
+const char *operstate_name(int operstate);
+
+class link_state
+{
+private:
+    bool known_;
+    unsigned flags_;
+    int operstate_;
+    int carrier_;
+    int64_t carrier_changes_;
+    int64_t carrier_up_count_;
+    int64_t carrier_down_count_;
+
+    double last_change_;        // when operstate or carrier last changed
+    std::deque<double> flaps_;  // carrier transitions, oldest first
+
+public:
+
+    link_state(void);
+
+    bool update(const link_event &ev, std::string *what);
+    size_t flaps(double now, double window);
+
+    bool known(void) const { return known_; }
+    bool down(void) const;
+    int operstate(void) const { return operstate_; }
+    int carrier(void) const { return carrier_; }
+    int64_t carrier_changes(void) const { return carrier_changes_; }
+    int64_t carrier_up_count(void) const { return carrier_up_count_; }
+    int64_t carrier_down_count(void) const { return carrier_down_count_; }
+    double last_change(void) const { return last_change_; }
+};
+
+#endif  // LINK_STATE_H
@@ -9,8 +9,12 @@
 
 #include <signal.h>                                 // POSIX signal handling
 #include <unistd.h>                                 // getopt
+#include <getopt.h>                                 // getopt_long
 #include <string.h>
 #include <stdint.h>
+#include <time.h>                                   // clock_gettime
+#include <poll.h>
+#include <errno.h>
 
 #include <vector>
 #include <string>
@@ -18,6 +22,9 @@
 
 #include "program_IO.h"
 #include "network_stats.h"
+#include "monitor.h"
+#include "netns_monitor.h"
+#include "collector_check.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 // Globals and Macros
@@ -30,18 +37,60 @@ namespace
 {
     enum
     {
-        DEFAULT_A_VALUE = 0
+        DEFAULT_A_VALUE = 0,
+
+        // seconds between sweeps
+        SAMPLE_INTERVAL = 1,
+
+        // seconds between looking for new network namespaces
+        DEFAULT_NETNS_RESCAN = 10,
+
+        // long options without a short form
+        OPTION_COLLECTOR = 256,
+        OPTION_CHECK_COLLECTORS,
+        OPTION_FD_BUDGET,
+        OPTION_IDLE_AFTER,
+        OPTION_IDLE_INTERVAL,
+        OPTION_NETNS_RESCAN,
+        OPTION_ETHTOOL,
+        OPTION_QUEUES,
+        OPTION_PROTOCOLS,
+        OPTION_SOFTNET,
+        OPTION_IRQS,
+        OPTION_TC,
+        OPTION_SOCKETS,
+        OPTION_FLOWS,
+        OPTION_CAPTURE_THREADS,
+        OPTION_FANOUT,
+        OPTION_PACKET_MIX,
+        OPTION_RECORD,
+        OPTION_REPLAY,
+        OPTION_REPLAY_SPEED
     };
 }
 
 struct commandline_options
 {
-    std::string interface;
-    std::vector<std::string> filenames;
+    monitor_options monitor;
+
+    bool all_namespaces;        // every netns, over netlink, instead
+    double netns_rescan;        // seconds between looking for new ones
+
+    double queue_hz;            // byte queue limit samples per second
+
+    bool check_collectors;      // run the conformance check instead
+
+    std::string replay_file;    // play a --record back instead
+    double replay_speed;        // times real time: 0 for flat out
 
     commandline_options(int option_a = DEFAULT_A_VALUE):
-        interface(),
-        filenames()
+        monitor(),
+        all_namespaces(false),
+        netns_rescan(DEFAULT_NETNS_RESCAN),
+        queue_hz(0.0),
+        check_collectors(false),
+        replay_file(),
+        replay_speed(0.0)
     {
 
     }
@@ -226,7 +275,80 @@ signum_to_string(int signum)
 void
 usage(void)
 {
-    ALWAYS("Don't");
+    ALWAYS("usage: main [-a] [-t|--top N] [-r rules_file] [-f seconds] [-e] "
+           "[-z threshold] [--collector kind] [--fd-budget N] "
+           "[--check-collectors] "
+           "[--idle-after seconds] [--idle-interval seconds] "
+           "[-c|--containers] [--ethtool] [--queues Hz] [--protocols] "
+           "[--softnet] [--irqs] [--tc] [--sockets port|cgroup] "
+           "[--flows N [--capture-threads N] [--fanout hash|cpu]] "
+           "[--packet-mix N] [-n|--netns [--netns-rescan seconds]] "
+           "[--record file] [--replay file [--replay-speed X]] "
+           "[interface ...]\n");
+    ALWAYS("    -a              monitor every interface\n");
+    ALWAYS("    -t, --top N     only print the N busiest interfaces (and only "
+           "their ethtool, IRQ,\n"
+           "                    qdisc, flow and packet mix lines)\n");
+    ALWAYS("    -r rules_file   alert rules, one per line\n");
+    ALWAYS("    -f seconds      window for counting carrier flaps (default %.0f)\n",
+           monitor_options().flap_window);
+    ALWAYS("    -e              error counter anomaly detection\n");
+    ALWAYS("    -z threshold    anomaly z-score (default %.1f)\n",
+           monitor_options().anomaly_threshold);
+    ALWAYS("    --collector kind  persistent (an fd per counter), openat (an "
+           "fd per interface),\n"
+           "                      pooled (LRU of at most --fd-budget fds), "
+           "procfs (/proc/net/dev: fewer counters),\n"
+           "                      netlink (one socket) or io_uring "
+           "(persistent's fds, read on one ring)\n");
+    ALWAYS("    --sysfs kind    the same as --collector\n");
+    ALWAYS("    --fd-budget N   stats fds to keep open; implies pooled "
+           "(default half the fd limit)\n");
+    ALWAYS("    --check-collectors  check every collector against sysfs on "
+           "the interfaces, and exit\n");
+    ALWAYS("    --idle-after seconds     release the files of interfaces quiet "
+           "this long (default never)\n");
+    ALWAYS("    --idle-interval seconds  and sample them this often until "
+           "they move (default %.0f)\n", monitor_options().idle_interval);
+    ALWAYS("    -c, --containers         per-namespace traffic through host "
+           "side veths\n");
+    ALWAYS("    --ethtool                driver counters (ethtool -S), "
+           "per queue where they are\n");
+    ALWAYS("    --queues Hz              sample tx queue byte queue limits "
+           "this often\n");
+    ALWAYS("    --protocols              TCP, UDP, IP ... counters from "
+           "/proc/net/snmp and netstat\n");
+    ALWAYS("    --softnet                per-CPU receive backlog drops and "
+           "squeezes\n");
+    ALWAYS("    --irqs                   per-queue, per-CPU interrupt rates "
+           "from /proc/interrupts\n");
+    ALWAYS("    --tc                     qdisc and class counters, via "
+           "netlink\n");
+    ALWAYS("    --sockets port|cgroup    TCP and UDP socket counters, via "
+           "sock_diag, rolled up by local port or cgroup\n");
+    ALWAYS("    --flows N                capture packets (AF_PACKET ring) and "
+           "print the N heaviest flows\n");
+    ALWAYS("    --capture-threads N      capture on N threads, in a "
+           "PACKET_FANOUT group (default on the main thread)\n");
+    ALWAYS("    --fanout hash|cpu        spread packets over them by flow "
+           "hash or receiving CPU (default hash)\n");
+    ALWAYS("    --packet-mix N           packet size and protocol histograms "
+           "from 1 in N packets\n"
+           "                             (captures, and so --flows, are "
+           "sampled too)\n");
+    ALWAYS("    -n, --netns              every interface in every network "
+           "namespace, via netlink\n");
+    ALWAYS("    --netns-rescan seconds   how often to look for new namespaces "
+           "(default %d)\n", (int)DEFAULT_NETNS_RESCAN);
+    ALWAYS("    --record file            every sweep's counters to file, for "
+           "--replay\n");
+    ALWAYS("    --replay file            run a recording through the monitor "
+           "instead of reading counters\n"
+           "                             (interfaces default to all of "
+           "those recorded)\n");
+    ALWAYS("    --replay-speed X         at X times the speed it was "
+           "recorded (default as fast as it goes)\n");
+    ALWAYS("    interfaces default to '%s'\n", C(DEFAULT_INTERFACE));
 }
 
 long
@@ -264,6 +386,8 @@ get_commandline_options(int argc, char *argv[], commandline_options *options)
     using ::opterr;
 
     int c;
+    bool collector_chosen = false;
+    bool rescan_chosen = false;
     extern char *optarg;
     extern int opterr;
     opterr = 1;
@@ -271,10 +395,204 @@ get_commandline_options(int argc, char *argv[], commandline_options *options)
     if (!options)
         RUNTIME("Null commandline options data struture");
 
-    while ((c = getopt(argc, argv, "")) != -1)
+    static const struct option long_options[] =
+    {
+        { "top", required_argument, 0, 't' },
+        { "collector", required_argument, 0, OPTION_COLLECTOR },
+        { "sysfs", required_argument, 0, OPTION_COLLECTOR },
+        { "check-collectors", no_argument, 0, OPTION_CHECK_COLLECTORS },
+        { "fd-budget", required_argument, 0, OPTION_FD_BUDGET },
+        { "idle-after", required_argument, 0, OPTION_IDLE_AFTER },
+        { "idle-interval", required_argument, 0, OPTION_IDLE_INTERVAL },
+        { "netns", no_argument, 0, 'n' },
+        { "containers", no_argument, 0, 'c' },
+        { "ethtool", no_argument, 0, OPTION_ETHTOOL },
+        { "queues", required_argument, 0, OPTION_QUEUES },
+        { "protocols", no_argument, 0, OPTION_PROTOCOLS },
+        { "softnet", no_argument, 0, OPTION_SOFTNET },
+        { "irqs", no_argument, 0, OPTION_IRQS },
+        { "tc", no_argument, 0, OPTION_TC },
+        { "sockets", required_argument, 0, OPTION_SOCKETS },
+        { "flows", required_argument, 0, OPTION_FLOWS },
+        { "capture-threads", required_argument, 0, OPTION_CAPTURE_THREADS },
+        { "fanout", required_argument, 0, OPTION_FANOUT },
+        { "packet-mix", required_argument, 0, OPTION_PACKET_MIX },
+        { "netns-rescan", required_argument, 0, OPTION_NETNS_RESCAN },
+        { "record", required_argument, 0, OPTION_RECORD },
+        { "replay", required_argument, 0, OPTION_REPLAY },
+        { "replay-speed", required_argument, 0, OPTION_REPLAY_SPEED },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((c = getopt_long(argc, argv, "at:r:f:ez:nc", long_options, 0)) != -1)
     {
         switch (c)
         {
+        case 'a':
+            options->monitor.all_interfaces = true;
+            break;
+
+        case 't':
+        {
+            long top = arg_as_long(optarg, "--top");
+            if (top <= 0)
+                RUNTIME("--top wants a positive count, not '%s'", optarg);
+            options->monitor.top = (size_t)top;
+            break;
+        }
+
+        case 'r':
+            options->monitor.rules_file = optarg;
+            break;
+
+        case 'f':
+            options->monitor.flap_window = arg_as_double(optarg, "-f");
+            if (options->monitor.flap_window <= 0.0)
+                RUNTIME("-f wants a positive number of seconds, not '%s'",
+                        optarg);
+            break;
+
+        case 'e':
+            options->monitor.anomaly_detection = true;
+            break;
+
+        case 'z':
+            options->monitor.anomaly_threshold = arg_as_double(optarg, "-z");
+            break;
+
+        case 'n':
+            options->all_namespaces = true;
+            break;
+
+        case 'c':
+            options->monitor.containers = true;
+            break;
+
+        case OPTION_ETHTOOL:
+            options->monitor.ethtool = true;
+            break;
+
+        case OPTION_PROTOCOLS:
+            options->monitor.protocols = true;
+            break;
+
+        case OPTION_SOFTNET:
+            options->monitor.softnet = true;
+            break;
+
+        case OPTION_IRQS:
+            options->monitor.irqs = true;
+            break;
+
+        case OPTION_TC:
+            options->monitor.tc = true;
+            break;
+
+        case OPTION_SOCKETS:
+            if (!sock_grouping_from_name(optarg, &options->monitor.socket_grouping))
+                RUNTIME("--sockets wants port or cgroup, not '%s'", optarg);
+            options->monitor.sockets = true;
+            break;
+
+        case OPTION_FLOWS:
+        {
+            long flows = arg_as_long(optarg, "--flows");
+            if (flows <= 0)
+                RUNTIME("--flows wants a positive count, not '%s'", optarg);
+            options->monitor.flows = (size_t)flows;
+            break;
+        }
+
+        case OPTION_CAPTURE_THREADS:
+        {
+            long threads = arg_as_long(optarg, "--capture-threads");
+            if (threads < 0)
+                RUNTIME("--capture-threads wants a count, not '%s'", optarg);
+            options->monitor.capture_threads = (size_t)threads;
+            break;
+        }
+
+        case OPTION_FANOUT:
+            if (!fanout_mode_from_name(optarg, &options->monitor.fanout))
+                RUNTIME("--fanout wants hash or cpu, not '%s'", optarg);
+            break;
+
+        case OPTION_PACKET_MIX:
+        {
+            long sample = arg_as_long(optarg, "--packet-mix");
+            if ((sample <= 0) || (sample > 0xffffffffL))
+                RUNTIME("--packet-mix wants a sampling ratio, not '%s'", optarg);
+            options->monitor.packet_mix = true;
+            options->monitor.sample = (unsigned)sample;
+            break;
+        }
+
+        case OPTION_QUEUES:
+            options->queue_hz = arg_as_double(optarg, "--queues");
+            if (options->queue_hz <= 0.0)
+                RUNTIME("--queues wants a positive rate in Hz, not '%s'", optarg);
+            options->monitor.queues = true;
+            break;
+
+        case OPTION_NETNS_RESCAN:
+            rescan_chosen = true;
+            options->netns_rescan = arg_as_double(optarg, "--netns-rescan");
+            if (options->netns_rescan <= 0.0)
+                RUNTIME("--netns-rescan wants a positive number of seconds, "
+                        "not '%s'", optarg);
+            break;
+
+        case OPTION_COLLECTOR:
+            if (!collector_kind_from_name(optarg, &options->monitor.collector))
+                RUNTIME("--collector wants persistent, openat, pooled, procfs, "
+                        "netlink or io_uring, not '%s'", optarg);
+            if (!collector_kind_built(options->monitor.collector))
+                RUNTIME("Built without the %s collector", optarg);
+            collector_chosen = true;
+            break;
+
+        case OPTION_CHECK_COLLECTORS:
+            options->check_collectors = true;
+            break;
+
+        case OPTION_FD_BUDGET:
+        {
+            long budget = arg_as_long(optarg, "--fd-budget");
+            if (budget <= 0)
+                RUNTIME("--fd-budget wants a positive count, not '%s'", optarg);
+            options->monitor.fd_budget = (size_t)budget;
+            break;
+        }
+
+        case OPTION_IDLE_AFTER:
+            options->monitor.idle_after = arg_as_double(optarg, "--idle-after");
+            if (options->monitor.idle_after < 0.0)
+                RUNTIME("--idle-after wants seconds, not '%s'", optarg);
+            break;
+
+        case OPTION_IDLE_INTERVAL:
+            options->monitor.idle_interval = arg_as_double(optarg,
+                                                           "--idle-interval");
+            if (options->monitor.idle_interval <= 0.0)
+                RUNTIME("--idle-interval wants a positive number of seconds, "
+                        "not '%s'", optarg);
+            break;
+
+        case OPTION_RECORD:
+            options->monitor.record_file = optarg;
+            break;
+
+        case OPTION_REPLAY:
+            options->replay_file = optarg;
+            break;
+
+        case OPTION_REPLAY_SPEED:
+            options->replay_speed = arg_as_double(optarg, "--replay-speed");
+            if (options->replay_speed < 0.0)
+                RUNTIME("--replay-speed wants a positive factor, or 0, not "
+                        "'%s'", optarg);
+            break;
+
         case '?':
         default:
             usage();
@@ -282,100 +600,293 @@ get_commandline_options(int argc, char *argv[], commandline_options *options)
         }
     }
 
+    // a budget only means something to the pool
+    if ((options->monitor.fd_budget != 0) && !collector_chosen)
+        options->monitor.collector = COLLECTOR_SYSFS_POOLED;
+    if ((options->monitor.fd_budget != 0)
+        && (options->monitor.collector != COLLECTOR_SYSFS_POOLED))
+        RUNTIME("--fd-budget only applies to --collector pooled");
+
+    // a recording only has counters: nothing else has anything to read
+    const monitor_options &m = options->monitor;
+    const bool replaying = !options->replay_file.empty();
+    if (replaying
+        && (m.ethtool || m.queues || m.protocols || m.softnet || m.irqs || m.tc
+            || m.sockets || m.flows || m.packet_mix || m.containers
+            || options->all_namespaces || options->check_collectors))
+        RUNTIME("--replay only has interface counters: it can't go with "
+                "anything that reads more");
+    if (replaying && !m.record_file.empty())
+        RUNTIME("--replay and --record don't go together");
+    if (!replaying && (options->replay_speed != 0.0))
+        RUNTIME("--replay-speed is for --replay");
+    if (options->all_namespaces && !m.record_file.empty())
+        RUNTIME("--record doesn't work with --netns");
+    if (rescan_chosen && !options->all_namespaces)
+        RUNTIME("--netns-rescan is for --netns");
+
     for ( ; !stop && (optind < argc); ++optind)
     {
-        CPRINT("Adding filename '%s'\n", argv[optind]);
-        options->filenames.push_back(argv[optind]);
+        CPRINT("Adding interface '%s'\n", argv[optind]);
+        options->monitor.interfaces.push_back(argv[optind]);
+    }
+
+    // netns_monitor only has every namespace's interface counters: refuse
+    // what it would otherwise quietly drop
+    if (options->all_namespaces)
+    {
+        const monitor_options defaults;
+        const struct
+        {
+            bool chosen;
+            const char *option;
+        } unsupported[] =
+        {
+            { m.anomaly_detection, "-e" },
+            { m.anomaly_threshold != defaults.anomaly_threshold, "-z" },
+            { !m.rules_file.empty(), "-r" },
+            { m.top != 0, "-t/--top" },
+            { m.flap_window != defaults.flap_window, "-f" },
+            { m.containers, "-c/--containers" },
+            { m.ethtool, "--ethtool" },
+            { m.queues, "--queues" },
+            { m.protocols, "--protocols" },
+            { m.softnet, "--softnet" },
+            { m.irqs, "--irqs" },
+            { m.tc, "--tc" },
+            { m.sockets, "--sockets" },
+            { m.flows != 0, "--flows" },
+            { m.capture_threads != 0, "--capture-threads" },
+            { m.fanout != defaults.fanout, "--fanout" },
+            { m.packet_mix, "--packet-mix" },
+            { m.idle_after != defaults.idle_after, "--idle-after" },
+            { m.idle_interval != defaults.idle_interval, "--idle-interval" },
+            { collector_chosen, "--collector" },
+            { m.fd_budget != 0, "--fd-budget" },
+            { options->check_collectors, "--check-collectors" },
+            { !m.interfaces.empty(), "interface names" }
+        };
+        for (size_t i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]);
+             ++i)
+        {
+            if (unsupported[i].chosen)
+                RUNTIME("--netns only has interface counters, for every "
+                        "interface: it can't go with %s",
+                        unsupported[i].option);
+        }
     }
 
-    if (options->filenames.size() == 0)
-        RUNTIME("Must have a filename to proceed.\n");
+    if ((options->monitor.interfaces.size() == 0)
+        && !options->monitor.all_interfaces)
+    {
+        if (replaying)
+            options->monitor.all_interfaces = true;
+        else
+            options->monitor.interfaces.push_back(DEFAULT_INTERFACE);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+/**
+    Seconds on a clock that doesn't jump when someone sets the date: only
+    good for intervals.
+*/
+
+double
+monotonic_seconds(void)
+{
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        ERROR("clock_gettime(CLOCK_MONOTONIC)");
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+    The event loop: sweep every SAMPLE_INTERVAL seconds, and in between
+    sleep in poll() on the monitor's link event socket so that interfaces
+    coming and going are dealt with as it happens, and on its capture
+    sockets so their rings are emptied as blocks fill.  If asked, queues are
+    sampled on their own, faster, schedule in between.
+*/
+
 void
-do_monitor(void)
+do_monitor(const commandline_options &options)
 {
-    network_stats stats;
+    monitor mon(options.monitor);
+
+    double then = monotonic_seconds();
+    double next_sweep = then + SAMPLE_INTERVAL;
 
-    std::set<rx_fields> rx_stats;
-    std::set<tx_fields> tx_stats;
+    const double queue_interval = (options.queue_hz > 0.0)
+                                ? 1.0 / options.queue_hz : 0.0;
+    double next_queue_sample = then + queue_interval;
 
-    rx_stats.insert(RX_BYTES);
-    rx_stats.insert(RX_PACKETS);
+    std::vector<struct pollfd> pfds;
+    std::vector<int> capture_fds;
 
-    tx_stats.insert(TX_BYTES);
-    tx_stats.insert(TX_PACKETS);
+    while (!stop)
+    {
+        double right_now = monotonic_seconds();
+        if (queue_interval && (right_now >= next_queue_sample))
+        {
+            mon.sample_queues();
+            next_queue_sample += queue_interval;
+            if (next_queue_sample < right_now)
+                next_queue_sample = right_now + queue_interval;
+        }
 
-    CPRINT("Setting Rx stats to update\n");
-    stats.set_rx_stats_to_update(rx_stats);
+        if (right_now < next_sweep)
+        {
+            double wake = next_sweep;
+            if (queue_interval && (next_queue_sample < wake))
+                wake = next_queue_sample;
+
+            // the link event socket first, then any capture sockets
+            mon.capture_fds(&capture_fds);
+            pfds.resize(1 + capture_fds.size());
+            pfds[0].fd = mon.event_fd();
+            for (size_t i = 0; i < capture_fds.size(); ++i)
+                pfds[i + 1].fd = capture_fds[i];
+            for (size_t i = 0; i < pfds.size(); ++i)
+            {
+                pfds[i].events = POLLIN;
+                pfds[i].revents = 0;
+            }
 
-    CPRINT("Setting Tx stats to update\n");
-    stats.set_tx_stats_to_update(tx_stats);
+            int timeout = (int)((wake - right_now) * 1000.0) + 1;
+            int ret = poll(&pfds[0], pfds.size(), timeout);
+            if ((ret == -1) && (errno != EINTR))
+                ERROR("poll on link event fd %d", pfds[0].fd);
+            if (ret <= 0)
+                continue;
+
+            bool captured = false;
+            for (size_t i = 1; i < pfds.size(); ++i)
+                captured = captured || (pfds[i].revents & POLLIN);
+            if (captured)
+                mon.drain_captures();
+            if (pfds[0].revents & POLLIN)
+                mon.handle_events();
+            continue;
+        }
 
-    stats.update_all();
-    uint64_t rx_bytes, rx_packets;
-    uint64_t a_rx_bytes, a_rx_packets;
-    uint64_t tx_bytes, tx_packets;
-    uint64_t a_tx_bytes, a_tx_packets;
+        // if we fell behind, don't try to catch up with a burst of sweeps
+        next_sweep += SAMPLE_INTERVAL;
+        if (next_sweep < right_now)
+            next_sweep = right_now + SAMPLE_INTERVAL;
 
-    rx_bytes = stats.get_rx_bytes();
-    tx_bytes = stats.get_tx_bytes();
+        time_t now = time(0);
+        double elapsed = right_now - then;
+        then = right_now;
 
-    rx_packets = stats.get_rx_packets();
-    tx_packets = stats.get_tx_packets();
+        mon.sweep(now, elapsed);
+    }
+}
+
+/**
+    The same timing as do_monitor(), but there are no link events to wait
+    on: netns_monitor finds out what's there from each sweep's dumps.
+*/
+
+void
+do_netns_monitor(const commandline_options &options)
+{
+    netns_monitor mon(options.netns_rescan);
+
+    double then = monotonic_seconds();
+    double next_sweep = then + SAMPLE_INTERVAL;
 
     while (!stop)
     {
-        sleep(1);
-        time_t now = time(0);
-        stats.update_all();
-
-        a_rx_bytes = stats.get_rx_bytes();
-        a_tx_bytes = stats.get_tx_bytes();
-        a_rx_packets = stats.get_rx_packets();
-        a_tx_packets = stats.get_tx_packets();
-
-        uint64_t diff_rx_bytes = a_rx_bytes - rx_bytes;
-        uint64_t diff_tx_bytes = a_tx_bytes - tx_bytes;
-
-        uint64_t diff_rx_packets = a_rx_packets - rx_packets;
-        uint64_t diff_tx_packets = a_tx_packets - tx_packets;
-
-        ALWAYS("%lu : Rx bytes: %llu -> %llu : %llu\n",
-               (unsigned long)now,
-               (unsigned long long)rx_bytes,
-               (unsigned long long)a_rx_bytes,
-               (unsigned long long)diff_rx_bytes);
-
-        ALWAYS("%lu : Tx bytes: %llu -> %llu : %llu\n",
-               (unsigned long)now,
-               (unsigned long long)tx_bytes,
-               (unsigned long long)a_tx_bytes,
-               (unsigned long long)diff_tx_bytes);
-
-        ALWAYS("%lu : Rx packets: %llu -> %llu : %llu\n",
-               (unsigned long)now,
-               (unsigned long long)rx_packets,
-               (unsigned long long)a_rx_packets,
-               (unsigned long long)diff_rx_packets);
-
-        ALWAYS("%lu : Tx packets: %llu -> %llu : %llu\n",
-               (unsigned long)now,
-               (unsigned long long)tx_packets,
-               (unsigned long long)a_tx_packets,
-               (unsigned long long)diff_tx_packets);
-
-        rx_bytes = a_rx_bytes;
-        tx_bytes = a_tx_bytes;
-        rx_packets = a_rx_packets;
-        tx_packets = a_tx_packets;
+        double right_now = monotonic_seconds();
+        if (right_now < next_sweep)
+        {
+            int timeout = (int)((next_sweep - right_now) * 1000.0) + 1;
+            if ((poll(0, 0, timeout) == -1) && (errno != EINTR))
+                ERROR("poll for %d ms", timeout);
+            continue;
+        }
+
+        next_sweep += SAMPLE_INTERVAL;
+        if (next_sweep < right_now)
+            next_sweep = right_now + SAMPLE_INTERVAL;
+
+        double elapsed = right_now - then;
+        then = right_now;
+
+        mon.sweep(time(0), elapsed);
     }
 }
 
+/**
+    --replay: each recorded sweep through the monitor, with the time and
+    interval it was recorded with, either as fast as they'll go or paced
+    at replay_speed times the recorded intervals.
+*/
+
+void
+do_replay(const commandline_options &options)
+{
+    counter_replay replay(options.replay_file);
+
+    monitor_options monitor_opts(options.monitor);
+    monitor_opts.replay = &replay;
+    monitor mon(monitor_opts);
+
+    const double started = monotonic_seconds();
+    double due = started;
+    double recorded = 0.0;
+
+    while (!stop && replay.next())
+    {
+        if (options.replay_speed > 0.0)
+        {
+            due += replay.elapsed() / options.replay_speed;
+            double right_now = monotonic_seconds();
+            while (!stop && (right_now < due))
+            {
+                int timeout = (int)((due - right_now) * 1000.0) + 1;
+                if ((poll(0, 0, timeout) == -1) && (errno != EINTR))
+                    ERROR("poll for %d ms", timeout);
+                right_now = monotonic_seconds();
+            }
+        }
+
+        recorded += replay.elapsed();
+        mon.sweep(replay.now(), replay.elapsed());
+    }
+
+    const double wall = monotonic_seconds() - started;
+    ALWAYS("Replayed %lu sweeps, %lu interface samples, of %.1f recorded "
+           "seconds in %.3f: %.0f samples/s, %.0fx real time\n",
+           (unsigned long)replay.sweeps(),
+           (unsigned long)replay.total_samples(), recorded, wall,
+           (wall > 0.0) ? (double)replay.total_samples() / wall : 0.0,
+           (wall > 0.0) ? recorded / wall : 0.0);
+}
+
+/**
+    --check-collectors: every collector against sysfs, on every interface
+    we were given.
+*/
+
+bool
+do_check_collectors(const commandline_options &options)
+{
+    const std::vector<std::string> interfaces(options.monitor.all_interfaces
+                                              ? network_stats::list_interfaces()
+                                              : options.monitor.interfaces);
+
+    bool passed = true;
+    for (size_t i = 0; i < interfaces.size(); ++i)
+        passed = check_collectors(interfaces[i]) && passed;
+    ALWAYS("Collectors %s\n", passed ? "conform" : "FAILED");
+    return passed;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -398,7 +909,16 @@ main(int argc, char *argv[])
 
     try
     {
-        do_monitor();
+        commandline_options options;
+        get_commandline_options(argc, argv, &options);
+        if (options.check_collectors)
+            return do_check_collectors(options) ? 0 : 1;
+        if (!options.replay_file.empty())
+            do_replay(options);
+        else if (options.all_namespaces)
+            do_netns_monitor(options);
+        else
+            do_monitor(options);
     } catch (std::exception &e)
     {
         ALWAYS("Caught exception.\n");
@@ -0,0 +1,1874 @@
+#include "monitor.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("monitor");
+
+    enum
+    {
+        // burstable billing: 95th percentile of 5 minute averages over a
+        // rolling 30 days
+        BILLING_BUCKET_SECONDS = 5 * 60,
+        BILLING_WINDOW_BUCKETS = 30 * 24 * 60 * 60 / BILLING_BUCKET_SECONDS,
+
+        // sysfs reports Mb/s; rules work in bytes/s
+        BYTES_PER_SECOND_PER_MBIT = 1000 * 1000 / 8,
+
+        // sweeps of history before an interface/CPU correlation is believed
+        SOFTNET_MIN_SAMPLES = 10,
+
+        // Space-Saving counters per flow printed: only flows with more than
+        // 1/K of the bytes are sure to be counted, so K well above N
+        FLOW_COUNTERS_PER_FLOW = 64
+    };
+
+    // about a minute of memory at one sweep a second
+    const double SOFTNET_CORRELATION_ALPHA = 1.0 / 60.0;
+
+    // weaker than this isn't worth naming
+    const double SOFTNET_MIN_CORRELATION = 0.5;
+
+    //* Print 'value' into 'buf' (16 chars) with 'fmt', or '-' if NaN.
+    const char *
+    format_metric(char *buf, double value, const char *fmt)
+    {
+        if (value != value)
+            std::snprintf(buf, 16, "-");
+        else
+            std::snprintf(buf, 16, fmt, value);
+        return buf;
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+monitor_options::monitor_options(void):
+    interfaces(),
+    all_interfaces(false),
+    rules_file(),
+    anomaly_detection(false),
+    anomaly_threshold(4.0),
+    top(0),
+    flap_window(60.0),
+    collector(COLLECTOR_SYSFS_FD),
+    fd_budget(0),
+    idle_after(0.0),
+    idle_interval(10.0),
+    containers(false),
+    ethtool(false),
+    queues(false),
+    protocols(false),
+    softnet(false),
+    irqs(false),
+    tc(false),
+    sockets(false),
+    socket_grouping(SOCK_BY_PORT),
+    flows(0),
+    capture_threads(0),
+    fanout(FANOUT_HASH),
+    packet_mix(false),
+    sample(1),
+    record_file(),
+    replay(0)
+{
+
+}
+
+monitor::interface_record::interface_record(const std::string &n,
+                                            network_stats *s, int index,
+                                            size_t rules):
+    name(n),
+    stats(s),
+    ethtool(0),
+    bql(0),
+    capture(0),
+    ifindex(index),
+    gone(false),
+    idle(false),
+    quiet_for(0.0),
+    unsampled(0.0),
+    covered(0.0),
+    fresh(false),
+    shown(false),
+    recorded(false),
+    sample(0),
+    peer_ifindex(-1),
+    peer_netnsid(-1),
+    peer_generation(0),
+    link_speed(std::numeric_limits<double>::quiet_NaN()),
+    rx_billing(BILLING_BUCKET_SECONDS, BILLING_WINDOW_BUCKETS),
+    tx_billing(BILLING_BUCKET_SECONDS, BILLING_WINDOW_BUCKETS),
+    alerts(rules)
+{
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+    {
+        previous.value[i] = current.value[i] = delta[i] = 0;
+        rate[i] = 0.0;
+    }
+}
+
+/**
+    Load the rules (if any), then open the stats files for each interface:
+    the byte and packet counters we always print, plus whatever the rules
+    and anomaly detection look at.
+
+    We subscribe to link events before listing interfaces, so nothing that
+    shows up in between is missed.
+*/
+
+monitor::monitor(const monitor_options &options):
+    interfaces_(),
+    all_interfaces_(options.all_interfaces),
+    wanted_(options.interfaces.begin(), options.interfaces.end()),
+    rx_fields_(),
+    tx_fields_(),
+    collector_(options.collector),
+    pool_(0),
+    idle_after_(options.idle_after),
+    idle_interval_(options.idle_interval),
+    recorder_(0),
+    replay_(options.replay),
+    replayed_(),
+    replayed_by_name_(),
+    peers_(options.containers ? new veth_peers : 0),
+    ethtool_socket_(-1),
+    queues_wanted_(options.queues),
+    proto_(options.protocols ? new proto_stats : 0),
+    softnet_(0),
+    irqs_(0),
+    irqs_remap_(true),
+    qdiscs_(0),
+    sockets_(0),
+    flows_(options.flows),
+    capture_threads_(options.capture_threads),
+    fanout_(options.fanout),
+    packet_mix_(options.packet_mix),
+    sample_(options.sample),
+    containers_(),
+    links_(),
+    flap_window_(options.flap_window),
+    alerts_(),
+    anomaly_detection_(options.anomaly_detection),
+    anomalies_(options.anomaly_threshold),
+    derived_(),
+    top_count_(options.top),
+    events_(),
+    top_entries_(),
+    link_events_(),
+    flow_tally_(options.flows * FLOW_COUNTERS_PER_FLOW),
+    flow_entries_()
+{
+    // when replaying, whatever was recorded
+    std::vector<std::string> interfaces;
+    if (!replay_)
+        interfaces = options.all_interfaces ? network_stats::list_interfaces()
+                                            : options.interfaces;
+
+    for (size_t m = 0; m < NUM_TOP_METRICS; ++m)
+        top_[m] = top_k<size_t>(top_count_);
+
+    if (collector_ == COLLECTOR_SYSFS_POOLED)
+    {
+        // leave the other half for the dirfds, sockets and whatever else
+        size_t budget = options.fd_budget;
+        if (budget == 0)
+        {
+            struct rlimit rl;
+            if (getrlimit(RLIMIT_NOFILE, &rl))
+                ERROR("getrlimit(RLIMIT_NOFILE)");
+            budget = (rl.rlim_cur == RLIM_INFINITY) ? 65536 : rl.rlim_cur / 2;
+        }
+        pool_ = new fd_pool(budget);
+        CPRINT("Pooling at most %lu stats fds\n", (unsigned long)budget);
+    }
+
+    if (!options.record_file.empty())
+        recorder_ = new counter_recorder(options.record_file);
+
+    if (options.ethtool)
+    {
+        ethtool_socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (ethtool_socket_ == -1)
+            ERROR("Opening socket for ethtool ioctls");
+    }
+
+    if (options.softnet)
+        softnet_ = new softnet_stats;
+    if (options.irqs)
+        irqs_ = new irq_stats;
+    if (options.tc)
+        qdiscs_ = new qdisc_stats;
+    if (options.sockets)
+        sockets_ = new sock_stats(options.socket_grouping);
+
+    if (!options.rules_file.empty())
+    {
+        alerts_.load(options.rules_file);
+        CPRINT("Loaded %lu alert rules from '%s'\n",
+               (unsigned long)alerts_.size(), C(options.rules_file));
+    }
+
+    // bytes and packets are printed; drops and errors feed the derived
+    // metrics and the top lists
+    std::set<rx_fields> &rx(rx_fields_);
+    std::set<tx_fields> &tx(tx_fields_);
+    rx.insert(RX_BYTES);
+    rx.insert(RX_PACKETS);
+    rx.insert(RX_DROPPED);
+    rx.insert(RX_ERRORS);
+    tx.insert(TX_BYTES);
+    tx.insert(TX_PACKETS);
+    tx.insert(TX_DROPPED);
+    tx.insert(TX_ERRORS);
+
+    std::set<size_t> used(alerts_.counters_used());
+    if (anomaly_detection_)
+        used.insert(ERROR_COUNTERS, ERROR_COUNTERS + NUM_ERROR_COUNTERS);
+
+    std::set<size_t>::const_iterator u = used.begin();
+    for ( ; u != used.end(); ++u)
+    {
+        if (*u < NUM_RX_FIELDS)
+            rx.insert((rx_fields)*u);
+        else
+            tx.insert((tx_fields)(*u - NUM_RX_FIELDS));
+    }
+
+    try
+    {
+        for (size_t i = 0; i < interfaces.size(); ++i)
+            add_interface(interfaces[i]);
+
+        // link state arrives with the answers, in the event loop
+        if (!replay_)
+            links_.request_dump();
+    } catch (...)
+    {
+        for (size_t i = 0; i < interfaces_.size(); ++i)
+        {
+            delete interfaces_[i]->stats;
+            delete interfaces_[i];
+        }
+        throw;
+    }
+}
+
+monitor::~monitor(void)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        delete interfaces_[i]->capture;
+        delete interfaces_[i]->bql;
+        delete interfaces_[i]->ethtool;
+        delete interfaces_[i]->stats;
+        delete interfaces_[i];
+    }
+
+    if (ethtool_socket_ != -1)
+        close(ethtool_socket_);
+
+    // after the network_stats, which give their fds back to it
+    delete pool_;
+    delete recorder_;
+    delete peers_;
+    delete proto_;
+    delete softnet_;
+    delete irqs_;
+    delete qdiscs_;
+    delete sockets_;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+bool
+monitor::wanted(const std::string &name) const
+{
+    return all_interfaces_ || (wanted_.count(name) != 0);
+}
+
+//* Position in interfaces_, or interfaces_.size() if we don't have it.
+size_t
+monitor::find_interface(int ifindex) const
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        if (interfaces_[i]->ifindex == ifindex)
+            return i;
+    }
+    return interfaces_.size();
+}
+
+/**
+    A network_stats for 'name' reading everything we want, with whichever
+    collector we've been told to use.
+*/
+
+network_stats *
+monitor::open_interface(const std::string &name)
+{
+    network_stats *stats = new network_stats(name, collector_, pool_);
+    try
+    {
+        CPRINT("%s: Setting Rx stats to update\n", C(name));
+        stats->set_rx_stats_to_update(rx_fields_);
+
+        CPRINT("%s: Setting Tx stats to update\n", C(name));
+        stats->set_tx_stats_to_update(tx_fields_);
+    } catch (...)
+    {
+        delete stats;
+        throw;
+    }
+    return stats;
+}
+
+/**
+    Open everything we read for 'name' and take a first reading, so its
+    first sweep has something to diff against.
+*/
+
+monitor::interface_record *
+monitor::add_interface(const std::string &name)
+{
+    interface_record *r = 0;
+    network_stats *stats = open_interface(name);
+    try
+    {
+        stats->update_all();
+
+        int ifindex = network_stats::interface_index(name);
+        r = new interface_record(name, stats, ifindex, alerts_.size());
+        stats->get_counter_table(&r->current);
+        r->previous = r->current;
+        interfaces_.push_back(r);
+    } catch (...)
+    {
+        delete stats;
+        throw;
+    }
+
+    derived_.resize(interfaces_.size());
+    irqs_remap_ = true;
+    refresh_link(r);
+    open_ethtool(r);
+    open_bql(r);
+    open_capture(r);
+    return r;
+}
+
+/**
+    Order of interfaces_ doesn't matter, so the last one fills the hole.
+*/
+
+void
+monitor::remove_interface(size_t i)
+{
+    CPRINT("%s: no longer monitoring\n",
+           C(interfaces_[i]->name));
+
+    delete interfaces_[i]->capture;
+    delete interfaces_[i]->bql;
+    delete interfaces_[i]->ethtool;
+    delete interfaces_[i]->stats;
+    delete interfaces_[i];
+    interfaces_[i] = interfaces_.back();
+    interfaces_.pop_back();
+
+    derived_.resize(interfaces_.size());
+    irqs_remap_ = true;
+}
+
+/**
+    sysfs paths have the name in them, so a rename means reopening
+    everything.  The counters themselves don't reset on rename, so we keep
+    the record -- and with it the history for rates, billing, alerts and
+    baselines -- and just swap in a fresh network_stats.
+*/
+
+void
+monitor::rename_interface(size_t i, const std::string &name)
+{
+    interface_record *r = interfaces_[i];
+    CPRINT("%s: renamed to '%s'\n", C(r->name), C(name));
+
+    if (!wanted(name))
+    {
+        remove_interface(i);
+        return;
+    }
+
+    network_stats *stats = open_interface(name);
+    if (r->idle)
+        stats->release_files();
+
+    delete r->stats;
+    r->stats = stats;
+    r->name = name;
+
+    // the ioctl goes by name too
+    delete r->ethtool;
+    r->ethtool = 0;
+    open_ethtool(r);
+    delete r->bql;
+    r->bql = 0;
+    open_bql(r);
+    irqs_remap_ = true;
+}
+
+/**
+    RTM_NEWLINK comes for new links, renames and any change of state, so
+    most of these are for links we already know about and are no-ops.
+
+    Links can be gone again by the time we try to open them (container
+    churn is like that): that's not worth dying over, and the RTM_DELLINK
+    will be along shortly.
+*/
+
+void
+monitor::handle_link_event(const link_event &ev)
+{
+    const size_t i = find_interface(ev.ifindex);
+    const bool known = i != interfaces_.size();
+
+    try
+    {
+        if (ev.type == LINK_DEL)
+        {
+            // its namespace may be going too, and its nsid up for reuse
+            if (peers_ && known && (interfaces_[i]->peer_netnsid != -1))
+                peers_->invalidate();
+            if (known)
+                remove_interface(i);
+        } else if (known)
+        {
+            interface_record *r = interfaces_[i];
+            if (!ev.name.empty()
+                && (ev.name != r->name))
+            {
+                rename_interface(i, ev.name);
+                if ((i >= interfaces_.size()) || (interfaces_[i] != r))
+                    return;     // renamed to something we don't watch
+            }
+            update_link_state(r, ev);
+        } else if (!ev.name.empty() && wanted(ev.name))
+        {
+            CPRINT("%s: appeared as ifindex %d\n", C(ev.name), ev.ifindex);
+            update_link_state(add_interface(ev.name), ev);
+        }
+    } catch (std::exception &e)
+    {
+        CPRINT("Ignoring link event for ifindex %d ('%s'): it went away\n",
+               ev.ifindex, C(ev.name));
+        if (known && (i < interfaces_.size())
+            && (interfaces_[i]->ifindex == ev.ifindex))
+            remove_interface(i);
+    }
+}
+
+/**
+    Print transitions as they happen.  A link that has bounced may have
+    come back at a different speed, so that's when link info is re-read.
+*/
+
+void
+monitor::update_link_state(interface_record *r, const link_event &ev)
+{
+    const int64_t changes = r->state.carrier_changes();
+
+    update_peer(r, ev);
+
+    std::string what;
+    if (r->state.update(ev, &what))
+    {
+        ALWAYS("%.3f : %s : %s : %lu carrier changes in last %.0f s\n",
+               ev.when, C(r->name), C(what),
+               (unsigned long)r->state.flaps(ev.when, flap_window_),
+               flap_window_);
+    }
+
+    if ((changes != -1) && (r->state.carrier_changes() != changes))
+        refresh_link(r);
+
+    // something is happening: don't wait for the slow tier to notice
+    if (!what.empty())
+        promote(r, "link state changed");
+}
+
+/**
+    Keep up with where a veth's other end is.  A peer in a namespace we
+    have no nsid for means a new namespace, so the nsid map is stale.
+*/
+
+void
+monitor::update_peer(interface_record *r, const link_event &ev)
+{
+    if (!peers_ || (ev.operstate == -1))
+        return;     // not asked to, or a hand-made event with nothing in it
+
+    const int netnsid = (ev.kind == "veth") ? ev.link_netnsid : -1;
+    if ((ev.kind == r->kind) && (ev.link == r->peer_ifindex)
+        && (netnsid == r->peer_netnsid))
+        return;
+
+    r->kind = ev.kind;
+    r->peer_ifindex = ev.link;
+    r->peer_netnsid = netnsid;
+    r->peer_generation = 0;
+    r->peer_name.clear();
+
+    if ((netnsid != -1) && !peers_->known(netnsid))
+        peers_->invalidate();
+}
+
+/**
+    We lost link events, so we can't trust our picture of what's there:
+    compare against sysfs once, ask for a fresh dump of link state, and go
+    back to relying on events.
+*/
+
+void
+monitor::resync(void)
+{
+    CPRINT("Resyncing interfaces with sysfs\n");
+
+    std::vector<std::string> names(network_stats::list_interfaces());
+    std::set<int> present;
+
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        int ifindex = network_stats::interface_index(names[n]);
+        if (ifindex < 0)
+            continue;
+        present.insert(ifindex);
+
+        link_event ev;
+        ev.type = LINK_NEW;
+        ev.ifindex = ifindex;
+        ev.name = names[n];
+        ev.flags = 0;
+        handle_link_event(ev);
+    }
+
+    for (size_t i = interfaces_.size(); i-- > 0; )
+    {
+        if (present.count(interfaces_[i]->ifindex) == 0)
+            remove_interface(i);
+    }
+
+    links_.request_dump();
+}
+
+//* The record for a recorded interface, or null if we haven't got one.
+monitor::interface_record *
+monitor::find_replayed(const recorded_sample &s) const
+{
+    if (s.ifindex == -1)
+    {
+        std::map<std::string, interface_record *>::const_iterator i
+            = replayed_by_name_.find(s.name);
+        return (i != replayed_by_name_.end()) ? i->second : 0;
+    }
+
+    std::map<int, interface_record *>::const_iterator i
+        = replayed_.find(s.ifindex);
+    return (i != replayed_.end()) ? i->second : 0;
+}
+
+//* remove_interface(), and out of replayed_.
+void
+monitor::remove_replayed(size_t i)
+{
+    const interface_record *r = interfaces_[i];
+    if (r->ifindex == -1)
+        replayed_by_name_.erase(r->name);
+    else
+        replayed_.erase(r->ifindex);
+    remove_interface(i);
+}
+
+//* As add_interface(), but everything's from the recording.
+monitor::interface_record *
+monitor::add_replayed(const recorded_sample &s)
+{
+    CPRINT("%s: in the recording as ifindex %d\n", s.name, s.ifindex);
+
+    interface_record *r = new interface_record(s.name, 0, s.ifindex,
+                                               alerts_.size());
+    std::memcpy(r->current.value, s.value, sizeof(r->current.value));
+    r->previous = r->current;
+    interfaces_.push_back(r);
+    if (s.ifindex == -1)
+        replayed_by_name_[r->name] = r;
+    else
+        replayed_[s.ifindex] = r;
+
+    derived_.resize(interfaces_.size());
+    set_link(r, s.link());
+    return r;
+}
+
+/**
+    Make interfaces_ what the replay's sweep says was there: new ones
+    added from their baselines, missing ones dropped, renames and link
+    changes followed.  Each is pointed at its sample for read_interface().
+*/
+
+void
+monitor::follow_replay(void)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+        interfaces_[i]->sample = 0;
+
+    const std::vector<recorded_sample> &samples(replay_->samples());
+    for (size_t n = 0; n < samples.size(); ++n)
+    {
+        const recorded_sample &s = samples[n];
+        if (!wanted(s.name))
+            continue;
+
+        interface_record *r = find_replayed(s);
+        if (s.flags & recorded_sample::BASELINE)
+        {
+            // new to the recorder: if we have it, it went and came back
+            // (rare enough to look for where)
+            if (r)
+                remove_replayed(std::find(interfaces_.begin(),
+                                          interfaces_.end(), r)
+                                - interfaces_.begin());
+            add_replayed(s);
+            continue;
+        }
+
+        // no baseline (the recording's been cut): this is it
+        if (!r)
+            r = add_replayed(s);
+        if (r->name != s.name)
+        {
+            CPRINT("%s: renamed to '%s'\n", C(r->name), s.name);
+            r->name = s.name;
+        }
+
+        const link_info link(s.link());
+        if ((link.speed != r->link.speed) || (link.mtu != r->link.mtu)
+            || (link.duplex != r->link.duplex))
+            set_link(r, link);
+
+        r->sample = &s;
+    }
+
+    // anything not in this sweep was gone by then
+    for (size_t i = interfaces_.size(); i-- > 0; )
+    {
+        if (!interfaces_[i]->sample)
+            remove_replayed(i);
+    }
+}
+
+/**
+    Everything read this sweep to recorder_, after the reading its deltas
+    are from for any interface it hasn't had yet.
+*/
+
+void
+monitor::record_sweep(time_t now, double elapsed)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        interface_record *r = interfaces_[i];
+        if (!r->recorded)
+        {
+            recorder_->add(r->name, r->ifindex, r->link, r->previous, true);
+            r->recorded = true;
+        }
+        recorder_->add(r->name, r->ifindex, r->link, r->current, false);
+    }
+    recorder_->write_sweep(now, elapsed);
+}
+
+//* Drop anything whose read failed this sweep.
+void
+monitor::remove_gone(void)
+{
+    for (size_t i = interfaces_.size(); i-- > 0; )
+    {
+        if (interfaces_[i]->gone)
+            remove_interface(i);
+    }
+}
+
+/**
+    Pull in this sweep's counters and turn them into deltas and rates.
+    Links that are down aren't read at all: their counters aren't going
+    anywhere, and on a host with lots of them that's a lot of reads saved.
+*/
+
+void
+monitor::read_interface(interface_record *r, double elapsed)
+{
+    r->previous = r->current;
+    r->covered = elapsed;
+    r->fresh = false;
+    if (r->state.down())
+    {
+        compute_rates(r, elapsed);
+        return;
+    }
+
+    // idle: nothing to read until the slow tier comes round, and then
+    // the deltas cover everything since the last read
+    if (r->idle)
+    {
+        r->unsampled += elapsed;
+        if (r->unsampled < idle_interval_)
+        {
+            compute_rates(r, elapsed);
+            return;
+        }
+        r->covered = r->unsampled;
+        r->unsampled = 0.0;
+    }
+
+    if (replay_)
+    {
+        if (r->sample)
+            std::memcpy(r->current.value, r->sample->value,
+                        sizeof(r->current.value));
+    } else
+    {
+        try
+        {
+            r->stats->update_all();
+        } catch (std::exception &e)
+        {
+            // most likely it was deleted and the event hasn't arrived yet
+            CPRINT("%s: read failed: dropping it\n",
+                   C(r->name));
+            r->gone = true;
+            return;
+        }
+        r->stats->get_counter_table(&r->current);
+    }
+
+    r->fresh = true;
+    if (r->ethtool)
+    {
+        try
+        {
+            r->ethtool->update();
+        } catch (std::exception &e)
+        {
+            CPRINT("%s: ethtool read failed: giving up on it\n",
+                   C(r->name));
+            delete r->ethtool;
+            r->ethtool = 0;
+        }
+    }
+
+    compute_rates(r, r->covered);
+    update_idle(r);
+}
+
+void
+monitor::refresh_link(interface_record *r)
+{
+    set_link(r, r->stats->get_link_info());
+}
+
+void
+monitor::set_link(interface_record *r, const link_info &link)
+{
+    r->link = link;
+    r->link_speed = (r->link.speed > 0)
+                  ? (double)r->link.speed * BYTES_PER_SECOND_PER_MBIT
+                  : std::numeric_limits<double>::quiet_NaN();
+
+    CPRINT("%s: link speed %ld Mb/s, %s duplex, MTU %ld\n",
+           C(r->name), r->link.speed,
+           link_duplex_name(r->link.duplex), r->link.mtu);
+}
+
+//* Deltas since last sweep and per second rates from them.
+void
+monitor::compute_rates(interface_record *r, double elapsed)
+{
+    counter_rates(r->current, r->previous, elapsed, r->delta, r->rate);
+}
+
+/**
+    After a read: demote an interface whose counters haven't moved for
+    idle_after_ seconds, and promote an idle one whose counters have.
+*/
+
+void
+monitor::update_idle(interface_record *r)
+{
+    if (idle_after_ <= 0.0)
+        return;
+
+    bool moved = false;
+    for (size_t i = 0; (i < NUM_COUNTERS) && !moved; ++i)
+        moved = r->delta[i] != 0;
+
+    if (moved)
+    {
+        r->quiet_for = 0.0;
+        promote(r, "counters moved");
+        return;
+    }
+
+    r->quiet_for += r->covered;
+    if (!r->idle && (r->quiet_for >= idle_after_))
+    {
+        CPRINT("%s: quiet for %.0f s: sampling every %.0f s\n",
+               C(r->name), r->quiet_for,
+               idle_interval_);
+        if (r->stats)
+            r->stats->release_files();
+        r->idle = true;
+        r->unsampled = 0.0;
+    }
+}
+
+void
+monitor::promote(interface_record *r, const char *why)
+{
+    if (!r->idle)
+        return;
+
+    CPRINT("%s: %s: back to sampling every sweep\n",
+           C(r->name), why);
+    if (r->stats)
+        r->stats->retain_files();
+    r->idle = false;
+    r->quiet_for = 0.0;
+    r->unsampled = 0.0;
+}
+
+/**
+    Copy this sweep's deltas into derived_'s input columns and let it
+    crunch all interfaces at once.
+*/
+
+void
+monitor::compute_derived(void)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        const interface_record *r = interfaces_[i];
+        const uint64_t *d = r->delta;
+
+        derived_.rx_bytes[i]   = (double)d[RX_BYTES];
+        derived_.rx_packets[i] = (double)d[RX_PACKETS];
+        derived_.rx_dropped[i] = (double)d[RX_DROPPED];
+        derived_.rx_errors[i]  = (double)d[RX_ERRORS];
+        derived_.tx_bytes[i]   = (double)d[NUM_RX_FIELDS + TX_BYTES];
+        derived_.tx_packets[i] = (double)d[NUM_RX_FIELDS + TX_PACKETS];
+        derived_.tx_dropped[i] = (double)d[NUM_RX_FIELDS + TX_DROPPED];
+        derived_.tx_errors[i]  = (double)d[NUM_RX_FIELDS + TX_ERRORS];
+        derived_.inverse_speed[i] = 1.0 / r->link_speed;
+        derived_.inverse_elapsed[i] = (r->covered > 0.0) ? 1.0 / r->covered : 0.0;
+    }
+
+    derived_.compute();
+}
+
+void
+monitor::print(const interface_record &r, size_t i, time_t now) const
+{
+    const char *name = C(r.name);
+
+    static const size_t shown[] =
+    {
+        RX_BYTES,
+        NUM_RX_FIELDS + TX_BYTES,
+        RX_PACKETS,
+        NUM_RX_FIELDS + TX_PACKETS
+    };
+    static const char *labels[] =
+    {
+        "Rx bytes", "Tx bytes", "Rx packets", "Tx packets"
+    };
+
+    for (size_t j = 0; j < sizeof(shown) / sizeof(shown[0]); ++j)
+    {
+        const size_t c = shown[j];
+        ALWAYS("%lu : %s : %s: %llu -> %llu : %llu\n",
+               (unsigned long)now, name, labels[j],
+               (unsigned long long)r.previous.value[c],
+               (unsigned long long)r.current.value[c],
+               (unsigned long long)r.delta[c]);
+    }
+
+    print_derived(r, i, now);
+}
+
+/**
+    Only for links that have flapped within the window: steady links
+    don't need a line saying so every sweep.
+*/
+
+void
+monitor::print_flaps(interface_record *r, time_t now)
+{
+    size_t flaps = r->state.flaps((double)now, flap_window_);
+    if (flaps == 0)
+        return;
+
+    ALWAYS("%lu : %s : link %s carrier %d : %lu carrier changes in last "
+           "%.0f s (up %lld down %lld), last at %.3f\n",
+           (unsigned long)now, C(r->name),
+           operstate_name(r->state.operstate()), r->state.carrier(),
+           (unsigned long)flaps, flap_window_,
+           (long long)r->state.carrier_up_count(),
+           (long long)r->state.carrier_down_count(),
+           r->state.last_change());
+}
+
+/**
+    Plenty of drivers (lo, for one) have no ethtool stats: that just means
+    there's nothing extra to print.
+*/
+
+void
+monitor::open_ethtool(interface_record *r)
+{
+    if (ethtool_socket_ == -1)
+        return;
+
+    try
+    {
+        r->ethtool = new ethtool_counters(ethtool_socket_,
+                                       r->name);
+    } catch (std::exception &e)
+    {
+        CPRINT("%s: no ethtool stats\n", C(r->name));
+    }
+}
+
+/**
+    The driver counters that moved this sweep, as rates: one line per
+    queue, one for everything else.  Nothing for a link that wasn't read
+    (down, or idle): its deltas are still the last read's.
+*/
+
+void
+monitor::print_ethtool(const interface_record &r, time_t now) const
+{
+    if (!r.ethtool || !r.fresh)
+        return;
+
+    const ethtool_counters &e = *r.ethtool;
+    const double per_second = (r.covered > 0.0) ? 1.0 / r.covered : 0.0;
+    const char *name = C(r.name);
+
+    std::vector<bool> per_queue(e.size(), false);
+    const std::vector<queue_counter> &queues = e.queues();
+
+    // queue counters come in runs of the same queue, in driver order
+    std::string line;
+    for (size_t q = 0; q < queues.size(); ++q)
+    {
+        per_queue[queues[q].index] = true;
+        if (e.delta(queues[q].index))
+        {
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%s%s %.0f/s",
+                          line.empty() ? "" : ", ", C(queues[q].metric),
+                          (double)e.delta(queues[q].index) * per_second);
+            line += buf;
+        }
+
+        const bool last = (q + 1 == queues.size())
+            || (queues[q + 1].direction != queues[q].direction)
+            || (queues[q + 1].queue != queues[q].queue);
+        if (last && !line.empty())
+        {
+            ALWAYS("%lu : %s : %s queue %d : %s\n", (unsigned long)now, name,
+                   (queues[q].direction == QUEUE_RX) ? "rx" : "tx",
+                   queues[q].queue, C(line));
+            line.clear();
+        }
+        else if (last)
+            line.clear();
+    }
+
+    for (size_t i = 0; i < e.size(); ++i)
+    {
+        if (per_queue[i] || !e.delta(i))
+            continue;
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%s%s %.0f/s", line.empty() ? "" : ", ",
+                      C(e.name(i)), (double)e.delta(i) * per_second);
+        line += buf;
+    }
+    if (!line.empty())
+        ALWAYS("%lu : %s : ethtool : %s\n", (unsigned long)now, name, C(line));
+}
+
+void
+monitor::open_bql(interface_record *r)
+{
+    if (!queues_wanted_)
+        return;
+
+    try
+    {
+        r->bql = new bql_stats(*r->stats);
+    } catch (std::exception &e)
+    {
+        CPRINT("%s: no byte queue limits\n", C(r->name));
+    }
+}
+
+/**
+    A line per tx queue that had anything in flight since the last sweep
+    (unless we're only printing the top N), then start the next interval.
+*/
+
+void
+monitor::print_bql(interface_record *r, time_t now)
+{
+    if (!r->bql)
+        return;
+
+    for (size_t i = 0; !top_count_ && (i < r->bql->size()); ++i)
+    {
+        const bql_queue &q = r->bql->queue(i);
+        if (!q.max_inflight && !q.stalls && !q.timeouts)
+            continue;
+
+        ALWAYS("%lu : %s : tx-%d : inflight p50 %llu p99 %llu max %llu B : "
+               "limit %llu B : at limit %.1f%% of %llu samples : "
+               "stalls %llu timeouts %llu\n",
+               (unsigned long)now, C(r->name), q.queue,
+               (unsigned long long)bql_stats::percentile(q, 0.50),
+               (unsigned long long)bql_stats::percentile(q, 0.99),
+               (unsigned long long)q.max_inflight, (unsigned long long)q.limit,
+               q.samples ? 100.0 * (double)q.at_limit / (double)q.samples : 0.0,
+               (unsigned long long)q.samples, (unsigned long long)q.stalls,
+               (unsigned long long)q.timeouts);
+    }
+
+    try
+    {
+        r->bql->reset();
+    } catch (std::exception &e)
+    {
+        CPRINT("%s: queue counters unreadable: giving up on them\n",
+               C(r->name));
+        delete r->bql;
+        r->bql = 0;
+    }
+}
+
+void
+monitor::open_capture(interface_record *r)
+{
+    if (!flows_ && !packet_mix_)
+        return;
+
+    try
+    {
+        r->capture = new capture_group(r->name,
+                                       flows_ * FLOW_COUNTERS_PER_FLOW,
+                                       capture_threads_, fanout_, sample_);
+    } catch (std::exception &e)
+    {
+        CPRINT("%s: no packet capture\n", C(r->name));
+    }
+}
+
+/**
+    The heaviest flows since the last sweep (collected into flow_tally_),
+    with how far each could be overcounted, and what the capture as a
+    whole saw, over all of its threads.  A flow is only printed if what
+    it's sure to have sent is more than its error: below that, it may just
+    be the latest of many small flows to take over a counter.  Sampled
+    counts are scaled back up.
+*/
+
+void
+monitor::print_flows(const interface_record &r, time_t now, double elapsed)
+{
+    const double per_second = (elapsed > 0.0)
+                            ? (double)r.capture->sample() / elapsed : 0.0;
+    const char *name = C(r.name);
+    const flow_tally &t(flow_tally_);
+
+    t.flows.sorted(&flow_entries_);
+    size_t printed = 0;
+    for (size_t i = 0; (i < flow_entries_.size()) && (printed < flows_); ++i)
+    {
+        const flow_counters::counter &c = flow_entries_[i];
+        if (c.count <= 2 * c.error)
+            continue;
+
+        ALWAYS("%lu : %s : flow %s : %.0f B/s (+/- %.0f) %.0f pkt/s\n",
+               (unsigned long)now, name, C(flow_name(c.key)),
+               (double)c.count * per_second, (double)c.error * per_second,
+               (double)c.hits * per_second);
+        ++printed;
+    }
+
+    const uint64_t drops = r.capture->drops();
+    if (t.packets || drops)
+        ALWAYS("%lu : %s : captured %.0f pkt/s %.0f B/s : not IP %.0f/s : "
+               "ring drops %.0f/s\n", (unsigned long)now, name,
+               (double)t.packets * per_second, (double)t.bytes * per_second,
+               (double)t.unparsed * per_second, (double)drops * per_second);
+}
+
+/**
+    Where the interface's average packet size comes from: the share of
+    packets in each size bucket, then the share of packets and average
+    size of each network and transport protocol, from this sweep's
+    (sampled) capture.
+*/
+
+void
+monitor::print_mix(const interface_record &r, time_t now) const
+{
+    const packet_mix &m = flow_tally_.mix;
+    const uint64_t packets = flow_tally_.packets;
+    if (!packets)
+        return;
+
+    const char *name = C(r.name);
+    const double percent = 100.0 / (double)packets;
+    char sample[32] = "";
+    if (r.capture->sample() > 1)
+        std::snprintf(sample, sizeof(sample), " (1 in %u)", r.capture->sample());
+
+    std::string line;
+    char buf[64];
+    for (size_t b = 0; b < NUM_SIZE_BUCKETS; ++b)
+    {
+        if (!m.size_packets[b])
+            continue;
+        std::snprintf(buf, sizeof(buf), " %s %.1f%%", size_bucket_name(b),
+                      (double)m.size_packets[b] * percent);
+        line += buf;
+    }
+    ALWAYS("%lu : %s : sizes%s :%s : avg %.0f B\n", (unsigned long)now, name,
+           sample, C(line), (double)flow_tally_.bytes / (double)packets);
+
+    line.clear();
+    for (size_t c = 0; c < NUM_L3_CLASSES; ++c)
+    {
+        if (!m.l3_packets[c])
+            continue;
+        std::snprintf(buf, sizeof(buf), " %s %.1f%% avg %.0f B", l3_class_name(c),
+                      (double)m.l3_packets[c] * percent,
+                      (double)m.l3_bytes[c] / (double)m.l3_packets[c]);
+        line += buf;
+    }
+    line += " :";
+    for (size_t c = 0; c < NUM_L4_CLASSES; ++c)
+    {
+        if (!m.l4_packets[c])
+            continue;
+        std::snprintf(buf, sizeof(buf), " %s %.1f%% avg %.0f B", l4_class_name(c),
+                      (double)m.l4_packets[c] * percent,
+                      (double)m.l4_bytes[c] / (double)m.l4_packets[c]);
+        line += buf;
+    }
+    ALWAYS("%lu : %s : mix%s :%s\n", (unsigned long)now, name, sample, C(line));
+}
+
+void
+monitor::print_derived(const interface_record &r, size_t i, time_t now) const
+{
+    char rx_util[16], rx_size[16], rx_drop[16], rx_err[16];
+    char tx_util[16], tx_size[16], tx_drop[16], tx_err[16];
+    ALWAYS("%lu : %s : Rx util %s%% pkt %sB drop %s%% err %s%% : "
+           "Tx util %s%% pkt %sB drop %s%% err %s%%\n",
+           (unsigned long)now, C(r.name),
+           format_metric(rx_util, derived_.rx_utilization[i], "%.2f"),
+           format_metric(rx_size, derived_.rx_packet_size[i], "%.0f"),
+           format_metric(rx_drop, derived_.rx_drop_ratio[i], "%.3f"),
+           format_metric(rx_err, derived_.rx_error_ratio[i], "%.3f"),
+           format_metric(tx_util, derived_.tx_utilization[i], "%.2f"),
+           format_metric(tx_size, derived_.tx_packet_size[i], "%.0f"),
+           format_metric(tx_drop, derived_.tx_drop_ratio[i], "%.3f"),
+           format_metric(tx_err, derived_.tx_error_ratio[i], "%.3f"));
+}
+
+/**
+    Put interface 'i' up for each of the top lists.  Idle interfaces
+    aren't offered at all, so a quiet host shows short lists rather than
+    N interfaces tied at zero.
+*/
+
+void
+monitor::offer_top(size_t i)
+{
+    const double *rate = interfaces_[i]->rate;
+    const double score[NUM_TOP_METRICS] =
+    {
+        rate[RX_BYTES],
+        rate[NUM_RX_FIELDS + TX_BYTES],
+        rate[RX_DROPPED] + rate[NUM_RX_FIELDS + TX_DROPPED],
+        rate[RX_ERRORS] + rate[NUM_RX_FIELDS + TX_ERRORS]
+    };
+
+    for (size_t m = 0; m < NUM_TOP_METRICS; ++m)
+    {
+        if (score[m] > 0.0)
+            top_[m].offer(score[m], i);
+    }
+}
+
+/**
+    The --top display: for each metric, the N interfaces with the highest
+    score this sweep.  Only those get formatted, so the cost is the same
+    with 10 interfaces or 10,000; they're marked shown so their ethtool,
+    IRQ, qdisc, flow and packet mix lines follow in sweep().
+*/
+
+void
+monitor::print_top(time_t now)
+{
+    static const char *titles[NUM_TOP_METRICS] =
+    {
+        "Rx bytes/s", "Tx bytes/s", "drops/s", "errors/s"
+    };
+
+    for (size_t m = 0; m < NUM_TOP_METRICS; ++m)
+    {
+        top_[m].sorted(&top_entries_);
+        ALWAYS("%lu : top %lu by %s of %lu interfaces\n",
+               (unsigned long)now, (unsigned long)top_count_, titles[m],
+               (unsigned long)interfaces_.size());
+
+        for (size_t j = 0; j < top_entries_.size(); ++j)
+        {
+            const size_t i = top_entries_[j].id;
+            interface_record &r = *interfaces_[i];
+            r.shown = true;
+            ALWAYS("%lu : #%lu %s : %.0f : Rx %.0f B/s %.0f pkt/s : "
+                   "Tx %.0f B/s %.0f pkt/s\n",
+                   (unsigned long)now, (unsigned long)j + 1,
+                   C(r.name), top_entries_[j].score,
+                   r.rate[RX_BYTES], r.rate[RX_PACKETS],
+                   r.rate[NUM_RX_FIELDS + TX_BYTES],
+                   r.rate[NUM_RX_FIELDS + TX_PACKETS]);
+            print_derived(r, i, now);
+        }
+    }
+}
+
+void
+monitor::evaluate_alerts(interface_record *r, time_t now)
+{
+    if (alerts_.empty())
+        return;
+
+    alert_inputs in;
+    in.value = r->current.value;
+    in.delta = r->delta;
+    in.rate = r->rate;
+    in.link_speed = r->link_speed;
+
+    events_.clear();
+    alerts_.evaluate(in, &r->alerts[0], &events_);
+
+    for (size_t i = 0; i < events_.size(); ++i)
+    {
+        const alert_event &ev = events_[i];
+        ALWAYS("%lu : %s : alert '%s' %s -> %s (%g)\n",
+               (unsigned long)now, C(r->name),
+               C(alerts_.rule_name(ev.rule)),
+               alert_level_name(ev.from), alert_level_name(ev.to), ev.value);
+    }
+}
+
+void
+monitor::update_billing(interface_record *r, time_t now, double elapsed)
+{
+    // Bytes over this sweep rather than the rate: when an idle interface
+    // is read, its delta spans sweeps that were already billed at zero, so
+    // it all goes in this one or we'd lose it
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    const double rx = (double)r->delta[RX_BYTES] * per_second;
+    const double tx = (double)r->delta[NUM_RX_FIELDS + TX_BYTES] * per_second;
+
+    // 'add' is true for both at once since they see the same elapsed times
+    bool rx_closed = r->rx_billing.add(rx, elapsed);
+    bool tx_closed = r->tx_billing.add(tx, elapsed);
+    if (rx_closed || tx_closed)
+    {
+        ALWAYS("%lu : %s : 95th percentile over %lu buckets: "
+               "Rx %.0f bits/s Tx %.0f bits/s\n",
+               (unsigned long)now, C(r->name),
+               (unsigned long)r->rx_billing.buckets(),
+               r->rx_billing.percentile() * 8.0,
+               r->tx_billing.percentile() * 8.0);
+    }
+}
+
+/**
+    Sum each veth's rates into the namespace at its other end: what goes
+    out of the host side went into the container, and vice versa.  Peer
+    names are looked up again after each rebuild of the nsid map, which
+    is how a peer renamed inside its container gets noticed.
+*/
+
+void
+monitor::print_containers(time_t now)
+{
+    peers_->refresh();
+
+    std::map<int, container_traffic>::iterator c = containers_.begin();
+    for ( ; c != containers_.end(); ++c)
+    {
+        c->second.veths.clear();
+        c->second.rx_bytes = c->second.rx_packets = 0.0;
+        c->second.tx_bytes = c->second.tx_packets = 0.0;
+    }
+
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        interface_record *r = interfaces_[i];
+        if (r->peer_netnsid == -1)
+            continue;
+
+        if (r->peer_generation != peers_->generation())
+        {
+            if (!peers_->peer_name(r->peer_netnsid, r->peer_ifindex,
+                                   &r->peer_name))
+                r->peer_name = "?";
+            r->peer_generation = peers_->generation();
+        }
+
+        container_traffic &t = containers_[r->peer_netnsid];
+        if (!t.veths.empty())
+            t.veths += ", ";
+        t.veths += r->name + " -> " + r->peer_name;
+        t.rx_bytes += r->rate[NUM_RX_FIELDS + TX_BYTES];
+        t.rx_packets += r->rate[NUM_RX_FIELDS + TX_PACKETS];
+        t.tx_bytes += r->rate[RX_BYTES];
+        t.tx_packets += r->rate[RX_PACKETS];
+    }
+
+    c = containers_.begin();
+    while (c != containers_.end())
+    {
+        // nothing points there any more
+        if (c->second.veths.empty())
+        {
+            containers_.erase(c++);
+            continue;
+        }
+
+        const netns_info *ns = peers_->lookup(c->first);
+        ALWAYS("%lu : netns %s : Rx %.0f B/s %.0f pkt/s : Tx %.0f B/s "
+               "%.0f pkt/s : %s\n", (unsigned long)now,
+               ns ? C(ns->name) : "?", c->second.rx_bytes, c->second.rx_packets,
+               c->second.tx_bytes, c->second.tx_packets, C(c->second.veths));
+        ++c;
+    }
+}
+
+/**
+    Only edges are printed: going anomalous, and coming back to normal.
+*/
+
+void
+monitor::detect_anomalies(interface_record *r, time_t now)
+{
+    if (!anomaly_detection_)
+        return;
+
+    for (size_t i = 0; i < NUM_ERROR_COUNTERS; ++i)
+    {
+        ewma_baseline &b = r->error_baselines[i];
+        const size_t c = ERROR_COUNTERS[i];
+        const double before_mean = b.mean;
+        const double before_stddev = std::sqrt(b.variance);
+
+        double z;
+        if (!anomalies_.update(&b, r->rate[c], &z))
+            continue;
+
+        ALWAYS("%lu : %s : %s %s: %.2f/s against baseline %.2f +/- %.2f/s "
+               "(z %.1f)\n",
+               (unsigned long)now, C(r->name),
+               counter_name(c), b.anomalous ? "anomalous" : "back to normal",
+               r->rate[c], before_mean, before_stddev, z);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Deal with whatever link events have arrived.  Call when event_fd() is
+    readable.
+*/
+
+void
+monitor::handle_events(void)
+{
+    link_events_.clear();
+    links_.read_events(&link_events_);
+
+    for (size_t e = 0; e < link_events_.size(); ++e)
+        handle_link_event(link_events_[e]);
+
+    if (links_.overrun())
+        resync();
+}
+
+//* Capture sockets for the owner to poll alongside event_fd(): none if threaded.
+void
+monitor::capture_fds(std::vector<int> *fds) const
+{
+    fds->clear();
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        if (interfaces_[i]->capture)
+            interfaces_[i]->capture->fds(fds);
+    }
+}
+
+/**
+    Empty every capture ring of the blocks the kernel has finished with.
+    Call when any capture fd is readable; those with nothing ready cost a
+    load each.
+*/
+
+void
+monitor::drain_captures(void)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        if (interfaces_[i]->capture)
+            interfaces_[i]->capture->drain();
+    }
+}
+
+/**
+    Host-wide protocol counters: rates for those that moved, a line per
+    section ("Tcp", "TcpExt" ...).  Gauges (Tcp.CurrEstab ...) are
+    printed as their value, when it changes.
+*/
+
+void
+monitor::read_protocols(time_t now, double elapsed)
+{
+    proto_->update();
+
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    std::string family;
+    std::string line;
+    for (size_t i = 0; i <= proto_->size(); ++i)
+    {
+        // the section is the part of the name before the '.'
+        std::string next_family;
+        if (i < proto_->size())
+            next_family = proto_->name(i).substr(0, proto_->name(i).find('.'));
+
+        if ((next_family != family) && !line.empty())
+        {
+            ALWAYS("%lu : %s : %s\n", (unsigned long)now, C(family), C(line));
+            line.clear();
+        }
+        family = next_family;
+        if (i == proto_->size())
+            break;
+
+        char buf[96];
+        const std::string field(proto_->name(i).substr(family.size() + 1));
+        if (proto_->gauge(i))
+        {
+            if (!proto_->changed(i))
+                continue;
+            std::snprintf(buf, sizeof(buf), "%s%s %llu",
+                          line.empty() ? "" : ", ", C(field),
+                          (unsigned long long)proto_->value(i));
+        } else
+        {
+            const uint64_t d = proto_->delta(i);
+            if (!d)
+                continue;
+            std::snprintf(buf, sizeof(buf), "%s%s %.0f/s",
+                          line.empty() ? "" : ", ", C(field),
+                          (double)d * per_second);
+        }
+        line += buf;
+    }
+}
+
+/**
+    Per-CPU receive backlog: a line for each CPU that dropped or squeezed
+    this sweep, or (with more than one CPU) did more than twice its share
+    of the host's receive work.  Each interface's rx packet rate is
+    correlated with every CPU's, so the line can say which interface is
+    most likely landing on it.  Idle interfaces aren't read every sweep,
+    so they sit out.
+*/
+
+void
+monitor::read_softnet(time_t now, double elapsed)
+{
+    softnet_->update();
+
+    const size_t cpus = softnet_->size();
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+
+    uint64_t total = 0;
+    for (size_t c = 0; c < cpus; ++c)
+        total += softnet_->cpu(c).delta[SOFTNET_PROCESSED];
+
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        interface_record *r = interfaces_[i];
+        if (r->idle)
+            continue;
+
+        // a CPU went offline or came back: start over
+        if (r->cpu_correlation.size() != cpus)
+            r->cpu_correlation.assign(cpus, rate_correlation());
+        for (size_t c = 0; c < cpus; ++c)
+        {
+            const double processed =
+                (double)softnet_->cpu(c).delta[SOFTNET_PROCESSED] * per_second;
+            r->cpu_correlation[c].update(r->rate[RX_PACKETS], processed,
+                                         SOFTNET_CORRELATION_ALPHA);
+        }
+    }
+
+    for (size_t c = 0; c < cpus; ++c)
+    {
+        const softnet_cpu &cpu = softnet_->cpu(c);
+        const double share = total ? (double)cpu.delta[SOFTNET_PROCESSED]
+            / (double)total : 0.0;
+        const bool hot = (cpus > 1) && (share * (double)cpus > 2.0);
+        if (!cpu.delta[SOFTNET_DROPPED] && !cpu.delta[SOFTNET_TIME_SQUEEZE]
+            && !hot)
+            continue;
+
+        // the interface whose rx rate tracks this CPU's the closest
+        const interface_record *best = 0;
+        double best_r = SOFTNET_MIN_CORRELATION;
+        for (size_t i = 0; i < interfaces_.size(); ++i)
+        {
+            const interface_record *r = interfaces_[i];
+            if ((r->cpu_correlation.size() != cpus)
+                || (r->cpu_correlation[c].samples < SOFTNET_MIN_SAMPLES))
+                continue;
+            const double v = r->cpu_correlation[c].value();
+            if (v > best_r)     // false for NaN
+            {
+                best = r;
+                best_r = v;
+            }
+        }
+
+        char tracks[64] = "";
+        if (best)
+            std::snprintf(tracks, sizeof(tracks), " : tracks %s (r=%.2f)",
+                          C(best->name), best_r);
+
+        ALWAYS("%lu : cpu%d : processed %.0f/s (%.0f%%) dropped %.0f/s "
+               "squeezed %.0f/s rps %.0f/s flow limited %.0f/s%s\n",
+               (unsigned long)now, cpu.cpu,
+               (double)cpu.delta[SOFTNET_PROCESSED] * per_second, share * 100.0,
+               (double)cpu.delta[SOFTNET_DROPPED] * per_second,
+               (double)cpu.delta[SOFTNET_TIME_SQUEEZE] * per_second,
+               (double)cpu.delta[SOFTNET_RECEIVED_RPS] * per_second,
+               (double)cpu.delta[SOFTNET_FLOW_LIMIT] * per_second, tracks);
+    }
+}
+
+/**
+    The IRQ map goes by interface name, so it's rebuilt whenever the
+    interfaces have changed; irq_stats notices for itself when the IRQs do.
+*/
+
+void
+monitor::read_irqs(void)
+{
+    if (irqs_remap_)
+    {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < interfaces_.size(); ++i)
+            names.push_back(interfaces_[i]->name);
+        irqs_->map_interfaces(names);
+        irqs_remap_ = false;
+        return;
+    }
+    irqs_->update();
+}
+
+/**
+    A line per interface with IRQs that fired: each queue's rate on every
+    CPU it fired on.  With more than one CPU, an interface whose interrupts
+    mostly land on one CPU is called out, since that CPU is doing all of
+    its receive work too.
+*/
+
+void
+monitor::print_irqs(const interface_record &r, time_t now, double elapsed) const
+{
+    const std::vector<size_t> *queues =
+        irqs_->queues_for(r.name);
+    if (!queues)
+        return;
+
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    const size_t cpus = irqs_->cpus();
+    std::vector<uint64_t> by_cpu(cpus, 0);
+    uint64_t total = 0;
+
+    std::string line;
+    for (size_t q = 0; q < queues->size(); ++q)
+    {
+        const irq_queue &iq = irqs_->queue((*queues)[q]);
+        for (size_t c = 0; c < cpus; ++c)
+        {
+            if (!iq.delta[c])
+                continue;
+            by_cpu[c] += iq.delta[c];
+            total += iq.delta[c];
+
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%s%s cpu%d %.0f/s",
+                          line.empty() ? "" : ", ", C(iq.queue), irqs_->cpu(c),
+                          (double)iq.delta[c] * per_second);
+            line += buf;
+        }
+    }
+    if (line.empty())
+        return;
+
+    size_t busiest = 0;
+    for (size_t c = 1; c < cpus; ++c)
+    {
+        if (by_cpu[c] > by_cpu[busiest])
+            busiest = c;
+    }
+    const double share = (double)by_cpu[busiest] / (double)total;
+
+    char imbalance[64] = "";
+    if ((cpus > 1) && (share * (double)cpus > 2.0))
+        std::snprintf(imbalance, sizeof(imbalance), " : imbalanced, cpu%d "
+                      "takes %.0f%%", irqs_->cpu(busiest), share * 100.0);
+
+    ALWAYS("%lu : %s : irqs : %s%s\n", (unsigned long)now,
+           C(r.name), C(line), imbalance);
+}
+
+/**
+    A line per port or cgroup whose sockets moved any bytes, retransmitted
+    or dropped this sweep, and a total.
+*/
+
+void
+monitor::print_sockets(time_t now, double elapsed)
+{
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+
+    sock_aggregate total;
+    std::memset(&total, 0, sizeof(total));
+
+    const sock_stats::aggregate_map &a = sockets_->aggregates();
+    sock_stats::aggregate_map::const_iterator i = a.begin();
+    for ( ; i != a.end(); ++i)
+    {
+        const sock_aggregate &g = i->second;
+        total.bytes_acked += g.bytes_acked;
+        total.bytes_received += g.bytes_received;
+        total.retransmits += g.retransmits;
+        total.drops += g.drops;
+        if (!g.bytes_acked && !g.bytes_received && !g.retransmits && !g.drops)
+            continue;
+
+        char rtt[48] = "";
+        if (g.rtt_count)
+            std::snprintf(rtt, sizeof(rtt), " : rtt %.0f us (max %u us)",
+                          (double)g.rtt_sum / (double)g.rtt_count, g.rtt_max);
+
+        ALWAYS("%lu : %s : %lu sockets : acked %.0f B/s received %.0f B/s : "
+               "retrans %.0f/s drops %.0f/s%s\n", (unsigned long)now,
+               C(sockets_->name(g)), (unsigned long)g.sockets,
+               (double)g.bytes_acked * per_second,
+               (double)g.bytes_received * per_second,
+               (double)g.retransmits * per_second, (double)g.drops * per_second,
+               rtt);
+    }
+
+    ALWAYS("%lu : sockets : %lu in %lu groups : acked %.0f B/s received "
+           "%.0f B/s : retrans %.0f/s drops %.0f/s\n", (unsigned long)now,
+           (unsigned long)sockets_->sockets(), (unsigned long)a.size(),
+           (double)total.bytes_acked * per_second,
+           (double)total.bytes_received * per_second,
+           (double)total.retransmits * per_second,
+           (double)total.drops * per_second);
+}
+
+/**
+    A line per qdisc or class on the interface that did anything this
+    sweep, or has something queued.
+*/
+
+void
+monitor::print_qdiscs(const interface_record &r, time_t now, double elapsed) const
+{
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    const char *name = C(r.name);
+
+    qdisc_stats::const_iterator i = qdiscs_->begin(r.ifindex);
+    for ( ; (i != qdiscs_->end()) && (i->first.ifindex == r.ifindex); ++i)
+    {
+        const qdisc_entry &e = i->second;
+        bool moved = (e.qlen != 0);
+        for (size_t c = 0; c < NUM_QDISC_COUNTERS; ++c)
+            moved = moved || e.delta[c];
+        if (!moved)
+            continue;
+
+        ALWAYS("%lu : %s : %s %s %s parent %s : %.0f B/s %.0f pkt/s : drops "
+               "%.0f/s overlimits %.0f/s requeues %.0f/s : backlog %u B %u pkt\n",
+               (unsigned long)now, name, e.is_class ? "class" : "qdisc",
+               C(e.kind), C(tc_handle_name(i->first.handle)),
+               C(tc_handle_name(i->first.parent)),
+               (double)e.delta[QDISC_BYTES] * per_second,
+               (double)e.delta[QDISC_PACKETS] * per_second,
+               (double)e.delta[QDISC_DROPS] * per_second,
+               (double)e.delta[QDISC_OVERLIMITS] * per_second,
+               (double)e.delta[QDISC_REQUEUES] * per_second, e.backlog, e.qlen);
+    }
+}
+
+/**
+    Between sweeps, as often as the owner likes: a look at every queue's
+    inflight bytes.  Down and idle interfaces have nothing in flight.
+*/
+
+void
+monitor::sample_queues(void)
+{
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        interface_record *r = interfaces_[i];
+        if (!r->bql || r->idle || r->state.down())
+            continue;
+
+        try
+        {
+            r->bql->sample();
+        } catch (std::exception &e)
+        {
+            // gone: the link event will be along
+            CPRINT("%s: queue sample failed: giving up on it\n",
+                   C(r->name));
+            delete r->bql;
+            r->bql = 0;
+        }
+    }
+}
+
+/**
+    Read everything, then push it down the pipeline.  'elapsed' is the
+    number of seconds since the last sweep.
+*/
+
+void
+monitor::sweep(time_t now, double elapsed)
+{
+    for (size_t m = 0; m < NUM_TOP_METRICS; ++m)
+        top_[m].clear();
+
+    if (replay_)
+        follow_replay();
+    start_collector_sweep();
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+        read_interface(interfaces_[i], elapsed);
+    remove_gone();
+    if (recorder_)
+        record_sweep(now, elapsed);
+
+    if (proto_)
+        read_protocols(now, elapsed);
+    if (softnet_)
+        read_softnet(now, elapsed);
+    if (irqs_)
+        read_irqs();
+    if (qdiscs_)
+        qdiscs_->sweep();
+    if (sockets_)
+        sockets_->sweep();
+
+    if (top_count_)
+    {
+        for (size_t i = 0; i < interfaces_.size(); ++i)
+            offer_top(i);
+    }
+
+    compute_derived();
+    if (top_count_)
+        print_top(now);
+    if (peers_)
+        print_containers(now);
+    if (sockets_)
+        print_sockets(now, elapsed);
+
+    for (size_t i = 0; i < interfaces_.size(); ++i)
+    {
+        interface_record *r = interfaces_[i];
+        if (r->capture)
+            r->capture->collect(&flow_tally_);
+
+        // with --top, the details are only for the interfaces it showed
+        if (!top_count_)
+            print(*r, i, now);
+        if (!top_count_ || r->shown)
+        {
+            if (r->capture && packet_mix_)
+                print_mix(*r, now);
+            if (r->capture && flows_)
+                print_flows(*r, now, elapsed);
+            print_ethtool(*r, now);
+            if (irqs_)
+                print_irqs(*r, now, elapsed);
+            if (qdiscs_)
+                print_qdiscs(*r, now, elapsed);
+        }
+        r->shown = false;
+
+        // flapping is rare and worth hearing about, --top or not
+        print_flaps(r, now);
+        print_bql(r, now);
+        evaluate_alerts(r, now);
+        detect_anomalies(r, now);
+        update_billing(r, now, elapsed);
+    }
+}
+
+#undef ALWAYS
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
@@ -0,0 +1,287 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include <time.h>
+
+#include "network_stats.h"
+#include "percentile_window.h"
+#include "alert_rules.h"
+#include "error_anomaly.h"
+#include "derived_metrics.h"
+#include "top_k.h"
+#include "link_events.h"
+#include "link_state.h"
+#include "fd_pool.h"
+#include "veth_peers.h"
+#include "ethtool_counters.h"
+#include "bql_stats.h"
+#include "proto_stats.h"
+#include "softnet_stats.h"
+#include "irq_stats.h"
+#include "qdisc_stats.h"
+#include "sock_stats.h"
+#include "capture_group.h"
+#include "counter_recording.h"
+
+struct monitor_options
+{
+    std::vector<std::string> interfaces;
+    bool all_interfaces;            // ignore 'interfaces': watch everything
+    std::string rules_file;
+
+    bool anomaly_detection;         // watch the error counters' baselines
+    double anomaly_threshold;       // z-score
+
+    size_t top;                     // 0: print everything; else top N only
+
+    double flap_window;             // seconds to count carrier flaps over
+
+    collector_kind collector;       // where the counters come from
+    size_t fd_budget;               // for the pooled collector; 0: half RLIMIT_NOFILE
+
+    double idle_after;              // seconds unchanged before demotion; 0: never
+    double idle_interval;           // seconds between samples once idle
+
+    bool containers;                // attribute veth traffic to namespaces
+    bool ethtool;                   // driver (and per-queue) counters too
+    bool queues;                    // byte queue limits, per tx queue
+    bool protocols;                 // /proc/net/snmp and netstat counters
+    bool softnet;                   // per-CPU backlog drops and squeezes
+    bool irqs;                      // per-queue, per-CPU interrupt rates
+    bool tc;                        // qdisc and class counters
+    bool sockets;                   // sock_diag: TCP and UDP sockets, rolled up ...
+    sock_grouping socket_grouping;  // ... by this
+    size_t flows;                   // capture packets, print the top N flows; 0: don't
+    size_t capture_threads;         // 0: capture on the main loop's thread
+    fanout_mode fanout;             // how to spread packets over the threads
+    bool packet_mix;                // capture for size and protocol histograms
+    unsigned sample;                // capture 1 in this many packets
+
+    std::string record_file;        // every sweep's counters, for replaying
+    counter_replay *replay;         // play these back instead of reading:
+                                    // not ours, and nothing else is read
+
+    monitor_options(void);
+};
+
+/**
+    Everything that happens to the counters after network_stats reads them:
+    deltas and rates, derived metrics, burstable billing percentiles, alert
+    rules, error anomaly detection and printing.  One network_stats per monitored
+    interface.
+
+    Interfaces come and go with link events: the owner polls event_fd()
+    alongside its sampling timer, calls handle_events() when it's readable
+    and sweep() every sampling interval.  When capturing, it polls
+    capture_fds() too, and calls drain_captures() when any is readable.
+
+    Given a record_file, every sweep's counters are written to it.  Given a
+    replay, there are no network_stats: the owner calls its next() and then
+    sweep() with its time, and the interfaces and their counters are
+    whatever was recorded, as fast as the owner likes.
+*/
+
+class monitor
+{
+private:
+    enum top_metric
+    {
+        TOP_RX_RATE,
+        TOP_TX_RATE,
+        TOP_DROPS,
+        TOP_ERRORS,
+        NUM_TOP_METRICS
+    };
+
+    struct interface_record
+    {
+        std::string name;
+        network_stats *stats;           // null when replaying
+        ethtool_counters *ethtool;      // null if not asked for, or none
+        bql_stats *bql;                 // likewise
+        capture_group *capture;         // likewise
+        int ifindex;
+        bool gone;                      // a read failed: drop after sweep
+
+        bool idle;                      // demoted: sampled every idle_interval_
+        double quiet_for;               // seconds since a counter last moved
+        double unsampled;               // while idle: seconds since last read
+        double covered;                 // seconds this sweep's deltas span
+        bool fresh;                     // read this sweep: not down or idle
+        bool shown;                     // in this sweep's --top lists
+
+        bool recorded;                  // its baseline's gone to recorder_
+        const recorded_sample *sample;  // replaying: this sweep's, if any
+
+        counter_table previous;
+        counter_table current;
+        uint64_t delta[NUM_COUNTERS];
+        double rate[NUM_COUNTERS];      // per second
+
+        link_state state;               // from link events
+
+        // veths: where the other end is, from link events; the peer's
+        // name is looked up when first needed, again after it changes,
+        // and again whenever peers_ rebuilds its nsid map
+        std::string kind;
+        int peer_ifindex;
+        int peer_netnsid;               // -1: same namespace, or not a veth
+        uint64_t peer_generation;       // peers_'s, at the lookup; 0: none
+        std::string peer_name;
+        link_info link;                 // refreshed when the link changes
+        double link_speed;              // bytes/s, NaN if unknown
+
+        burstable_rate rx_billing;
+        burstable_rate tx_billing;
+
+        // rx packet rate against each CPU's softirq packet rate, by
+        // position in softnet_stats: which CPUs this interface lands on
+        std::vector<rate_correlation> cpu_correlation;
+
+        std::vector<alert_state> alerts;
+        ewma_baseline error_baselines[NUM_ERROR_COUNTERS];
+
+        interface_record(const std::string &n, network_stats *s, int index,
+                         size_t rules);
+    };
+
+    std::vector<interface_record *> interfaces_;
+
+    // which interfaces to pick up as they appear, and what to read from them
+    bool all_interfaces_;
+    std::set<std::string> wanted_;
+    std::set<rx_fields> rx_fields_;
+    std::set<tx_fields> tx_fields_;
+    collector_kind collector_;
+    fd_pool *pool_;                 // for COLLECTOR_SYSFS_POOLED, else null
+    double idle_after_;
+    double idle_interval_;
+
+    counter_recorder *recorder_;        // null unless recording
+    counter_replay *replay_;            // null unless replaying: not ours
+
+    // replaying: interfaces_ by recorded ifindex, or by name where that's
+    // -1 (a recording from a --netns run, say)
+    std::map<int, interface_record *> replayed_;
+    std::map<std::string, interface_record *> replayed_by_name_;
+
+    // for attributing veth traffic to the namespace at the other end
+    struct container_traffic
+    {
+        std::string veths;              // "host veth -> peer", ...
+        double rx_bytes;                // as the container sees it
+        double rx_packets;
+        double tx_bytes;
+        double tx_packets;
+    };
+
+    veth_peers *peers_;                 // null unless asked to
+    int ethtool_socket_;                // -1 unless asked for ethtool stats
+    bool queues_wanted_;
+    proto_stats *proto_;                // null unless asked for
+    softnet_stats *softnet_;            // likewise
+    irq_stats *irqs_;                   // likewise
+    bool irqs_remap_;                   // interfaces changed since the last map
+    qdisc_stats *qdiscs_;               // null unless asked for
+    sock_stats *sockets_;               // likewise
+    size_t flows_;                      // top flows to print; 0: no capture
+    size_t capture_threads_;
+    fanout_mode fanout_;
+    bool packet_mix_;
+    unsigned sample_;
+    std::map<int, container_traffic> containers_;   // by nsid, every sweep
+
+    link_events links_;
+    double flap_window_;
+
+    alert_engine alerts_;
+    bool anomaly_detection_;
+    anomaly_detector anomalies_;
+
+    // one slot per entry in interfaces_
+    derived_metrics derived_;
+
+    // busiest interfaces this sweep, by index into interfaces_
+    size_t top_count_;
+    top_k<size_t> top_[NUM_TOP_METRICS];
+
+    // scratch, reused every sweep so we don't allocate in the loop
+    std::vector<alert_event> events_;
+    std::vector<top_k<size_t>::entry> top_entries_;
+    std::vector<link_event> link_events_;
+    flow_tally flow_tally_;             // this sweep's, for one interface
+    std::vector<flow_counters::counter> flow_entries_;
+
+private:
+
+    bool wanted(const std::string &name) const;
+    network_stats *open_interface(const std::string &name);
+    size_t find_interface(int ifindex) const;
+    interface_record *add_interface(const std::string &name);
+    void remove_interface(size_t i);
+    void rename_interface(size_t i, const std::string &name);
+    void handle_link_event(const link_event &ev);
+    void update_link_state(interface_record *r, const link_event &ev);
+    void resync(void);
+    void remove_gone(void);
+
+    interface_record *find_replayed(const recorded_sample &s) const;
+    void remove_replayed(size_t i);
+    interface_record *add_replayed(const recorded_sample &s);
+    void follow_replay(void);
+    void record_sweep(time_t now, double elapsed);
+
+    void read_interface(interface_record *r, double elapsed);
+    void refresh_link(interface_record *r);
+    void set_link(interface_record *r, const link_info &link);
+    void compute_rates(interface_record *r, double elapsed);
+    void update_idle(interface_record *r);
+    void promote(interface_record *r, const char *why);
+    void compute_derived(void);
+    void offer_top(size_t i);
+    void print(const interface_record &r, size_t i, time_t now) const;
+    void print_derived(const interface_record &r, size_t i, time_t now) const;
+    void print_flaps(interface_record *r, time_t now);
+    void open_ethtool(interface_record *r);
+    void print_ethtool(const interface_record &r, time_t now) const;
+    void open_bql(interface_record *r);
+    void print_bql(interface_record *r, time_t now);
+    void open_capture(interface_record *r);
+    void print_flows(const interface_record &r, time_t now, double elapsed);
+    void print_mix(const interface_record &r, time_t now) const;
+    void read_protocols(time_t now, double elapsed);
+    void read_softnet(time_t now, double elapsed);
+    void read_irqs(void);
+    void print_irqs(const interface_record &r, time_t now, double elapsed) const;
+    void print_qdiscs(const interface_record &r, time_t now, double elapsed) const;
+    void print_top(time_t now);
+    void update_peer(interface_record *r, const link_event &ev);
+    void print_containers(time_t now);
+    void print_sockets(time_t now, double elapsed);
+    void evaluate_alerts(interface_record *r, time_t now);
+    void update_billing(interface_record *r, time_t now, double elapsed);
+    void detect_anomalies(interface_record *r, time_t now);
+
+    // uncopyable: owns network_stats, which are themselves uncopyable
+    monitor(const monitor &m);
+    monitor &operator =(const monitor &m);
+
+public:
+
+    monitor(const monitor_options &options);
+    ~monitor(void);
+
+    int event_fd(void) const { return links_.fd(); }
+    void handle_events(void);
+    void capture_fds(std::vector<int> *fds) const;
+    void drain_captures(void);
+    void sample_queues(void);
+    void sweep(time_t now, double elapsed);
+};
+
+#endif  // MONITOR_H
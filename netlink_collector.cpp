@@ -0,0 +1,318 @@
+#include "netlink_collector.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <net/if.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("netlink_collector");
+
+    enum
+    {
+        // one message with one attribute: a few hundred bytes
+        RECV_BUFFER_SIZE = 4 * 1024,
+
+        // a reply should be immediate, but never wait forever
+        RECV_TIMEOUT_SECONDS = 1
+    };
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    int
+    open_socket(void)
+    {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd == -1)
+            ERROR("Opening rtnetlink socket");
+        ++collector_syscalls.opens;
+
+        struct timeval timeout;
+        timeout.tv_sec = RECV_TIMEOUT_SECONDS;
+        timeout.tv_usec = 0;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+            REPORT("Setting receive timeout on fd %d", fd);
+        return fd;
+    }
+
+    /**
+        The rtnetlink socket every netlink_collector asks on, open while
+        any of them is retained, and the sequence numbers they share: an
+        answer that turns up after its asker gave up is one nobody's
+        waiting for, and is skipped.
+    */
+
+    class rtnl_socket
+    {
+    private:
+        int fd_;                        // -1 while nobody's retained
+        size_t retained_;               // collectors holding fd_ open
+        uint32_t sequence_;             // the last one handed out
+
+        // uncopyable: owns fd_
+        rtnl_socket(const rtnl_socket &s);
+        rtnl_socket &operator =(const rtnl_socket &s);
+
+    public:
+
+        rtnl_socket(void): fd_(-1), retained_(0), sequence_(0) {}
+        ~rtnl_socket(void)
+        {
+            if (fd_ != -1)
+                close(fd_);
+        }
+
+        int fd(void) const { return fd_; }
+        uint32_t next_sequence(void) { return ++sequence_; }
+
+        void retain(void)
+        {
+            if ((retained_++ == 0) && (fd_ == -1))
+                fd_ = open_socket();
+        }
+
+        void release(void)
+        {
+            if ((retained_ == 0) || (--retained_ != 0) || (fd_ == -1))
+                return;
+            if (close(fd_))
+                REPORT("Closing rtnetlink socket %d", fd_);
+            ++collector_syscalls.closes;
+            fd_ = -1;
+        }
+    };
+
+    //* The one everybody shares.
+    rtnl_socket &
+    shared_socket(void)
+    {
+        static rtnl_socket s;
+        return s;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+netlink_collector::netlink_collector(const collector_target &target):
+    interface_(target.interface),
+    ifindex_(0),
+    retained_(false),
+    sequence_(0),
+    counters_(),
+    latest_()
+{
+    ifindex_ = (int)if_nametoindex(C(interface_));
+    if (ifindex_ == 0)
+        ERROR("No ifindex for '%s'", C(interface_));
+    retain();
+}
+
+netlink_collector::~netlink_collector(void)
+{
+    release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Ask, and read the answer into latest_.
+*/
+
+void
+netlink_collector::request(void)
+{
+    struct
+    {
+        struct nlmsghdr header;
+        struct if_stats_msg body;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body));
+    request.header.nlmsg_type = RTM_GETSTATS;
+    request.header.nlmsg_flags = NLM_F_REQUEST;
+    sequence_ = shared_socket().next_sequence();
+    request.header.nlmsg_seq = sequence_;
+    request.body.family = AF_UNSPEC;
+    request.body.ifindex = (uint32_t)ifindex_;
+    request.body.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+    const int shared = shared_socket().fd();
+    const int fd = (shared != -1) ? shared : open_socket();
+    bool answered = false;
+    try
+    {
+        ssize_t sent;
+        do
+            sent = send(fd, &request, request.header.nlmsg_len, 0);
+        while ((sent == -1) && (errno == EINTR));
+        ++collector_syscalls.reads;
+        if (sent == -1)
+            ERROR("Asking for stats of '%s' on fd %d", C(interface_), fd);
+
+        answered = read_reply(fd);
+    } catch (...)
+    {
+        if (fd != shared)
+            close(fd);
+        throw;
+    }
+
+    if (fd != shared)
+    {
+        close(fd);
+        ++collector_syscalls.closes;
+    }
+    if (!answered)
+        RUNTIME("No stats for '%s' from rtnetlink", C(interface_));
+}
+
+/**
+    True once our RTM_NEWSTATS is in latest_.  Anything with an older
+    sequence number (a reply we gave up on) is skipped.
+*/
+
+bool
+netlink_collector::read_reply(int fd)
+{
+    // netlink messages want 4 byte alignment
+    uint32_t buffer[RECV_BUFFER_SIZE / sizeof(uint32_t)];
+
+    for (;;)
+    {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        ++collector_syscalls.reads;
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                CPRINT("%s: stats request timed out\n", C(interface_));
+                return false;
+            }
+            ERROR("Reading stats of '%s' from fd %d", C(interface_), fd);
+        }
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            if (h->nlmsg_seq != sequence_)
+                continue;
+
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(h);
+                RUNTIME("Stats of '%s': %s", C(interface_), strerror(-e->error));
+            }
+
+            if (h->nlmsg_type != RTM_NEWSTATS)
+                continue;
+
+            const struct if_stats_msg *ifsm =
+                (const struct if_stats_msg *)NLMSG_DATA(h);
+            int attr_len = (int)h->nlmsg_len
+                - (int)NLMSG_LENGTH(sizeof(struct if_stats_msg));
+            struct rtattr *a = (struct rtattr *)((char *)ifsm
+                                    + NLMSG_ALIGN(sizeof(struct if_stats_msg)));
+            for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+            {
+                if (a->rta_type != IFLA_STATS_LINK_64)
+                    continue;
+
+                // attributes are only 4 byte aligned
+                struct rtnl_link_stats64 stats;
+                memset(&stats, 0, sizeof(stats));
+                memcpy(&stats, RTA_DATA(a),
+                       std::min((size_t)RTA_PAYLOAD(a), sizeof(stats)));
+                stats64_to_counters(stats, &latest_);
+                return true;
+            }
+            return false;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+netlink_collector::add(size_t counter)
+{
+    if (!provides(counter))
+        RUNTIME("For '%s': no such counter", counter_name(counter));
+
+    const bool first = counters_.empty();
+    std::vector<size_t>::iterator i = counters_.begin();
+    while ((i != counters_.end()) && (*i < counter))
+        ++i;
+    if ((i == counters_.end()) || (*i != counter))
+        counters_.insert(i, counter);
+
+    // so an interface the kernel won't tell us about shows up now
+    if (first)
+        request();
+}
+
+void
+netlink_collector::collect(size_t first, size_t last, counter_table *values)
+{
+    request();
+
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        const size_t c = counters_[i];
+        if (c >= last)
+            break;
+        if (c >= first)
+            values->value[c] = latest_.value[c];
+    }
+}
+
+void
+netlink_collector::release(void)
+{
+    if (!retained_)
+        return;
+    shared_socket().release();
+    retained_ = false;
+}
+
+void
+netlink_collector::retain(void)
+{
+    if (retained_)
+        return;
+    shared_socket().retain();
+    retained_ = true;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,55 @@
+#ifndef NETLINK_COLLECTOR_H
+#define NETLINK_COLLECTOR_H
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collector.h"
+
+/**
+    COLLECTOR_NETLINK: RTM_GETSTATS for the interface's ifindex, asking
+    for IFLA_STATS_LINK_64 and nothing else.  One request per interface a
+    sweep, a send and a receive, answered with all of its counters in
+    binary.  Every netlink_collector shares one rtnetlink socket, held
+    open while any of them is retained, so however many interfaces
+    there are it's one fd; while none is, a socket is made and closed
+    around each request.
+
+    The ifindex is looked up once: like the sysfs collectors' paths, a
+    renamed or recreated interface wants a new collector.
+*/
+
+class netlink_collector
+{
+private:
+    std::string interface_;
+    int ifindex_;
+    bool retained_;
+    uint32_t sequence_;         // of the request we want the answer to
+    std::vector<size_t> counters_;      // in index order
+    counter_table latest_;
+
+    void request(void);
+    bool read_reply(int fd);
+
+    // uncopyable: holds the shared socket open
+    netlink_collector(const netlink_collector &c);
+    netlink_collector &operator =(const netlink_collector &c);
+
+public:
+
+    explicit netlink_collector(const collector_target &target);
+    ~netlink_collector(void);
+
+    bool provides(size_t counter) const { return counter < NUM_COUNTERS; }
+    void add(size_t counter);
+    void collect(size_t first, size_t last, counter_table *values);
+    void release(void);
+    void retain(void);
+    const char *name(void) const { return collector_kind_name(COLLECTOR_NETLINK); }
+};
+
+#endif  // NETLINK_COLLECTOR_H
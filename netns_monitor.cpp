@@ -0,0 +1,137 @@
+#include "netns_monitor.h"
+
+#include <time.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("netns_monitor");
+
+    double
+    monotonic_ms(void)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+    }
+}
+
+#define ALWAYS(fmt, args...) ALWAYS_WITH_NAME(NAME, fmt, ##args)
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+netns_monitor::netns_monitor(double rescan_interval):
+    stats_(),
+    records_(),
+    samples_(),
+    rescan_interval_(rescan_interval),
+    since_rescan_(0.0)
+{
+    stats_.rescan();
+    CPRINT("Watching %lu network namespaces\n", (unsigned long)stats_.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+void
+netns_monitor::print(const key &k, const record &r, time_t now,
+                     double elapsed) const
+{
+    const double per_second = (elapsed > 0.0) ? 1.0 / elapsed : 0.0;
+    double rate[NUM_COUNTERS];
+    bool moved = false;
+    for (size_t i = 0; i < NUM_COUNTERS; ++i)
+    {
+        const uint64_t now_value = r.current.value[i];
+        const uint64_t then = r.previous.value[i];
+        const uint64_t delta = (now_value >= then) ? now_value - then : 0;
+        rate[i] = (double)delta * per_second;
+        moved = moved || delta;
+    }
+
+    if (!moved)
+        return;
+
+    ALWAYS("%lu : %s : %s : Rx %.0f B/s %.0f pkt/s drop %.0f/s err %.0f/s"
+           " : Tx %.0f B/s %.0f pkt/s drop %.0f/s err %.0f/s\n",
+           (unsigned long)now, C(stats_.namespace_name(k.first)), C(r.name),
+           rate[counter_index(RX_BYTES)], rate[counter_index(RX_PACKETS)],
+           rate[counter_index(RX_DROPPED)], rate[counter_index(RX_ERRORS)],
+           rate[counter_index(TX_BYTES)], rate[counter_index(TX_PACKETS)],
+           rate[counter_index(TX_DROPPED)], rate[counter_index(TX_ERRORS)]);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Rescan for namespaces if it's time, dump every namespace's links, and
+    print what moved.  An interface's first sample only sets its baseline;
+    interfaces missing from the dump (deleted, or their namespace went
+    away) are forgotten.
+*/
+
+void
+netns_monitor::sweep(time_t now, double elapsed)
+{
+    since_rescan_ += elapsed;
+    if (since_rescan_ >= rescan_interval_)
+    {
+        stats_.rescan();
+        since_rescan_ = 0.0;
+    }
+
+    const double start = monotonic_ms();
+    stats_.sweep(&samples_);
+    const double dumped = monotonic_ms();
+
+    std::map<key, record>::iterator r = records_.begin();
+    for ( ; r != records_.end(); ++r)
+        r->second.seen = false;
+
+    for (size_t i = 0; i < samples_.size(); ++i)
+    {
+        const netns_sample &s = samples_[i];
+        const key k(s.netns, s.ifindex);
+
+        r = records_.find(k);
+        if (r == records_.end())
+        {
+            record &fresh = records_[k];
+            fresh.name = s.name;
+            fresh.seen = true;
+            fresh.previous = fresh.current = s.counters;
+            continue;
+        }
+
+        r->second.name = s.name;        // may have been renamed
+        r->second.seen = true;
+        r->second.previous = r->second.current;
+        r->second.current = s.counters;
+        print(k, r->second, now, elapsed);
+    }
+
+    r = records_.begin();
+    while (r != records_.end())
+    {
+        if (r->second.seen)
+            ++r;
+        else
+            records_.erase(r++);
+    }
+
+    ALWAYS("%lu : %lu namespaces, %lu interfaces : dump %.3f ms\n",
+           (unsigned long)now, (unsigned long)stats_.size(),
+           (unsigned long)records_.size(), dumped - start);
+}
+
+#undef ALWAYS
+#undef CPRINT
@@ -0,0 +1,58 @@
+#ifndef NETNS_MONITOR_H
+#define NETNS_MONITOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include <time.h>
+#include <stdint.h>
+
+#include "network_stats.h"
+#include "netns_stats.h"
+
+/**
+    Rates for every interface in every network namespace, from netns_stats'
+    netlink dumps.  Interfaces are keyed by (namespace inode, ifindex):
+    names and ifindexes are only unique within a namespace.
+
+    With hundreds of namespaces most interfaces are idle at any moment, so
+    only those whose counters moved are printed, plus a one line summary
+    per sweep.
+*/
+
+class netns_monitor
+{
+private:
+    typedef std::pair<uint64_t, int> key;      // (netns inode, ifindex)
+
+    struct record
+    {
+        std::string name;
+        bool seen;                  // in this sweep's dump
+        counter_table previous;
+        counter_table current;
+    };
+
+    netns_stats stats_;
+    std::map<key, record> records_;
+    std::vector<netns_sample> samples_;     // scratch, reused every sweep
+
+    double rescan_interval_;
+    double since_rescan_;
+
+    void print(const key &k, const record &r, time_t now, double elapsed) const;
+
+    // uncopyable: netns_stats is
+    netns_monitor(const netns_monitor &m);
+    netns_monitor &operator =(const netns_monitor &m);
+
+public:
+
+    explicit netns_monitor(double rescan_interval);
+
+    void sweep(time_t now, double elapsed);
+};
+
+#endif  // NETNS_MONITOR_H
@@ -0,0 +1,451 @@
+#include "netns_stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("netns_stats");
+
+    const char NAMED_NETNS_DIR[] = "/run/netns";
+    const char PROC_DIR[] = "/proc";
+
+    enum
+    {
+        // a dump reply is as big as the kernel cares to make it, which is
+        // never more than this
+        RECV_BUFFER_SIZE = 64 * 1024,
+
+        // the kernel always answers a dump promptly; if it hasn't in this
+        // long, something's badly wrong and we'll try again next sweep
+        RECV_TIMEOUT_SECONDS = 1
+    };
+
+    /**
+        What the helper thread is given, and what it hands back: one fd
+        (or -1 and an errno) per namespace.
+    */
+
+    struct socket_job
+    {
+        const std::vector<netns_info> *namespaces;
+        std::vector<int> fds;
+        std::vector<int> errors;
+    };
+
+    /**
+        Runs on the helper thread: into each namespace, make a socket, on
+        to the next.  Whatever namespace the thread ends up in dies with
+        it.  No exceptions on this side of pthread_join().
+    */
+
+    void *
+    open_sockets_thread(void *arg)
+    {
+        socket_job *job = (socket_job *)arg;
+        const std::vector<netns_info> &namespaces = *job->namespaces;
+
+        for (size_t i = 0; i < namespaces.size(); ++i)
+        {
+            int nsfd = open(namespaces[i].path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (nsfd == -1)
+            {
+                job->errors[i] = errno;
+                continue;
+            }
+
+            // the pid may have died and been reused since we listed it
+            struct stat st;
+            if (fstat(nsfd, &st) || ((uint64_t)st.st_ino != namespaces[i].inode))
+            {
+                job->errors[i] = ESTALE;
+                close(nsfd);
+                continue;
+            }
+
+            if (setns(nsfd, CLONE_NEWNET))
+            {
+                job->errors[i] = errno;
+                close(nsfd);
+                continue;
+            }
+            close(nsfd);
+
+            int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+            if (fd == -1)
+            {
+                job->errors[i] = errno;
+                continue;
+            }
+            job->fds[i] = fd;
+        }
+
+        return 0;
+    }
+
+    void
+    add_namespace(std::map<uint64_t, netns_info> *found, const std::string &path,
+                  const std::string &name)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st))
+            return;     // gone already, or not ours to look at
+
+        const uint64_t inode = (uint64_t)st.st_ino;
+        if (found->find(inode) != found->end())
+            return;
+
+        netns_info &info = (*found)[inode];
+        info.inode = inode;
+        info.name = name;
+        info.path = path;
+    }
+
+    bool
+    all_digits(const char *s)
+    {
+        if (!*s)
+            return false;
+        for ( ; *s; ++s)
+        {
+            if ((*s < '0') || (*s > '9'))
+                return false;
+        }
+        return true;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+/**
+    Every network namespace we can find, once each, sorted by inode.
+    Named ones first, so they keep their names.
+*/
+
+std::vector<netns_info>
+list_namespaces(void)
+{
+    std::map<uint64_t, netns_info> found;
+
+    DIR *dir = opendir(NAMED_NETNS_DIR);
+    if (dir)
+    {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != 0)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+            add_namespace(&found, std::string(NAMED_NETNS_DIR) + "/" + entry->d_name,
+                          entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    dir = opendir(PROC_DIR);
+    if (!dir)
+        ERROR("Opening '%s'", PROC_DIR);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != 0)
+    {
+        if (!all_digits(entry->d_name))
+            continue;
+        add_namespace(&found, std::string(PROC_DIR) + "/" + entry->d_name + "/ns/net",
+                      std::string("pid:") + entry->d_name);
+    }
+    closedir(dir);
+
+    std::vector<netns_info> namespaces;
+    namespaces.reserve(found.size());
+    std::map<uint64_t, netns_info>::const_iterator i = found.begin();
+    for ( ; i != found.end(); ++i)
+        namespaces.push_back(i->second);
+    return namespaces;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+netns_stats::netns_stats(void):
+    sockets_(),
+    sequence_(0)
+{
+
+}
+
+netns_stats::~netns_stats(void)
+{
+    std::map<uint64_t, namespace_socket>::iterator i = sockets_.begin();
+    for ( ; i != sockets_.end(); ++i)
+    {
+        if (close(i->second.fd))
+            REPORT("Closing netlink socket %d", i->second.fd);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One socket in each of 'added', made by a helper thread.  Namespaces we
+    couldn't get into are skipped: they'll be tried again next rescan if
+    they're still there.
+*/
+
+void
+netns_stats::open_sockets(const std::vector<netns_info> &added)
+{
+    socket_job job;
+    job.namespaces = &added;
+    job.fds.assign(added.size(), -1);
+    job.errors.assign(added.size(), 0);
+
+    pthread_t helper;
+    int ret = pthread_create(&helper, 0, open_sockets_thread, &job);
+    if (ret)
+    {
+        errno = ret;
+        ERROR("Starting namespace helper thread");
+    }
+    ret = pthread_join(helper, 0);
+    if (ret)
+    {
+        errno = ret;
+        ERROR("Joining namespace helper thread");
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = RECV_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+
+    for (size_t i = 0; i < added.size(); ++i)
+    {
+        if (job.fds[i] == -1)
+        {
+            CPRINT("%s: no socket: %s\n", C(added[i].name),
+                   strerror(job.errors[i]));
+            continue;
+        }
+
+        if (setsockopt(job.fds[i], SOL_SOCKET, SO_RCVTIMEO,
+                       &timeout, sizeof(timeout)))
+            REPORT("Setting receive timeout on fd %d", job.fds[i]);
+
+        namespace_socket &s = sockets_[added[i].inode];
+        s.name = added[i].name;
+        s.fd = job.fds[i];
+        s.pending = false;
+        CPRINT("%s (netns %llu): socket %d\n", C(s.name),
+               (unsigned long long)added[i].inode, s.fd);
+    }
+}
+
+/**
+    Read one namespace's dump through to NLMSG_DONE, appending a sample per
+    link.  Answers to earlier requests (a sweep that died part way) are
+    recognised by their sequence number and skipped.
+*/
+
+void
+netns_stats::read_dump(uint64_t inode, namespace_socket *s,
+                       std::vector<netns_sample> *samples)
+{
+    // netlink messages want 4 byte alignment
+    static uint32_t buffer[RECV_BUFFER_SIZE / sizeof(uint32_t)];
+
+    s->pending = false;
+    for (;;)
+    {
+        ssize_t n = recv(s->fd, buffer, sizeof(buffer), 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                CPRINT("%s: dump timed out\n", C(s->name));
+                return;
+            }
+            ERROR("Reading link dump for '%s' from fd %d", C(s->name), s->fd);
+        }
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            if (h->nlmsg_seq != sequence_)
+                continue;
+
+            if (h->nlmsg_type == NLMSG_DONE)
+                return;
+
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(h);
+                CPRINT("%s: link dump failed: %s\n", C(s->name),
+                       strerror(-e->error));
+                return;
+            }
+
+            if (h->nlmsg_type != RTM_NEWLINK)
+                continue;
+
+            const struct ifinfomsg *ifi = (const struct ifinfomsg *)NLMSG_DATA(h);
+
+            netns_sample sample;
+            sample.netns = inode;
+            sample.ifindex = ifi->ifi_index;
+            bool have_stats = false;
+
+            int attr_len = IFLA_PAYLOAD(h);
+            struct rtattr *a = IFLA_RTA(ifi);
+            for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+            {
+                switch (a->rta_type)
+                {
+                case IFLA_IFNAME:
+                    sample.name = (const char *)RTA_DATA(a);
+                    break;
+                case IFLA_STATS64:
+                {
+                    // attributes are only 4 byte aligned
+                    struct rtnl_link_stats64 stats;
+                    memset(&stats, 0, sizeof(stats));
+                    memcpy(&stats, RTA_DATA(a),
+                           std::min((size_t)RTA_PAYLOAD(a), sizeof(stats)));
+                    stats64_to_counters(stats, &sample.counters);
+                    have_stats = true;
+                    break;
+                }
+                }
+            }
+
+            if (have_stats)
+                samples->push_back(sample);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Bring our sockets in line with the namespaces that exist now: open
+    sockets in new ones, and close those of namespaces nobody else is
+    holding on to any more (our socket would keep them alive otherwise).
+*/
+
+void
+netns_stats::rescan(void)
+{
+    const std::vector<netns_info> namespaces(list_namespaces());
+
+    std::vector<netns_info> added;
+    std::set<uint64_t> present;
+    for (size_t i = 0; i < namespaces.size(); ++i)
+    {
+        present.insert(namespaces[i].inode);
+        if (sockets_.find(namespaces[i].inode) == sockets_.end())
+            added.push_back(namespaces[i]);
+    }
+
+    std::map<uint64_t, namespace_socket>::iterator i = sockets_.begin();
+    while (i != sockets_.end())
+    {
+        if (present.count(i->first))
+        {
+            ++i;
+            continue;
+        }
+
+        CPRINT("%s (netns %llu): gone\n", C(i->second.name),
+               (unsigned long long)i->first);
+        if (close(i->second.fd))
+            REPORT("Closing netlink socket %d", i->second.fd);
+        sockets_.erase(i++);
+    }
+
+    if (!added.empty())
+        open_sockets(added);
+}
+
+/**
+    Counters for every link in every namespace.  All the dump requests go
+    out before any answer is read, so the kernel works on them while we
+    read the first.
+*/
+
+void
+netns_stats::sweep(std::vector<netns_sample> *samples)
+{
+    samples->clear();
+    ++sequence_;
+
+    struct
+    {
+        struct nlmsghdr header;
+        struct ifinfomsg body;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body));
+    request.header.nlmsg_type = RTM_GETLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = sequence_;
+    request.body.ifi_family = AF_UNSPEC;
+
+    std::map<uint64_t, namespace_socket>::iterator i = sockets_.begin();
+    for ( ; i != sockets_.end(); ++i)
+    {
+        if (send(i->second.fd, &request, request.header.nlmsg_len, 0) == -1)
+        {
+            CPRINT("%s: requesting link dump: %s\n", C(i->second.name),
+                   strerror(errno));
+            continue;
+        }
+        i->second.pending = true;
+    }
+
+    for (i = sockets_.begin(); i != sockets_.end(); ++i)
+    {
+        if (i->second.pending)
+            read_dump(i->first, &i->second, samples);
+    }
+}
+
+std::string
+netns_stats::namespace_name(uint64_t inode) const
+{
+    std::map<uint64_t, namespace_socket>::const_iterator i = sockets_.find(inode);
+    return (i == sockets_.end()) ? std::string("?") : i->second.name;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,82 @@
+#ifndef NETNS_STATS_H
+#define NETNS_STATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+
+#include "network_stats.h"
+
+/**
+    Interface counters from every network namespace on the host, which
+    /sys/class/net (being our own namespace's view) can't show us.
+
+    Namespaces are found under /run/netns (named by 'ip netns') and
+    /proc/<pid>/ns/net (everything else with a process in it), and told
+    apart by their nsfs inode.  A netlink socket belongs to the namespace
+    it was created in, forever, so a helper thread setns()es into each new
+    namespace just long enough to make one; the main thread never leaves
+    home, and there's one thread per rescan rather than one per namespace.
+
+    Each sweep sends an RTM_GETLINK dump down every socket before reading
+    any of the answers, so the namespaces are dumped concurrently rather
+    than one round trip at a time.
+
+    Holding a socket keeps its namespace alive, so rescan() closes the
+    sockets of namespaces that are no longer listed anywhere.
+*/
+
+struct netns_info
+{
+    uint64_t inode;         // nsfs inode: the namespace's identity
+    std::string name;       // 'ip netns' name, else "pid:<pid>"
+    std::string path;       // something to open() to get at it
+};
+
+std::vector<netns_info> list_namespaces(void);
+
+//* One interface's counters, as of the latest sweep.
+struct netns_sample
+{
+    uint64_t netns;         // inode
+    int ifindex;
+    std::string name;
+    counter_table counters;
+};
+
+class netns_stats
+{
+private:
+    struct namespace_socket
+    {
+        std::string name;
+        int fd;
+        bool pending;       // dump requested, not yet read
+    };
+
+    std::map<uint64_t, namespace_socket> sockets_;
+    uint32_t sequence_;
+
+    void open_sockets(const std::vector<netns_info> &added);
+    void read_dump(uint64_t inode, namespace_socket *s,
+                   std::vector<netns_sample> *samples);
+
+    // uncopyable: owns sockets
+    netns_stats(const netns_stats &n);
+    netns_stats &operator =(const netns_stats &n);
+
+public:
+
+    netns_stats(void);
+    ~netns_stats(void);
+
+    void rescan(void);
+    void sweep(std::vector<netns_sample> *samples);
+
+    size_t size(void) const { return sockets_.size(); }
+    std::string namespace_name(uint64_t inode) const;
+};
+
+#endif  // NETNS_STATS_H
@@ -2,134 +2,192 @@
 #define NETWORK_STATS_H
 
 #include <string>
+#include <vector>
 #include <map>
 #include <set>
 
 #include <stdint.h>
 #include <unistd.h>
 
-struct receive_data
-{
-    uint64_t bytes,
-             compressed,
-             CRC_errors,
-             dropped,
-             errors,
-             FIFO_errors,
-             frame_errors,
-             length_errors,
-             missed_errors,
-             over_errors,
-             packets;
-};
+#include "counter_table.h"
+#include "collector.h"
 
-struct transmit_data
+enum link_duplex
 {
-    uint64_t aborted_errors,
-             bytes,
-             carrier_errors,
-             compressed,
-             dropped,
-             errors,
-             FIFO_errors,
-             heartbeat_errors,
-             packets,
-             window_errors;
+    LINK_DUPLEX_UNKNOWN,
+    LINK_DUPLEX_HALF,
+    LINK_DUPLEX_FULL
 };
 
+const char *link_duplex_name(link_duplex d);
 
-enum rx_fields
+//* Things about a link that only change when the link does.
+struct link_info
 {
-    RX_BYTES,
-    RX_COMPRESSED,
-    RX_CRC_ERRORS,
-    RX_DROPPED,
-    RX_ERRORS,
-    RX_FIFO_ERRORS,
-    RX_FRAME_ERRORS,
-    RX_LENGTH_ERRORS,
-    RX_MISSED_ERRORS,
-    RX_OVER_ERRORS,
-    RX_PACKETS
-};
+    long speed;             // Mb/s, -1 if the kernel doesn't know
+    link_duplex duplex;
+    long mtu;               // bytes, -1 if unreadable
 
-enum tx_fields
-{
-    TX_ABORTED_ERRORS,
-    TX_BYTES,
-    TX_CARRIER_ERRORS,
-    TX_COMPRESSED,
-    TX_DROPPED,
-    TX_ERRORS,
-    TX_FIFO_ERRORS,
-    TX_HEARTBEAT_ERRORS,
-    TX_PACKETS,
-    TX_WINDOW_ERRORS
+    link_info(void): speed(-1), duplex(LINK_DUPLEX_UNKNOWN), mtu(-1) {}
 };
 
 extern std::string DEFAULT_INTERFACE;
 
-class network_stats
+/**
+    The half of basic_network_stats that doesn't care where the counters
+    come from: the interface, the values last read, and everything about
+    the link that isn't a counter.
+*/
+
+class network_stats_base
 {
-private:
-    struct netdata
-    {
-        uint64_t value; // value pulled from stats file
-        int fd;         // file descriptor for stats file
+protected:
+    std::string interface_name_;
+    std::string interface_path_;
+    collector_target target_;
 
-        netdata(void): value(0), fd(-1) {}
-        netdata(int file_d, uint64_t v = 0): value(v), fd(file_d) {}
-        ~netdata(void){}
-    };
+    // Everything we've read, in counter_table order: zero for the fields
+    // we aren't monitoring, which are never written.
+    counter_table values_;
+    bool wanted_[NUM_COUNTERS];
+    bool released_;         // release_files(): hold nothing open
 
-    static std::map<rx_fields, std::string> rx_fields_to_filename;
-    static std::map<tx_fields, std::string> tx_fields_to_filename;
+    network_stats_base(const std::string &interface, collector_kind kind,
+                       fd_pool *pool);
+    ~network_stats_base(void) {}
 
-    std::string interface_name_;
-    std::string interface_stats_path_;
-
-    // Map from type of data to file descriptor used to update that kind of
-    // data: map has entries only for those fields we are supposed to
-    // update.
-    std::map<rx_fields, netdata> rx_to_update_;
-    std::map<tx_fields, netdata> tx_to_update_;
-#if 0
-    receive_data rx_data_;
-    transmit_data tx_data_;
-#endif
-private:
+    std::vector<size_t> not_yet_wanted(const std::set<rx_fields> &to_update) const;
+    std::vector<size_t> not_yet_wanted(const std::set<tx_fields> &to_update) const;
 
-    static void build_fields_to_filename_maps(void);
+    uint64_t fetch_one_rx(rx_fields r) const { return values_.value[counter_index(r)]; }
+    uint64_t fetch_one_tx(tx_fields t) const { return values_.value[counter_index(t)]; }
+    bool read_attribute(const std::string &file, char *buf, size_t len) const;
+    long read_long_attribute(const std::string &file) const;
 
-    uint64_t fetch_one_rx(rx_fields r) const;
-    uint64_t fetch_one_tx(tx_fields t) const;
-    uint64_t update_one(int fd);
+private:
 
     // uncopyable for now: would need to get open fds and suchlike (blick)
-    network_stats(const network_stats &s);
-    network_stats &operator =(const network_stats &s);
+    network_stats_base(const network_stats_base &s);
+    network_stats_base &operator =(const network_stats_base &s);
 
 public:
 
-    network_stats(const std::string interface = DEFAULT_INTERFACE);
-    ~network_stats(void);
+    static const collector_syscall_counts &get_syscall_counts(void)
+    {
+        return collector_syscalls;
+    }
+
+    static std::vector<std::string> list_interfaces(void);
+    static uint64_t update_one(int fd) { return read_stats_file(fd); }
+    static int interface_index(const std::string &interface);
 
-    void set_rx_stats_to_update(const std::set<rx_fields> &to_update);
-    void set_tx_stats_to_update(const std::set<tx_fields> &to_update);
-    void update_all(void);
-    void update_receive_data(void);
-    void update_transmit_data(void);
+    bool files_released(void) const { return released_; }
 
     // Fill out and return these, I guess
     receive_data get_receive_data(void) const;
     transmit_data get_transmit_data(void) const;
 
-    uint64_t get_rx_bytes(void) const;
-    uint64_t get_rx_packets(void) const;
+    uint64_t get_rx_bytes(void) const { return fetch_one_rx(RX_BYTES); }
+    uint64_t get_rx_packets(void) const { return fetch_one_rx(RX_PACKETS); }
+
+    uint64_t get_tx_bytes(void) const { return fetch_one_tx(TX_BYTES); }
+    uint64_t get_tx_packets(void) const { return fetch_one_tx(TX_PACKETS); }
 
-    uint64_t get_tx_bytes(void) const;
-    uint64_t get_tx_packets(void) const;
+    void get_counter_table(counter_table *table) const { *table = values_; }
+
+    const std::string &get_interface_name(void) const { return interface_name_; }
+    const std::string &get_interface_path(void) const { return interface_path_; }
+    long get_link_speed(void) const;
+    link_info get_link_info(void) const;
 };
 
-#endif  // NETWORK_STATS_H
+/**
+    One interface's counters, read by a 'Collector' (see collector.h).
+    Named outright, as in basic_network_stats<netlink_collector>, the
+    collector's reads inline into update_all(); network_stats below picks
+    one at run time.  'kind' and 'pool' are only for the collectors that
+    want them.
+*/
+
+template <typename Collector>
+class basic_network_stats : public network_stats_base
+{
+private:
+    Collector collector_;
+
+    template <typename Fields>
+    void want(const std::set<Fields> &to_update)
+    {
+        const std::vector<size_t> added(not_yet_wanted(to_update));
+        for (size_t i = 0; i < added.size(); ++i)
+        {
+            collector_.add(added[i]);
+            wanted_[added[i]] = true;
+        }
+    }
+
+public:
+
+    basic_network_stats(const std::string interface = DEFAULT_INTERFACE,
+                        collector_kind kind = COLLECTOR_SYSFS_FD,
+                        fd_pool *pool = 0):
+        network_stats_base(interface, kind, pool),
+        collector_(target_)
+    {
+    }
+
+    void set_rx_stats_to_update(const std::set<rx_fields> &to_update)
+    {
+        want(to_update);
+    }
+    void set_tx_stats_to_update(const std::set<tx_fields> &to_update)
+    {
+        want(to_update);
+    }
+
+    void update_all(void) { collector_.collect(0, NUM_COUNTERS, &values_); }
+    void update_receive_data(void)
+    {
+        collector_.collect(0, NUM_RX_FIELDS, &values_);
+    }
+    void update_transmit_data(void)
+    {
+        collector_.collect(NUM_RX_FIELDS, NUM_COUNTERS, &values_);
+    }
+
+    /**
+        Give back every fd held for the counters and read by open/read/
+        close (or the collector's equivalent) until retain_files().  For
+        interfaces sampled so rarely that holding the files open isn't
+        worth the fds.
+    */
+
+    void release_files(void)
+    {
+        collector_.release();
+        released_ = true;
+    }
+    void retain_files(void)
+    {
+        collector_.retain();
+        released_ = false;
+    }
+
+    bool provides(size_t counter) const { return collector_.provides(counter); }
+    const char *get_collector_name(void) const { return collector_.name(); }
+};
 
+//* With the collector chosen at run time: what the monitor uses.
+class network_stats : public basic_network_stats<dynamic_collector>
+{
+public:
+
+    network_stats(const std::string interface = DEFAULT_INTERFACE,
+                  collector_kind kind = COLLECTOR_SYSFS_FD,
+                  fd_pool *pool = 0):
+        basic_network_stats<dynamic_collector>(interface, kind, pool)
+    {
+    }
+};
+
+#endif  // NETWORK_STATS_H
@@ -0,0 +1,114 @@
+#include "packet_mix.h"
+
+#include <cstring>
+
+#include <netinet/in.h>
+
+namespace
+{
+    const char *const SIZE_NAMES[NUM_SIZE_BUCKETS] =
+    {
+        "<=64",
+        "65-127",
+        "128-255",
+        "256-511",
+        "512-1023",
+        "1024-1518",
+        ">1518"
+    };
+
+    const char *const L3_NAMES[NUM_L3_CLASSES] =
+    {
+        "ipv4",
+        "ipv6",
+        "arp",
+        "other"
+    };
+
+    const char *const L4_NAMES[NUM_L4_CLASSES] =
+    {
+        "tcp",
+        "udp",
+        "icmp",
+        "other"
+    };
+
+    template <size_t N>
+    void
+    add_array(uint64_t (&to)[N], const uint64_t (&from)[N])
+    {
+        for (size_t i = 0; i < N; ++i)
+            to[i] += from[i];
+    }
+}
+
+const char *
+size_bucket_name(size_t b)
+{
+    return (b < NUM_SIZE_BUCKETS) ? SIZE_NAMES[b] : "?";
+}
+
+const char *
+l3_class_name(size_t c)
+{
+    return (c < NUM_L3_CLASSES) ? L3_NAMES[c] : "?";
+}
+
+const char *
+l4_class_name(size_t c)
+{
+    return (c < NUM_L4_CLASSES) ? L4_NAMES[c] : "?";
+}
+
+packet_mix::packet_mix(void)
+{
+    clear();
+}
+
+void
+packet_mix::clear(void)
+{
+    std::memset(this, 0, sizeof(*this));
+}
+
+void
+packet_mix::merge(const packet_mix &m)
+{
+    add_array(size_packets, m.size_packets);
+    add_array(size_bytes, m.size_bytes);
+    add_array(l3_packets, m.l3_packets);
+    add_array(l3_bytes, m.l3_bytes);
+    add_array(l4_packets, m.l4_packets);
+    add_array(l4_bytes, m.l4_bytes);
+}
+
+size_t
+packet_mix::bucket(uint32_t length)
+{
+    if (length <= 64)
+        return SIZE_64;
+    if (length <= 127)
+        return SIZE_65_127;
+    if (length <= 255)
+        return SIZE_128_255;
+    if (length <= 511)
+        return SIZE_256_511;
+    if (length <= 1023)
+        return SIZE_512_1023;
+    if (length <= 1518)
+        return SIZE_1024_1518;
+    return SIZE_JUMBO;
+}
+
+size_t
+packet_mix::l4(uint8_t protocol)
+{
+    switch (protocol)
+    {
+    case IPPROTO_TCP:       return L4_TCP;
+    case IPPROTO_UDP:       return L4_UDP;
+    case IPPROTO_ICMP:
+    case IPPROTO_ICMPV6:    return L4_ICMP;
+    }
+    return L4_OTHER;
+}
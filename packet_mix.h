@@ -0,0 +1,83 @@
+#ifndef PACKET_MIX_H
+#define PACKET_MIX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//* RFC 2819's etherStatsPkts buckets, by length on the wire.
+enum packet_size_bucket
+{
+    SIZE_64,                    // and runts
+    SIZE_65_127,
+    SIZE_128_255,
+    SIZE_256_511,
+    SIZE_512_1023,
+    SIZE_1024_1518,
+    SIZE_JUMBO,
+    NUM_SIZE_BUCKETS
+};
+
+enum l3_class
+{
+    L3_IPV4,
+    L3_IPV6,
+    L3_ARP,
+    L3_OTHER,
+    NUM_L3_CLASSES
+};
+
+//* Of IPv4 and IPv6 packets only.
+enum l4_class
+{
+    L4_TCP,
+    L4_UDP,
+    L4_ICMP,                    // or ICMPv6
+    L4_OTHER,
+    NUM_L4_CLASSES
+};
+
+const char *size_bucket_name(size_t b);
+const char *l3_class_name(size_t c);
+const char *l4_class_name(size_t c);
+
+/**
+    What an interface's packets look like: how many, and how many bytes,
+    in each size bucket, network protocol and transport protocol.  Plain
+    arrays, so counting a packet is three increments and two adds, and
+    merging or clearing is a few hundred bytes.
+*/
+
+struct packet_mix
+{
+    uint64_t size_packets[NUM_SIZE_BUCKETS];
+    uint64_t size_bytes[NUM_SIZE_BUCKETS];
+    uint64_t l3_packets[NUM_L3_CLASSES];
+    uint64_t l3_bytes[NUM_L3_CLASSES];
+    uint64_t l4_packets[NUM_L4_CLASSES];
+    uint64_t l4_bytes[NUM_L4_CLASSES];
+
+    packet_mix(void);
+    void clear(void);
+    void merge(const packet_mix &m);
+
+    //* 'protocol' is IPPROTO_*, ignored unless 'l3' is IPv4 or IPv6.
+    void add(l3_class l3, uint8_t protocol, uint32_t length)
+    {
+        const size_t b = bucket(length);
+        ++size_packets[b];
+        size_bytes[b] += length;
+        ++l3_packets[l3];
+        l3_bytes[l3] += length;
+        if ((l3 == L3_IPV4) || (l3 == L3_IPV6))
+        {
+            const size_t c = l4(protocol);
+            ++l4_packets[c];
+            l4_bytes[c] += length;
+        }
+    }
+
+    static size_t bucket(uint32_t length);
+    static size_t l4(uint8_t protocol);
+};
+
+#endif  // PACKET_MIX_H
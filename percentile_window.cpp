@@ -0,0 +1,168 @@
+#include "percentile_window.h"
+
+#include <string>
+#include <cmath>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("percentile_window");
+}
+
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// sliding_percentile
+////////////////////////////////////////////////////////////////////////////////
+
+sliding_percentile::sliding_percentile(double fraction, size_t capacity):
+    fraction_(fraction),
+    capacity_(capacity),
+    window_(),
+    low_(),
+    high_(),
+    current_(0.0)
+{
+    if ((fraction <= 0.0) || (fraction > 1.0))
+        RUNTIME("Percentile fraction %f must be in (0, 1]", fraction);
+    if (capacity == 0)
+        RUNTIME("Percentile window must hold at least one sample");
+}
+
+/**
+    How many samples belong in 'low_' when the window holds 'n' of them.
+    The epsilon keeps 0.95 * 100 from turning into 96 on us.
+*/
+
+size_t
+sliding_percentile::rank(size_t n) const
+{
+    size_t k = (size_t)std::ceil(fraction_ * (double)n - 1e-9);
+    return (k == 0) ? 1 : k;
+}
+
+/**
+    Drop one instance of 'value' from whichever half holds it.  Equal
+    values are interchangeable, so it doesn't matter which one goes.
+*/
+
+void
+sliding_percentile::remove(double value)
+{
+    if (!low_.empty() && (value <= *low_.rbegin()))
+    {
+        std::multiset<double>::iterator i = low_.find(value);
+        if (i != low_.end())
+        {
+            low_.erase(i);
+            return;
+        }
+    }
+
+    std::multiset<double>::iterator i = high_.find(value);
+    if (i == high_.end())
+        RUNTIME("Expiring sample %f that isn't in the window", value);
+    high_.erase(i);
+}
+
+/**
+    Shuffle at most a couple of elements across the boundary so that
+    'low_' is back to holding exactly rank(n) samples.
+*/
+
+void
+sliding_percentile::rebalance(void)
+{
+    const size_t k = rank(window_.size());
+
+    while (low_.size() > k)
+    {
+        std::multiset<double>::iterator i = low_.end();
+        --i;
+        high_.insert(*i);
+        low_.erase(i);
+    }
+
+    while ((low_.size() < k) && !high_.empty())
+    {
+        std::multiset<double>::iterator i = high_.begin();
+        low_.insert(*i);
+        high_.erase(i);
+    }
+
+    current_ = low_.empty() ? 0.0 : *low_.rbegin();
+}
+
+void
+sliding_percentile::add(double value)
+{
+    if (window_.size() == capacity_)
+    {
+        remove(window_.front());
+        window_.pop_front();
+    }
+
+    window_.push_back(value);
+    if (low_.empty() || (value <= *low_.rbegin()))
+        low_.insert(value);
+    else
+        high_.insert(value);
+
+    rebalance();
+}
+
+void
+sliding_percentile::clear(void)
+{
+    window_.clear();
+    low_.clear();
+    high_.clear();
+    current_ = 0.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// burstable_rate
+////////////////////////////////////////////////////////////////////////////////
+
+burstable_rate::burstable_rate(double bucket_seconds, size_t window_buckets,
+                               double fraction):
+    bucket_seconds_(bucket_seconds),
+    accumulated_(0.0),
+    elapsed_(0.0),
+    last_bucket_(0.0),
+    window_(fraction, window_buckets)
+{
+    if (bucket_seconds <= 0.0)
+        RUNTIME("Bucket length %f must be positive", bucket_seconds);
+}
+
+/**
+    Account for 'rate' having held for 'seconds'.  Returns true if that
+    closed out a bucket, in which case its average has been pushed into the
+    window and the percentile is up to date.
+
+    A sample that straddles the bucket boundary is charged entirely to the
+    bucket it closes: with samples a second or so apart this is noise.
+*/
+
+bool
+burstable_rate::add(double rate, double seconds)
+{
+    if (seconds <= 0.0)
+        return false;
+
+    accumulated_ += rate * seconds;
+    elapsed_ += seconds;
+    if (elapsed_ < bucket_seconds_)
+        return false;
+
+    last_bucket_ = accumulated_ / elapsed_;
+    window_.add(last_bucket_);
+    accumulated_ = 0.0;
+    elapsed_ = 0.0;
+    return true;
+}
+
+#undef RUNTIME
@@ -0,0 +1,83 @@
+#ifndef PERCENTILE_WINDOW_H
+#define PERCENTILE_WINDOW_H
+
+#include <deque>
+#include <set>
+
+#include <stddef.h>
+
+/**
+    Exact percentile over a sliding window of the most recent N samples.
+
+    Samples are split between two ordered multisets: 'low_' holds the
+    ceil(p * n) smallest samples and 'high_' holds the rest, so the
+    percentile is always the largest element of 'low_'.  Adding a sample
+    and expiring the oldest one are each O(log n), and the answer is
+    cached so that percentile() is O(1).
+
+    This is the "nearest rank" definition used for burstable billing:
+    sort the samples, throw away the top (1 - p) of them, and the biggest
+    survivor is the answer.
+*/
+
+class sliding_percentile
+{
+private:
+    double fraction_;           // e.g. 0.95 for the 95th percentile
+    size_t capacity_;           // # samples in the window
+
+    std::deque<double> window_; // samples in arrival order, for expiry
+    std::multiset<double> low_;
+    std::multiset<double> high_;
+
+    double current_;            // cached answer
+
+private:
+
+    size_t rank(size_t n) const;
+    void remove(double value);
+    void rebalance(void);
+
+public:
+
+    sliding_percentile(double fraction, size_t capacity);
+
+    void add(double value);
+    void clear(void);
+
+    double percentile(void) const { return current_; }
+    size_t size(void) const { return window_.size(); }
+    size_t capacity(void) const { return capacity_; }
+    bool full(void) const { return window_.size() == capacity_; }
+};
+
+/**
+    Turns a stream of (rate, elapsed time) samples into fixed-length
+    bucket averages -- 5 minutes is the usual for transit billing -- and
+    keeps the exact percentile of those averages over a rolling window of
+    buckets, e.g. 30 days' worth.
+*/
+
+class burstable_rate
+{
+private:
+    double bucket_seconds_;
+    double accumulated_;        // integral of rate over the open bucket
+    double elapsed_;            // seconds in the open bucket
+    double last_bucket_;        // average of the most recently closed bucket
+
+    sliding_percentile window_;
+
+public:
+
+    burstable_rate(double bucket_seconds, size_t window_buckets,
+                   double fraction = 0.95);
+
+    bool add(double rate, double seconds);
+
+    double last_bucket(void) const { return last_bucket_; }
+    double percentile(void) const { return window_.percentile(); }
+    size_t buckets(void) const { return window_.size(); }
+};
+
+#endif  // PERCENTILE_WINDOW_H
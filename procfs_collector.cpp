@@ -0,0 +1,399 @@
+#include "procfs_collector.h"
+
+#include <map>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("procfs_collector");
+
+    enum
+    {
+        // numbers on each line after the name
+        NUM_COLUMNS = 16,
+
+        // the file's a few hundred bytes more for every interface
+        INITIAL_BUFFER = 16 * 1024
+    };
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+namespace
+{
+    /**
+        /proc/net/dev as of the latest reading, shared by every
+        procfs_collector: each interface's numbers, by name.  Its fd is
+        held open while any of them is retained.
+    */
+
+    class proc_net_dev
+    {
+    private:
+        struct line
+        {
+            uint64_t columns[NUM_COLUMNS];
+            uint64_t reading;           // the last one it was in
+            bool complete;              // all NUM_COLUMNS were there
+        };
+
+        int fd_;                        // -1 while nobody's retained
+        size_t retained_;               // collectors holding fd_ open
+        std::vector<char> buffer_;      // the whole file
+        std::map<std::string, line> lines_;
+        std::string name_;              // parse()'s scratch
+        uint64_t reading_;              // readings so far
+        uint64_t sweep_;                // collector_sweep at the latest
+
+        // uncopyable: owns fd_
+        proc_net_dev(const proc_net_dev &p);
+        proc_net_dev &operator =(const proc_net_dev &p);
+
+        int open_file(void);
+        void read_file(void);
+        void parse(void);
+        void refresh(void);
+
+    public:
+
+        proc_net_dev(void);
+        ~proc_net_dev(void);
+
+        void retain(void);
+        void release(void);
+
+        const uint64_t *columns(const std::string &interface, uint64_t *seen);
+    };
+
+    ////////////////////////////////////////////////////////////////////////
+    // Constructors and destructor
+    ////////////////////////////////////////////////////////////////////////
+
+    proc_net_dev::proc_net_dev(void):
+        fd_(-1),
+        retained_(0),
+        buffer_(INITIAL_BUFFER),
+        lines_(),
+        name_(),
+        reading_(0),
+        sweep_(0)
+    {
+
+    }
+
+    proc_net_dev::~proc_net_dev(void)
+    {
+        if (fd_ != -1)
+            close(fd_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // Private
+    ////////////////////////////////////////////////////////////////////////
+
+    int
+    proc_net_dev::open_file(void)
+    {
+        int fd = open(C(PROC_NET_DEV), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            ERROR("Opening '%s'", C(PROC_NET_DEV));
+        ++collector_syscalls.opens;
+        return fd;
+    }
+
+    /**
+        All of it into buffer_, NUL terminated, growing it as needed.
+        While nobody's retained, the file's opened and closed around that.
+    */
+
+    void
+    proc_net_dev::read_file(void)
+    {
+        const int fd = (fd_ != -1) ? fd_ : open_file();
+
+        size_t used = 0;
+        for (;;)
+        {
+            if (used + 1 >= buffer_.size())
+                buffer_.resize(buffer_.size() * 2);
+
+            ssize_t n = pread(fd, &buffer_[used], buffer_.size() - used - 1,
+                              (off_t)used);
+            ++collector_syscalls.reads;
+            if (n == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (fd != fd_)
+                    close(fd);
+                ERROR("Reading '%s'", C(PROC_NET_DEV));
+            }
+            if (n == 0)
+                break;
+            used += (size_t)n;
+        }
+        buffer_[used] = '\0';
+
+        if (fd != fd_)
+        {
+            close(fd);
+            ++collector_syscalls.closes;
+        }
+    }
+
+    /**
+        Every interface's line into lines_, as reading_, and the lines of
+        interfaces that have gone out.  A name is padded on the left and
+        ends with a ':', which no interface name can have in it; the two
+        header lines have no ':'.
+    */
+
+    void
+    proc_net_dev::parse(void)
+    {
+        ++reading_;
+
+        char *text = &buffer_[0];
+        while (*text)
+        {
+            char *end = std::strchr(text, '\n');
+            if (end)
+                *end = '\0';
+
+            char *name = text + std::strspn(text, " ");
+            char *colon = std::strchr(name, ':');
+            if (colon)
+            {
+                name_.assign(name, colon - name);
+                line &l = lines_[name_];
+                l.reading = reading_;
+                l.complete = true;
+
+                char *p = colon + 1;
+                for (size_t c = 0; c < NUM_COLUMNS; ++c)
+                {
+                    char *next;
+                    l.columns[c] = std::strtoull(p, &next, 10);
+                    if (next == p)
+                    {
+                        l.complete = false;
+                        break;
+                    }
+                    p = next;
+                }
+            }
+
+            if (!end)
+                break;
+            text = end + 1;
+        }
+
+        std::map<std::string, line>::iterator i = lines_.begin();
+        while (i != lines_.end())
+        {
+            if (i->second.reading != reading_)
+                lines_.erase(i++);
+            else
+                ++i;
+        }
+    }
+
+    void
+    proc_net_dev::refresh(void)
+    {
+        read_file();
+        parse();
+        sweep_ = collector_sweep;
+    }
+
+    ////////////////////////////////////////////////////////////////////////
+    // Public
+    ////////////////////////////////////////////////////////////////////////
+
+    void
+    proc_net_dev::retain(void)
+    {
+        if ((retained_++ == 0) && (fd_ == -1))
+            fd_ = open_file();
+    }
+
+    void
+    proc_net_dev::release(void)
+    {
+        if ((retained_ == 0) || (--retained_ != 0) || (fd_ == -1))
+            return;
+        if (close(fd_))
+            REPORT("Closing '%s'", C(PROC_NET_DEV));
+        ++collector_syscalls.closes;
+        fd_ = -1;
+    }
+
+    /**
+        The numbers on 'interface's line.  Read afresh for the first
+        caller of a sweep, for anyone who'd otherwise get the reading they
+        had last time ('seen', which is updated), and for an interface
+        that's newer than the reading.
+    */
+
+    const uint64_t *
+    proc_net_dev::columns(const std::string &interface, uint64_t *seen)
+    {
+        bool fresh = false;
+        if ((reading_ == 0) || (*seen == reading_)
+            || (sweep_ != collector_sweep))
+        {
+            refresh();
+            fresh = true;
+        }
+
+        std::map<std::string, line>::const_iterator i = lines_.find(interface);
+        if ((i == lines_.end()) && !fresh)
+        {
+            refresh();
+            i = lines_.find(interface);
+        }
+        *seen = reading_;
+
+        if (i == lines_.end())
+            RUNTIME("No '%s' in '%s'", C(interface), C(PROC_NET_DEV));
+        if (!i->second.complete)
+            RUNTIME("Short line for '%s' in '%s'", C(interface),
+                    C(PROC_NET_DEV));
+        return i->second.columns;
+    }
+
+    //* The one everybody shares.
+    proc_net_dev &
+    shared_file(void)
+    {
+        static proc_net_dev file;
+        return file;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+procfs_collector::procfs_collector(const collector_target &target):
+    interface_(target.interface),
+    retained_(false),
+    counters_(),
+    seen_(0)
+{
+    retain();
+}
+
+procfs_collector::~procfs_collector(void)
+{
+    release();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+//* Our line's numbers, from this sweep's reading.
+const uint64_t *
+procfs_collector::columns(void)
+{
+    return shared_file().columns(interface_, &seen_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Where 'counter' is on a line (after the name), or -1 if it isn't.
+*/
+
+int
+procfs_collector::column(size_t counter)
+{
+    switch (counter)
+    {
+    case RX_BYTES:                              return 0;
+    case RX_PACKETS:                            return 1;
+    case RX_ERRORS:                             return 2;
+    case RX_DROPPED:                            return 3;
+    case RX_FIFO_ERRORS:                        return 4;
+    case RX_COMPRESSED:                         return 6;
+    case NUM_RX_FIELDS + TX_BYTES:              return 8;
+    case NUM_RX_FIELDS + TX_PACKETS:            return 9;
+    case NUM_RX_FIELDS + TX_ERRORS:             return 10;
+    case NUM_RX_FIELDS + TX_DROPPED:            return 11;
+    case NUM_RX_FIELDS + TX_FIFO_ERRORS:        return 12;
+    case NUM_RX_FIELDS + TX_COMPRESSED:         return 15;
+    }
+    return -1;
+}
+
+void
+procfs_collector::add(size_t counter)
+{
+    if (!provides(counter))
+        RUNTIME("For '%s': not in '%s'", counter_name(counter),
+                C(PROC_NET_DEV));
+
+    const bool first = counters_.empty();
+    std::vector<size_t>::iterator i = counters_.begin();
+    while ((i != counters_.end()) && (*i < counter))
+        ++i;
+    if ((i == counters_.end()) || (*i != counter))
+        counters_.insert(i, counter);
+
+    // so a missing interface shows up now: once is enough
+    if (first)
+        columns();
+}
+
+void
+procfs_collector::collect(size_t first, size_t last, counter_table *values)
+{
+    const uint64_t *line = columns();
+
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        const size_t c = counters_[i];
+        if (c >= last)
+            break;
+        if (c >= first)
+            values->value[c] = line[column(c)];
+    }
+}
+
+void
+procfs_collector::release(void)
+{
+    if (!retained_)
+        return;
+    shared_file().release();
+    retained_ = false;
+}
+
+void
+procfs_collector::retain(void)
+{
+    if (retained_)
+        return;
+    shared_file().retain();
+    retained_ = true;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,55 @@
+#ifndef PROCFS_COLLECTOR_H
+#define PROCFS_COLLECTOR_H
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collector.h"
+
+/**
+    COLLECTOR_PROCFS: the interface's line of /proc/net/dev.
+
+    The file is read and parsed once a sweep for every procfs_collector
+    there is (see start_collector_sweep()), and each looks its own line up
+    in that by name: a sweep is one read and N lines, and one fd held open
+    between them however many interfaces there are.
+
+    It only has what the kernel prints.  That's bytes, packets, errors,
+    FIFO errors, compressed and (Tx) drops each way; Rx drops include
+    rx_missed_errors; the individual kinds of Rx and Tx error are summed
+    into columns we don't use, so provides() says no to them.
+*/
+
+class procfs_collector
+{
+private:
+    std::string interface_;
+    bool retained_;
+    std::vector<size_t> counters_;      // in index order
+    uint64_t seen_;                     // the last reading we used
+
+    const uint64_t *columns(void);
+
+    // uncopyable: holds the shared fd open
+    procfs_collector(const procfs_collector &c);
+    procfs_collector &operator =(const procfs_collector &c);
+
+public:
+
+    explicit procfs_collector(const collector_target &target);
+    ~procfs_collector(void);
+
+    static int column(size_t counter);
+
+    bool provides(size_t counter) const { return column(counter) >= 0; }
+    void add(size_t counter);
+    void collect(size_t first, size_t last, counter_table *values);
+    void release(void);
+    void retain(void);
+    const char *name(void) const { return collector_kind_name(COLLECTOR_PROCFS); }
+};
+
+#endif  // PROCFS_COLLECTOR_H
@@ -0,0 +1,262 @@
+#include "proto_stats.h"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("proto_stats");
+
+    const char *const PATHS[] = { "/proc/net/snmp", "/proc/net/netstat" };
+
+    // Not counters: a delta of these means nothing
+    const char *const GAUGES[] =
+    {
+        "Ip.Forwarding", "Ip.DefaultTTL",
+        "Tcp.RtoAlgorithm", "Tcp.RtoMin", "Tcp.RtoMax", "Tcp.MaxConn",
+        "Tcp.CurrEstab"
+    };
+
+    enum
+    {
+        // both files are a few KB; grown if ever not enough
+        INITIAL_BUFFER_SIZE = 16 * 1024
+    };
+
+    //* Start of the line after 'p', or 'end'.
+    const char *
+    next_line(const char *p, const char *end)
+    {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        return nl ? nl + 1 : end;
+    }
+
+    bool
+    is_gauge(const std::string &name)
+    {
+        for (size_t i = 0; i < sizeof(GAUGES) / sizeof(GAUGES[0]); ++i)
+        {
+            if (name == GAUGES[i])
+                return true;
+        }
+        return false;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+proto_stats::proto_stats(void):
+    sections_(),
+    names_(),
+    gauge_(),
+    values_(),
+    previous_()
+{
+    for (size_t f = 0; f < NUM_FILES; ++f)
+    {
+        files_[f].path = PATHS[f];
+        files_[f].fd = open(PATHS[f], O_RDONLY | O_CLOEXEC);
+        if (files_[f].fd == -1)
+        {
+            for (size_t g = 0; g < f; ++g)
+                close(files_[g].fd);
+            ERROR("Opening '%s'", PATHS[f]);
+        }
+        files_[f].buffer.resize(INITIAL_BUFFER_SIZE);
+        files_[f].length = 0;
+    }
+
+    for (size_t f = 0; f < NUM_FILES; ++f)
+        read_file(&files_[f]);
+    index();
+    if (!parse())
+        RUNTIME("Can't make sense of the protocol counter files");
+    previous_ = values_;
+}
+
+proto_stats::~proto_stats(void)
+{
+    for (size_t f = 0; f < NUM_FILES; ++f)
+    {
+        if (close(files_[f].fd))
+            REPORT("Closing '%s'", files_[f].path);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    The whole file in one pread(), if the buffer is big enough; if it was
+    filled to the brim there may be more, so grow it and go again.
+*/
+
+void
+proto_stats::read_file(source *s)
+{
+    for (;;)
+    {
+        ssize_t n = pread(s->fd, &s->buffer[0], s->buffer.size(), 0);
+        if (n == -1)
+            ERROR("Reading '%s'", s->path);
+        if ((size_t)n < s->buffer.size())
+        {
+            s->length = (size_t)n;
+            return;
+        }
+        s->buffer.resize(s->buffer.size() * 2);
+    }
+}
+
+/**
+    Names for every field, from the header lines.  Only done when the
+    layout is new to us.
+*/
+
+void
+proto_stats::index(void)
+{
+    sections_.clear();
+    names_.clear();
+    gauge_.clear();
+
+    for (size_t f = 0; f < NUM_FILES; ++f)
+    {
+        const char *p = &files_[f].buffer[0];
+        const char *end = p + files_[f].length;
+        while (p < end)
+        {
+            const char *header_end = next_line(p, end);
+            const char *values_end = next_line(header_end, end);
+
+            const char *colon = (const char *)memchr(p, ':', header_end - p);
+            if (!colon)
+                break;
+
+            section s;
+            s.file = f;
+            s.prefix.assign(p, colon + 1);
+            s.first = names_.size();
+
+            const std::string family(p, colon);
+            const char *q = colon + 1;
+            while (q < header_end)
+            {
+                while ((q < header_end) && ((*q == ' ') || (*q == '\n')))
+                    ++q;
+                const char *word = q;
+                while ((q < header_end) && (*q != ' ') && (*q != '\n'))
+                    ++q;
+                if (q > word)
+                {
+                    names_.push_back(family + "." + std::string(word, q));
+                    gauge_.push_back(is_gauge(names_.back()));
+                }
+            }
+
+            s.count = names_.size() - s.first;
+            sections_.push_back(s);
+            p = values_end;
+        }
+    }
+
+    values_.assign(names_.size(), 0);
+    previous_.assign(names_.size(), 0);
+    CPRINT("Indexed %lu protocol counters in %lu sections\n",
+           (unsigned long)names_.size(), (unsigned long)sections_.size());
+}
+
+/**
+    The fast path: values only, trusting the index.  False as soon as the
+    files don't look the way the index says they should.
+*/
+
+bool
+proto_stats::parse(void)
+{
+    size_t s = 0;
+    for (size_t f = 0; f < NUM_FILES; ++f)
+    {
+        const char *p = &files_[f].buffer[0];
+        const char *end = p + files_[f].length;
+        for ( ; (s < sections_.size()) && (sections_[s].file == f); ++s)
+        {
+            const section &sec = sections_[s];
+            p = next_line(p, end);          // header: already indexed
+
+            const size_t len = sec.prefix.size();
+            if (((size_t)(end - p) < len) || memcmp(p, sec.prefix.data(), len))
+                return false;
+            p += len;
+
+            uint64_t *v = &values_[sec.first];
+            for (size_t i = 0; i < sec.count; ++i)
+            {
+                while ((p < end) && (*p == ' '))
+                    ++p;
+                bool negative = false;
+                if ((p < end) && (*p == '-'))
+                {
+                    negative = true;
+                    ++p;
+                }
+                if ((p >= end) || (*p < '0') || (*p > '9'))
+                    return false;
+
+                uint64_t x = 0;
+                while ((p < end) && (*p >= '0') && (*p <= '9'))
+                    x = x * 10 + (uint64_t)(*p++ - '0');
+                v[i] = negative ? (uint64_t)-(int64_t)x : x;
+            }
+
+            if ((p < end) && (*p != '\n'))
+                return false;               // more values than names
+            p = next_line(p, end);
+        }
+
+        if (p != end)
+            return false;                   // a section we don't know about
+    }
+
+    return s == sections_.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+proto_stats::update(void)
+{
+    for (size_t f = 0; f < NUM_FILES; ++f)
+        read_file(&files_[f]);
+
+    previous_.swap(values_);
+    if (parse())
+        return;
+
+    // the layout changed: start over, with no deltas this time
+    index();
+    if (!parse())
+        RUNTIME("Can't make sense of the protocol counter files");
+    previous_ = values_;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,86 @@
+#ifndef PROTO_STATS_H
+#define PROTO_STATS_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+/**
+    Host-wide protocol counters from /proc/net/snmp and /proc/net/netstat:
+    TCP retransmits, UDP receive buffer errors, listen queue overflows and
+    the rest of what no interface counter can show.
+
+    Both files are pairs of lines, a header naming the fields then the
+    values, per section ("Tcp:", "TcpExt:" ...).  The headers are indexed
+    once into flat names like "Tcp.RetransSegs"; after that an update() is
+    one pread() per file and a walk over the value lines that does nothing
+    but check each section's prefix and convert numbers.  If the layout
+    ever doesn't match (a different kernel, or a module loaded that adds a
+    section) the headers are indexed again.
+
+    A few of the fields are gauges, not counters (Tcp.CurrEstab, say):
+    those have no meaningful delta and are flagged as such; changed() says
+    whether one moved.
+*/
+
+class proto_stats
+{
+private:
+    struct source
+    {
+        const char *path;
+        int fd;
+        std::vector<char> buffer;
+        size_t length;              // of the last read
+    };
+
+    struct section
+    {
+        size_t file;                // index into files_
+        std::string prefix;         // "Tcp:" etc, colon included
+        size_t first;               // into values_
+        size_t count;
+    };
+
+    enum { NUM_FILES = 2 };
+
+    source files_[NUM_FILES];
+    std::vector<section> sections_;     // in file order
+    std::vector<std::string> names_;
+    std::vector<bool> gauge_;
+    std::vector<uint64_t> values_;
+    std::vector<uint64_t> previous_;
+
+    void read_file(source *s);
+    void index(void);
+    bool parse(void);
+
+    // uncopyable: owns fds
+    proto_stats(const proto_stats &p);
+    proto_stats &operator =(const proto_stats &p);
+
+public:
+
+    proto_stats(void);
+    ~proto_stats(void);
+
+    void update(void);
+
+    size_t size(void) const { return values_.size(); }
+    const std::string &name(size_t i) const { return names_[i]; }
+    bool gauge(size_t i) const { return gauge_[i]; }
+    uint64_t value(size_t i) const { return values_[i]; }
+
+    //* Since the last update(); 0 for gauges and counters that went backwards.
+    uint64_t delta(size_t i) const
+    {
+        return (gauge_[i] || (values_[i] < previous_[i]))
+            ? 0 : values_[i] - previous_[i];
+    }
+
+    //* Since the last update(): for gauges, whose delta() is always 0.
+    bool changed(size_t i) const { return values_[i] != previous_[i]; }
+};
+
+#endif  // PROTO_STATS_H
@@ -0,0 +1,332 @@
+#include "qdisc_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/gen_stats.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("qdisc_stats");
+
+    enum
+    {
+        // a dump reply is as big as the kernel cares to make it, which is
+        // never more than this
+        RECV_BUFFER_SIZE = 64 * 1024,
+
+        // as for link dumps: prompt, or try again next sweep
+        RECV_TIMEOUT_SECONDS = 1
+    };
+
+    // qdiscs that have classes worth dumping.  fq_codel and friends
+    // report their flows as classes, which is a lot of dump for nothing.
+    const char *CLASSFUL[] =
+    {
+        "htb", "hfsc", "drr", "qfq", "prio", "mq", "mqprio", "multiq",
+        "ets", "taprio", "cbq", "atm", 0
+    };
+
+    bool
+    classful(const std::string &kind)
+    {
+        for (const char **k = CLASSFUL; *k; ++k)
+        {
+            if (kind == *k)
+                return true;
+        }
+        return false;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+std::string
+tc_handle_name(uint32_t handle)
+{
+    switch (handle)
+    {
+    case TC_H_ROOT:     return "root";
+    case TC_H_INGRESS:  return "ingress";
+    case TC_H_UNSPEC:   return "none";
+    }
+
+    char buf[32];
+    if (TC_H_MIN(handle))
+        std::snprintf(buf, sizeof(buf), "%x:%x", TC_H_MAJ(handle) >> 16,
+                      TC_H_MIN(handle));
+    else
+        std::snprintf(buf, sizeof(buf), "%x:", TC_H_MAJ(handle) >> 16);
+    return buf;
+}
+
+bool
+qdisc_stats::key::operator <(const key &k) const
+{
+    if (ifindex != k.ifindex)
+        return ifindex < k.ifindex;
+    if (parent != k.parent)
+        return parent < k.parent;
+    if (handle != k.handle)
+        return handle < k.handle;
+    return is_class < k.is_class;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+qdisc_stats::qdisc_stats(void):
+    fd_(-1),
+    sequence_(0),
+    entries_(),
+    classful_()
+{
+    fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd_ == -1)
+        ERROR("Opening rtnetlink socket");
+
+    struct timeval timeout;
+    timeout.tv_sec = RECV_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    if (setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+        REPORT("Setting receive timeout on fd %d", fd_);
+}
+
+qdisc_stats::~qdisc_stats(void)
+{
+    if (close(fd_))
+        REPORT("Closing rtnetlink socket %d", fd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One RTM_NEWQDISC or RTM_NEWTCLASS: find (or make) its entry and update
+    the counters.  The basic and queue counters are only 32 bits apart from
+    bytes (and packets, on kernels with TCA_STATS_PKT64), so those deltas
+    wrap at 32 bits.
+*/
+
+void
+qdisc_stats::add(const struct nlmsghdr *h)
+{
+    const struct tcmsg *tcm = (const struct tcmsg *)NLMSG_DATA(h);
+
+    key k;
+    k.ifindex = tcm->tcm_ifindex;
+    k.parent = tcm->tcm_parent;
+    k.handle = tcm->tcm_handle;
+    k.is_class = (h->nlmsg_type == RTM_NEWTCLASS);
+
+    std::string kind;
+    uint64_t now[NUM_QDISC_COUNTERS] = { 0, 0, 0, 0, 0 };
+    bool packets64 = false;
+    uint32_t backlog = 0;
+    uint32_t qlen = 0;
+    bool have_stats = false;
+
+    int attr_len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*tcm));
+    struct rtattr *a = (struct rtattr *)((char *)tcm + NLMSG_ALIGN(sizeof(*tcm)));
+    for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+    {
+        if (a->rta_type == TCA_KIND)
+        {
+            kind = (const char *)RTA_DATA(a);
+            continue;
+        }
+        if (a->rta_type != TCA_STATS2)
+            continue;
+
+        have_stats = true;
+        int nested_len = RTA_PAYLOAD(a);
+        struct rtattr *s = (struct rtattr *)RTA_DATA(a);
+        for ( ; RTA_OK(s, nested_len); s = RTA_NEXT(s, nested_len))
+        {
+            // attributes are only 4 byte aligned
+            switch (s->rta_type)
+            {
+            case TCA_STATS_BASIC:
+            {
+                struct gnet_stats_basic b;
+                memset(&b, 0, sizeof(b));
+                memcpy(&b, RTA_DATA(s), std::min((size_t)RTA_PAYLOAD(s), sizeof(b)));
+                now[QDISC_BYTES] = b.bytes;
+                if (!packets64)
+                    now[QDISC_PACKETS] = b.packets;
+                break;
+            }
+            case TCA_STATS_PKT64:
+                memcpy(&now[QDISC_PACKETS], RTA_DATA(s), sizeof(uint64_t));
+                packets64 = true;
+                break;
+            case TCA_STATS_QUEUE:
+            {
+                struct gnet_stats_queue q;
+                memset(&q, 0, sizeof(q));
+                memcpy(&q, RTA_DATA(s), std::min((size_t)RTA_PAYLOAD(s), sizeof(q)));
+                now[QDISC_DROPS] = q.drops;
+                now[QDISC_OVERLIMITS] = q.overlimits;
+                now[QDISC_REQUEUES] = q.requeues;
+                backlog = q.backlog;
+                qlen = q.qlen;
+                break;
+            }
+            }
+        }
+    }
+
+    if (!have_stats)
+        return;
+
+    std::map<key, qdisc_entry>::iterator i = entries_.find(k);
+    const bool fresh = (i == entries_.end()) || (i->second.kind != kind);
+    if (i == entries_.end())
+        i = entries_.insert(std::make_pair(k, qdisc_entry())).first;
+
+    qdisc_entry &e = i->second;
+    for (size_t c = 0; c < NUM_QDISC_COUNTERS; ++c)
+    {
+        if (fresh)
+            e.delta[c] = 0;
+        else if ((c == QDISC_BYTES) || ((c == QDISC_PACKETS) && packets64))
+            e.delta[c] = now[c] - e.value[c];
+        else
+            e.delta[c] = (uint32_t)(now[c] - e.value[c]);
+        e.value[c] = now[c];
+    }
+    e.is_class = k.is_class;
+    e.kind = kind;
+    e.backlog = backlog;
+    e.qlen = qlen;
+    e.seen = true;
+
+    if (!k.is_class && classful(kind)
+        && (std::find(classful_.begin(), classful_.end(), k.ifindex) == classful_.end()))
+        classful_.push_back(k.ifindex);
+}
+
+/**
+    Dump 'type' (RTM_GETQDISC or RTM_GETTCLASS) for 'ifindex' (0: every
+    interface, for qdiscs) and fold the answers into entries_.
+*/
+
+void
+qdisc_stats::dump(uint16_t type, int ifindex)
+{
+    // netlink messages want 4 byte alignment
+    static uint32_t buffer[RECV_BUFFER_SIZE / sizeof(uint32_t)];
+
+    struct
+    {
+        struct nlmsghdr header;
+        struct tcmsg tcm;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.tcm));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++sequence_;
+    request.tcm.tcm_family = AF_UNSPEC;
+    request.tcm.tcm_ifindex = ifindex;
+
+    if (send(fd_, &request, request.header.nlmsg_len, 0) == -1)
+        ERROR("Sending tc dump request on fd %d", fd_);
+
+    for (;;)
+    {
+        ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                CPRINT("tc dump timed out\n");
+                return;
+            }
+            ERROR("Reading tc dump from fd %d", fd_);
+        }
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            // leftovers from a dump that timed out
+            if (h->nlmsg_seq != sequence_)
+                continue;
+
+            if (h->nlmsg_type == NLMSG_DONE)
+                return;
+
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(h);
+                CPRINT("tc dump for ifindex %d failed: %s\n", ifindex,
+                       strerror(-e->error));
+                return;
+            }
+
+            if ((h->nlmsg_type == RTM_NEWQDISC) || (h->nlmsg_type == RTM_NEWTCLASS))
+                add(h);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+qdisc_stats::sweep(void)
+{
+    std::map<key, qdisc_entry>::iterator i = entries_.begin();
+    for ( ; i != entries_.end(); ++i)
+        i->second.seen = false;
+    classful_.clear();
+
+    dump(RTM_GETQDISC, 0);
+    for (size_t c = 0; c < classful_.size(); ++c)
+        dump(RTM_GETTCLASS, classful_[c]);
+
+    i = entries_.begin();
+    while (i != entries_.end())
+    {
+        if (!i->second.seen)
+            entries_.erase(i++);
+        else
+            ++i;
+    }
+}
+
+qdisc_stats::const_iterator
+qdisc_stats::begin(int ifindex) const
+{
+    key k;
+    k.ifindex = ifindex;
+    k.parent = 0;
+    k.handle = 0;
+    k.is_class = false;
+    return entries_.lower_bound(k);
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
@@ -0,0 +1,91 @@
+#ifndef QDISC_STATS_H
+#define QDISC_STATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+
+/**
+    Traffic control statistics: every qdisc on the host, and the classes of
+    the classful ones, from rtnetlink dumps (RTM_GETQDISC, RTM_GETTCLASS).
+    Drops and backlog inside a qdisc -- fq_codel dropping, an htb class
+    over its rate, one mq child queueing -- never reach the interface
+    statistics in sysfs.
+
+    One qdisc dump covers every interface.  Class dumps are per interface
+    (the kernel insists), and a netlink socket runs one dump at a time, so
+    they're only asked for where there's a classful qdisc to have classes.
+
+    Counters come from TCA_STATS2.  Entries are kept by (ifindex, parent,
+    handle) across sweeps for the deltas; one that isn't in a dump is gone.
+*/
+
+enum qdisc_counters
+{
+    QDISC_BYTES,
+    QDISC_PACKETS,
+    QDISC_DROPS,
+    QDISC_OVERLIMITS,
+    QDISC_REQUEUES,
+    NUM_QDISC_COUNTERS
+};
+
+struct qdisc_entry
+{
+    bool is_class;
+    std::string kind;               // "fq_codel", "htb" ...; classes: their qdisc's
+    uint64_t value[NUM_QDISC_COUNTERS];
+    uint64_t delta[NUM_QDISC_COUNTERS];
+    uint32_t backlog;               // gauges: bytes ...
+    uint32_t qlen;                  // ... and packets queued right now
+    bool seen;                      // in this sweep's dumps
+};
+
+//* "1:10", "1:", "root", "ingress" ...
+std::string tc_handle_name(uint32_t handle);
+
+class qdisc_stats
+{
+public:
+    struct key
+    {
+        int ifindex;
+        uint32_t parent;
+        uint32_t handle;
+        bool is_class;
+
+        bool operator <(const key &k) const;
+    };
+
+    typedef std::map<key, qdisc_entry>::const_iterator const_iterator;
+
+private:
+    int fd_;                        // NETLINK_ROUTE
+    uint32_t sequence_;
+    std::map<key, qdisc_entry> entries_;
+    std::vector<int> classful_;     // ifindexes, from this sweep's qdiscs
+
+    void dump(uint16_t type, int ifindex);
+    void add(const struct nlmsghdr *h);
+
+    // uncopyable: owns the socket
+    qdisc_stats(const qdisc_stats &q);
+    qdisc_stats &operator =(const qdisc_stats &q);
+
+public:
+
+    qdisc_stats(void);
+    ~qdisc_stats(void);
+
+    void sweep(void);
+
+    size_t size(void) const { return entries_.size(); }
+
+    //* Everything on interface 'ifindex': qdiscs and classes by parent.
+    const_iterator begin(int ifindex) const;
+    const_iterator end(void) const { return entries_.end(); }
+};
+
+#endif  // QDISC_STATS_H
@@ -0,0 +1,557 @@
+#include "sock_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <mntent.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("sock_stats");
+
+    const char PORT_RANGE_PATH[] = "/proc/sys/net/ipv4/ip_local_port_range";
+
+    enum
+    {
+        // bigger reads mean fewer of them: the kernel fills as much of
+        // the buffer as we offer, a message per socket
+        RECV_BUFFER_SIZE = 256 * 1024,
+        SOCKET_BUFFER_SIZE = 4 * 1024 * 1024,
+
+        RECV_TIMEOUT_SECONDS = 1,
+
+        // the kernel's defaults, if we can't read the sysctl
+        DEFAULT_EPHEMERAL_LOW = 32768,
+        DEFAULT_EPHEMERAL_HIGH = 60999,
+
+        INITIAL_TABLE_SIZE = 1024,
+
+        // from the kernel's tcp_states.h, which isn't exported
+        STATE_TIME_WAIT = 6,
+        STATE_NEW_SYN_RECV = 12
+    };
+
+    // TIME_WAIT and SYN_RECV entries are minisocks without counters
+    const uint32_t TCP_STATES = ~((1U << STATE_TIME_WAIT) | (1U << STATE_NEW_SYN_RECV));
+    const uint32_t UDP_STATES = ~0U;
+
+    //* Cookies are handed out in sequence, so they need mixing.
+    inline size_t
+    slot_index(uint64_t cookie, size_t mask)
+    {
+        uint64_t h = cookie * 0x9e3779b97f4a7c15ULL;
+        return (size_t)(h ^ (h >> 32)) & mask;
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+const char *
+sock_grouping_name(sock_grouping g)
+{
+    switch (g)
+    {
+    case SOCK_BY_PORT:      return "port";
+    case SOCK_BY_CGROUP:    return "cgroup";
+    }
+    return "?";
+}
+
+bool
+sock_grouping_from_name(const std::string &name, sock_grouping *g)
+{
+    if (name == "port")
+        *g = SOCK_BY_PORT;
+    else if (name == "cgroup")
+        *g = SOCK_BY_CGROUP;
+    else
+        return false;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cookie_table
+////////////////////////////////////////////////////////////////////////////////
+
+sock_stats::cookie_table::cookie_table(void):
+    slots_(INITIAL_TABLE_SIZE),
+    used_(0)
+{
+
+}
+
+//* Double the table, past 70% full: linear probing falls apart after that.
+void
+sock_stats::cookie_table::grow(void)
+{
+    std::vector<cookie_slot> old(slots_.size() * 2);
+    old.swap(slots_);
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = 0; i < old.size(); ++i)
+    {
+        if (!old[i].cookie)
+            continue;
+        size_t j = slot_index(old[i].cookie, mask);
+        while (slots_[j].cookie)
+            j = (j + 1) & mask;
+        slots_[j] = old[i];
+    }
+}
+
+sock_stats::cookie_slot *
+sock_stats::cookie_table::find_or_insert(uint64_t cookie, bool *inserted)
+{
+    if ((used_ + 1) * 10 > slots_.size() * 7)
+        grow();
+
+    const size_t mask = slots_.size() - 1;
+    size_t i = slot_index(cookie, mask);
+    for ( ; slots_[i].cookie; i = (i + 1) & mask)
+    {
+        if (slots_[i].cookie == cookie)
+        {
+            *inserted = false;
+            return &slots_[i];
+        }
+    }
+
+    std::memset(&slots_[i], 0, sizeof(slots_[i]));
+    slots_[i].cookie = cookie;
+    ++used_;
+    *inserted = true;
+    return &slots_[i];
+}
+
+/**
+    Remove every socket not seen since before dump 'oldest'.  Deleting from a
+    linear probing table means closing the gap: later entries of the run
+    that could have lived in the hole move back into it.  Whatever moves
+    into slot i is looked at again before going on.
+*/
+
+void
+sock_stats::cookie_table::expire(uint32_t oldest)
+{
+    const size_t mask = slots_.size() - 1;
+    size_t i = 0;
+    while (i < slots_.size())
+    {
+        if (!slots_[i].cookie || (slots_[i].generation >= oldest))
+        {
+            ++i;
+            continue;
+        }
+
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; slots_[j].cookie; j = (j + 1) & mask)
+        {
+            // j can move back if its home isn't cyclically in (hole, j]
+            const size_t home = slot_index(slots_[j].cookie, mask);
+            const bool stays = (hole <= j) ? ((home > hole) && (home <= j))
+                                           : ((home > hole) || (home <= j));
+            if (stays)
+                continue;
+            slots_[hole] = slots_[j];
+            hole = j;
+        }
+        slots_[hole].cookie = 0;
+        --used_;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+sock_stats::sock_stats(sock_grouping grouping):
+    fd_(-1),
+    sequence_(0),
+    buffer_(RECV_BUFFER_SIZE / sizeof(uint32_t)),
+    grouping_(grouping),
+    ephemeral_low_(DEFAULT_EPHEMERAL_LOW),
+    ephemeral_high_(DEFAULT_EPHEMERAL_HIGH),
+    table_(),
+    generation_(0),
+    baseline_(true),
+    aggregates_(),
+    last_(),
+    have_last_(false),
+    sockets_(0),
+    unsupported_(),
+    cgroups_(),
+    cgroups_scanned_(false)
+{
+    fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd_ == -1)
+        ERROR("Opening sock_diag socket");
+
+    struct timeval timeout;
+    timeout.tv_sec = RECV_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    if (setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+        REPORT("Setting receive timeout on fd %d", fd_);
+
+    const int size = SOCKET_BUFFER_SIZE;
+    if (setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)))
+        REPORT("Setting receive buffer size on fd %d", fd_);
+
+    FILE *f = std::fopen(PORT_RANGE_PATH, "r");
+    if (f)
+    {
+        int low, high;
+        if (std::fscanf(f, "%d %d", &low, &high) == 2)
+        {
+            ephemeral_low_ = low;
+            ephemeral_high_ = high;
+        }
+        std::fclose(f);
+    }
+}
+
+sock_stats::~sock_stats(void)
+{
+    if (close(fd_))
+        REPORT("Closing sock_diag socket %d", fd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One socket from the dump: diff it against the table and fold it into
+    its aggregate.  Sockets come grouped by hash chain, which for
+    listeners and connections to them often means by port, so the last
+    aggregate is tried before the map.
+*/
+
+void
+sock_stats::add(const struct nlmsghdr *h, int protocol)
+{
+    const struct inet_diag_msg *m = (const struct inet_diag_msg *)NLMSG_DATA(h);
+
+    struct tcp_info info;
+    bool have_info = false;
+    uint32_t drops = 0;
+    uint64_t cgroup = 0;
+
+    int attr_len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*m));
+    struct rtattr *a = (struct rtattr *)((char *)m + NLMSG_ALIGN(sizeof(*m)));
+    for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+    {
+        // attributes are only 4 byte aligned
+        switch (a->rta_type)
+        {
+        case INET_DIAG_INFO:
+            // older kernels have a shorter tcp_info; missing fields are 0
+            std::memset(&info, 0, sizeof(info));
+            std::memcpy(&info, RTA_DATA(a),
+                        std::min((size_t)RTA_PAYLOAD(a), sizeof(info)));
+            have_info = true;
+            break;
+        case INET_DIAG_SKMEMINFO:
+            if (RTA_PAYLOAD(a) >= (SK_MEMINFO_DROPS + 1) * sizeof(uint32_t))
+                drops = ((const uint32_t *)RTA_DATA(a))[SK_MEMINFO_DROPS];
+            break;
+        case INET_DIAG_CGROUP_ID:
+            std::memcpy(&cgroup, RTA_DATA(a), sizeof(cgroup));
+            break;
+        }
+    }
+
+    // an orphan in FIN_WAIT2 turns into a timewait minisock, which gets
+    // past the state filter (it's checked against the substate) but has
+    // no tcp_info: its counters are gone, not zero
+    if ((protocol == IPPROTO_TCP) && !have_info)
+        return;
+
+    const uint64_t cookie = (uint64_t)m->id.idiag_cookie[0]
+        | ((uint64_t)m->id.idiag_cookie[1] << 32);
+    const uint64_t acked = have_info ? info.tcpi_bytes_acked : 0;
+    const uint64_t received = have_info ? info.tcpi_bytes_received : 0;
+    const uint32_t retransmits = have_info ? info.tcpi_total_retrans : 0;
+
+    bool inserted;
+    cookie_slot *s = table_.find_or_insert(cookie, &inserted);
+    if (inserted)
+    {
+        // new since the last dump: it all happened since then
+        if (baseline_)
+        {
+            s->bytes_acked = acked;
+            s->bytes_received = received;
+            s->retransmits = retransmits;
+            s->drops = drops;
+        }
+    }
+
+    const uint64_t d_acked = acked - s->bytes_acked;
+    const uint64_t d_received = received - s->bytes_received;
+    const uint32_t d_retransmits = retransmits - s->retransmits;
+    const uint32_t d_drops = drops - s->drops;
+    s->bytes_acked = acked;
+    s->bytes_received = received;
+    s->retransmits = retransmits;
+    s->drops = drops;
+    s->generation = generation_;
+
+    uint64_t key = cgroup;
+    if (grouping_ == SOCK_BY_PORT)
+    {
+        const int port = ntohs(m->id.idiag_sport);
+        key = ((port >= ephemeral_low_) && (port <= ephemeral_high_)) ? 0 : port;
+    }
+
+    const aggregate_key k(protocol, key);
+    if (!have_last_ || (last_->first != k))
+    {
+        last_ = aggregates_.find(k);
+        if (last_ == aggregates_.end())
+        {
+            sock_aggregate fresh;
+            std::memset(&fresh, 0, sizeof(fresh));
+            fresh.protocol = protocol;
+            fresh.key = key;
+            last_ = aggregates_.insert(std::make_pair(k, fresh)).first;
+        }
+        have_last_ = true;
+    }
+
+    sock_aggregate &g = last_->second;
+    ++g.sockets;
+    g.bytes_acked += d_acked;
+    g.bytes_received += d_received;
+    g.retransmits += d_retransmits;
+    g.drops += d_drops;
+    if (have_info && info.tcpi_rtt)
+    {
+        g.rtt_sum += info.tcpi_rtt;
+        ++g.rtt_count;
+        g.rtt_max = std::max(g.rtt_max, info.tcpi_rtt);
+    }
+    ++sockets_;
+}
+
+/**
+    Dump every 'protocol' socket of 'family'.  A kernel without the diag
+    module for it (udp_diag, usually) says so once, and isn't asked again.
+*/
+
+void
+sock_stats::dump(int family, int protocol)
+{
+    const std::pair<int, int> which(family, protocol);
+    if (unsupported_.count(which))
+        return;
+
+    struct
+    {
+        struct nlmsghdr header;
+        struct inet_diag_req_v2 diag;
+    } request;
+    std::memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++sequence_;
+    request.diag.sdiag_family = family;
+    request.diag.sdiag_protocol = protocol;
+    request.diag.idiag_states = (protocol == IPPROTO_TCP) ? TCP_STATES : UDP_STATES;
+    request.diag.idiag_ext = (1 << (INET_DIAG_INFO - 1))
+        | (1 << (INET_DIAG_SKMEMINFO - 1));
+
+    if (send(fd_, &request, sizeof(request), 0) == -1)
+        ERROR("Sending sock_diag request on fd %d", fd_);
+
+    const size_t size = buffer_.size() * sizeof(uint32_t);
+    for (;;)
+    {
+        ssize_t n = recv(fd_, &buffer_[0], size, 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                CPRINT("sock_diag dump timed out\n");
+                return;
+            }
+            ERROR("Reading sock_diag dump from fd %d", fd_);
+        }
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)&buffer_[0];
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            // leftovers from a dump that timed out
+            if (h->nlmsg_seq != sequence_)
+                continue;
+
+            if (h->nlmsg_type == NLMSG_DONE)
+                return;
+
+            if (h->nlmsg_type == NLMSG_ERROR)
+            {
+                const struct nlmsgerr *e = (const struct nlmsgerr *)NLMSG_DATA(h);
+                CPRINT("%s %s sockets can't be dumped: %s\n",
+                       (family == AF_INET) ? "IPv4" : "IPv6",
+                       (protocol == IPPROTO_TCP) ? "TCP" : "UDP",
+                       strerror(-e->error));
+                unsupported_.insert(which);
+                return;
+            }
+
+            if (h->nlmsg_type == SOCK_DIAG_BY_FAMILY)
+                add(h, protocol);
+        }
+    }
+}
+
+/**
+    cgroup ids are the inode numbers of the cgroup2 directories, so a walk
+    of the mount gives us names for them.  No cgroup2 mount (a v1-only
+    host) and every socket is in the root, id 1.
+*/
+
+void
+sock_stats::scan_cgroups(void)
+{
+    cgroups_scanned_ = true;
+
+    std::string root;
+    FILE *mounts = setmntent("/proc/self/mounts", "r");
+    if (!mounts)
+        return;
+    for (struct mntent *e; (e = getmntent(mounts)); )
+    {
+        if (!std::strcmp(e->mnt_type, "cgroup2"))
+        {
+            root = e->mnt_dir;
+            break;
+        }
+    }
+    endmntent(mounts);
+    if (root.empty())
+        return;
+
+    cgroups_.clear();
+    std::vector<std::string> pending(1, "");
+    while (!pending.empty())
+    {
+        const std::string relative(pending.back());
+        pending.pop_back();
+
+        const std::string path(root + relative);
+        struct stat st;
+        if (stat(C(path), &st))
+            continue;
+        cgroups_[st.st_ino] = relative.empty() ? "/" : relative;
+
+        DIR *d = opendir(C(path));
+        if (!d)
+            continue;
+        for (struct dirent *e; (e = readdir(d)); )
+        {
+            if ((e->d_type == DT_DIR) && (e->d_name[0] != '.'))
+                pending.push_back(relative + "/" + e->d_name);
+        }
+        closedir(d);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+sock_stats::sweep(void)
+{
+    ++generation_;
+    sockets_ = 0;
+
+    aggregate_map::iterator i = aggregates_.begin();
+    for ( ; i != aggregates_.end(); ++i)
+    {
+        const int protocol = i->second.protocol;
+        const uint64_t key = i->second.key;
+        std::memset(&i->second, 0, sizeof(i->second));
+        i->second.protocol = protocol;
+        i->second.key = key;
+    }
+
+    dump(AF_INET, IPPROTO_TCP);
+    dump(AF_INET6, IPPROTO_TCP);
+    dump(AF_INET, IPPROTO_UDP);
+    dump(AF_INET6, IPPROTO_UDP);
+
+    // a dump isn't a snapshot: sockets can be skipped as the hash tables
+    // change under it.  One that's missed and then turns up next time
+    // would look new and count its whole life, so give it a dump's grace.
+    table_.expire(generation_ - 1);
+    baseline_ = false;
+    cgroups_scanned_ = false;
+
+    // ports and cgroups with no sockets left
+    have_last_ = false;
+    i = aggregates_.begin();
+    while (i != aggregates_.end())
+    {
+        if (!i->second.sockets)
+            aggregates_.erase(i++);
+        else
+            ++i;
+    }
+}
+
+std::string
+sock_stats::name(const sock_aggregate &a)
+{
+    std::string s((a.protocol == IPPROTO_TCP) ? "tcp " : "udp ");
+
+    char buf[32];
+    if (grouping_ == SOCK_BY_PORT)
+    {
+        if (!a.key)
+            return s + "ephemeral";
+        std::snprintf(buf, sizeof(buf), "port %lu", (unsigned long)a.key);
+        return s + buf;
+    }
+
+    std::map<uint64_t, std::string>::const_iterator c = cgroups_.find(a.key);
+    if ((c == cgroups_.end()) && !cgroups_scanned_)
+    {
+        scan_cgroups();
+        c = cgroups_.find(a.key);
+    }
+    if (c != cgroups_.end())
+        return s + c->second;
+
+    std::snprintf(buf, sizeof(buf), "cgroup %lu", (unsigned long)a.key);
+    return s + buf;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
@@ -0,0 +1,142 @@
+#ifndef SOCK_STATS_H
+#define SOCK_STATS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    Per-socket TCP and UDP statistics from sock_diag (NETLINK_SOCK_DIAG):
+    every socket on the host dumped each sweep, with its tcp_info and
+    memory info, and rolled up by local port or by cgroup.
+
+    Counters in tcp_info are totals for the socket's lifetime, so the
+    per-sweep numbers are deltas against the previous dump, kept by socket
+    cookie (the kernel's unique, never reused, id for a socket).  A proxy
+    has a million of them, so the previous values live in an open
+    addressing table: one flat array, no allocation per socket, and a
+    socket costs a probe or two and some subtraction.  Sockets gone from
+    two dumps in a row are swept out of the table afterwards.
+
+    Sockets that appear between dumps count in full (everything they did,
+    they did since the last dump); the first dump is only a baseline.
+    Sockets that close between dumps take their last few bytes with them.
+
+    Local ports in the ephemeral range (net.ipv4.ip_local_port_range) are
+    one bucket: on a proxy they're the outbound connections, and there'd
+    be tens of thousands of buckets otherwise.
+*/
+
+enum sock_grouping
+{
+    SOCK_BY_PORT,
+    SOCK_BY_CGROUP
+};
+
+const char *sock_grouping_name(sock_grouping g);
+bool sock_grouping_from_name(const std::string &name, sock_grouping *g);
+
+//* One port's or cgroup's sockets, with counters for the latest sweep.
+struct sock_aggregate
+{
+    int protocol;               // IPPROTO_TCP or IPPROTO_UDP
+    uint64_t key;               // local port (0: ephemeral) or cgroup id
+
+    uint64_t sockets;
+    uint64_t bytes_acked;
+    uint64_t bytes_received;
+    uint64_t retransmits;
+    uint64_t drops;
+
+    uint64_t rtt_sum;           // microseconds, over TCP sockets with an RTT
+    uint64_t rtt_count;
+    uint32_t rtt_max;
+};
+
+class sock_stats
+{
+public:
+    typedef std::pair<int, uint64_t> aggregate_key;     // protocol, key
+    typedef std::map<aggregate_key, sock_aggregate> aggregate_map;
+
+private:
+    // the previous dump's counters, by cookie
+    struct cookie_slot
+    {
+        uint64_t cookie;        // 0: empty (the kernel never hands out 0)
+        uint64_t bytes_acked;
+        uint64_t bytes_received;
+        uint32_t retransmits;
+        uint32_t drops;
+        uint32_t generation;    // the dump it was last seen in
+    };
+
+    class cookie_table
+    {
+    private:
+        std::vector<cookie_slot> slots_;
+        size_t used_;
+
+        void grow(void);
+
+    public:
+        cookie_table(void);
+
+        cookie_slot *find_or_insert(uint64_t cookie, bool *inserted);
+        void expire(uint32_t oldest);
+        size_t size(void) const { return used_; }
+        size_t capacity(void) const { return slots_.size(); }
+    };
+
+    int fd_;                    // NETLINK_SOCK_DIAG
+    uint32_t sequence_;
+    std::vector<uint32_t> buffer_;  // netlink messages want 4 byte alignment
+
+    sock_grouping grouping_;
+    int ephemeral_low_;
+    int ephemeral_high_;
+
+    cookie_table table_;
+    uint32_t generation_;
+    bool baseline_;             // the first dump: nothing to diff against
+
+    aggregate_map aggregates_;
+    aggregate_map::iterator last_;  // the aggregate add() used last ...
+    bool have_last_;                // ... if it's still valid
+    size_t sockets_;            // in the latest dump
+
+    std::set<std::pair<int, int> > unsupported_;    // family, protocol
+
+    // cgroup id -> path, from walking the cgroup2 mount when we meet an
+    // id we don't know (at most once a sweep)
+    std::map<uint64_t, std::string> cgroups_;
+    bool cgroups_scanned_;
+
+    void dump(int family, int protocol);
+    void add(const struct nlmsghdr *h, int protocol);
+    void scan_cgroups(void);
+
+    // uncopyable: owns the socket
+    sock_stats(const sock_stats &s);
+    sock_stats &operator =(const sock_stats &s);
+
+public:
+
+    sock_stats(sock_grouping grouping);
+    ~sock_stats(void);
+
+    void sweep(void);
+
+    size_t sockets(void) const { return sockets_; }
+    const aggregate_map &aggregates(void) const { return aggregates_; }
+
+    //* "tcp port 443", "udp ephemeral", "tcp /system.slice/nginx.service" ...
+    std::string name(const sock_aggregate &a);
+};
+
+#endif  // SOCK_STATS_H
@@ -0,0 +1,223 @@
+#include "softnet_stats.h"
+
+#include <cmath>
+#include <limits>
+#include <cstring>
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("softnet_stats");
+
+    const char SOFTNET_PATH[] = "/proc/net/softnet_stat";
+
+    enum
+    {
+        // a line is 15 columns of 9 chars: this is 100+ CPUs, and grows
+        INITIAL_BUFFER_SIZE = 16 * 1024,
+
+        // columns we want, counting from 0
+        COLUMN_PROCESSED = 0,
+        COLUMN_DROPPED = 1,
+        COLUMN_TIME_SQUEEZE = 2,
+        COLUMN_RECEIVED_RPS = 9,
+        COLUMN_FLOW_LIMIT = 10,
+        COLUMN_CPU = 12,
+        MAX_COLUMNS = 16
+    };
+
+    int
+    hex_digit(char c)
+    {
+        if ((c >= '0') && (c <= '9'))
+            return c - '0';
+        if ((c >= 'a') && (c <= 'f'))
+            return c - 'a' + 10;
+        if ((c >= 'A') && (c <= 'F'))
+            return c - 'A' + 10;
+        return -1;
+    }
+}
+
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// rate_correlation
+////////////////////////////////////////////////////////////////////////////////
+
+rate_correlation::rate_correlation(void):
+    mean_x(0.0),
+    mean_y(0.0),
+    mean_xy(0.0),
+    mean_xx(0.0),
+    mean_yy(0.0),
+    samples(0)
+{
+
+}
+
+void
+rate_correlation::update(double x, double y, double alpha)
+{
+    // the first sample is the whole story so far
+    const double a = samples ? alpha : 1.0;
+    mean_x += a * (x - mean_x);
+    mean_y += a * (y - mean_y);
+    mean_xy += a * (x * y - mean_xy);
+    mean_xx += a * (x * x - mean_xx);
+    mean_yy += a * (y * y - mean_yy);
+    ++samples;
+}
+
+/**
+    Pearson's r, or NaN if either rate hasn't varied (a flat line doesn't
+    correlate with anything).
+*/
+
+double
+rate_correlation::value(void) const
+{
+    const double var_x = mean_xx - mean_x * mean_x;
+    const double var_y = mean_yy - mean_y * mean_y;
+    const double cov = mean_xy - mean_x * mean_y;
+    if ((var_x <= 0.0) || (var_y <= 0.0))
+        return std::numeric_limits<double>::quiet_NaN();
+    return cov / std::sqrt(var_x * var_y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+softnet_stats::softnet_stats(void):
+    fd_(-1),
+    buffer_(INITIAL_BUFFER_SIZE),
+    cpus_()
+{
+    fd_ = open(SOFTNET_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd_ == -1)
+        ERROR("Opening '%s'", SOFTNET_PATH);
+
+    try
+    {
+        update();
+    } catch (...)
+    {
+        close(fd_);
+        throw;
+    }
+
+    // the first read is a baseline, not a delta
+    for (size_t i = 0; i < cpus_.size(); ++i)
+        memset(cpus_[i].delta, 0, sizeof(cpus_[i].delta));
+}
+
+softnet_stats::~softnet_stats(void)
+{
+    if (close(fd_))
+        REPORT("Closing '%s'", SOFTNET_PATH);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    One pread() of the whole file.  CPUs coming and going (hotplug) change
+    the line count; a CPU we haven't seen before starts with no deltas.
+*/
+
+void
+softnet_stats::update(void)
+{
+    size_t length;
+    for (;;)
+    {
+        ssize_t n = pread(fd_, &buffer_[0], buffer_.size(), 0);
+        if (n == -1)
+            ERROR("Reading '%s'", SOFTNET_PATH);
+        if ((size_t)n < buffer_.size())
+        {
+            length = (size_t)n;
+            break;
+        }
+        buffer_.resize(buffer_.size() * 2);
+    }
+
+    const char *p = &buffer_[0];
+    const char *end = p + length;
+    size_t line = 0;
+    while (p < end)
+    {
+        uint64_t column[MAX_COLUMNS];
+        size_t columns = 0;
+        while ((p < end) && (*p != '\n'))
+        {
+            while ((p < end) && (*p == ' '))
+                ++p;
+            uint64_t x = 0;
+            int d;
+            const char *start = p;
+            while ((p < end) && ((d = hex_digit(*p)) >= 0))
+            {
+                x = (x << 4) | (uint64_t)d;
+                ++p;
+            }
+            if (p == start)
+            {
+                if ((p < end) && (*p != '\n'))
+                    RUNTIME("Unexpected '%c' in '%s'", *p, SOFTNET_PATH);
+                break;
+            }
+            if (columns < MAX_COLUMNS)
+                column[columns++] = x;
+        }
+        if (p < end)
+            ++p;        // the newline
+        if (columns <= COLUMN_FLOW_LIMIT)
+            RUNTIME("Only %lu columns in '%s'", (unsigned long)columns,
+                    SOFTNET_PATH);
+
+        const int cpu = (columns > COLUMN_CPU) ? (int)column[COLUMN_CPU] : (int)line;
+        if ((line >= cpus_.size()) || (cpus_[line].cpu != cpu))
+        {
+            if (line >= cpus_.size())
+                cpus_.resize(line + 1);
+            cpus_[line].cpu = cpu;
+            cpus_[line].value[SOFTNET_PROCESSED] = column[COLUMN_PROCESSED];
+            cpus_[line].value[SOFTNET_DROPPED] = column[COLUMN_DROPPED];
+            cpus_[line].value[SOFTNET_TIME_SQUEEZE] = column[COLUMN_TIME_SQUEEZE];
+            cpus_[line].value[SOFTNET_RECEIVED_RPS] = column[COLUMN_RECEIVED_RPS];
+            cpus_[line].value[SOFTNET_FLOW_LIMIT] = column[COLUMN_FLOW_LIMIT];
+        }
+
+        softnet_cpu &c = cpus_[line];
+        const uint64_t now[NUM_SOFTNET_FIELDS] =
+        {
+            column[COLUMN_PROCESSED], column[COLUMN_DROPPED],
+            column[COLUMN_TIME_SQUEEZE], column[COLUMN_RECEIVED_RPS],
+            column[COLUMN_FLOW_LIMIT]
+        };
+        for (size_t f = 0; f < NUM_SOFTNET_FIELDS; ++f)
+        {
+            // the columns are only 32 bits: wrap, rather than reset
+            c.delta[f] = (uint32_t)(now[f] - c.value[f]);
+            c.value[f] = now[f];
+        }
+        ++line;
+    }
+
+    cpus_.resize(line);
+}
+
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
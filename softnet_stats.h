@@ -0,0 +1,79 @@
+#ifndef SOFTNET_STATS_H
+#define SOFTNET_STATS_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    Per-CPU receive backlog statistics from /proc/net/softnet_stat: packets
+    each CPU's softirq processed, dropped because its backlog was full, and
+    how often it ran out of budget with work left (time_squeeze).  Backlog
+    drops happen after the driver has counted the packet as received, so
+    they never show up in any interface's rx_dropped.
+
+    One line per online CPU, in hex; the CPU number is the 13th column on
+    kernels that have it, else the line number.
+*/
+
+enum softnet_fields
+{
+    SOFTNET_PROCESSED,
+    SOFTNET_DROPPED,
+    SOFTNET_TIME_SQUEEZE,
+    SOFTNET_RECEIVED_RPS,
+    SOFTNET_FLOW_LIMIT,
+    NUM_SOFTNET_FIELDS
+};
+
+struct softnet_cpu
+{
+    int cpu;
+    uint64_t value[NUM_SOFTNET_FIELDS];
+    uint64_t delta[NUM_SOFTNET_FIELDS];
+};
+
+/**
+    Correlation of two rates over time, from exponentially weighted
+    moments: no history to keep, so it's cheap enough to track for every
+    (interface, CPU) pair.
+*/
+
+struct rate_correlation
+{
+    double mean_x;
+    double mean_y;
+    double mean_xy;
+    double mean_xx;
+    double mean_yy;
+    uint64_t samples;
+
+    rate_correlation(void);
+    void update(double x, double y, double alpha);
+    double value(void) const;
+};
+
+class softnet_stats
+{
+private:
+    int fd_;
+    std::vector<char> buffer_;
+    std::vector<softnet_cpu> cpus_;
+
+    // uncopyable: owns an fd
+    softnet_stats(const softnet_stats &s);
+    softnet_stats &operator =(const softnet_stats &s);
+
+public:
+
+    softnet_stats(void);
+    ~softnet_stats(void);
+
+    void update(void);
+
+    size_t size(void) const { return cpus_.size(); }
+    const softnet_cpu &cpu(size_t i) const { return cpus_[i]; }
+};
+
+#endif  // SOFTNET_STATS_H
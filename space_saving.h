@@ -0,0 +1,221 @@
+#ifndef SPACE_SAVING_H
+#define SPACE_SAVING_H
+
+#include <vector>
+#include <algorithm>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+    Heavy hitters in fixed memory: Space-Saving (Metwally et al.), weighted.
+    K counters; a key we're already counting adds its weight, and a new key
+    takes over the smallest counter, inheriting its count as the error.
+    Any key whose true total is more than 1/K of everything offered is
+    guaranteed to be in there, and no count is off by more than its error.
+
+    Keys are found through an open addressing index of 2K slots, and the
+    counters are a min-heap by count, so the one to evict is always the
+    root: offer() is a probe plus a sift down (counts only grow), with no
+    allocation after construction.
+
+    Hash is a functor: size_t operator()(const Key &) const.
+*/
+
+template <typename Key, typename Hash>
+class space_saving
+{
+public:
+    struct counter
+    {
+        Key key;
+        uint64_t count;         // weight, overestimated by at most 'error'
+        uint64_t error;
+        uint64_t hits;          // times offered since taking the counter
+    };
+
+private:
+    enum { EMPTY = -1 };
+
+    size_t k_;
+    std::vector<counter> counters_;     // the first used_ are live
+    size_t used_;
+    std::vector<size_t> heap_;          // counter indices, min count at root
+    std::vector<size_t> position_;      // counter index -> place in heap_
+    std::vector<long> index_;           // key slot -> counter index, or EMPTY
+    size_t mask_;
+    Hash hash_;
+
+    static bool less(const counter &a, const counter &b)
+    {
+        return a.count < b.count;
+    }
+
+    static bool greater(const counter &a, const counter &b)
+    {
+        return a.count > b.count;
+    }
+
+    void swap_heap(size_t a, size_t b)
+    {
+        std::swap(heap_[a], heap_[b]);
+        position_[heap_[a]] = a;
+        position_[heap_[b]] = b;
+    }
+
+    //* The counter at heap_[i] has grown: push it down to where it fits.
+    void sift_down(size_t i)
+    {
+        for (;;)
+        {
+            size_t smallest = i;
+            const size_t left = 2 * i + 1;
+            const size_t right = left + 1;
+            if ((left < used_)
+                && less(counters_[heap_[left]], counters_[heap_[smallest]]))
+                smallest = left;
+            if ((right < used_)
+                && less(counters_[heap_[right]], counters_[heap_[smallest]]))
+                smallest = right;
+            if (smallest == i)
+                return;
+            swap_heap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    //* Slot holding 'key', or the empty slot where it would go.
+    size_t find_slot(const Key &key) const
+    {
+        size_t s = hash_(key) & mask_;
+        while ((index_[s] != EMPTY) && !(counters_[index_[s]].key == key))
+            s = (s + 1) & mask_;
+        return s;
+    }
+
+    //* Remove the key in slot 's', closing the gap behind it.
+    void erase_slot(size_t s)
+    {
+        size_t hole = s;
+        for (size_t j = (s + 1) & mask_; index_[j] != EMPTY; j = (j + 1) & mask_)
+        {
+            const size_t home = hash_(counters_[index_[j]].key) & mask_;
+            const bool stays = (hole <= j) ? ((home > hole) && (home <= j))
+                                           : ((home > hole) || (home <= j));
+            if (stays)
+                continue;
+            index_[hole] = index_[j];
+            hole = j;
+        }
+        index_[hole] = EMPTY;
+    }
+
+    //* Count 'weight' against 'key': the index of its counter.
+    size_t add(const Key &key, uint64_t weight)
+    {
+        size_t s = find_slot(key);
+        if (index_[s] != EMPTY)
+        {
+            counter &c = counters_[index_[s]];
+            c.count += weight;
+            ++c.hits;
+            sift_down(position_[index_[s]]);
+            return index_[s];
+        }
+
+        if (used_ < k_)
+        {
+            const size_t i = used_++;
+            counter &c = counters_[i];
+            c.key = key;
+            c.count = weight;
+            c.error = 0;
+            c.hits = 1;
+            index_[s] = (long)i;
+
+            // a newcomer may be the smallest yet: sift it up
+            heap_[i] = i;
+            position_[i] = i;
+            size_t h = i;
+            while ((h > 0) && less(counters_[heap_[h]], counters_[heap_[(h - 1) / 2]]))
+            {
+                swap_heap(h, (h - 1) / 2);
+                h = (h - 1) / 2;
+            }
+            return i;
+        }
+
+        // full: the smallest counter changes hands
+        const size_t victim = heap_[0];
+        counter &c = counters_[victim];
+        erase_slot(find_slot(c.key));
+
+        c.key = key;
+        c.error = c.count;
+        c.count += weight;
+        c.hits = 1;
+        index_[find_slot(key)] = (long)victim;
+        sift_down(0);
+        return victim;
+    }
+
+public:
+
+    explicit space_saving(size_t k = 1, const Hash &hash = Hash()):
+        k_(k ? k : 1),
+        counters_(k_),
+        used_(0),
+        heap_(k_),
+        position_(k_),
+        index_(),
+        mask_(0),
+        hash_(hash)
+    {
+        size_t slots = 1;
+        while (slots < 2 * k_)
+            slots <<= 1;
+        index_.assign(slots, EMPTY);
+        mask_ = slots - 1;
+    }
+
+    void offer(const Key &key, uint64_t weight)
+    {
+        add(key, weight);
+    }
+
+    /**
+        Fold in another summary's counters, errors and all.  Counts stay
+        upper bounds and errors stay honest either way; with summaries of
+        disjoint sets of keys (a fanout group spreading by flow hash) they
+        don't get any looser unless this one has to evict.
+    */
+
+    void merge(const space_saving &other)
+    {
+        for (size_t i = 0; i < other.used_; ++i)
+        {
+            const counter &o = other.counters_[i];
+            counter &c = counters_[add(o.key, o.count)];
+            c.error += o.error;
+            c.hits += o.hits - 1;
+        }
+    }
+
+    //* Biggest first.
+    void sorted(std::vector<counter> *out) const
+    {
+        out->assign(counters_.begin(), counters_.begin() + used_);
+        std::sort(out->begin(), out->end(), greater);
+    }
+
+    void clear(void)
+    {
+        used_ = 0;
+        std::fill(index_.begin(), index_.end(), (long)EMPTY);
+    }
+
+    size_t size(void) const { return used_; }
+    size_t capacity(void) const { return k_; }
+};
+
+#endif  // SPACE_SAVING_H
@@ -0,0 +1,230 @@
+#include "sysfs_collector.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "program_IO.h"
+#include "fd_pool.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("sysfs_collector");
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Nothing is opened until we're told what to read, except the stats dir
+    (O_PATH: no reading, just a handle to openat() relative to) for those
+    that want it.
+*/
+
+sysfs_collector::sysfs_collector(const collector_target &target,
+                                 bool want_dirfd):
+    stats_path_(target.stats_path),
+    dirfd_(-1),
+    counters_(),
+    released_(false)
+{
+    CPRINT("Got interface stats path as '%s'\n", C(stats_path_));
+
+    if (want_dirfd)
+    {
+        dirfd_ = open(C(stats_path_), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (dirfd_ == -1)
+            ERROR("Opening stats dir '%s'", C(stats_path_));
+        ++collector_syscalls.opens;
+    }
+}
+
+sysfs_collector::~sysfs_collector(void)
+{
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        if (counters_[i].fd != -1)
+            close(counters_[i].fd);
+    }
+    if (dirfd_ != -1)
+        close(dirfd_);
+}
+
+sysfs_pooled_collector::sysfs_pooled_collector(const collector_target &target):
+    sysfs_collector(target, true),
+    pool_(target.pool)
+{
+    if (!pool_)
+        RUNTIME("Interface '%s': pooled collector without an fd pool",
+                C(target.interface));
+}
+
+//* Before the dir goes: the pool keys its fds by it.
+sysfs_pooled_collector::~sysfs_pooled_collector(void)
+{
+    pool_->forget(dirfd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Protected
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    A slot for 'index' (not open), keeping counters_ in index order.
+*/
+
+sysfs_collector::counter &
+sysfs_collector::insert(size_t index)
+{
+    std::vector<counter>::iterator i = counters_.begin();
+    while ((i != counters_.end()) && (i->index < index))
+        ++i;
+
+    counter c;
+    c.index = index;
+    c.fd = -1;
+    return *counters_.insert(i, c);
+}
+
+//* Is the file there and readable?  Throws if not.
+void
+sysfs_collector::check(size_t index) const
+{
+    if (faccessat(dirfd_, counter_filename(index), R_OK, 0))
+        ERROR("For '%s': no readable stats file '%s%s'",
+              counter_name(index), C(stats_path_), counter_filename(index));
+}
+
+int
+sysfs_collector::open_counter(size_t index)
+{
+    std::string statfile_path(stats_path_ + counter_filename(index));
+    CPRINT("For '%s': opening stats file @ '%s'\n",
+           counter_name(index), C(statfile_path));
+
+    int fd = open(C(statfile_path), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        ERROR("For '%s': opening stats file '%s'",
+              counter_name(index), C(statfile_path));
+    ++collector_syscalls.opens;
+
+    CPRINT("For '%s': got file descriptor as %d\n", counter_name(index), fd);
+    return fd;
+}
+
+/**
+    Open, read, close: for OPENAT, and for everyone while released.
+*/
+
+uint64_t
+sysfs_collector::read_transient(size_t index)
+{
+    const char *filename = counter_filename(index);
+    int fd;
+    if (dirfd_ != -1)
+        fd = openat(dirfd_, filename, O_RDONLY | O_CLOEXEC);
+    else
+        fd = open(C(stats_path_ + filename), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        ERROR("Opening '%s%s'", C(stats_path_), filename);
+    ++collector_syscalls.opens;
+
+    uint64_t value;
+    try
+    {
+        value = read_stats_file(fd);
+    } catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    ++collector_syscalls.closes;
+    return value;
+}
+
+void
+sysfs_collector::close_counters(void)
+{
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        counter &c = counters_[i];
+        if (c.fd == -1)
+            continue;
+        if (close(c.fd))
+            REPORT("Closing fd %d for '%s'", c.fd, counter_filename(c.index));
+        ++collector_syscalls.closes;
+        c.fd = -1;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+uint64_t
+sysfs_pooled_collector::read_pooled(size_t index)
+{
+    bool opened;
+    int fd = pool_->acquire(dirfd_, (int)index, counter_filename(index), &opened);
+    if (opened)
+        ++collector_syscalls.opens;
+    return read_stats_file(fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+void
+sysfs_fd_collector::add(size_t index)
+{
+    const int fd = open_counter(index);
+    insert(index).fd = fd;
+}
+
+/**
+    Give back every fd held for the counters, and read by open/read/close
+    until retain(): the fds are opened again as they're next read.
+*/
+
+void
+sysfs_fd_collector::release(void)
+{
+    close_counters();
+    released_ = true;
+}
+
+void
+sysfs_openat_collector::add(size_t index)
+{
+    check(index);
+    insert(index);
+}
+
+void
+sysfs_pooled_collector::add(size_t index)
+{
+    check(index);
+    insert(index);
+}
+
+void
+sysfs_pooled_collector::release(void)
+{
+    pool_->forget(dirfd_);
+    released_ = true;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
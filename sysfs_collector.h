@@ -0,0 +1,146 @@
+#ifndef SYSFS_COLLECTOR_H
+#define SYSFS_COLLECTOR_H
+
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "collector.h"
+
+/**
+    What the collectors reading /sys/class/net/<interface>/statistics/
+    have in common: a file per counter, opened as collector_kind says, and
+    read by open/read/close while released.
+*/
+
+class sysfs_collector
+{
+protected:
+    struct counter
+    {
+        size_t index;           // into a counter_table
+        int fd;                 // -1 unless held open
+    };
+
+    std::string stats_path_;
+    int dirfd_;                 // O_PATH on stats_path_, or -1
+    std::vector<counter> counters_;     // in index order
+    bool released_;
+
+    sysfs_collector(const collector_target &target, bool want_dirfd);
+    ~sysfs_collector(void);
+
+    counter &insert(size_t index);
+    void check(size_t index) const;
+    int open_counter(size_t index);
+    uint64_t read_transient(size_t index);
+    void close_counters(void);
+
+private:
+
+    // uncopyable: owns fds
+    sysfs_collector(const sysfs_collector &c);
+    sysfs_collector &operator =(const sysfs_collector &c);
+
+public:
+
+    bool provides(size_t counter) const { return counter < NUM_COUNTERS; }
+    void retain(void) { released_ = false; }
+};
+
+//* COLLECTOR_SYSFS_FD: an fd per counter, reopened after a release.
+class sysfs_fd_collector : public sysfs_collector
+{
+public:
+
+    explicit sysfs_fd_collector(const collector_target &target):
+        sysfs_collector(target, false) {}
+
+    void add(size_t index);
+
+    void collect(size_t first, size_t last, counter_table *values)
+    {
+        for (size_t i = 0; i < counters_.size(); ++i)
+        {
+            counter &c = counters_[i];
+            if (c.index >= last)
+                break;
+            if (c.index < first)
+                continue;
+
+            if (released_)
+                values->value[c.index] = read_transient(c.index);
+            else
+            {
+                if (c.fd == -1)
+                    c.fd = open_counter(c.index);
+                values->value[c.index] = read_stats_file(c.fd);
+            }
+        }
+    }
+
+    void release(void);
+    const char *name(void) const { return collector_kind_name(COLLECTOR_SYSFS_FD); }
+};
+
+//* COLLECTOR_SYSFS_OPENAT: nothing held but the dir.
+class sysfs_openat_collector : public sysfs_collector
+{
+public:
+
+    explicit sysfs_openat_collector(const collector_target &target):
+        sysfs_collector(target, true) {}
+
+    void add(size_t index);
+
+    void collect(size_t first, size_t last, counter_table *values)
+    {
+        for (size_t i = 0; i < counters_.size(); ++i)
+        {
+            const counter &c = counters_[i];
+            if (c.index >= last)
+                break;
+            if (c.index >= first)
+                values->value[c.index] = read_transient(c.index);
+        }
+    }
+
+    void release(void) { released_ = true; }
+    const char *name(void) const { return collector_kind_name(COLLECTOR_SYSFS_OPENAT); }
+};
+
+//* COLLECTOR_SYSFS_POOLED: the fds belong to the pool.
+class sysfs_pooled_collector : public sysfs_collector
+{
+private:
+    fd_pool *pool_;             // not ours
+
+    uint64_t read_pooled(size_t index);
+
+public:
+
+    explicit sysfs_pooled_collector(const collector_target &target);
+    ~sysfs_pooled_collector(void);
+
+    void add(size_t index);
+
+    void collect(size_t first, size_t last, counter_table *values)
+    {
+        for (size_t i = 0; i < counters_.size(); ++i)
+        {
+            const counter &c = counters_[i];
+            if (c.index >= last)
+                break;
+            if (c.index >= first)
+                values->value[c.index] = released_ ? read_transient(c.index)
+                                                   : read_pooled(c.index);
+        }
+    }
+
+    void release(void);
+    const char *name(void) const { return collector_kind_name(COLLECTOR_SYSFS_POOLED); }
+};
+
+#endif  // SYSFS_COLLECTOR_H
@@ -0,0 +1,72 @@
+#ifndef TOP_K_H
+#define TOP_K_H
+
+#include <vector>
+#include <algorithm>
+
+#include <stddef.h>
+
+/**
+    The K biggest scores seen since the last clear(), without sorting
+    everything: a min-heap of at most K entries whose root is the score to
+    beat.  offer() is O(1) for anything that doesn't make the cut -- which
+    on a host with thousands of mostly idle interfaces is nearly
+    everything -- and O(log K) otherwise.
+*/
+
+template <typename Id>
+class top_k
+{
+public:
+    struct entry
+    {
+        double score;
+        Id id;
+    };
+
+private:
+    size_t k_;
+    std::vector<entry> heap_;
+
+    // 'greater' as the heap's less-than makes it a min-heap
+    static bool greater(const entry &a, const entry &b)
+    {
+        return a.score > b.score;
+    }
+
+public:
+
+    explicit top_k(size_t k = 0): k_(k), heap_()
+    {
+        heap_.reserve(k);
+    }
+
+    void offer(double score, const Id &id)
+    {
+        if (heap_.size() < k_)
+        {
+            entry e = { score, id };
+            heap_.push_back(e);
+            std::push_heap(heap_.begin(), heap_.end(), greater);
+        } else if ((k_ != 0) && (score > heap_.front().score))
+        {
+            std::pop_heap(heap_.begin(), heap_.end(), greater);
+            heap_.back().score = score;
+            heap_.back().id = id;
+            std::push_heap(heap_.begin(), heap_.end(), greater);
+        }
+    }
+
+    //* Biggest first: sorts only the K survivors.
+    void sorted(std::vector<entry> *out) const
+    {
+        *out = heap_;
+        std::sort(out->begin(), out->end(), greater);
+    }
+
+    void clear(void) { heap_.clear(); }
+    size_t size(void) const { return heap_.size(); }
+    size_t capacity(void) const { return k_; }
+};
+
+#endif  // TOP_K_H
@@ -0,0 +1,454 @@
+#include "uring_collector.h"
+
+#include <set>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#include "program_IO.h"
+
+// IORING_OP_READ came with 5.6, as did this
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define URING_COLLECTOR_BUILT 1
+#else
+#define URING_COLLECTOR_BUILT 0
+#endif
+
+namespace
+{
+    // module/class name
+    const std::string NAME("uring_collector");
+
+    enum
+    {
+        // reads to an io_uring_enter(): a dozen interfaces' worth, and
+        // small enough for the default RLIMIT_MEMLOCK of older kernels
+        RING_ENTRIES = 256,
+
+        // as for read_stats_file(): far more than a counter needs
+        READ_SIZE = 32
+    };
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define RUNTIME(fmt, args...) RUNTIME_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+#if URING_COLLECTOR_BUILT
+
+/**
+    The three shared mappings, and where things are in them; the
+    collectors that use it; and the reads queued but not yet submitted.
+*/
+
+struct uring_collector::ring
+{
+    int fd;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;               // == sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    std::set<uring_collector *> members;
+    unsigned queued;            // since the last flush()
+    uint64_t batch;             // read_all()s so far
+    uint64_t sweep;             // collector_sweep at the latest
+
+    ring(void);
+    ~ring(void);
+    void tear_down(void);
+
+    void queue(int fd, char *buffer, unsigned length, int *result);
+    void submit_and_wait(unsigned n);
+    void flush(void);
+};
+
+uring_collector::ring::ring(void):
+    fd(-1),
+    sq_map(MAP_FAILED),
+    sq_map_size(0),
+    cq_map(MAP_FAILED),
+    cq_map_size(0),
+    sqes((struct io_uring_sqe *)MAP_FAILED),
+    sqes_size(0),
+    sq_tail(0),
+    sq_mask(0),
+    sq_array(0),
+    sq_entries(0),
+    cq_head(0),
+    cq_tail(0),
+    cq_mask(0),
+    cqes(0),
+    members(),
+    queued(0),
+    batch(0),
+    sweep(0)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+    if (fd == -1)
+        ERROR("Setting up an io_uring");
+    ++collector_syscalls.opens;
+    sq_entries = p.sq_entries;
+
+    try
+    {
+        sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && (cq_map_size > sq_map_size))
+            sq_map_size = cq_map_size;
+
+        sq_map = mmap(0, sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_map == MAP_FAILED)
+            ERROR("Mapping io_uring submission ring");
+        if (single)
+            cq_map = sq_map;
+        else
+        {
+            cq_map = mmap(0, cq_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_map == MAP_FAILED)
+                ERROR("Mapping io_uring completion ring");
+        }
+
+        sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe *)mmap(0, sqes_size, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, fd,
+                                           IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            ERROR("Mapping io_uring submission entries");
+    } catch (...)
+    {
+        tear_down();
+        throw;
+    }
+
+    char *sq = (char *)sq_map;
+    sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq + p.sq_off.array);
+
+    char *cq = (char *)cq_map;
+    cq_head = (unsigned *)(cq + p.cq_off.head);
+    cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+}
+
+uring_collector::ring::~ring(void)
+{
+    tear_down();
+}
+
+void
+uring_collector::ring::tear_down(void)
+{
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqes_size);
+    if ((cq_map != MAP_FAILED) && (cq_map != sq_map))
+        munmap(cq_map, cq_map_size);
+    if (sq_map != MAP_FAILED)
+        munmap(sq_map, sq_map_size);
+    if (fd != -1)
+        close(fd);
+
+    sqes = (struct io_uring_sqe *)MAP_FAILED;
+    cq_map = sq_map = MAP_FAILED;
+    fd = -1;
+}
+
+/**
+    A read of 'fd' into 'buffer', what it returns to go in 'result'.  A
+    full ring is flushed first.
+*/
+
+void
+uring_collector::ring::queue(int fd, char *buffer, unsigned length,
+                             int *result)
+{
+    if (queued == sq_entries)
+        flush();
+
+    const unsigned tail = *sq_tail;
+    const unsigned slot = tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = 0;
+    sqe->user_data = (uint64_t)(uintptr_t)result;
+    sq_array[slot] = slot;
+
+    // the entry before the tail that covers it
+    __sync_synchronize();
+    *(volatile unsigned *)sq_tail = tail + 1;
+    ++queued;
+}
+
+/**
+    Tell the kernel about the last 'n' requests and wait until they're all
+    done: usually one io_uring_enter(), more only if interrupted.
+*/
+
+void
+uring_collector::ring::submit_and_wait(unsigned n)
+{
+    unsigned submitted = 0;
+    for (;;)
+    {
+        const unsigned ready = *(volatile unsigned *)cq_tail - *cq_head;
+        if ((submitted == n) && (ready >= n))
+            break;
+
+        const long ret = syscall(__NR_io_uring_enter, fd, n - submitted,
+                                 n, IORING_ENTER_GETEVENTS, 0, 0);
+        ++collector_syscalls.reads;
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            ERROR("Submitting %u reads to io_uring %d", n - submitted, fd);
+        }
+        submitted += (unsigned)ret;
+    }
+    __sync_synchronize();
+}
+
+//* Submit what's queued, and put each answer where its read said.
+void
+uring_collector::ring::flush(void)
+{
+    if (queued == 0)
+        return;
+    const unsigned n = queued;
+    queued = 0;
+    submit_and_wait(n);
+
+    unsigned head = *cq_head;
+    for (unsigned k = 0; k < n; ++k, ++head)
+    {
+        const struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        *(int *)(uintptr_t)cqe->user_data = cqe->res;
+    }
+    __sync_synchronize();
+    *(volatile unsigned *)cq_head = head;
+}
+
+#else
+
+struct uring_collector::ring
+{
+};
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+uring_collector::uring_collector(const collector_target &target):
+    sysfs_collector(target, false),
+    buffers_(),
+    results_(),
+    batch_(0),
+    seen_(0)
+{
+#if URING_COLLECTOR_BUILT
+    shared_ring().members.insert(this);
+#else
+    RUNTIME("Interface '%s': built without io_uring", C(target.interface));
+#endif
+}
+
+uring_collector::~uring_collector(void)
+{
+#if URING_COLLECTOR_BUILT
+    shared_ring().members.erase(this);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+//* The one everybody shares, made by the first of them.
+uring_collector::ring &
+uring_collector::shared_ring(void)
+{
+    static ring r;
+    return r;
+}
+
+/**
+    Every retained collector's reads, as the ring's next batch.  A read
+    that fails is left for its own collector's collect() to report.
+*/
+
+void
+uring_collector::read_all(void)
+{
+#if URING_COLLECTOR_BUILT
+    ring &r = shared_ring();
+    ++r.batch;
+    r.sweep = collector_sweep;
+
+    std::set<uring_collector *>::const_iterator i;
+    for (i = r.members.begin(); i != r.members.end(); ++i)
+        (*i)->queue_reads(r);
+    r.flush();
+#endif
+}
+
+//* A read for each counter with an fd, to be in 'r's batch.
+void
+uring_collector::queue_reads(ring &r)
+{
+#if URING_COLLECTOR_BUILT
+    if (released_)
+        return;
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        if (counters_[i].fd == -1)
+            continue;
+        results_[i] = 0;
+        r.queue(counters_[i].fd, &buffers_[i * READ_SIZE], READ_SIZE - 1,
+                &results_[i]);
+    }
+    batch_ = r.batch;
+#else
+    (void)r;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+bool
+uring_collector::built(void)
+{
+    return URING_COLLECTOR_BUILT;
+}
+
+void
+uring_collector::add(size_t index)
+{
+    const int fd = open_counter(index);
+    insert(index).fd = fd;
+    buffers_.resize(counters_.size() * READ_SIZE);
+    results_.resize(counters_.size());
+
+    // not in the latest batch
+    batch_ = 0;
+}
+
+/**
+    The counters in range from this sweep's batch of reads, made now for
+    the first caller of a sweep, for anyone who'd otherwise get the batch
+    they had last time, and for a collector that isn't in the latest
+    (added to or retained since).  While released, it's open/read/close
+    for each and the ring isn't used.
+*/
+
+void
+uring_collector::collect(size_t first, size_t last, counter_table *values)
+{
+#if URING_COLLECTOR_BUILT
+    if (released_)
+    {
+        for (size_t i = 0; i < counters_.size(); ++i)
+        {
+            const size_t index = counters_[i].index;
+            if (index >= last)
+                break;
+            if (index >= first)
+                values->value[index] = read_transient(index);
+        }
+        return;
+    }
+
+    bool missing = false;
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        counter &c = counters_[i];
+        if (c.index >= last)
+            break;
+        if ((c.index >= first) && (c.fd == -1))
+        {
+            c.fd = open_counter(c.index);
+            missing = true;
+        }
+    }
+
+    const ring &r = shared_ring();
+    if (missing || (r.sweep != collector_sweep) || (seen_ == r.batch)
+        || (batch_ != r.batch))
+        read_all();
+    seen_ = r.batch;
+
+    for (size_t i = 0; i < counters_.size(); ++i)
+    {
+        const size_t index = counters_[i].index;
+        if (index >= last)
+            break;
+        if (index < first)
+            continue;
+
+        if (results_[i] <= 0)
+        {
+            errno = -results_[i];
+            ERROR("Reading '%s%s' through io_uring", C(stats_path_),
+                  counter_filename(index));
+        }
+        if (results_[i] >= READ_SIZE - 1)
+            RUNTIME("Wow, actually read %d bytes of '%s'", results_[i],
+                    counter_filename(index));
+
+        char *text = &buffers_[i * READ_SIZE];
+        text[results_[i]] = '\0';
+        values->value[index] = strtoull(text, 0, 10);
+    }
+#else
+    (void)first;
+    (void)last;
+    (void)values;
+#endif
+}
+
+void
+uring_collector::release(void)
+{
+    close_counters();
+    released_ = true;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef RUNTIME
+#undef REPORT
@@ -0,0 +1,54 @@
+#ifndef URING_COLLECTOR_H
+#define URING_COLLECTOR_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sysfs_collector.h"
+
+/**
+    COLLECTOR_IO_URING: the files of COLLECTOR_SYSFS_FD, read by a read
+    request each on one ring that every uring_collector shares.  The first
+    collect() of a sweep queues every retained interface's reads, a
+    ring-full to an io_uring_enter() that submits them and waits for the
+    lot, and the others take their answers from that; so it's one ring fd
+    (and its three mappings) however many interfaces there are, plus the
+    fd per counter.  Raw syscalls, no liburing.
+
+    sysfs files can't be read without blocking, so the kernel hands each
+    read to one of its io-wq workers: fewer syscalls than pread(), not
+    necessarily less CPU.  built() is false where the headers are too old
+    (5.6) to have IORING_OP_READ, and the constructor throws where the
+    kernel won't make a ring.
+*/
+
+class uring_collector : public sysfs_collector
+{
+private:
+    struct ring;
+
+    std::vector<char> buffers_;         // READ_SIZE for each of counters_
+    std::vector<int> results_;          // what each of their reads got
+    uint64_t batch_;                    // the ring's batch they're from
+    uint64_t seen_;                     // the batch collect() last used
+
+    static ring &shared_ring(void);
+    static void read_all(void);
+    void queue_reads(ring &r);
+
+public:
+
+    explicit uring_collector(const collector_target &target);
+    ~uring_collector(void);
+
+    static bool built(void);
+
+    void add(size_t index);
+    void collect(size_t first, size_t last, counter_table *values);
+    void release(void);
+    const char *name(void) const { return collector_kind_name(COLLECTOR_IO_URING); }
+};
+
+#endif  // URING_COLLECTOR_H
@@ -0,0 +1,274 @@
+#include "veth_peers.h"
+
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <linux/net_namespace.h>
+
+#include "program_IO.h"
+
+namespace
+{
+    // module/class name
+    const std::string NAME("veth_peers");
+
+    enum
+    {
+        // one link or one nsid: small, but a link message with all its
+        // stats attached is a couple of KB
+        RECV_BUFFER_SIZE = 16 * 1024,
+        REQUEST_BUFFER_SIZE = 256,
+
+        RECV_TIMEOUT_SECONDS = 1,
+
+        // how stale the nsid map, and the peer names, can get: as often
+        // as --netns looks for new namespaces
+        REBUILD_SECONDS = 10
+    };
+
+    //* Append an attribute to 'h', which has room for it.
+    void
+    add_attribute(struct nlmsghdr *h, unsigned short type, const void *data,
+                  size_t len)
+    {
+        struct rtattr *a = (struct rtattr *)((char *)h + NLMSG_ALIGN(h->nlmsg_len));
+        a->rta_type = type;
+        a->rta_len = RTA_LENGTH(len);
+        memcpy(RTA_DATA(a), data, len);
+        h->nlmsg_len = NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(a->rta_len);
+    }
+}
+
+#define CPRINT(fmt, args...) CPRINT_WITH_NAME(NAME, fmt, ##args)
+#define ERROR(fmt, args...) ERROR_WITH_NAME(NAME, fmt, ##args)
+#define REPORT(fmt, args...) REPORT_WITH_NAME(NAME, fmt, ##args)
+
+////////////////////////////////////////////////////////////////////////////////
+// Constructors and destructor
+////////////////////////////////////////////////////////////////////////////////
+
+veth_peers::veth_peers(void):
+    fd_(-1),
+    sequence_(0),
+    valid_(false),
+    rebuilt_(0),
+    generation_(0),
+    by_nsid_()
+{
+    fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd_ == -1)
+        ERROR("Opening rtnetlink socket");
+
+    struct timeval timeout;
+    timeout.tv_sec = RECV_TIMEOUT_SECONDS;
+    timeout.tv_usec = 0;
+    if (setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+        REPORT("Setting receive timeout on fd %d", fd_);
+}
+
+veth_peers::~veth_peers(void)
+{
+    if (close(fd_))
+        REPORT("Closing rtnetlink socket %d", fd_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Private
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+    Send 'request' and wait for its answer: the reply message if it's of
+    'reply_type', or null if the kernel said no (or didn't say anything).
+    The reply lives in a static buffer until the next call.
+*/
+
+const struct nlmsghdr *
+veth_peers::transact(struct nlmsghdr *request, uint16_t reply_type)
+{
+    // netlink messages want 4 byte alignment
+    static uint32_t buffer[RECV_BUFFER_SIZE / sizeof(uint32_t)];
+
+    request->nlmsg_seq = ++sequence_;
+    if (send(fd_, request, request->nlmsg_len, 0) == -1)
+        ERROR("Sending netlink request on fd %d", fd_);
+
+    for (;;)
+    {
+        ssize_t n = recv(fd_, buffer, sizeof(buffer), 0);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+                return 0;
+            ERROR("Reading netlink reply from fd %d", fd_);
+        }
+
+        int len = (int)n;
+        struct nlmsghdr *h = (struct nlmsghdr *)buffer;
+        for ( ; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len))
+        {
+            // leftovers from a request that timed out
+            if (h->nlmsg_seq != sequence_)
+                continue;
+            if (h->nlmsg_type == reply_type)
+                return h;
+            if (h->nlmsg_type == NLMSG_ERROR)
+                return 0;
+        }
+    }
+}
+
+/**
+    Our nsid for the namespace at 'path', or -1 if it hasn't got one: the
+    kernel only assigns them when something (like a veth) links across.
+*/
+
+int
+veth_peers::nsid_of(const std::string &path)
+{
+    int nsfd = open(C(path), O_RDONLY | O_CLOEXEC);
+    if (nsfd == -1)
+        return -1;      // gone already
+
+    uint32_t request_buffer[REQUEST_BUFFER_SIZE / sizeof(uint32_t)];
+    memset(request_buffer, 0, sizeof(request_buffer));
+    struct nlmsghdr *request = (struct nlmsghdr *)request_buffer;
+    request->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    request->nlmsg_type = RTM_GETNSID;
+    request->nlmsg_flags = NLM_F_REQUEST;
+    ((struct rtgenmsg *)NLMSG_DATA(request))->rtgen_family = AF_UNSPEC;
+
+    const uint32_t fd = nsfd;
+    add_attribute(request, NETNSA_FD, &fd, sizeof(fd));
+
+    const struct nlmsghdr *reply = 0;
+    try
+    {
+        reply = transact(request, RTM_NEWNSID);
+    } catch (...)
+    {
+        close(nsfd);
+        throw;
+    }
+    close(nsfd);
+
+    if (!reply)
+        return -1;
+
+    int nsid = -1;
+    int attr_len = reply->nlmsg_len - NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    struct rtattr *a = (struct rtattr *)((char *)NLMSG_DATA(reply)
+                                         + NLMSG_ALIGN(sizeof(struct rtgenmsg)));
+    for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+    {
+        if (a->rta_type == NETNSA_NSID)
+            nsid = *(const int32_t *)RTA_DATA(a);
+    }
+    return nsid;
+}
+
+void
+veth_peers::rebuild(void)
+{
+    by_nsid_.clear();
+
+    const std::vector<netns_info> namespaces(list_namespaces());
+    for (size_t i = 0; i < namespaces.size(); ++i)
+    {
+        int nsid = nsid_of(namespaces[i].path);
+        if (nsid < 0)
+            continue;
+        by_nsid_[nsid] = namespaces[i];
+    }
+
+    valid_ = true;
+    rebuilt_ = time(0);
+    ++generation_;
+    CPRINT("%lu of %lu namespaces have nsids\n",
+           (unsigned long)by_nsid_.size(), (unsigned long)namespaces.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Public
+////////////////////////////////////////////////////////////////////////////////
+
+//* Rebuild the nsid map if it's been invalidated or is REBUILD_SECONDS old.
+void
+veth_peers::refresh(void)
+{
+    const time_t now = time(0);
+    if (!valid_ || (now - rebuilt_ >= REBUILD_SECONDS) || (now < rebuilt_))
+        rebuild();
+}
+
+/**
+    The namespace our nsid 'nsid' refers to, or null if we can't find it
+    (its processes may all have gone, leaving only a bind mount we don't
+    know about).
+*/
+
+const netns_info *
+veth_peers::lookup(int nsid)
+{
+    if (!valid_)
+        rebuild();
+
+    std::map<int, netns_info>::const_iterator i = by_nsid_.find(nsid);
+    return (i == by_nsid_.end()) ? 0 : &i->second;
+}
+
+/**
+    Name of interface 'ifindex' in the namespace we call 'nsid'.
+*/
+
+bool
+veth_peers::peer_name(int nsid, int ifindex, std::string *name)
+{
+    uint32_t request_buffer[REQUEST_BUFFER_SIZE / sizeof(uint32_t)];
+    memset(request_buffer, 0, sizeof(request_buffer));
+    struct nlmsghdr *request = (struct nlmsghdr *)request_buffer;
+    request->nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+    request->nlmsg_type = RTM_GETLINK;
+    request->nlmsg_flags = NLM_F_REQUEST;
+    struct ifinfomsg *ifi = (struct ifinfomsg *)NLMSG_DATA(request);
+    ifi->ifi_family = AF_UNSPEC;
+    ifi->ifi_index = ifindex;
+
+    const int32_t target = nsid;
+    add_attribute(request, IFLA_TARGET_NETNSID, &target, sizeof(target));
+
+    // skip the stats: all we want is the name
+    const uint32_t mask = RTEXT_FILTER_SKIP_STATS;
+    add_attribute(request, IFLA_EXT_MASK, &mask, sizeof(mask));
+
+    const struct nlmsghdr *reply = transact(request, RTM_NEWLINK);
+    if (!reply)
+        return false;
+
+    int attr_len = IFLA_PAYLOAD(reply);
+    struct rtattr *a = IFLA_RTA((struct ifinfomsg *)NLMSG_DATA(reply));
+    for ( ; RTA_OK(a, attr_len); a = RTA_NEXT(a, attr_len))
+    {
+        if (a->rta_type == IFLA_IFNAME)
+        {
+            *name = (const char *)RTA_DATA(a);
+            return true;
+        }
+    }
+    return false;
+}
+
+#undef CPRINT
+#undef ERROR
+#undef REPORT
@@ -0,0 +1,63 @@
+#ifndef VETH_PEERS_H
+#define VETH_PEERS_H
+
+#include <string>
+#include <map>
+
+#include <stdint.h>
+#include <time.h>
+
+#include "netns_stats.h"
+
+/**
+    Who's on the other end of a veth.  A host-side veth's link messages
+    carry its peer's ifindex (IFLA_LINK) and an nsid (IFLA_LINK_NETNSID):
+    a number our namespace has given the peer's namespace, meaningful only
+    to us.  We turn nsids back into namespaces by asking (RTM_GETNSID) for
+    the nsid of every namespace list_namespaces() finds, and get the
+    peer's name by asking for the link inside the peer's namespace
+    (IFLA_TARGET_NETNSID), all without entering it.
+
+    The nsid map is cached.  nsids are reused once their namespace dies,
+    so the owner calls invalidate() when link events hint the set of
+    namespaces has changed -- an nsid we haven't seen, or a veth gone --
+    and the next lookup rebuilds it.  Nothing here hears about a peer
+    renamed inside its namespace, so refresh() also rebuilds it every
+    REBUILD_SECONDS; a peer name looked up before the latest rebuild
+    (generation() has moved on) is one to look up again.
+*/
+
+class veth_peers
+{
+private:
+    int fd_;                // NETLINK_ROUTE, for requests
+    uint32_t sequence_;
+
+    bool valid_;
+    time_t rebuilt_;        // when, if valid_
+    uint64_t generation_;   // rebuilds so far
+    std::map<int, netns_info> by_nsid_;
+
+    const struct nlmsghdr *transact(struct nlmsghdr *request, uint16_t reply_type);
+    int nsid_of(const std::string &path);
+    void rebuild(void);
+
+    // uncopyable: owns the socket
+    veth_peers(const veth_peers &v);
+    veth_peers &operator =(const veth_peers &v);
+
+public:
+
+    veth_peers(void);
+    ~veth_peers(void);
+
+    void invalidate(void) { valid_ = false; }
+    void refresh(void);
+    uint64_t generation(void) const { return generation_; }
+    bool known(int nsid) const { return by_nsid_.find(nsid) != by_nsid_.end(); }
+
+    const netns_info *lookup(int nsid);
+    bool peer_name(int nsid, int ifindex, std::string *name);
+};
+
+#endif  // VETH_PEERS_H